@@ -0,0 +1,471 @@
+/* ------------------------------------------------------------------------
+ *
+ * bench_report.c
+ *
+ * Short description: TIPC benchmark demo (result history report)
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2014, Ericsson AB
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the names of the copyright holders nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ------------------------------------------------------------------------
+ */
+
+/*
+ * Reads history files written by 'client_tipc -o <file>' and produces a
+ * single self-contained HTML page with one SVG trend chart per series.
+ * A series is one host, protocol, server node, test, message size and
+ * connection count; its points are the runs ordered by time. Changes of
+ * kernel release are marked in the charts, and a summary table flags
+ * series whose latest run is worse than the previous one.
+ */
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_THRESHOLD 5	/* regression limit [%] */
+#define MAX_METRICS       3
+#define MAX_FIELDS        32
+
+#define CHART_W   720
+#define CHART_H   260
+#define MARGIN_L  70
+#define MARGIN_R  20
+#define MARGIN_T  20
+#define MARGIN_B  40
+
+#define die(fmt, arg...)  \
+	do { \
+		fprintf(stderr, fmt, ## arg); \
+		exit(1); \
+	} while (0)
+
+struct metric_def {
+	const char *key;
+	const char *label;
+};
+
+struct chart_def {
+	const char *test;
+	const char *title;
+	const char *unit;
+	double scale;
+	bool higher_better;
+	struct metric_def metrics[MAX_METRICS];
+};
+
+/* The first metric of each chart is the one checked for regressions */
+static const struct chart_def charts[] = {
+	{"throughput", "Throughput", "Mb/s", 1, true,
+	 {{"mbps", "total"}}},
+	{"sink", "Throughput, discarding receiver", "Mb/s", 1, true,
+	 {{"mbps", "total"}}},
+	{"latency", "Round-trip latency", "us", 0.001, false,
+	 {{"p50_ns", "p50"}, {"p90_ns", "p90"}, {"p99_ns", "p99"}}},
+	{"lookup", "RDM round-trip by address type", "us", 0.001, false,
+	 {{"name_ns", "by name"}, {"id_ns", "by port id"},
+	  {"conn_ns", "connected"}}},
+};
+
+#define NUM_CHARTS (sizeof(charts) / sizeof(charts[0]))
+
+static const char *colors[MAX_METRICS] = {"#1f77b4", "#ff7f0e", "#d62728"};
+
+struct record {
+	long long time;
+	char host[64];
+	char kernel[64];
+	char proto[8];
+	char server[24];
+	unsigned int msglen;
+	unsigned int conns;
+	unsigned int names;
+	double val[MAX_METRICS];
+	const struct chart_def *chart;
+};
+
+static struct record *recs;
+static int num_recs;
+
+static void copy_field(char *dst, size_t len, const char *src)
+{
+	strncpy(dst, src, len - 1);
+	dst[len - 1] = 0;
+}
+
+static const struct chart_def *find_chart(const char *test)
+{
+	int i;
+
+	for (i = 0; i < NUM_CHARTS; i++) {
+		if (!strcmp(charts[i].test, test))
+			return &charts[i];
+	}
+	return NULL;
+}
+
+/* Parse one history line; unknown tests and malformed lines are skipped */
+static bool parse_record(char *line, struct record *r)
+{
+	char *key[MAX_FIELDS], *val[MAX_FIELDS];
+	char *tok, *save;
+	int i, j, n = 0;
+
+	memset(r, 0, sizeof(*r));
+	for (tok = strtok_r(line, " \t\n", &save); tok && n < MAX_FIELDS;
+	     tok = strtok_r(NULL, " \t\n", &save)) {
+		val[n] = strchr(tok, '=');
+		if (!val[n])
+			continue;
+		*val[n]++ = 0;
+		key[n++] = tok;
+	}
+	for (i = 0; i < n; i++) {
+		if (!strcmp(key[i], "test"))
+			r->chart = find_chart(val[i]);
+	}
+	if (!r->chart)
+		return false;
+
+	for (i = 0; i < n; i++) {
+		if (!strcmp(key[i], "time"))
+			r->time = strtoll(val[i], NULL, 10);
+		else if (!strcmp(key[i], "host"))
+			copy_field(r->host, sizeof(r->host), val[i]);
+		else if (!strcmp(key[i], "kernel"))
+			copy_field(r->kernel, sizeof(r->kernel), val[i]);
+		else if (!strcmp(key[i], "proto"))
+			copy_field(r->proto, sizeof(r->proto), val[i]);
+		else if (!strcmp(key[i], "server"))
+			copy_field(r->server, sizeof(r->server), val[i]);
+		else if (!strcmp(key[i], "msglen"))
+			r->msglen = strtoul(val[i], NULL, 10);
+		else if (!strcmp(key[i], "conns"))
+			r->conns = strtoul(val[i], NULL, 10);
+		else if (!strcmp(key[i], "names"))
+			r->names = strtoul(val[i], NULL, 10);
+		for (j = 0; j < MAX_METRICS && r->chart->metrics[j].key; j++) {
+			if (!strcmp(key[i], r->chart->metrics[j].key))
+				r->val[j] = strtod(val[i], NULL) *
+					    r->chart->scale;
+		}
+	}
+	return r->time != 0;
+}
+
+static void read_history(const char *path)
+{
+	char line[1024];
+	struct record r;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		die("Unable to open history file %s\n", path);
+	while (fgets(line, sizeof(line), f)) {
+		if (!parse_record(line, &r))
+			continue;
+		if (!(num_recs % 256)) {
+			recs = realloc(recs, (num_recs + 256) * sizeof(*recs));
+			if (!recs)
+				die("Out of memory\n");
+		}
+		recs[num_recs++] = r;
+	}
+	fclose(f);
+}
+
+static int cmp_series(const struct record *a, const struct record *b)
+{
+	int rc;
+
+	if (a->chart != b->chart)
+		return a->chart < b->chart ? -1 : 1;
+	if ((rc = strcmp(a->host, b->host)))
+		return rc;
+	if ((rc = strcmp(a->proto, b->proto)))
+		return rc;
+	if ((rc = strcmp(a->server, b->server)))
+		return rc;
+	if (a->msglen != b->msglen)
+		return a->msglen < b->msglen ? -1 : 1;
+	if (a->conns != b->conns)
+		return a->conns < b->conns ? -1 : 1;
+	if (a->names != b->names)
+		return a->names < b->names ? -1 : 1;
+	return 0;
+}
+
+static int cmp_record(const void *x, const void *y)
+{
+	const struct record *a = x, *b = y;
+	int rc = cmp_series(a, b);
+
+	if (rc)
+		return rc;
+	return (a->time > b->time) - (a->time < b->time);
+}
+
+static void html_puts(FILE *out, const char *s)
+{
+	for (; *s; s++) {
+		switch (*s) {
+		case '<':
+			fputs("&lt;", out);
+			break;
+		case '>':
+			fputs("&gt;", out);
+			break;
+		case '&':
+			fputs("&amp;", out);
+			break;
+		case '"':
+			fputs("&quot;", out);
+			break;
+		default:
+			fputc(*s, out);
+		}
+	}
+}
+
+static char *time_str(long long t, char *buf, size_t len)
+{
+	time_t tt = t;
+
+	strftime(buf, len, "%Y-%m-%d %H:%M", gmtime(&tt));
+	return buf;
+}
+
+static void series_name(FILE *out, const struct record *r)
+{
+	fprintf(out, "%s, %s ", r->chart->title, r->proto);
+	html_puts(out, r->host);
+	fputs(" &rarr; ", out);
+	html_puts(out, r->server);
+	fprintf(out, ", %u octets, %u conn%s", r->msglen, r->conns,
+		r->conns == 1 ? "" : "s");
+	if (!strcmp(r->chart->test, "lookup"))
+		fprintf(out, ", %u names", r->names);
+}
+
+static void print_chart(FILE *out, const struct record *s, int n)
+{
+	const struct chart_def *c = s->chart;
+	double tmin = s[0].time, tmax = s[n - 1].time, ymax = 0;
+	double pw = CHART_W - MARGIN_L - MARGIN_R;
+	double ph = CHART_H - MARGIN_T - MARGIN_B;
+	double x, y;
+	char tbuf[32];
+	int i, m, nm;
+
+	for (nm = 0; nm < MAX_METRICS && c->metrics[nm].key; nm++)
+		;
+	for (i = 0; i < n; i++) {
+		for (m = 0; m < nm; m++) {
+			if (s[i].val[m] > ymax)
+				ymax = s[i].val[m];
+		}
+	}
+	ymax = ymax ? ymax * 1.1 : 1;
+
+#define XPOS(t) (MARGIN_L + (tmax > tmin ? ((t) - tmin) / (tmax - tmin) * pw \
+					 : pw / 2))
+#define YPOS(v) (MARGIN_T + ph - (v) / ymax * ph)
+
+	fprintf(out, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" "
+		"height=\"%d\" font-size=\"11\">\n", CHART_W, CHART_H);
+	fprintf(out, "<rect x=\"%d\" y=\"%d\" width=\"%.0f\" height=\"%.0f\" "
+		"fill=\"none\" stroke=\"#888\"/>\n", MARGIN_L, MARGIN_T, pw, ph);
+
+	/* Horizontal grid with value labels */
+	for (i = 0; i <= 4; i++) {
+		y = YPOS(ymax * i / 4);
+		fprintf(out, "<line x1=\"%d\" y1=\"%.1f\" x2=\"%.0f\" y2=\"%.1f\" "
+			"stroke=\"#ddd\"/>\n", MARGIN_L, y, MARGIN_L + pw, y);
+		fprintf(out, "<text x=\"%d\" y=\"%.1f\" text-anchor=\"end\">"
+			"%.4g</text>\n", MARGIN_L - 4, y + 4, ymax * i / 4);
+	}
+	fprintf(out, "<text x=\"12\" y=\"%.0f\" transform=\"rotate(-90 12 %.0f)\" "
+		"text-anchor=\"middle\">%s</text>\n", MARGIN_T + ph / 2,
+		MARGIN_T + ph / 2, c->unit);
+
+	/* Time axis */
+	fprintf(out, "<text x=\"%d\" y=\"%d\">%s</text>\n", MARGIN_L,
+		CHART_H - 8, time_str(s[0].time, tbuf, sizeof(tbuf)));
+	fprintf(out, "<text x=\"%.0f\" y=\"%d\" text-anchor=\"end\">%s</text>\n",
+		MARGIN_L + pw, CHART_H - 8,
+		time_str(s[n - 1].time, tbuf, sizeof(tbuf)));
+
+	/* Kernel release markers, at the first run and at each change */
+	for (i = 0; i < n; i++) {
+		if (i && !strcmp(s[i].kernel, s[i - 1].kernel))
+			continue;
+		x = XPOS(s[i].time);
+		fprintf(out, "<line x1=\"%.1f\" y1=\"%d\" x2=\"%.1f\" y2=\"%.0f\" "
+			"stroke=\"#2ca02c\" stroke-dasharray=\"4,3\"/>\n",
+			x, MARGIN_T, x, MARGIN_T + ph);
+		fprintf(out, "<text x=\"%.1f\" y=\"%d\" fill=\"#2ca02c\">",
+			x + 3, MARGIN_T + 12);
+		html_puts(out, s[i].kernel);
+		fputs("</text>\n", out);
+	}
+
+	/* One line per metric, with a tooltip on every point */
+	for (m = 0; m < nm; m++) {
+		fprintf(out, "<polyline fill=\"none\" stroke=\"%s\" "
+			"stroke-width=\"1.5\" points=\"", colors[m]);
+		for (i = 0; i < n; i++)
+			fprintf(out, "%.1f,%.1f ", XPOS(s[i].time),
+				YPOS(s[i].val[m]));
+		fputs("\"/>\n", out);
+		for (i = 0; i < n; i++) {
+			fprintf(out, "<circle cx=\"%.1f\" cy=\"%.1f\" r=\"2.5\" "
+				"fill=\"%s\"><title>%s %s: %.4g %s, kernel ",
+				XPOS(s[i].time), YPOS(s[i].val[m]), colors[m],
+				time_str(s[i].time, tbuf, sizeof(tbuf)),
+				c->metrics[m].label, s[i].val[m], c->unit);
+			html_puts(out, s[i].kernel);
+			fputs("</title></circle>\n", out);
+		}
+		fprintf(out, "<text x=\"%.0f\" y=\"%d\" fill=\"%s\">%s</text>\n",
+			MARGIN_L + pw / 2 + (m - nm / 2.0) * 90, CHART_H - 8,
+			colors[m], c->metrics[m].label);
+	}
+	fputs("</svg>\n", out);
+#undef XPOS
+#undef YPOS
+}
+
+static void print_report(FILE *out, double threshold)
+{
+	const struct chart_def *c;
+	double last, prev, change;
+	bool worse;
+	int i, n, id;
+	char tbuf[32];
+
+	fputs("<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\">\n"
+	      "<title>TIPC benchmark history</title>\n<style>\n"
+	      "body { font-family: sans-serif; margin: 2em; }\n"
+	      "table { border-collapse: collapse; }\n"
+	      "td, th { border: 1px solid #ccc; padding: 2px 8px; }\n"
+	      "td.num { text-align: right; }\n"
+	      ".worse { color: #d62728; font-weight: bold; }\n"
+	      "</style></head><body>\n<h1>TIPC benchmark history</h1>\n", out);
+	fprintf(out, "<p>%d records, regression limit %.1f%%.</p>\n",
+		num_recs, threshold);
+
+	/* Summary: latest run of each series against the one before */
+	fputs("<table>\n<tr><th>Series</th><th>Runs</th><th>Latest</th>"
+	      "<th>Previous</th><th>Change</th></tr>\n", out);
+	for (i = 0, id = 0; i < num_recs; i += n, id++) {
+		for (n = 1; i + n < num_recs &&
+			    !cmp_series(&recs[i], &recs[i + n]); n++)
+			;
+		c = recs[i].chart;
+		last = recs[i + n - 1].val[0];
+		fprintf(out, "<tr><td><a href=\"#s%d\">", id);
+		series_name(out, &recs[i]);
+		fprintf(out, "</a></td><td class=\"num\">%d</td>"
+			"<td class=\"num\">%.4g %s</td>", n, last, c->unit);
+		if (n < 2 || !recs[i + n - 2].val[0]) {
+			fputs("<td></td><td></td></tr>\n", out);
+			continue;
+		}
+		prev = recs[i + n - 2].val[0];
+		change = (last - prev) * 100 / prev;
+		worse = c->higher_better ? change < -threshold
+					 : change > threshold;
+		fprintf(out, "<td class=\"num\">%.4g %s</td>"
+			"<td class=\"num%s\">%+.1f%%</td></tr>\n", prev, c->unit,
+			worse ? " worse" : "", change);
+	}
+	fputs("</table>\n", out);
+
+	for (i = 0, id = 0; i < num_recs; i += n, id++) {
+		for (n = 1; i + n < num_recs &&
+			    !cmp_series(&recs[i], &recs[i + n]); n++)
+			;
+		fprintf(out, "<h3 id=\"s%d\">", id);
+		series_name(out, &recs[i]);
+		fputs("</h3>\n", out);
+		print_chart(out, &recs[i], n);
+		fprintf(out, "<p>%d runs, latest %s UTC</p>\n", n,
+			time_str(recs[i + n - 1].time, tbuf, sizeof(tbuf)));
+	}
+	fputs("</body></html>\n", out);
+}
+
+static void usage(char *app)
+{
+	fprintf(stderr, "Usage:\n");
+	fprintf(stderr, " %s [-t <percent>] [-o <html file>] "
+		"<history file>...\n", app);
+	fprintf(stderr, "\tchange flagged as regression (default %u%%)\n",
+		DEFAULT_THRESHOLD);
+	fprintf(stderr, "\toutput file (default stdout)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	double threshold = DEFAULT_THRESHOLD;
+	FILE *out = stdout;
+	int c;
+
+	while ((c = getopt(argc, argv, "t:o:")) != -1) {
+		switch (c) {
+		case 't':
+			threshold = atof(optarg);
+			break;
+		case 'o':
+			out = fopen(optarg, "w");
+			if (!out)
+				die("Unable to create %s\n", optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+	for (; optind < argc; optind++)
+		read_history(argv[optind]);
+
+	qsort(recs, num_recs, sizeof(*recs), cmp_record);
+	print_report(out, threshold);
+	if (out != stdout)
+		fclose(out);
+	free(recs);
+	return 0;
+}
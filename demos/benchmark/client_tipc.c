@@ -37,12 +37,28 @@
  */
 
 #include "common_tipc.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <time.h>
+#include <sys/utsname.h>
 
 #define TERMINATE 1
 #define DEFAULT_LAT_MSGS  80000
 #define DEFAULT_THRU_MSGS 640000
 #define DEFAULT_BURST     16
 #define DEFAULT_MSGLEN    64
+#define DEFAULT_LOOKUP_MSGS 20000
+#define DEFAULT_MAX_NAMES 10000
+
+#define SMOKE_NAME        21111
+#define SMOKE_LAT_MS      1000
+#define SMOKE_THRU_MS     1500
+#define SMOKE_SMALL_MSG   64
+#define SMOKE_LARGE_MSG   65000
+#define SMOKE_TIMEOUT     10		/* [s] */
+#define SMOKE_ECHO        1
+#define SMOKE_COUNT       2
 
 
 static const struct sockaddr_tipc clnt_ctrl_addr = {
@@ -67,10 +83,13 @@ static int master_clnt_sd;
 static int master_srv_sd;
 static uint client_id;
 static unsigned char *buf = NULL;
+static uint verify;
+static __u32 tx_seqno, echo_seqno;
+static struct verify_stats vstats;
 static int select_ip(struct srv_info *sinfo, char *name);
 static void stream_messages(int peer_sd, int clnt_id,
 			    int msgcnt, int msglen,
-			    int bounce);
+			    int bounce, __u32 *rtt_ns);
 
 
 #define CLNT_EXEC         3
@@ -113,24 +132,41 @@ static void client_from_master(uint *cmd, uint *msglen, uint *msgcnt, uint *boun
 
 #define CLNT_READY    1
 #define CLNT_FINISHED 2
+
+/* Round-trip percentiles reported after a latency run, in [ns] */
+#define RTT_P50       0
+#define RTT_P90       1
+#define RTT_P99       2
+#define RTT_MAX       3
+#define RTT_PCTLS     4
 struct client_master_cmd {
 	__u32 cmd;
+	__u32 rtt_ns[RTT_PCTLS];
+	struct verify_stats vstats;
 };
 
-static void client_to_master(uint cmd)
+static void client_to_master(uint cmd, const __u32 *rtt_ns)
 {
 	struct client_master_cmd c;
+	int i;
 
+	memset(&c, 0, sizeof(c));
 	c.cmd = htonl(cmd);
+	for (i = 0; rtt_ns && i < RTT_PCTLS; i++)
+		c.rtt_ns[i] = htonl(rtt_ns[i]);
+	c.vstats = vstats;
+	verify_stats_hton(&c.vstats);
+	memset(&vstats, 0, sizeof(vstats));
 	if (sizeof(c) != sendto(master_sd, &c, sizeof(c), 0,
 				(struct sockaddr *)&master_clnt_addr,
 				sizeof(master_clnt_addr)))
 		die("Client: Unable to send msg to master\n");
 }
 
-static void master_from_client(uint *cmd)
+static void master_from_client(uint *cmd, __u32 *rtt_ns)
 {
 	struct client_master_cmd c;
+	int i;
 
 	if (wait_for_msg(master_clnt_sd))
 		die("Client: No command from master\n");
@@ -138,6 +174,9 @@ static void master_from_client(uint *cmd)
 	if (recv(master_clnt_sd, &c, sizeof(c), 0) != sizeof(c))
 		die("Client: Invalid msg msg from master\n");
 	*cmd = ntohl(c.cmd);
+	for (i = 0; rtt_ns && i < RTT_PCTLS; i++)
+		rtt_ns[i] = ntohl(c.rtt_ns[i]);
+	verify_stats_add(&vstats, &c.vstats);
 }
 
 static void master_to_srv(uint cmd, uint msglen, uint msgcnt, uint echo)
@@ -148,6 +187,7 @@ static void master_to_srv(uint cmd, uint msglen, uint msgcnt, uint echo)
 	c.msglen = htonl(msglen);
 	c.msgcnt = htonl(msgcnt);
 	c.echo = htonl(echo);
+	c.verify = htonl(verify);
 	if (sizeof(c) != sendto(master_srv_sd, &c, sizeof(c), 0,
 				(struct sockaddr *)&srv_ctrl_addr,
 				sizeof(srv_ctrl_addr)))
@@ -169,6 +209,53 @@ static void master_from_srv(uint *cmd, struct srv_info *sinfo, __u32 *tipc_addr)
 		*tipc_addr = ntohl(c.tipc_addr);
 	if (sinfo)
 		memcpy(sinfo, &c.sinfo, sizeof(*sinfo));
+	verify_stats_add(&vstats, &c.vstats);
+}
+
+/*
+ * Result history: with -o every measurement is appended to a file as one
+ * line of space separated key=value fields, starting with the run time,
+ * host, kernel release, protocol and server node. bench_report turns such
+ * a file into trend charts.
+ */
+static int hist_fd = -1;
+static char hist_prefix[256];
+
+static void history_open(const char *path, uint conn_typ, __u32 srv_node)
+{
+	struct utsname uts;
+
+	hist_fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+	if (hist_fd < 0)
+		die("Unable to open history file %s\n", path);
+	if (uname(&uts) < 0)
+		die("uname() failed\n");
+	snprintf(hist_prefix, sizeof(hist_prefix),
+		 "time=%llu host=%s kernel=%s proto=%s server=%u.%u.%u",
+		 (unsigned long long)time(NULL), uts.nodename, uts.release,
+		 conn_typ == TCP_CONN ? "tcp" : "tipc", tipc_zone(srv_node),
+		 tipc_cluster(srv_node), tipc_node(srv_node));
+}
+
+static void history_add(const char *fmt, ...)
+{
+	char line[512];
+	va_list args;
+	int len;
+
+	if (hist_fd < 0)
+		return;
+	len = snprintf(line, sizeof(line), "%s ", hist_prefix);
+	va_start(args, fmt);
+	len += vsnprintf(line + len, sizeof(line) - len - 1, fmt, args);
+	va_end(args);
+	if (len > sizeof(line) - 2)
+		len = sizeof(line) - 2;
+	line[len++] = '\n';
+
+	/* A single O_APPEND write keeps records whole if runs overlap */
+	if (write(hist_fd, line, len) != len)
+		die("Unable to write history record\n");
 }
 
 static void usage(char *app)
@@ -177,7 +264,8 @@ static void usage(char *app)
 	fprintf(stderr," %s ", app);
 	fprintf(stderr, "[-l [lat msgs]] [-t [<tput msgs>]]"
                          " [-c <num conns>] [-p <tipc | tcp>]"
-		         "[-i <ifname>]\n");
+		         "[-i <ifname>] [-s] [-r [<lookup msgs>]] [-n <max names>]"
+		         " [-o <history file>] [-q] [-v]\n");
 	fprintf(stderr, "\tmsgs to transfer for latency measurement (default %u)\n",
 		DEFAULT_LAT_MSGS);
 	fprintf(stderr, "\tmsgs to transfer for throughput measurement (default %u)\n",
@@ -185,6 +273,15 @@ static void usage(char *app)
 	fprintf(stderr, "\tnumber of connections defaults to %d\n", DEFAULT_CLIENTS);
 	fprintf(stderr, "\tprotocol to measure (defaults to tipc)\n");
 	fprintf(stderr, "\tinterface to use for tcp (default: last found)\n");
+	fprintf(stderr, "\talso measure throughput with servers discarding data\n");
+	fprintf(stderr, "\tmsgs per RDM name lookup measurement, not with -l or -t "
+		"(default %u)\n",
+		DEFAULT_LOOKUP_MSGS);
+	fprintf(stderr, "\tlargest name table used in lookup measurement (default %u)\n",
+		DEFAULT_MAX_NAMES);
+	fprintf(stderr, "\tappend results to history file (see bench_report)\n");
+	fprintf(stderr, "\tquick in-process loopback smoke test, no server needed\n");
+	fprintf(stderr, "\tverify sequence and CRC32C of every message (not in sink runs)\n");
 }
 
 static unsigned long long elapsedusec(struct timeval *from)
@@ -212,6 +309,26 @@ static void print_throughput_header(void)
 	       "----------------------------------------------+\n");
 }
 
+static void print_throughput(const char *test,
+			     unsigned long long elapsed,
+			     unsigned long long msglen,
+			     unsigned long long msgcnt,
+			     unsigned long long num_clients)
+{
+	unsigned long long thruput;
+	unsigned long long msg_per_sec;
+
+	msg_per_sec = (msgcnt * num_clients * 1000000) / elapsed;
+	thruput = msg_per_sec * msglen * 8/1000000;
+	printf("| %8llu  | %12llu  | %11llu  | %14llu  |\n",
+	       elapsed/1000, msg_per_sec, thruput, thruput/num_clients);
+	history_add("test=%s msglen=%llu conns=%llu msgs=%llu elapsed_us=%llu "
+		    "msg_per_sec=%llu mbps=%llu", test, msglen, num_clients,
+		    msgcnt, elapsed, msg_per_sec, thruput);
+	printf("+-------------------------------------------------"
+	       "--------------------------------------------+\n");
+}
+
 static void print_latency_header(void)
 {
 	printf("+----------------------------------------"
@@ -222,6 +339,20 @@ static void print_latency_header(void)
 	       "----------------------------+\n");
 }
 
+static void print_lookup_header(void)
+{
+	printf("+-------------------------------------------"
+	       "---------------------------------+\n");
+	printf("| Name table | Msg Size |  # Msgs  |"
+	       "           Avg round-trip [us]           |\n");
+	printf("|  [names]   | [octets] |          +"
+	       "-------------+-------------+-------------+\n");
+	printf("|            |          |          |"
+	       "   By name   |  By port id |  Connected  |\n");
+	printf("+-------------------------------------------"
+	       "---------------------------------+\n");
+}
+
 static const char *impstr[4] = {"LOW", "MEDIUM", "HIGH", "CRITICAL"};
 
 static void client_create(unsigned int clnt_id, ushort tcp_port, int tcp_addr)
@@ -229,6 +360,7 @@ static void client_create(unsigned int clnt_id, ushort tcp_port, int tcp_addr)
 	int peer_sd;
 	int imp = clnt_id % 4;
 	uint cmd, msglen, msgcnt, bounce;
+	__u32 rtt_ns[RTT_PCTLS];
 	struct sockaddr_in tcp_dest;
 	fflush(stdout);
 	if (fork())
@@ -236,6 +368,7 @@ static void client_create(unsigned int clnt_id, ushort tcp_port, int tcp_addr)
 	printf("Client %u created with importance %s\n", clnt_id, impstr[imp]);
 	client_id = clnt_id;
 	close(master_clnt_sd);
+	memset(&vstats, 0, sizeof(vstats));
 	
 	/* Create socket for communication with master: */
 
@@ -279,7 +412,7 @@ static void client_create(unsigned int clnt_id, ushort tcp_port, int tcp_addr)
 	}
 
 	/* Notify master that we're ready to run tests */
-	client_to_master(CLNT_READY);
+	client_to_master(CLNT_READY, 0);
 
 	/* Process commands from client master until told to shut down */
 
@@ -293,18 +426,44 @@ static void client_create(unsigned int clnt_id, ushort tcp_port, int tcp_addr)
 		}
 
 		/* Execute command */
-		stream_messages(peer_sd, client_id, msgcnt, msglen, bounce);
+		stream_messages(peer_sd, client_id, msgcnt, msglen, bounce,
+				rtt_ns);
 
 		/* Done. Tell master */
-		client_to_master(CLNT_FINISHED);
+		client_to_master(CLNT_FINISHED, rtt_ns);
 	}
 }
 
+static unsigned long long nsec_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	__u32 x = *(const __u32 *)a;
+	__u32 y = *(const __u32 *)b;
+
+	return (x > y) - (x < y);
+}
+
 static void stream_messages(int peer_sd, int clnt_id, int msgcnt,
-			    int msglen, int bounce)
+			    int msglen, int bounce, __u32 *rtt_ns)
 {
 	int sent = 0;
 	int yield = (1 << 21) / msglen;
+	unsigned long long t0, rtt;
+	__u32 *rtts = NULL;
+
+	memset(rtt_ns, 0, RTT_PCTLS * sizeof(*rtt_ns));
+	if (bounce && msgcnt > 0) {
+		rtts = malloc(msgcnt * sizeof(*rtts));
+		if (!rtts)
+			die("Client %u: Unable to allocate rtt samples\n", clnt_id);
+	}
 	dprintf("Cli %u: bouncing %u msg of len %u, bounce = %u\n",
 		client_id, msgcnt,msglen,bounce);
 	while (sent < msgcnt) {
@@ -312,6 +471,9 @@ static void stream_messages(int peer_sd, int clnt_id, int msgcnt,
 			sched_yield();
 			yield = (1 << 22) / msglen;
 		}
+		if (verify)
+			verify_stamp(buf, msglen, tx_seqno++);
+		t0 = bounce ? nsec_now() : 0;
 		sent++;
 		if (msglen != send(peer_sd, buf, msglen, 0))
 			die("Client %u: send failed\n", clnt_id);
@@ -324,10 +486,312 @@ static void stream_messages(int peer_sd, int clnt_id, int msgcnt,
 			
 		if (msglen != recv(peer_sd, buf, msglen, MSG_WAITALL))
 			die("Client %u: invalid msg from server \n", clnt_id);
+		rtt = nsec_now() - t0;
+		rtts[sent - 1] = rtt > ~0U ? ~0U : rtt;
+		if (verify)
+			verify_check(buf, msglen, &echo_seqno, &vstats);
 	};
+	if (rtts) {
+		qsort(rtts, msgcnt, sizeof(*rtts), cmp_u32);
+		rtt_ns[RTT_P50] = rtts[(msgcnt - 1) * 50 / 100];
+		rtt_ns[RTT_P90] = rtts[(msgcnt - 1) * 90 / 100];
+		rtt_ns[RTT_P99] = rtts[(msgcnt - 1) * 99 / 100];
+		rtt_ns[RTT_MAX] = rtts[msgcnt - 1];
+		free(rtts);
+	}
 	dprintf("cli %u: reporting FINISHED to master\n", clnt_id);
 }
 
+/*
+ * One throughput measurement over all client connections. rcv_mode is
+ * passed to the servers: 0 for normal receive, SINK_MSGS for discard.
+ */
+static unsigned long long thruput_round(uint msglen, uint msgcnt,
+					uint num_clients, uint rcv_mode)
+{
+	struct timeval start_time;
+	uint cmd;
+	int i;
+
+	gettimeofday(&start_time, 0);
+
+	/* Tell servers what to expect */
+	master_to_srv(RCV_MSG_LEN, msglen, msgcnt, rcv_mode);
+
+	/* Wait until all servers are ready: */
+	for (i = 1; i <= num_clients; i++) {
+		master_from_srv(&cmd, 0, 0);
+	}
+
+	/* Tell clients to run a throughput test: */
+	master_to_client(CLNT_EXEC, msglen, msgcnt, 0);
+
+	/* Wait until all clients and servers are finished */
+	for (i = 1; i <= num_clients; i++) {
+		master_from_client(&cmd, 0);
+		master_from_srv(&cmd, 0, 0);
+	}
+	return elapsedusec(&start_time);
+}
+
+/*
+ * Request/response round trips from the master to the RDM echo server.
+ * dst == NULL means sd is connected. If src is given, it returns the
+ * port id of the responding server socket.
+ */
+static unsigned long long rdm_roundtrips(int sd, const struct sockaddr_tipc *dst,
+					 struct sockaddr_tipc *src,
+					 uint msgcnt, uint msglen)
+{
+	socklen_t src_len = sizeof(*src);
+	struct timeval start_time;
+	unsigned long long elapsed;
+	uint cmd, i;
+	int rc;
+
+	master_to_srv(RCV_MSG_LEN, msglen, msgcnt, 1);
+	master_from_srv(&cmd, 0, 0);
+
+	gettimeofday(&start_time, 0);
+	for (i = 0; i < msgcnt; i++) {
+		if (dst)
+			rc = sendto(sd, buf, msglen, 0,
+				    (struct sockaddr *)dst, sizeof(*dst));
+		else
+			rc = send(sd, buf, msglen, 0);
+		if (msglen != rc)
+			die("Master: lookup benchmark send failed\n");
+		if (wait_for_msg(sd))
+			die("Master: no resp from srv at %u\n", i);
+		if (msglen != recvfrom(sd, buf, msglen, 0, (struct sockaddr *)src,
+				       src ? &src_len : 0))
+			die("Master: invalid msg from server\n");
+	}
+	elapsed = elapsedusec(&start_time);
+
+	master_from_srv(&cmd, 0, 0);
+	return elapsed;
+}
+
+/*
+ * Compare the cost of sending by service name, which makes the kernel
+ * translate the name for every message, with sending to the resolved port
+ * id and over a connection. The name table on this node is grown between
+ * rounds by publishing node local instances of the server's own type, so
+ * each lookup has to search among them.
+ */
+static void lookup_benchmark(uint msgcnt, uint msglen, uint max_names)
+{
+	struct sockaddr_tipc fill_addr = srv_rdm_addr;
+	struct sockaddr_tipc srv_id;
+	unsigned long long by_name, by_id, by_conn;
+	uint names = 0, table_sz;
+	int rdm_sd, conn_sd, fill_sd;
+
+	rdm_sd = socket(AF_TIPC, SOCK_RDM, 0);
+	fill_sd = socket(AF_TIPC, SOCK_RDM, 0);
+	conn_sd = socket(AF_TIPC, SOCK_SEQPACKET, 0);
+	if (rdm_sd < 0 || fill_sd < 0 || conn_sd < 0)
+		die("Master: Can't create lookup benchmark sockets\n");
+	if (connect(conn_sd, (struct sockaddr *)&srv_lstn_addr,
+		    sizeof(srv_lstn_addr)) < 0)
+		die("Master: connect to RDM echo server failed\n");
+
+	fill_addr.scope = TIPC_NODE_SCOPE;
+	print_lookup_header();
+
+	for (table_sz = 0; table_sz <= max_names;
+	     table_sz = table_sz ? table_sz * 10 : 10) {
+
+		while (names < table_sz) {
+			fill_addr.addr.name.name.instance = ++names;
+			if (bind(fill_sd, (struct sockaddr *)&fill_addr,
+				 sizeof(fill_addr)))
+				die("Master: Failed to publish name %u\n", names);
+		}
+		printf("| %10u | %8u | %8u |", table_sz, msglen, msgcnt);
+
+		by_name = rdm_roundtrips(rdm_sd, &srv_rdm_addr, &srv_id,
+					 msgcnt, msglen);
+		by_id = rdm_roundtrips(rdm_sd, &srv_id, 0, msgcnt, msglen);
+		by_conn = rdm_roundtrips(conn_sd, 0, 0, msgcnt, msglen);
+
+		by_name = by_name * 100 / msgcnt;
+		by_id = by_id * 100 / msgcnt;
+		by_conn = by_conn * 100 / msgcnt;
+		printf(" %8llu.%02llu | %8llu.%02llu | %8llu.%02llu |\n",
+		       by_name / 100, by_name % 100, by_id / 100, by_id % 100,
+		       by_conn / 100, by_conn % 100);
+		history_add("test=lookup msglen=%u conns=1 names=%u msgs=%u "
+			    "name_ns=%llu id_ns=%llu conn_ns=%llu", msglen,
+			    table_sz, msgcnt, by_name * 10, by_id * 10,
+			    by_conn * 10);
+		printf("+-------------------------------------------"
+		       "---------------------------------+\n");
+	}
+	close(conn_sd);
+	close(fill_sd);
+	close(rdm_sd);
+}
+
+/*
+ * Loopback smoke test: a server thread and the calling thread exchange
+ * messages over node local connections, without server_tipc, topology
+ * subscriptions or the master control protocol. The whole profile takes
+ * about four seconds and ends with a single PASSED or FAIL line.
+ */
+static void smoke_alarm(int signo)
+{
+	printf("TIPC smoke test FAIL: timeout after %u s\n", SMOKE_TIMEOUT);
+	exit(1);
+}
+
+/* Each connection starts with a struct srv_cmd telling the server what to do */
+static void *smoke_server(void *arg)
+{
+	int lstn_sd = *(int *)arg;
+	unsigned char *sbuf;
+	struct srv_cmd c;
+	uint msglen, ack = 0;
+	int peer_sd, rc;
+
+	sbuf = malloc(SMOKE_LARGE_MSG);
+	if (!sbuf)
+		die("TIPC smoke test FAIL: no server buffer");
+	for (;;) {
+		peer_sd = accept(lstn_sd, 0, 0);
+		if (peer_sd < 0)
+			die("TIPC smoke test FAIL: accept");
+		if (recv(peer_sd, &c, sizeof(c), MSG_WAITALL) != sizeof(c))
+			die("TIPC smoke test FAIL: server command");
+		msglen = ntohl(c.msglen);
+		while ((rc = recv(peer_sd, sbuf, msglen, MSG_WAITALL)) == msglen) {
+
+			/* Echo everything, or ack the message flagged as last */
+			if (ntohl(c.cmd) == SMOKE_COUNT && !*(__u32 *)sbuf)
+				continue;
+			if (ntohl(c.cmd) == SMOKE_COUNT)
+				rc = send(peer_sd, &ack, sizeof(ack), 0) - sizeof(ack);
+			else
+				rc = send(peer_sd, sbuf, msglen, 0) - msglen;
+			if (rc)
+				die("TIPC smoke test FAIL: server send");
+		}
+		if (rc < 0)
+			die("TIPC smoke test FAIL: server recv");
+		close(peer_sd);
+	}
+	return NULL;
+}
+
+static int smoke_connect(const struct sockaddr_tipc *srv, uint cmd,
+			 uint msglen)
+{
+	struct srv_cmd c;
+	int sd;
+
+	sd = socket(AF_TIPC, SOCK_STREAM, 0);
+	if (sd < 0)
+		die("TIPC smoke test FAIL: client socket");
+	if (connect(sd, (struct sockaddr *)srv, sizeof(*srv)) < 0)
+		die("TIPC smoke test FAIL: connect");
+	c.cmd = htonl(cmd);
+	c.msglen = htonl(msglen);
+	if (send(sd, &c, sizeof(c), 0) != sizeof(c))
+		die("TIPC smoke test FAIL: client command");
+	return sd;
+}
+
+/* Stream msglen sized messages for ms milliseconds, returns Mb/s */
+static unsigned long long smoke_thruput(const struct sockaddr_tipc *srv,
+					unsigned char *sbuf, uint msglen,
+					uint ms)
+{
+	unsigned long long elapsed, sent = 0;
+	struct timeval start_time;
+	uint ack;
+	int sd;
+
+	sd = smoke_connect(srv, SMOKE_COUNT, msglen);
+	memset(sbuf, 0, msglen);
+	gettimeofday(&start_time, 0);
+	do {
+		if ((sent & 63) == 63 && elapsedusec(&start_time) >= ms * 1000)
+			*(__u32 *)sbuf = htonl(1);
+		if (send(sd, sbuf, msglen, 0) != msglen)
+			die("TIPC smoke test FAIL: send");
+		sent++;
+	} while (!*(__u32 *)sbuf);
+	if (recv(sd, &ack, sizeof(ack), MSG_WAITALL) != sizeof(ack))
+		die("TIPC smoke test FAIL: no ack from server");
+	elapsed = elapsedusec(&start_time);
+	close(sd);
+	return sent * msglen * 8 / elapsed;
+}
+
+static int smoke_test(void)
+{
+	struct sockaddr_tipc srv = {
+		.family                  = AF_TIPC,
+		.addrtype                = TIPC_ADDR_NAME,
+		.addr.name.name.type     = SMOKE_NAME,
+		.addr.name.name.instance = getpid(),
+		.scope                   = TIPC_NODE_SCOPE,
+	};
+	unsigned long long elapsed, rtts = 0, lat, small, large;
+	struct timeval start_time;
+	unsigned char *sbuf;
+	pthread_t srv_thread;
+	uint node;
+	int lstn_sd, sd;
+
+	if (signal(SIGALRM, smoke_alarm) == SIG_ERR)
+		die("TIPC smoke test FAIL: can't catch alarm signals");
+	alarm(SMOKE_TIMEOUT);
+
+	node = own_node();
+	srv.addr.name.domain = node;
+	sbuf = malloc(SMOKE_LARGE_MSG);
+	if (!sbuf)
+		die("TIPC smoke test FAIL: no client buffer");
+
+	lstn_sd = socket(AF_TIPC, SOCK_STREAM, 0);
+	if (lstn_sd < 0)
+		die("TIPC smoke test FAIL: listener socket");
+	if (bind(lstn_sd, (struct sockaddr *)&srv, sizeof(srv)) < 0)
+		die("TIPC smoke test FAIL: bind");
+	if (listen(lstn_sd, 4) < 0)
+		die("TIPC smoke test FAIL: listen");
+	if (pthread_create(&srv_thread, NULL, smoke_server, &lstn_sd))
+		die("TIPC smoke test FAIL: server thread");
+
+	/* Latency: small echoed messages for a fixed time */
+	sd = smoke_connect(&srv, SMOKE_ECHO, SMOKE_SMALL_MSG);
+	gettimeofday(&start_time, 0);
+	do {
+		if (send(sd, sbuf, SMOKE_SMALL_MSG, 0) != SMOKE_SMALL_MSG)
+			die("TIPC smoke test FAIL: send");
+		if (recv(sd, sbuf, SMOKE_SMALL_MSG, MSG_WAITALL) !=
+		    SMOKE_SMALL_MSG)
+			die("TIPC smoke test FAIL: no echo from server");
+		rtts++;
+	} while ((rtts & 63) || (elapsed = elapsedusec(&start_time)) <
+		 SMOKE_LAT_MS * 1000);
+	close(sd);
+	lat = elapsed * 100 / rtts;
+
+	/* Throughput: small and large messages for a fixed time each */
+	small = smoke_thruput(&srv, sbuf, SMOKE_SMALL_MSG, SMOKE_THRU_MS);
+	large = smoke_thruput(&srv, sbuf, SMOKE_LARGE_MSG, SMOKE_THRU_MS);
+
+	printf("TIPC smoke test PASSED on %u.%u.%u: latency %llu.%02llu us, "
+	       "throughput %u B %llu Mb/s, %u B %llu Mb/s\n",
+	       tipc_zone(node), tipc_cluster(node), tipc_node(node),
+	       lat / 100, lat % 100, SMOKE_SMALL_MSG, small,
+	       SMOKE_LARGE_MSG, large);
+	return 0;
+}
+
 /*
  * Master
  */
@@ -337,6 +801,15 @@ int main(int argc, char *argv[], char *dummy[])
 	uint cmd;
 	uint latency_transf = DEFAULT_LAT_MSGS;
 	uint thruput_transf = DEFAULT_THRU_MSGS;
+	uint lookup_transf = 0;
+	uint max_names = DEFAULT_MAX_NAMES;
+	uint sink = 0;
+	uint lat_thru = 0;
+	uint lookup = 0;
+	uint smoke = 0;
+	char *hist_path = NULL;
+	__u32 rtt_ns[RTT_PCTLS];
+	int exit_code = 0;
 	uint req_clients = DEFAULT_CLIENTS;
 	uint first_msglen = DEFAULT_MSGLEN;
 	uint last_msglen = TIPC_MAX_USER_MSG_SIZE;
@@ -358,17 +831,40 @@ int main(int argc, char *argv[], char *dummy[])
 
 	/* Process command line arguments */
 
-	while ((c = getopt(argc, argv, "l::t::c:p:m:i:")) != -1) {
+	while ((c = getopt(argc, argv, "l::t::c:p:m:i:r::n:so:qv")) != -1) {
 		switch (c) {
 		case 'l':
 			if (optarg)
 				latency_transf = atoi(optarg);
 			thruput_transf = 0;
+			lat_thru = 1;
 			break;
 		case 't':
 			if (optarg)
 				thruput_transf = atoi(optarg);
 			latency_transf = 0;
+			lat_thru = 1;
+			break;
+		case 'r':
+			lookup_transf = DEFAULT_LOOKUP_MSGS;
+			if (optarg)
+				lookup_transf = atoi(optarg);
+			lookup = 1;
+			break;
+		case 'n':
+			max_names = atoi(optarg);
+			break;
+		case 's':
+			sink = 1;
+			break;
+		case 'o':
+			hist_path = optarg;
+			break;
+		case 'q':
+			smoke = 1;
+			break;
+		case 'v':
+			verify = 1;
 			break;
 		case 'm':
 			first_msglen = atoi(optarg);
@@ -397,9 +893,28 @@ int main(int argc, char *argv[], char *dummy[])
 		}
 	}
 
+	/* The lookup measurement replaces the others */
+	if (lookup && lat_thru) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (smoke)
+		return smoke_test();
+
+	if (lookup) {
+		latency_transf = 0;
+		thruput_transf = 0;
+		if (conn_typ == TCP_CONN)
+			die("Lookup benchmark is only available for tipc\n");
+		conn_typ = TIPC_RDM;
+		last_msglen = first_msglen;
+	}
+
 	buf = malloc(last_msglen);
 	if (!buf)
 		die("Unable to allocate buffer\n");
+	if (verify)
+		verify_fill(buf, last_msglen);
 
 	/* Create socket used to communicate with clients */
 
@@ -439,10 +954,14 @@ int main(int argc, char *argv[], char *dummy[])
 			latency_transf /= 10;
 		if (thruput_transf == DEFAULT_THRU_MSGS)
 			thruput_transf /= 10;			
+		if (lookup_transf == DEFAULT_LOOKUP_MSGS)
+			lookup_transf /= 10;
 	}
 	
 	tcp_port = ntohs(sinfo.tcp_port);
 	tcp_addr = select_ip(&sinfo, ifname);
+	if (hist_path)
+		history_open(hist_path, conn_typ, peer_tipc_addr);
 
 	printf("****** TIPC Benchmark Client Started ******\n");
 	if (conn_typ == TCP_CONN) {
@@ -462,7 +981,7 @@ int main(int argc, char *argv[], char *dummy[])
 
 	/* Create first child client and wait until it is connected */
 	client_create(++num_clients, tcp_port, tcp_addr);
-	master_from_client(&cmd);
+	master_from_client(&cmd, 0);
 	sleep(1);
 	print_latency_header();
 	iter = 1;
@@ -485,7 +1004,7 @@ int main(int argc, char *argv[], char *dummy[])
 		master_to_client(CLNT_EXEC, msglen, msgcnt, 1);
 
 		/* Wait until client and server are finished:*/
-		master_from_client(&cmd);
+		master_from_client(&cmd, rtt_ns);
 		master_from_srv(&cmd, 0, 0);
 
 		/* Calculate and present result: */
@@ -496,6 +1015,11 @@ int main(int argc, char *argv[], char *dummy[])
 
 		printf(" %11llu  | %15llu.%llu  |\n", 
 		       elapsed/1000, latency_us, latency_dec);
+		history_add("test=latency msglen=%llu conns=1 msgs=%llu "
+			    "elapsed_us=%llu avg_ns=%llu p50_ns=%u p90_ns=%u "
+			    "p99_ns=%u max_ns=%u", msglen, msgcnt, elapsed,
+			    elapsed * 1000 / msgcnt, rtt_ns[RTT_P50],
+			    rtt_ns[RTT_P90], rtt_ns[RTT_P99], rtt_ns[RTT_MAX]);
 		printf("+--------------------------------------------------"
 		       "-------------------+\n");
 	}
@@ -515,7 +1039,7 @@ end_latency:
 
 	while (num_clients < req_clients) {
 		client_create(++num_clients, tcp_port, tcp_addr);
-		master_from_client(&cmd);
+		master_from_client(&cmd, 0);
 	}
 
 	dprintf("Master: all clients and servers started\n");
@@ -526,48 +1050,48 @@ end_latency:
 
 	for (msglen = first_msglen; msglen <= last_msglen; msglen *= 4) {
 
-		unsigned long long thruput;
-		unsigned long long msg_per_sec;
-		int i;
-
 		msgcnt = thruput_transf / (1 << (iter - 1));
 		iter ++;
 		printf("| %9llu  | %4llu  | %8llu  ", msglen, num_clients, msgcnt);
+		elapsed = thruput_round(msglen, msgcnt, num_clients, 0);
+		print_throughput("throughput", elapsed, msglen, msgcnt,
+				 num_clients);
 
-		gettimeofday(&start_time, 0);
+		if (!sink)
+			continue;
 
-		/* Tell servers what to expect */
-		master_to_srv(RCV_MSG_LEN, msglen, msgcnt, 0);
+		/* Same transfer, but servers discard instead of copying out */
+		printf("|      sink  | %4llu  | %8llu  ", num_clients, msgcnt);
+		elapsed = thruput_round(msglen, msgcnt, num_clients, SINK_MSGS);
+		print_throughput("sink", elapsed, msglen, msgcnt, num_clients);
+	}
+	printf("Completed Throughput Benchmark\n");
 
-		/* Wait until all servers are ready: */
-		for (i = 1; i <= num_clients; i++) {
-			master_from_srv(&cmd, 0, 0);
-		}
+end_thruput:
 
-		/* Tell clients to run a throughput test: */
-		master_to_client(CLNT_EXEC, msglen, msgcnt, 0);
+	/* Optionally run name lookup test */
 
-		/* Wait until all clients and servers are finished */
-		for (i = 1; i <= num_clients; i++) {
-			master_from_client(&cmd);
-			master_from_srv(&cmd, 0, 0);
-		}
+	if (!lookup_transf)
+		goto end_lookup;
 
-		/* Calculate and present result: */
-		elapsed = elapsedusec(&start_time);
-		msg_per_sec = (msgcnt * num_clients * 1000000) / elapsed;
-		thruput = msg_per_sec * msglen * 8/1000000;
-		printf("| %8llu  | %12llu  | %11llu  | %14llu  |\n", 
-		       elapsed/1000, msg_per_sec, thruput, thruput/num_clients);
-		printf("+-------------------------------------------------"
-		       "--------------------------------------------+\n");
-	}
-	printf("Completed Throughput Benchmark\n");
+	printf("Transferring %u messages per round in TIPC RDM Lookup Benchmark\n",
+	       lookup_transf);
+	lookup_benchmark(lookup_transf, first_msglen, max_names);
+	printf("Completed Lookup Benchmark\n");
 
-end_thruput:
+end_lookup:
+
+	if (verify) {
+		printf("Payload verification: %u msgs checked, %u lost, "
+		       "%u duplicated, %u corrupted\n", vstats.checked,
+		       vstats.lost, vstats.dup, vstats.corrupt);
+		if (vstats.lost || vstats.dup || vstats.corrupt)
+			exit_code = 1;
+	}
 
 	/* Terminate all client processes */
-	master_to_client(CLNT_TERM, 0, 0, 0);
+	if (num_clients)
+		master_to_client(CLNT_TERM, 0, 0, 0);
 
 	if (signal(SIGALRM, sig_alarm) == SIG_ERR)
 		die("Master: Can't catch alarm signals\n");
@@ -583,7 +1107,7 @@ end_thruput:
 	close(master_clnt_sd);
 	shutdown(master_srv_sd, SHUT_RDWR);
 	close(master_srv_sd);
-	exit(0);
+	exit(exit_code);
 }
 
 static int select_ip(struct srv_info *sinfo, char* ifname)
@@ -62,6 +62,7 @@
 #define SRV_CTRL_NAME   17777
 #define SRV_LSTN_NAME   18888
 #define CLNT_CTRL_NAME  19999
+#define SRV_RDM_NAME    20000
 
 #define TERMINATE 1
 #define DEFAULT_CLIENTS 1
@@ -109,6 +110,15 @@ static const struct sockaddr_tipc srv_lstn_addr = {
 	.addr.name.domain        = 0
 };
 
+static const struct sockaddr_tipc srv_rdm_addr = {
+	.family                  = AF_TIPC,
+	.addrtype                = TIPC_ADDR_NAME,
+	.addr.name.name.type     = SRV_RDM_NAME,
+	.addr.name.name.instance = 0,
+	.scope                   = TIPC_ZONE_SCOPE,
+	.addr.name.domain        = 0
+};
+
 static int master_sd;
 
 struct srv_info {
@@ -117,6 +127,23 @@ struct srv_info {
 	__u32 ips[16];
 };
 
+/*
+ * Payload verification (-v): every message starts with a CRC32C over the
+ * rest of the message, followed by a sequence number counting messages
+ * sent on the connection. Receivers report what they found to the master.
+ */
+struct verify_hdr {
+	__u32 crc;
+	__u32 seqno;
+};
+
+struct verify_stats {
+	__u32 checked;
+	__u32 lost;
+	__u32 dup;
+	__u32 corrupt;
+};
+
 #define SRV_INFO         0
 #define SRV_MSGLEN_ACK   1
 #define SRV_FINISHED     2
@@ -124,19 +151,26 @@ struct srv_to_master_cmd {
 	__u32 cmd;
 	__u32 tipc_addr;
 	struct srv_info sinfo;
+	struct verify_stats vstats;
 };
 
 #define TIPC_CONN         0
 #define TCP_CONN          1
 #define RCV_MSG_LEN       2
 #define RESTART           3
+#define TIPC_RDM          4
 struct master_srv_cmd {
 	__u32 cmd;
 	__u32 msglen;
 	__u32 msgcnt;
 	__u32 echo;
+	__u32 verify;
 };
 
+/* Value of master_srv_cmd.echo asking the server to discard the data */
+#define SINK_MSGS         2
+#define SINK_BUF_LEN      (1 << 20)
+
 static void sig_alarm(int signo)
 {
 	printf("TIPC benchmark timeout, exiting...\n");
@@ -185,6 +219,118 @@ __u32 wait_for_name(__u32 name_type, __u32 name_instance, int wait)
 	return ntohl(event.port.node);
 }
 
+static __u32 crc32c_table[256];
+
+static __u32 crc32c_sw(__u32 crc, const unsigned char *p, size_t len)
+{
+	while (len--)
+		crc = crc32c_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static __u32 crc32c_hw(__u32 crc, const unsigned char *p, size_t len)
+{
+	unsigned long long crc64 = crc, v;
+
+	for (; len >= 8; len -= 8, p += 8) {
+		memcpy(&v, p, sizeof(v));
+		crc64 = __builtin_ia32_crc32di(crc64, v);
+	}
+	crc = crc64;
+	while (len--)
+		crc = __builtin_ia32_crc32qi(crc, *p++);
+	return crc;
+}
+#endif
+
+static inline __u32 crc32c(const unsigned char *p, size_t len)
+{
+	static __u32 (*crc_fn)(__u32, const unsigned char *, size_t);
+	__u32 i, j, c;
+
+	if (!crc_fn) {
+		for (i = 0; i < 256; i++) {
+			for (c = i, j = 0; j < 8; j++)
+				c = (c & 1) ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+			crc32c_table[i] = c;
+		}
+		crc_fn = crc32c_sw;
+#if defined(__x86_64__)
+		if (__builtin_cpu_supports("sse4.2"))
+			crc_fn = crc32c_hw;
+#endif
+	}
+	return ~crc_fn(~0, p, len);
+}
+
+/* Give the payload some non-trivial content, once per buffer */
+static inline void verify_fill(unsigned char *p, size_t len)
+{
+	__u32 x = 2463534242u;
+
+	while (len--) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		*p++ = x;
+	}
+}
+
+static inline void verify_stamp(unsigned char *msg, size_t len, __u32 seqno)
+{
+	struct verify_hdr *hdr = (struct verify_hdr *)msg;
+
+	if (len < sizeof(*hdr))
+		return;
+	hdr->seqno = htonl(seqno);
+	hdr->crc = htonl(crc32c(msg + sizeof(hdr->crc),
+				len - sizeof(hdr->crc)));
+}
+
+/* next_seqno is the sequence number expected in this message */
+static inline void verify_check(const unsigned char *msg, size_t len,
+			 __u32 *next_seqno, struct verify_stats *st)
+{
+	const struct verify_hdr *hdr = (const struct verify_hdr *)msg;
+	__u32 seqno;
+
+	if (len < sizeof(*hdr))
+		return;
+	st->checked++;
+	if (ntohl(hdr->crc) != crc32c(msg + sizeof(hdr->crc),
+				      len - sizeof(hdr->crc))) {
+		st->corrupt++;
+		(*next_seqno)++;
+		return;
+	}
+	seqno = ntohl(hdr->seqno);
+	if ((int)(seqno - *next_seqno) < 0) {
+		st->dup++;
+		return;
+	}
+	st->lost += seqno - *next_seqno;
+	*next_seqno = seqno + 1;
+}
+
+static inline void verify_stats_hton(struct verify_stats *st)
+{
+	st->checked = htonl(st->checked);
+	st->lost = htonl(st->lost);
+	st->dup = htonl(st->dup);
+	st->corrupt = htonl(st->corrupt);
+}
+
+static inline void verify_stats_add(struct verify_stats *sum,
+			     const struct verify_stats *net)
+{
+	sum->checked += ntohl(net->checked);
+	sum->lost += ntohl(net->lost);
+	sum->dup += ntohl(net->dup);
+	sum->corrupt += ntohl(net->corrupt);
+}
+
 static int wait_for_msg(int sd)
 {
 	struct pollfd pfd;
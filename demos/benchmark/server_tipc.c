@@ -41,8 +41,15 @@
 #define SRV_TIMEOUT 30
 
 static unsigned char *buf = NULL;
+static unsigned char *sink_buf = NULL;
+static uint conn_typ;
+static uint verify;
+static __u32 rx_seqno;
+static struct verify_stats vstats;
 static int wait_for_connection(int listener_sd);
 static void echo_messages(int peer_sd, int master_sd, int srv_id);
+static void echo_rdm_messages(int rdm_sd, int lstn_sd, int master_sd);
+static void sink_messages(int peer_sd, uint msglen, uint msgcnt, int srv_id);
 static __u32 own_node_addr;
 
 static void srv_to_master(uint cmd, struct srv_info *sinfo)
@@ -56,6 +63,9 @@ static void srv_to_master(uint cmd, struct srv_info *sinfo)
 	c.tipc_addr = htonl(own_node_addr);
 	if (sinfo)
 		memcpy(&c.sinfo, sinfo, sizeof(*sinfo));
+	c.vstats = vstats;
+	verify_stats_hton(&c.vstats);
+	memset(&vstats, 0, sizeof(vstats));
 	if (sizeof(c) != sendto(master_sd, &c, sizeof(c), 0,	
 				(struct sockaddr *)&master_srv_addr,
 				sizeof(master_srv_addr)))
@@ -78,6 +88,7 @@ static void srv_from_master(uint *cmd, uint* msglen, uint *msgcnt, uint *echo)
 		*msgcnt = ntohl(c.msgcnt);
 	if (echo)
 		*echo = ntohl(c.echo);
+	verify = ntohl(c.verify);
 }
 
 int main(int argc, char *argv[], char *dummy[])
@@ -87,7 +98,7 @@ int main(int argc, char *argv[], char *dummy[])
 	uint cmd;
 	uint max_msglen;
 	struct sockaddr_in srv_addr;
-	int lstn_sd, peer_sd;
+	int lstn_sd, peer_sd, rdm_sd;
 	int srv_id = 0, srv_cnt = 0;;
 
 	own_node_addr = own_node();
@@ -111,6 +122,7 @@ reset:
 
 	/* Wait for command from master: */
 	srv_from_master(&cmd, &max_msglen, 0, 0);
+	conn_typ = cmd;
 	buf = malloc(max_msglen);
 	if (!buf)
 		die("Failed to create buffer of size %u\n", ntohl(max_msglen));
@@ -150,6 +162,32 @@ reset:
 		printf("******    TCP Listener Socket Created    ******\n");
 		srv_to_master(SRV_INFO, &sinfo);
 		close(master_sd);
+	} else if (cmd == TIPC_RDM) {
+		rdm_sd = socket(AF_TIPC, SOCK_RDM, 0);
+		if (rdm_sd < 0)
+			die("Server master: can't create RDM socket\n");
+		if (bind(rdm_sd, (struct sockaddr *)&srv_rdm_addr,
+			 sizeof(srv_rdm_addr)) < 0)
+			die("TIPC Server master: failed to bind RDM port name\n");
+
+		/* Connected reference path for the lookup benchmark */
+		lstn_sd = socket(AF_TIPC, SOCK_SEQPACKET, 0);
+		if (lstn_sd < 0)
+			die("Server master: can't create listening socket\n");
+		if (bind(lstn_sd, (struct sockaddr *)&srv_lstn_addr,
+			 sizeof(srv_lstn_addr)) < 0)
+			die("TIPC Server master: failed to bind port name\n");
+		if (listen(lstn_sd, 32) < 0)
+			die("Server: listen() failed");
+		printf("******    RDM Echo Socket Created        ******\n");
+		srv_to_master(SRV_INFO, 0);
+
+		echo_rdm_messages(rdm_sd, lstn_sd, master_sd);
+		close(rdm_sd);
+		close(lstn_sd);
+		close(master_sd);
+		printf("******      RDM Echo Socket Deleted      ******\n");
+		goto reset;
 	} else {
 		close(master_sd);
 		goto reset;
@@ -234,12 +272,19 @@ static void echo_messages(int peer_sd, int master_sd, int srv_id)
 
 		dprintf("srv %u: expecting %u msgs of size %u, echoing = %u\n", 
 			srv_id, msgcnt,msglen,echo);
+		if (echo == SINK_MSGS) {
+			sink_messages(peer_sd, msglen, msgcnt, srv_id);
+			rx_seqno += msgcnt;
+			rcvd = msgcnt;
+		}
 		while (rcvd < msgcnt) {
 			if (wait_for_msg(peer_sd))
 				die("poll() from client failed\n");
 			if (msglen != recv(peer_sd, buf, msglen, MSG_WAITALL))
 				die("Server %u: echo_messages recv() error\n", srv_id);
 			rcvd++;
+			if (verify)
+				verify_check(buf, msglen, &rx_seqno, &vstats);
 			if (!echo)
 				continue;
 			if (msglen != send(peer_sd, buf, msglen, 0))
@@ -256,3 +301,101 @@ static void echo_messages(int peer_sd, int master_sd, int srv_id)
 	close(master_sd);
 	exit(0);
 }
+
+/*
+ * Receive and throw away msgcnt * msglen bytes without any per message
+ * poll() or copy to a message sized buffer. TCP can discard inside the
+ * kernel with MSG_TRUNC; TIPC streams ignore that flag, so they are
+ * drained with large reads spanning many messages instead.
+ */
+static void sink_messages(int peer_sd, uint msglen, uint msgcnt, int srv_id)
+{
+	unsigned long long left = (unsigned long long)msglen * msgcnt;
+	size_t len;
+	int rc;
+
+	if (!sink_buf && conn_typ != TCP_CONN) {
+		sink_buf = malloc(SINK_BUF_LEN);
+		if (!sink_buf)
+			die("Failed to create sink buffer\n");
+	}
+	while (left) {
+		len = left < SINK_BUF_LEN ? left : SINK_BUF_LEN;
+		if (conn_typ == TCP_CONN)
+			rc = recv(peer_sd, NULL, len, MSG_TRUNC);
+		else
+			rc = recv(peer_sd, sink_buf, len, 0);
+		if (rc <= 0)
+			die("Server %u: sink_messages recv() error\n", srv_id);
+		left -= rc;
+	}
+}
+
+/*
+ * Echo server for the name lookup benchmark. Requests arrive either on the
+ * RDM socket, addressed by service name or by port id, or on a single
+ * SEQPACKET connection accepted from lstn_sd. Replies always go straight
+ * back to the originating port, so only the client pays for name lookup.
+ */
+static void echo_rdm_messages(int rdm_sd, int lstn_sd, int master_sd)
+{
+	uint cmd, msglen, msgcnt, echo, rcvd;
+	struct sockaddr_tipc peer;
+	socklen_t peer_len;
+	struct pollfd pfd[3];
+	int conn_sd = -1;
+
+	do {
+		srv_from_master(&cmd, &msglen, &msgcnt, &echo);
+		if (cmd != RCV_MSG_LEN)
+			break;
+
+		srv_to_master(SRV_MSGLEN_ACK, 0);
+
+		dprintf("rdm srv: expecting %u msgs of size %u\n",
+			msgcnt, msglen);
+		for (rcvd = 0; rcvd < msgcnt;) {
+			pfd[0].fd = rdm_sd;
+			pfd[1].fd = lstn_sd;
+			pfd[2].fd = conn_sd;
+			pfd[0].events = pfd[1].events = pfd[2].events = POLLIN;
+			if (poll(pfd, 3, MAX_DELAY) <= 0)
+				die("poll() from client failed\n");
+
+			if (pfd[0].revents & POLLIN) {
+				peer_len = sizeof(peer);
+				if (msglen != recvfrom(rdm_sd, buf, msglen, 0,
+						       (struct sockaddr *)&peer,
+						       &peer_len))
+					die("echo_rdm_messages: recvfrom() error\n");
+				rcvd++;
+				if (msglen != sendto(rdm_sd, buf, msglen, 0,
+						     (struct sockaddr *)&peer,
+						     peer_len))
+					die("echo_rdm_messages: sendto failed\n");
+			}
+			if (pfd[2].revents & POLLIN) {
+				if (msglen != recv(conn_sd, buf, msglen, 0))
+					die("echo_rdm_messages: recv() error\n");
+				rcvd++;
+				if (msglen != send(conn_sd, buf, msglen, 0))
+					die("echo_rdm_messages: send failed\n");
+			} else if (pfd[2].revents) {
+				close(conn_sd);
+				conn_sd = -1;
+			}
+			if (pfd[1].revents & POLLIN) {
+				if (conn_sd >= 0)
+					close(conn_sd);
+				conn_sd = accept(lstn_sd, 0, 0);
+				if (conn_sd < 0)
+					die("Server master: accept failed\n");
+			}
+		}
+		dprintf("rdm srv: reporting FINISHED to master\n");
+		srv_to_master(SRV_FINISHED, 0);
+	} while (1);
+
+	if (conn_sd >= 0)
+		close(conn_sd);
+}
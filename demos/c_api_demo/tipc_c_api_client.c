@@ -43,7 +43,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <netinet/in.h>
-#include "tipcc.h"
+#include <tipcc.h>
 #include <poll.h>
 
 #define RDM_SRV_TYPE     18888
@@ -223,7 +223,7 @@ int main(int argc, char *argv[], char *dummy[])
 			pfd[2].fd = tipc_socket(SOCK_SEQPACKET);
 		}
 		if (pfd[3].revents & POLLIN) {
-			if (tipc_srv_evt(pfd[3].fd, &srv, &up, 0))
+			if (tipc_srv_evt(pfd[3].fd, &srv, NULL, &up, NULL))
 				die("reception of service event failed\n");
 			if (srv.type == RDM_SRV_TYPE) {
 				rdm_service_demo(pfd[0].fd, up, &srv_node);
@@ -41,7 +41,7 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
-#include "tipcc.h"
+#include <tipcc.h>
 #include <poll.h>
 
 #define RDM_SRV_TYPE     18888
@@ -43,7 +43,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <netinet/in.h>
-#include "tipcc.h"
+#include <tipcc.h>
 #include <poll.h>
 
 #define RDM_SRV_TYPE     18888
@@ -97,7 +97,7 @@ int main(int argc, char *argv[], char *dummy[])
 
 	while (poll(pfd, 6, 3000000)) {
 		if (pfd[0].revents & POLLIN) {
-			if (tipc_srv_evt(pfd[0].fd, &srv, &up, 0))
+			if (tipc_srv_evt(pfd[0].fd, &srv, NULL, &up, NULL))
 				die("reception of service event failed\n");
 			tipc_ntoa(&srv, sbuf, BUF_SZ);
 			if (srv.type == RDM_SRV_TYPE) {
@@ -0,0 +1,175 @@
+/* ------------------------------------------------------------------------
+ *
+ * test_buf.c
+ *
+ * Short description: libtipcc check, pooled message buffers
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ *
+ * ------------------------------------------------------------------------
+ */
+
+/* Buffers of each size class and beyond must be at least as large as
+ * asked, not overlap while held, and be recycled by the thread that
+ * frees them once the last reference is dropped. A producer thread then
+ * hands buffers to a consumer thread, which frees them, while both keep
+ * a reference for a while; nothing may be lost or freed twice.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "tipcc.h"
+
+#define HELD		1000
+#define PASSED		100000
+
+static const size_t sizes[] = {
+	1, 256, 257, 1024, 4000, 16384, 20000, TIPC_MAX_USER_MSG_SIZE,
+	TIPC_MAX_USER_MSG_SIZE + 1
+};
+
+#define SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static int pfd[2];
+static int failed;
+
+#define check(cond) do { if (!(cond)) { \
+	fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+	failed = 1; } } while (0)
+
+static void test_sizes(void)
+{
+	static unsigned char *held[HELD];
+	unsigned int i, j;
+	size_t sz;
+
+	for (i = 0; i < HELD; i++) {
+		sz = sizes[i % SIZES];
+		held[i] = tipc_buf_alloc(sz);
+		check(held[i] != NULL);
+		if (!held[i])
+			return;
+		check(tipc_buf_size(held[i]) >= sz);
+		check(!((uintptr_t)held[i] % 16));
+		memset(held[i], i & 0xff, sz);
+	}
+	for (i = 0; i < HELD; i++) {
+		sz = sizes[i % SIZES];
+		for (j = 0; j < sz; j++) {
+			if (held[i][j] != (i & 0xff))
+				break;
+		}
+		check(j == sz);
+		tipc_buf_put(held[i]);
+	}
+}
+
+static void test_refs(void)
+{
+	void *a, *b;
+
+	a = tipc_buf_alloc(100);
+	check(tipc_buf_get(a) == a);
+	tipc_buf_put(a);
+
+	/* Still held: a new buffer must be another one */
+	b = tipc_buf_alloc(100);
+	check(b != a);
+	tipc_buf_put(b);
+	tipc_buf_put(a);
+
+	/* Last put: the thread gets it back next */
+	check(tipc_buf_alloc(100) == a);
+	tipc_buf_put(a);
+	tipc_buf_put(NULL);
+}
+
+static void *producer(void *arg)
+{
+	unsigned int i;
+	uint32_t *buf;
+
+	for (i = 0; i < PASSED; i++) {
+		buf = tipc_buf_alloc(sizes[i % (SIZES - 1)]);
+		if (!buf) {
+			failed = 1;
+			break;
+		}
+		*buf = i;
+		tipc_buf_get(buf);
+		if (write(pfd[1], &buf, sizeof(buf)) != sizeof(buf))
+			failed = 1;
+		tipc_buf_put(buf);
+	}
+	buf = NULL;
+	if (write(pfd[1], &buf, sizeof(buf)) != sizeof(buf))
+		failed = 1;
+	return NULL;
+}
+
+static void *consumer(void *arg)
+{
+	unsigned int i = 0;
+	uint32_t *buf;
+
+	while (read(pfd[0], &buf, sizeof(buf)) == sizeof(buf) && buf) {
+		if (*buf != i++)
+			failed = 1;
+		tipc_buf_put(buf);
+	}
+	if (i != PASSED)
+		failed = 1;
+	return NULL;
+}
+
+int main(void)
+{
+	pthread_t tp, tc;
+
+	test_sizes();
+	test_refs();
+	if (pipe(pfd)) {
+		perror("pipe");
+		return 1;
+	}
+	pthread_create(&tc, NULL, consumer, NULL);
+	pthread_create(&tp, NULL, producer, NULL);
+	pthread_join(tp, NULL);
+	pthread_join(tc, NULL);
+
+	/* Buffers freed by the exited threads are back in the pool */
+	test_sizes();
+	return failed;
+}
@@ -0,0 +1,157 @@
+/* ------------------------------------------------------------------------
+ *
+ * test_coro.cpp
+ *
+ * Short description: libtipcc check, C++ coroutine echo over a reactor
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ *
+ * ------------------------------------------------------------------------
+ */
+
+/* One reactor runs an echo server and several clients as coroutines on
+ * SEQPACKET connections. Each client awaits a task<int> that sends its
+ * messages and checks the echoes, and the last one to finish stops the
+ * reactor. Also checks that a failed operation is thrown from co_await,
+ * and that sleep_for() resumes no earlier than asked.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include "tipcc.hpp"
+
+#define CORO_TYPE	18891
+#define CLIENTS		4
+#define MSGS		1000
+#define MSG_LEN		256
+#define SLEEP_MS	20
+
+static int failed;
+
+#define check(cond) do { if (!(cond)) { \
+	fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+	failed = 1; } } while (0)
+
+static const tipc::addr srv = {CORO_TYPE, 1, 0};
+static int clients_left = CLIENTS;
+static int echoed;
+
+static tipc::task<> echo(tipc::reactor &r, tipc::socket s)
+{
+	tipc::async_socket as(r, std::move(s));
+	std::byte buf[MSG_LEN];
+	int n;
+
+	for (;;) {
+		n = co_await as.recv(buf);
+		if (n <= 0)
+			co_return;
+		co_await as.send(std::span(buf, n));
+	}
+}
+
+static tipc::task<> server(tipc::reactor &r, tipc::async_socket &ls)
+{
+	for (int i = 0; i < CLIENTS; i++)
+		r.spawn(echo(r, co_await ls.accept()));
+}
+
+static tipc::task<int> exchange(tipc::async_socket &as, int id)
+{
+	std::byte msg[MSG_LEN], buf[MSG_LEN];
+	int i, n = 0;
+
+	for (i = 0; i < MSGS; i++) {
+		memset(msg, id + i, sizeof(msg));
+		co_await as.send(msg);
+		if (co_await as.recv(buf) != sizeof(buf) ||
+		    memcmp(msg, buf, sizeof(buf)))
+			break;
+		n++;
+	}
+	co_return n;
+}
+
+static tipc::task<> client(tipc::reactor &r, int id)
+{
+	tipc::async_socket as(r, tipc::socket(SOCK_SEQPACKET));
+
+	co_await as.connect(srv);
+	echoed += co_await exchange(as, id);
+	as.close();
+	if (!--clients_left)
+		r.stop();
+}
+
+static tipc::task<> errors(tipc::reactor &r)
+{
+	tipc::async_socket as(r, tipc::socket(SOCK_SEQPACKET));
+	tipc::addr none = {CORO_TYPE, 99, 0};
+	auto t0 = std::chrono::steady_clock::now();
+	int err = 0;
+
+	co_await r.sleep_for(std::chrono::milliseconds(SLEEP_MS));
+	check(std::chrono::steady_clock::now() - t0 >=
+	      std::chrono::milliseconds(SLEEP_MS));
+
+	/* Nobody serves this name */
+	try {
+		co_await as.connect(none);
+	} catch (const std::system_error &e) {
+		err = e.code().value();
+	}
+	check(err != 0);
+}
+
+int main()
+{
+	try {
+		tipc::reactor r;
+		tipc::socket s(SOCK_SEQPACKET);
+
+		s.bind(srv.type, srv.instance, srv.instance);
+		s.listen();
+		tipc::async_socket ls(r, std::move(s));
+
+		r.spawn(server(r, ls));
+		for (int i = 0; i < CLIENTS; i++)
+			r.spawn(client(r, i));
+		r.spawn(errors(r));
+		r.run();
+	} catch (const std::system_error &e) {
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+	check(echoed == CLIENTS * MSGS);
+	return failed;
+}
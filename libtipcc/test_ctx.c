@@ -0,0 +1,145 @@
+/* ------------------------------------------------------------------------
+ *
+ * test_ctx.c
+ *
+ * Short description: libtipcc check, context link name cache
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ * ------------------------------------------------------------------------
+ */
+
+/* Link names are looked up through SIOCGETLINKNAME, which this program
+ * answers itself, counting the calls and handing out a new name each
+ * time. A cached name must be served without a call by every context,
+ * and a link down event must make all of them ask again for that link,
+ * and for that link only.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <dlfcn.h>
+#include <sys/ioctl.h>
+#include "tipcc.h"
+
+#define PEER	0x01001002
+#define BEARER	1
+#define OTHER	2
+
+static int lookups;
+static int failed;
+
+#define check(cond) do { if (!(cond)) { \
+	fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+	failed = 1; } } while (0)
+
+int ioctl(int fd, unsigned long req, ...)
+{
+	static int (*real_ioctl)(int, unsigned long, void *);
+	struct tipc_sioc_ln_req *lr;
+	va_list ap;
+	void *arg;
+
+	va_start(ap, req);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+	if (req != SIOCGETLINKNAME) {
+		if (!real_ioctl)
+			real_ioctl = dlsym(RTLD_NEXT, "ioctl");
+		return real_ioctl(fd, req, arg);
+	}
+	lr = arg;
+	snprintf(lr->linkname, sizeof(lr->linkname), "link-%x-%u-%d",
+		 lr->peer, lr->bearer_id, ++lookups);
+	return 0;
+}
+
+static void link_evt(uint32_t event, tipc_domain_t peer, int bearerid)
+{
+	struct tipc_event evt;
+
+	memset(&evt, 0, sizeof(evt));
+	evt.event = event;
+	evt.found_lower = evt.found_upper = peer;
+	evt.port.ref = bearerid;
+	tipc_link_evt_parse(&evt, NULL, NULL, NULL, NULL);
+}
+
+int main(void)
+{
+	struct tipc_ctx *ctx[2];
+	char a[TIPC_MAX_LINK_NAME], b[TIPC_MAX_LINK_NAME];
+	char c[TIPC_MAX_LINK_NAME];
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		ctx[i] = tipc_ctx_create();
+		check(ctx[i] != NULL);
+		if (!ctx[i])
+			return 1;
+		check(tipc_ctx_own_node(ctx[i]) == tipc_own_node());
+	}
+
+	tipc_ctx_linkname(ctx[0], a, sizeof(a), PEER, BEARER);
+	tipc_ctx_linkname(ctx[1], b, sizeof(b), PEER, BEARER);
+	tipc_linkname(c, sizeof(c), PEER, BEARER);
+	tipc_linkname(c, sizeof(c), PEER, OTHER);
+	check(lookups == 4);
+	check(a[0] && b[0] && strcmp(a, b));
+
+	/* Served from the caches */
+	tipc_ctx_linkname(ctx[0], a, sizeof(a), PEER, BEARER);
+	tipc_ctx_linkname(ctx[1], b, sizeof(b), PEER, BEARER);
+	tipc_linkname(c, sizeof(c), PEER, BEARER);
+	check(lookups == 4);
+	check(!strcmp(a, "link-1001002-1-1"));
+
+	/* Link up is no reason to drop anything */
+	link_evt(TIPC_PUBLISHED, PEER, BEARER);
+	tipc_ctx_linkname(ctx[0], a, sizeof(a), PEER, BEARER);
+	check(lookups == 4);
+
+	link_evt(TIPC_WITHDRAWN, PEER, BEARER);
+	tipc_ctx_linkname(ctx[0], a, sizeof(a), PEER, BEARER);
+	tipc_ctx_linkname(ctx[1], b, sizeof(b), PEER, BEARER);
+	tipc_linkname(c, sizeof(c), PEER, BEARER);
+	tipc_linkname(c, sizeof(c), PEER, OTHER);
+	check(lookups == 7);
+	check(!strcmp(a, "link-1001002-1-5"));
+
+	tipc_ctx_destroy(ctx[0]);
+	tipc_ctx_destroy(ctx[1]);
+	printf("%d link name lookups\n", lookups);
+	return failed;
+}
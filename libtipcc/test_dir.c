@@ -0,0 +1,153 @@
+/* ------------------------------------------------------------------------
+ *
+ * test_dir.c
+ *
+ * Short description: libtipcc check, service directory and tipc_srv_wait()
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ * ------------------------------------------------------------------------
+ */
+
+/* A directory follows a port binding and unbinding a name, with lookups
+ * and callbacks in step. Then tipc_srv_wait() waits for more services
+ * than it keeps subscribed, and again for the first ones, which must
+ * still be found after their subscriptions were dropped. A wait for a
+ * service nobody serves must give up after its time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <time.h>
+#include "tipcc.h"
+
+#define DIR_TYPE	18889
+#define SERVICES	64
+#define WAIT_MS		200
+
+static int ups, downs;
+static int failed;
+
+#define check(cond) do { if (!(cond)) { \
+	fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+	failed = 1; } } while (0)
+
+static void dir_cb(struct tipc_dir *dir, uint32_t type, uint32_t lower,
+		   uint32_t upper, const struct tipc_addr *id, bool up,
+		   void *arg)
+{
+	check(type == DIR_TYPE);
+	if (up)
+		ups++;
+	else
+		downs++;
+}
+
+/* Updates the directory until cond holds or a second has passed */
+#define dir_until(dir, cond) do { \
+	struct pollfd pfd = {tipc_dir_fd(dir), POLLIN, 0}; \
+	int n_ = 100; \
+	while (!(cond) && n_-- && poll(&pfd, 1, 10) >= 0) \
+		check(tipc_dir_update(dir) >= 0); \
+	check(cond); \
+} while (0)
+
+static void test_dir(void)
+{
+	struct tipc_dir *dir = tipc_dir_create(0, dir_cb, NULL);
+	struct tipc_addr id, found;
+	unsigned int gen;
+	int sd;
+
+	check(dir != NULL);
+	sd = tipc_socket(SOCK_RDM);
+	check(sd >= 0 && !tipc_sockid(sd, &id));
+	check(!tipc_dir_subscr(dir, DIR_TYPE, 0, 99));
+	check(!tipc_dir_subscr(dir, DIR_TYPE, 0, 99));
+	gen = tipc_dir_gen(dir);
+
+	check(!tipc_bind(sd, DIR_TYPE, 5, 5, 0));
+	dir_until(dir, ups == 1);
+	check(tipc_dir_lookup(dir, DIR_TYPE, 5, 0, &found, 1) == 1);
+	check(found.instance == id.instance);
+	check(!tipc_dir_lookup(dir, DIR_TYPE, 6, 0, NULL, 0));
+	check(tipc_dir_gen(dir) != gen);
+
+	check(!tipc_unbind(sd, DIR_TYPE, 5, 5));
+	dir_until(dir, downs == 1);
+	check(!tipc_dir_lookup(dir, DIR_TYPE, 5, 0, NULL, 0));
+
+	/* Counted twice, so the first unsubscribe keeps it */
+	check(!tipc_dir_unsubscr(dir, DIR_TYPE, 0, 99));
+	check(!tipc_bind(sd, DIR_TYPE, 7, 7, 0));
+	dir_until(dir, ups == 2);
+	check(!tipc_dir_unsubscr(dir, DIR_TYPE, 0, 99));
+	check(!tipc_dir_lookup(dir, DIR_TYPE, 7, 0, NULL, 0));
+	check(tipc_dir_unsubscr(dir, DIR_TYPE, 0, 99) < 0);
+
+	tipc_close(sd);
+	tipc_dir_destroy(dir);
+	printf("directory: %d up, %d down\n", ups, downs);
+}
+
+static void test_srv_wait(void)
+{
+	struct tipc_addr srv = {DIR_TYPE + 1, 0, 0};
+	struct timespec t0, t1;
+	int sd, i, ms;
+
+	sd = tipc_socket(SOCK_RDM);
+	check(sd >= 0 && !tipc_bind(sd, srv.type, 0, SERVICES - 1, 0));
+	for (i = 0; i < 2 * SERVICES; i++) {
+		srv.instance = i % SERVICES;
+		check(tipc_srv_wait(&srv, 1000));
+	}
+
+	srv.instance = SERVICES;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	check(!tipc_srv_wait(&srv, WAIT_MS));
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ms = (t1.tv_sec - t0.tv_sec) * 1000 +
+		(t1.tv_nsec - t0.tv_nsec) / 1000000;
+	check(ms >= WAIT_MS - 10 && ms < WAIT_MS + 1000);
+	tipc_close(sd);
+	printf("tipc_srv_wait: %d services, gave up after %d ms\n",
+	       SERVICES, ms);
+}
+
+int main(void)
+{
+	test_dir();
+	test_srv_wait();
+	return failed;
+}
@@ -0,0 +1,181 @@
+/* ------------------------------------------------------------------------
+ *
+ * test_dl.c
+ *
+ * Short description: libtipcc check, deadline aware receive and accept
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ *
+ * ------------------------------------------------------------------------
+ */
+
+/* The deadline calls must time out with ETIMEDOUT neither early nor much
+ * late, return a message that comes in time, keep what a waitall receive
+ * got before timing out, and fail at once when the deadline has passed.
+ * A non-blocking socket still gives EAGAIN, and a plain receive after a
+ * deadline call must not inherit its timeout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "tipcc.h"
+
+#define DL_TYPE		18894
+#define WAIT_MS		50
+
+/* A timeout may end this much later than asked on a loaded machine */
+#define SLACK_MS	500
+
+static int failed;
+
+#define check(cond) do { if (!(cond)) { \
+	fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+	failed = 1; } } while (0)
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Checks that a call started at t0 timed out after about WAIT_MS */
+static void check_timeout(int rc, uint64_t t0)
+{
+	uint64_t ms = (now_ns() - t0) / 1000000;
+
+	check(rc == -1 && errno == ETIMEDOUT);
+	check(ms >= WAIT_MS && ms < WAIT_MS + SLACK_MS);
+}
+
+static bool rcvtimeo_set(int sd)
+{
+	struct timeval tv;
+	socklen_t len = sizeof(tv);
+
+	return !getsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &tv, &len) &&
+		(tv.tv_sec || tv.tv_usec);
+}
+
+int main(void)
+{
+	char msg[] = "hello", buf[64];
+	struct tipc_addr id;
+	int rsd, tsd, lsd, sv[2];
+	uint64_t t0, dl;
+	int rc;
+
+	check(tipc_deadline(-1) == 0);
+	t0 = now_ns();
+	dl = tipc_deadline(WAIT_MS);
+	check(dl >= t0 + WAIT_MS * 1000000ull);
+
+	rsd = tipc_socket(SOCK_RDM);
+	tsd = tipc_socket(SOCK_RDM);
+	lsd = tipc_socket(SOCK_SEQPACKET);
+	if (rsd < 0 || tsd < 0 || lsd < 0 || tipc_sockid(rsd, &id) ||
+	    tipc_bind(lsd, DL_TYPE, 1, 1, 0) || tipc_listen(lsd, 0) ||
+	    socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+		perror("setup");
+		return 1;
+	}
+
+	/* Nothing comes */
+	t0 = now_ns();
+	rc = tipc_recvfrom_dl(rsd, buf, sizeof(buf), NULL, NULL, NULL,
+			      tipc_deadline(WAIT_MS));
+	check_timeout(rc, t0);
+	t0 = now_ns();
+	rc = tipc_accept_dl(lsd, NULL, tipc_deadline(WAIT_MS));
+	check_timeout(rc, t0);
+
+	/* Something comes in time, twice with the timeout left in place */
+	check(tipc_sendto(tsd, msg, sizeof(msg), &id) == sizeof(msg));
+	check(tipc_sendto(tsd, msg, sizeof(msg), &id) == sizeof(msg));
+	check(tipc_recvfrom_dl(rsd, buf, sizeof(buf), NULL, NULL, NULL,
+			       tipc_deadline(1000)) == sizeof(msg));
+	check(tipc_recvfrom_dl(rsd, buf, sizeof(buf), NULL, NULL, NULL,
+			       tipc_deadline(1000)) == sizeof(msg));
+	check(!strcmp(buf, msg));
+	check(rcvtimeo_set(rsd));
+
+	/* A plain receive clears it before waiting */
+	check(tipc_sendto(tsd, msg, sizeof(msg), &id) == sizeof(msg));
+	check(tipc_recvfrom(rsd, buf, sizeof(buf), NULL, NULL,
+			    NULL) == sizeof(msg));
+	check(!rcvtimeo_set(rsd));
+
+	/* Already passed, even with a message waiting */
+	check(tipc_sendto(tsd, msg, sizeof(msg), &id) == sizeof(msg));
+	t0 = now_ns();
+	errno = 0;
+	check(tipc_recvfrom_dl(rsd, buf, sizeof(buf), NULL, NULL, NULL,
+			       1) == -1 && errno == ETIMEDOUT);
+	check(now_ns() - t0 < WAIT_MS * 1000000ull);
+
+	/* Non-blocking: EAGAIN once the waiting message is read */
+	check(poll(&(struct pollfd){rsd, POLLIN, 0}, 1, 1000) == 1);
+	check(tipc_sock_non_block(rsd) >= 0);
+	check(tipc_recvfrom_dl(rsd, buf, sizeof(buf), NULL, NULL, NULL,
+			       tipc_deadline(WAIT_MS)) == sizeof(msg));
+	errno = 0;
+	check(tipc_recvfrom_dl(rsd, buf, sizeof(buf), NULL, NULL, NULL,
+			       tipc_deadline(WAIT_MS)) == -1 &&
+	      errno == EAGAIN);
+
+	/* waitall keeps what came before the deadline */
+	check(write(sv[0], msg, 4) == 4);
+	t0 = now_ns();
+	rc = tipc_recv_dl(sv[1], buf, sizeof(buf), true,
+			  tipc_deadline(WAIT_MS));
+	check(rc == 4);
+	check(now_ns() - t0 >= WAIT_MS * 1000000ull);
+	t0 = now_ns();
+	rc = tipc_recv_dl(sv[1], buf, sizeof(buf), true,
+			  tipc_deadline(WAIT_MS));
+	check_timeout(rc, t0);
+
+	close(sv[0]);
+	close(sv[1]);
+	tipc_close(lsd);
+	tipc_close(tsd);
+	tipc_close(rsd);
+	return failed;
+}
@@ -0,0 +1,203 @@
+/* ------------------------------------------------------------------------
+ *
+ * test_evt.c
+ *
+ * Short description: libtipcc check, topology event batching and coalescing
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ *
+ * ------------------------------------------------------------------------
+ */
+
+/* First tipc_srv_coalesce() on made up events, in both byte orders.
+ * Then a coalescer on a real topology connection must hold events back
+ * for its window, never report a port that flaps within it, and release
+ * everything at once when full. tipc_srv_evts() must read a burst of
+ * events in one call.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include "tipcc.h"
+
+#define EVT_TYPE	18892
+#define WINDOW_MS	100
+#define BURST		10
+
+static int failed;
+
+#define check(cond) do { if (!(cond)) { \
+	fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+	failed = 1; } } while (0)
+
+static struct tipc_event mk_evt(uint32_t kind, uint32_t inst, uint32_t ref,
+				bool swap)
+{
+	struct tipc_event e;
+
+	memset(&e, 0, sizeof(e));
+	e.event = kind;
+	e.found_lower = e.found_upper = inst;
+	e.port.ref = ref;
+	e.port.node = 1;
+	e.s.seq.type = EVT_TYPE;
+	e.s.seq.upper = ~0;
+	e.s.filter = TIPC_SUB_PORTS;
+	if (swap) {
+		e.event = __builtin_bswap32(kind);
+		e.s.filter = __builtin_bswap32(TIPC_SUB_PORTS);
+	}
+	return e;
+}
+
+static void test_coalesce(bool swap)
+{
+	uint32_t pub = TIPC_PUBLISHED, wdr = TIPC_WITHDRAWN;
+	struct tipc_event evts[] = {
+		mk_evt(pub, 1, 100, swap),
+		mk_evt(pub, 2, 200, swap),
+		mk_evt(wdr, 1, 100, swap),
+		mk_evt(pub, 3, 300, swap),
+		mk_evt(wdr, 3, 300, swap),
+		mk_evt(pub, 1, 100, swap),
+		mk_evt(wdr, 2, 201, swap),
+	};
+
+	check(tipc_srv_coalesce(evts, 7) == 3);
+	check(evts[0].port.ref == 200 && evts[1].port.ref == 100);
+	check(evts[2].port.ref == 201);
+}
+
+/* Reads the coalescer until it releases something, or for a second */
+static int coal_wait(int sd, struct tipc_srv_coal *c,
+		     struct tipc_event *evts, int max)
+{
+	struct pollfd pfd = {sd, POLLIN, 0};
+	int i, n = 0;
+
+	for (i = 0; i < 100 && !n; i++) {
+		poll(&pfd, 1, 10);
+		n = tipc_srv_coal_read(c, evts, max);
+	}
+	return n;
+}
+
+static void test_coal(void)
+{
+	struct tipc_event evts[BURST];
+	struct tipc_srv_coal *c;
+	struct tipc_addr srv, id, a;
+	bool up, expired;
+	int tsd, sd, sd2, n;
+
+	tsd = tipc_topsrv_conn(0);
+	sd = tipc_socket(SOCK_RDM);
+	sd2 = tipc_socket(SOCK_RDM);
+	check(tsd >= 0 && sd >= 0 && sd2 >= 0);
+	check(!tipc_srv_subscr(tsd, EVT_TYPE, 0, 99, true, -1));
+	check(!tipc_sockid(sd, &a));
+	c = tipc_srv_coal_create(tsd, WINDOW_MS, 0);
+	check(c != NULL);
+
+	/* sd flaps on 1 and stays; sd2 only comes and goes */
+	check(!tipc_bind(sd, EVT_TYPE, 1, 1, 0));
+	check(!tipc_unbind(sd, EVT_TYPE, 1, 1));
+	check(!tipc_bind(sd2, EVT_TYPE, 2, 2, 0));
+	check(!tipc_bind(sd, EVT_TYPE, 1, 1, 0));
+	check(!tipc_unbind(sd2, EVT_TYPE, 2, 2));
+
+	poll(&(struct pollfd){tsd, POLLIN, 0}, 1, 1000);
+	n = tipc_srv_coal_read(c, evts, BURST);
+	check(n == 0);
+	check(tipc_srv_coal_timeout(c) > 0);
+	n = coal_wait(tsd, c, evts, BURST);
+	check(n == 1);
+	tipc_srv_evt_parse(&evts[0], &srv, &id, &up, &expired);
+	check(up && !expired && srv.instance == 1);
+	check(id.instance == a.instance);
+	check(!tipc_srv_coal_pending(c));
+	tipc_srv_coal_destroy(c);
+
+	/* Room for two only: released as soon as they are in */
+	c = tipc_srv_coal_create(tsd, 10 * WINDOW_MS, 2);
+	check(!tipc_bind(sd2, EVT_TYPE, 2, 2, 0));
+	check(!tipc_bind(sd2, EVT_TYPE, 3, 3, 0));
+	n = coal_wait(tsd, c, evts, BURST);
+	check(n == 2);
+	check(tipc_srv_coal_timeout(c) == -1);
+	tipc_srv_coal_destroy(c);
+
+	tipc_close(sd);
+	tipc_close(sd2);
+	tipc_close(tsd);
+}
+
+static void test_burst(void)
+{
+	struct tipc_event evts[2 * BURST];
+	int tsd, sd, i, n, got = 0, calls = 0;
+
+	tsd = tipc_topsrv_conn(0);
+	sd = tipc_socket(SOCK_RDM);
+	check(tsd >= 0 && sd >= 0);
+	check(!tipc_srv_subscr(tsd, EVT_TYPE + 1, 0, 99, true, -1));
+	for (i = 0; i < BURST; i++)
+		check(!tipc_bind(sd, EVT_TYPE + 1, i, i, 0));
+
+	/* Let the burst arrive, then read it */
+	poll(&(struct pollfd){tsd, POLLIN, 0}, 1, 1000);
+	poll(NULL, 0, 50);
+	while (got < BURST && calls < BURST) {
+		n = tipc_srv_evts(tsd, evts, 2 * BURST);
+		check(n > 0);
+		if (n <= 0)
+			break;
+		got += n;
+		calls++;
+	}
+	check(got == BURST);
+	check(calls == 1);
+	tipc_close(sd);
+	tipc_close(tsd);
+}
+
+int main(void)
+{
+	test_coalesce(false);
+	test_coalesce(true);
+	test_coal();
+	test_burst();
+	return failed;
+}
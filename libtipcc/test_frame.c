@@ -0,0 +1,196 @@
+/* ------------------------------------------------------------------------
+ *
+ * test_frame.c
+ *
+ * Short description: libtipcc check, framed records over a stream socket
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ *
+ * ------------------------------------------------------------------------
+ */
+
+/* Sends records of varying length, corked and uncorked, over an AF_UNIX
+ * stream socket pair into a one page receive ring, so that records keep
+ * crossing the ring end. Checks that corked records stay buffered until
+ * due, that every record arrives whole and in order, that a record
+ * larger than the ring fails with EMSGSIZE, and that the peer closing is
+ * reported as 0.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "tipcc.h"
+
+#define RECS		20000
+#define MAX_REC		1500
+#define CORK_BYTES	8192
+#define CORK_US		50000
+#define RING_SZ		4096
+
+static int sv[2];
+static int failed;
+
+#define check(cond) do { if (!(cond)) { \
+	fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+	failed = 1; } } while (0)
+
+/* Length and contents of record i, the same on both sides */
+static size_t rec_len(unsigned int i)
+{
+	return (i * 7919) % MAX_REC;
+}
+
+static void rec_fill(char *buf, unsigned int i)
+{
+	memset(buf, i & 0xff, rec_len(i));
+}
+
+static void *writer(void *arg)
+{
+	struct tipc_frame *f;
+	char buf[MAX_REC];
+	unsigned int i;
+
+	f = tipc_frame_create(sv[0], (size_t)arg, 0, 0);
+	if (!f) {
+		failed = 1;
+		return NULL;
+	}
+	for (i = 0; i < RECS; i++) {
+		rec_fill(buf, i);
+		if (tipc_frame_send(f, buf, rec_len(i))) {
+			failed = 1;
+			break;
+		}
+	}
+	if (tipc_frame_flush(f))
+		failed = 1;
+	tipc_frame_destroy(f);
+	return NULL;
+}
+
+/* Receives all records of one writer run into a one page ring */
+static void stream(size_t cork_bytes)
+{
+	struct tipc_frame *f;
+	struct iovec recs[16];
+	char buf[MAX_REC];
+	unsigned int i = 0;
+	pthread_t tid;
+	int n, j;
+
+	f = tipc_frame_create(sv[1], 0, 0, RING_SZ);
+	check(f != NULL);
+	if (!f)
+		return;
+	pthread_create(&tid, NULL, writer, (void *)cork_bytes);
+	while (i < RECS) {
+		n = tipc_frame_recv(f, recs, 16);
+		check(n > 0);
+		if (n <= 0)
+			break;
+		for (j = 0; j < n; j++, i++) {
+			rec_fill(buf, i);
+			check(recs[j].iov_len == rec_len(i));
+			check(!memcmp(recs[j].iov_base, buf, rec_len(i)));
+		}
+	}
+	pthread_join(tid, NULL);
+	tipc_frame_destroy(f);
+}
+
+int main(void)
+{
+	struct tipc_frame *tx, *rx;
+	struct iovec rec;
+	char buf[RING_SZ];
+	uint32_t hdr;
+	int tmo;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+		perror("socketpair");
+		return 1;
+	}
+	stream(0);
+	stream(CORK_BYTES);
+
+	/* Corked records are held until cork_bytes or cork_us is reached */
+	tx = tipc_frame_create(sv[0], CORK_BYTES, CORK_US, 0);
+	rx = tipc_frame_create(sv[1], 0, 0, RING_SZ);
+	if (!tx || !rx) {
+		perror("tipc_frame_create");
+		return 1;
+	}
+	check(tipc_frame_timeout(tx) == -1);
+	memset(buf, 1, sizeof(buf));
+	check(!tipc_frame_send(tx, buf, 100));
+	check(tipc_frame_pending(tx) == 104);
+	tmo = tipc_frame_timeout(tx);
+	check(tmo > 0 && tmo <= CORK_US / 1000);
+	check(recv(sv[1], buf, 1, MSG_DONTWAIT | MSG_PEEK) < 0 &&
+	      errno == EAGAIN);
+	usleep(CORK_US);
+	check(tipc_frame_timeout(tx) == 0);
+	check(!tipc_frame_send(tx, buf, 100));
+	check(!tipc_frame_pending(tx));
+	check(tipc_frame_recv(rx, &rec, 1) == 1 && rec.iov_len == 100);
+	check(tipc_frame_recv(rx, &rec, 1) == 1 && rec.iov_len == 100);
+
+	/* A record that can never fit in the ring */
+	hdr = htonl(RING_SZ);
+	check(send(sv[0], &hdr, sizeof(hdr), 0) == sizeof(hdr));
+	check(send(sv[0], buf, RING_SZ, 0) == RING_SZ);
+	errno = 0;
+	check(tipc_frame_recv(rx, &rec, 1) == -1 && errno == EMSGSIZE);
+	tipc_frame_destroy(rx);
+
+	/* End of stream */
+	rx = tipc_frame_create(sv[1], 0, 0, 0);
+	while (recv(sv[1], buf, sizeof(buf), MSG_DONTWAIT) > 0)
+		;
+	check(!tipc_frame_send(tx, buf, 10) && !tipc_frame_flush(tx));
+	shutdown(sv[0], SHUT_WR);
+	check(tipc_frame_recv(rx, &rec, 1) == 1 && rec.iov_len == 10);
+	check(tipc_frame_recv(rx, &rec, 1) == 0);
+
+	tipc_frame_destroy(tx);
+	tipc_frame_destroy(rx);
+	close(sv[0]);
+	close(sv[1]);
+	return failed;
+}
@@ -0,0 +1,152 @@
+/* ------------------------------------------------------------------------
+ *
+ * test_iov.c
+ *
+ * Short description: libtipcc check, scatter-gather send and receive
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ *
+ * ------------------------------------------------------------------------
+ */
+
+/* Messages sent from separate header and body buffers must arrive split
+ * the same way, with the total length returned, and a message shorter
+ * than the header must be reported as such. A message rejected by a
+ * closed port must come back into the same buffers with its error code.
+ * Also covers connected sockets and the receive context variant.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "tipcc.h"
+
+#define IOV_TYPE	18896
+#define BODY_LEN	1000
+
+struct hdr {
+	uint32_t seq;
+	uint32_t len;
+};
+
+static int failed;
+
+#define check(cond) do { if (!(cond)) { \
+	fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+	failed = 1; } } while (0)
+
+int main(void)
+{
+	char body[BODY_LEN], rbody[BODY_LEN], three[3], *p;
+	struct hdr h = {7, BODY_LEN}, rh;
+	struct tipc_addr id, src, srv = {IOV_TYPE, 1, 0};
+	struct tipc_rcv_ctx ctx;
+	struct iovec iov[3];
+	int tx, rx, dead, lsd, csd, asd, err;
+
+	tx = tipc_socket(SOCK_RDM);
+	rx = tipc_socket(SOCK_RDM);
+	dead = tipc_socket(SOCK_RDM);
+	if (tx < 0 || rx < 0 || dead < 0 || tipc_sockid(rx, &id) ||
+	    tipc_sock_rejectable(tx)) {
+		perror("setup");
+		return 1;
+	}
+	memset(body, 'b', sizeof(body));
+
+	/* Header and body land where they were sent from */
+	check(tipc_send_hdr(tx, &h, sizeof(h), body, sizeof(body), &id) ==
+	      sizeof(h) + BODY_LEN);
+	memset(&rh, 0, sizeof(rh));
+	check(tipc_recv_hdr(rx, &rh, sizeof(rh), rbody, sizeof(rbody), &src,
+			    NULL, NULL) == sizeof(h) + BODY_LEN);
+	check(rh.seq == 7 && rh.len == BODY_LEN);
+	check(!memcmp(body, rbody, BODY_LEN));
+
+	/* Three pieces in, three pieces out, through a receive context */
+	iov[0] = (struct iovec){&h, sizeof(h)};
+	iov[1] = (struct iovec){body, 3};
+	iov[2] = (struct iovec){body + 3, 10};
+	check(tipc_sendv(tx, iov, 3, &id) == sizeof(h) + 13);
+	iov[0] = (struct iovec){&rh, sizeof(rh)};
+	iov[1] = (struct iovec){three, sizeof(three)};
+	iov[2] = (struct iovec){rbody, sizeof(rbody)};
+	memset(rbody, 0, sizeof(rbody));
+	tipc_rcv_ctx_init(&ctx, rx);
+	check(tipc_recvv_ctx(&ctx, iov, 3, NULL, NULL, NULL) ==
+	      sizeof(h) + 13);
+	check(!memcmp(three, "bbb", 3) && !memcmp(rbody, body, 10));
+
+	/* Shorter than the header */
+	check(tipc_send_hdr(tx, &h, 2, NULL, 0, &id) == 2);
+	check(tipc_recv_hdr(rx, &rh, sizeof(rh), rbody, sizeof(rbody), NULL,
+			    NULL, NULL) == 2);
+
+	/* Returned from a port that closed before reading it */
+	check(!tipc_sockid(dead, &id));
+	h.seq = 8;
+	check(tipc_send_hdr(tx, &h, sizeof(h), body, 100, &id) ==
+	      sizeof(h) + 100);
+	tipc_close(dead);
+	memset(&rh, 0, sizeof(rh));
+	memset(rbody, 0, sizeof(rbody));
+	err = 0;
+	check(tipc_recv_hdr(tx, &rh, sizeof(rh), rbody, sizeof(rbody), &src,
+			    NULL, &err) == sizeof(h) + 100);
+	check(err == TIPC_ERR_NO_PORT);
+	check(rh.seq == 8 && !memcmp(rbody, body, 100));
+
+	/* Connected: no destination */
+	lsd = tipc_socket(SOCK_SEQPACKET);
+	csd = tipc_socket(SOCK_SEQPACKET);
+	check(lsd >= 0 && csd >= 0);
+	check(!tipc_bind(lsd, IOV_TYPE, 1, 1, 0) && !tipc_listen(lsd, 0));
+	check(!tipc_connect(csd, &srv));
+	asd = tipc_accept(lsd, NULL);
+	check(asd >= 0);
+	check(tipc_send_hdr(csd, &h, sizeof(h), body, BODY_LEN, NULL) ==
+	      sizeof(h) + BODY_LEN);
+	p = malloc(sizeof(h) + BODY_LEN);
+	check(tipc_recv(asd, p, sizeof(h) + BODY_LEN, false) ==
+	      sizeof(h) + BODY_LEN);
+	check(!memcmp(p, &h, sizeof(h)) &&
+	      !memcmp(p + sizeof(h), body, BODY_LEN));
+	free(p);
+
+	tipc_close(asd);
+	tipc_close(csd);
+	tipc_close(lsd);
+	tipc_close(rx);
+	tipc_close(tx);
+	return failed;
+}
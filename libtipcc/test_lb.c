@@ -0,0 +1,216 @@
+/* ------------------------------------------------------------------------
+ *
+ * test_lb.c
+ *
+ * Short description: libtipcc check, load balancing policies
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ *
+ * ------------------------------------------------------------------------
+ */
+
+/* Three ports serve the same name. Round-robin must spread picks evenly,
+ * least outstanding must prefer ports with fewer picks not yet done, and
+ * hashing must keep a key on its port, moving only the keys of a port
+ * that goes away. tipc_lb_sendto() must deliver to the port it reports,
+ * and a name nobody serves must give EHOSTUNREACH.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include "tipcc.h"
+
+#define LB_TYPE		18895
+#define PORTS		3
+#define KEYS		300
+
+static struct tipc_addr ids[PORTS];
+static int failed;
+
+static int port_cnt(struct tipc_dir *dir)
+{
+	struct tipc_addr found[PORTS];
+
+	return tipc_dir_lookup(dir, LB_TYPE, 1, 0, found, PORTS);
+}
+
+#define check(cond) do { if (!(cond)) { \
+	fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+	failed = 1; } } while (0)
+
+/* Updates the directory until cond holds or a second has passed */
+#define dir_until(dir, cond) do { \
+	struct pollfd pfd = {tipc_dir_fd(dir), POLLIN, 0}; \
+	int n_ = 100; \
+	while (!(cond) && n_-- && poll(&pfd, 1, 10) >= 0) \
+		check(tipc_dir_update(dir) >= 0); \
+	check(cond); \
+} while (0)
+
+static int port_idx(const struct tipc_addr *id)
+{
+	int i;
+
+	for (i = 0; i < PORTS; i++) {
+		if (ids[i].instance == id->instance &&
+		    ids[i].domain == id->domain)
+			return i;
+	}
+	return -1;
+}
+
+static void test_rr(struct tipc_dir *dir)
+{
+	struct tipc_lb *lb = tipc_lb_create(dir, LB_TYPE, 1, 0, TIPC_LB_RR);
+	int cnt[PORTS] = {0}, i, p;
+	struct tipc_addr id;
+
+	check(lb != NULL);
+	for (i = 0; i < 3 * PORTS; i++) {
+		check(!tipc_lb_pick(lb, 0, &id));
+		p = port_idx(&id);
+		check(p >= 0);
+		if (p >= 0)
+			cnt[p]++;
+		tipc_lb_done(lb, &id);
+	}
+	for (i = 0; i < PORTS; i++)
+		check(cnt[i] == 3);
+	tipc_lb_destroy(lb);
+}
+
+static void test_least(struct tipc_dir *dir)
+{
+	struct tipc_lb *lb = tipc_lb_create(dir, LB_TYPE, 1, 0,
+					    TIPC_LB_LEAST);
+	struct tipc_addr id[PORTS], again;
+	int i;
+
+	check(lb != NULL);
+	for (i = 0; i < PORTS; i++)
+		check(!tipc_lb_pick(lb, 0, &id[i]));
+
+	/* One of each outstanding; the one done first comes next */
+	check(port_idx(&id[0]) != port_idx(&id[1]));
+	check(port_idx(&id[1]) != port_idx(&id[2]));
+	check(port_idx(&id[0]) != port_idx(&id[2]));
+	tipc_lb_done(lb, &id[1]);
+	check(!tipc_lb_pick(lb, 0, &again));
+	check(port_idx(&again) == port_idx(&id[1]));
+	tipc_lb_destroy(lb);
+}
+
+static void test_hash(struct tipc_dir *dir, int *sds)
+{
+	struct tipc_lb *lb = tipc_lb_create(dir, LB_TYPE, 1, 0,
+					    TIPC_LB_HASH);
+	int before[KEYS], cnt[PORTS] = {0}, i, p, gone;
+	struct tipc_addr id;
+
+	check(lb != NULL);
+	for (i = 0; i < KEYS; i++) {
+		check(!tipc_lb_pick(lb, i, &id));
+		before[i] = port_idx(&id);
+		check(before[i] >= 0);
+		if (before[i] >= 0)
+			cnt[before[i]]++;
+		check(!tipc_lb_pick(lb, i, &id));
+		check(port_idx(&id) == before[i]);
+	}
+	for (i = 0; i < PORTS; i++)
+		check(cnt[i] > 0);
+
+	/* Only keys of the port that goes move */
+	gone = PORTS - 1;
+	check(!tipc_unbind(sds[gone], LB_TYPE, 1, 1));
+	dir_until(dir, port_cnt(dir) == PORTS - 1);
+	for (i = 0; i < KEYS; i++) {
+		check(!tipc_lb_pick(lb, i, &id));
+		p = port_idx(&id);
+		check(p != gone);
+		if (before[i] != gone)
+			check(p == before[i]);
+	}
+	tipc_lb_destroy(lb);
+}
+
+int main(void)
+{
+	struct tipc_dir *dir = tipc_dir_create(0, NULL, NULL);
+	struct tipc_lb *lb;
+	struct tipc_addr id;
+	int sds[PORTS], sd, i;
+	char buf[16];
+
+	check(dir != NULL);
+	for (i = 0; i < PORTS; i++) {
+		sds[i] = tipc_socket(SOCK_RDM);
+		if (sds[i] < 0 || tipc_sockid(sds[i], &ids[i]) ||
+		    tipc_bind(sds[i], LB_TYPE, 1, 1, 0)) {
+			perror("setup");
+			return 1;
+		}
+	}
+	check(!tipc_dir_subscr(dir, LB_TYPE, 1, 1));
+	dir_until(dir, port_cnt(dir) == PORTS);
+
+	test_rr(dir);
+	test_least(dir);
+
+	/* Delivered where it says */
+	sd = tipc_socket(SOCK_RDM);
+	lb = tipc_lb_create(dir, LB_TYPE, 1, 0, TIPC_LB_LOCAL);
+	check(sd >= 0 && lb);
+	check(tipc_lb_sendto(sd, lb, 0, "lb", 3, &id) == 3);
+	i = port_idx(&id);
+	check(i >= 0);
+	if (i >= 0)
+		check(tipc_recv(sds[i], buf, sizeof(buf), false) == 3);
+	tipc_lb_destroy(lb);
+
+	/* Nobody there */
+	lb = tipc_lb_create(dir, LB_TYPE, 2, 0, TIPC_LB_RR);
+	errno = 0;
+	check(tipc_lb_pick(lb, 0, &id) < 0 && errno == EHOSTUNREACH);
+	tipc_lb_destroy(lb);
+
+	test_hash(dir, sds);
+
+	tipc_close(sd);
+	for (i = 0; i < PORTS; i++)
+		tipc_close(sds[i]);
+	tipc_dir_destroy(dir);
+	return failed;
+}
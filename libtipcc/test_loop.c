@@ -0,0 +1,126 @@
+/* ------------------------------------------------------------------------
+ *
+ * test_loop.c
+ *
+ * Short description: libtipcc check, event loop message delivery and end of connection
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ * ------------------------------------------------------------------------
+ */
+
+/* The peer writes a few messages and closes its end at once, so that one
+ * batch read by the loop holds both the messages and the end. The
+ * callback must get all messages, in order and without empty ones, then
+ * exactly one msgs == NULL call, after which the socket is out of the
+ * loop. Runs over SEQPACKET and STREAM socket pairs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "tipcc.h"
+
+#define MSGS	5
+#define MSG_LEN	100
+
+static int rcvd, bytes, ends;
+static int failed;
+
+#define check(cond) do { if (!(cond)) { \
+	fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+	failed = 1; } } while (0)
+
+static void msg_cb(struct tipc_loop *loop, int sd, struct tipc_mmsg *msgs,
+		   int num, void *arg)
+{
+	int i;
+
+	if (!msgs) {
+		ends++;
+		check(tipc_loop_del(loop, sd) < 0);
+		tipc_loop_stop(loop);
+		return;
+	}
+	check(!ends);
+	for (i = 0; i < num; i++) {
+		check(msgs[i].len > 0);
+		check(!msgs[i].err);
+		bytes += msgs[i].len;
+		rcvd++;
+	}
+}
+
+static void tmo_cb(struct tipc_loop *loop, int id, void *arg)
+{
+	fprintf(stderr, "end of connection not reported\n");
+	failed = 1;
+	tipc_loop_stop(loop);
+}
+
+static void run(int type, const char *name)
+{
+	struct tipc_loop *loop = tipc_loop_create();
+	char msg[MSG_LEN];
+	int sv[2], i;
+
+	rcvd = bytes = ends = 0;
+	if (!loop || socketpair(AF_UNIX, type, 0, sv)) {
+		perror(name);
+		exit(1);
+	}
+	for (i = 0; i < MSGS; i++) {
+		memset(msg, i, sizeof(msg));
+		check(send(sv[1], msg, sizeof(msg), 0) == sizeof(msg));
+	}
+	close(sv[1]);
+
+	check(tipc_loop_add_msg(loop, sv[0], msg_cb, NULL) == 0);
+	tipc_loop_timer(loop, 5000, false, tmo_cb, NULL);
+	tipc_loop_run(loop);
+	check(ends == 1);
+	check(bytes == MSGS * MSG_LEN);
+	if (type == SOCK_SEQPACKET)
+		check(rcvd == MSGS);
+	printf("%s: %d messages, %d bytes, %d end\n", name, rcvd, bytes,
+	       ends);
+	tipc_loop_destroy(loop);
+	close(sv[0]);
+}
+
+int main(void)
+{
+	run(SOCK_SEQPACKET, "SOCK_SEQPACKET");
+	run(SOCK_STREAM, "SOCK_STREAM");
+	return failed;
+}
@@ -0,0 +1,169 @@
+/* ------------------------------------------------------------------------
+ *
+ * test_mmsg.c
+ *
+ * Short description: libtipcc check, batched send and receive
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ *
+ * ------------------------------------------------------------------------
+ */
+
+/* Sends more messages than one batch holds, to a port id and to a
+ * service address in turn, with one message too large to send. That one
+ * alone must fail with EMSGSIZE. The rest must arrive in order in as
+ * few receive calls as there are batches, with source and destination
+ * filled in. Then the same over a connection, without destinations.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "tipcc.h"
+
+#define MMSG_TYPE	18897
+#define MSGS		100
+#define BAD		37
+
+static char bufs[MSGS][16];
+static char big[TIPC_MAX_USER_MSG_SIZE + 1];
+static int failed;
+
+#define check(cond) do { if (!(cond)) { \
+	fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+	failed = 1; } } while (0)
+
+static void fill(struct tipc_mmsg *msgs, const struct tipc_addr *port,
+		 const struct tipc_addr *srv)
+{
+	int i;
+
+	memset(msgs, 0, MSGS * sizeof(*msgs));
+	for (i = 0; i < MSGS; i++) {
+		msgs[i].buf = bufs[i];
+		msgs[i].len = snprintf(bufs[i], sizeof(bufs[i]), "msg %d", i);
+		if (port)
+			msgs[i].dst = (i & 1) ? *srv : *port;
+	}
+}
+
+/* Receives n messages; returns the number of calls it took */
+static int drain(int sd, struct tipc_mmsg *msgs, int n)
+{
+	static char rbufs[MSGS][16];
+	int i, rc, got = 0, calls = 0;
+
+	while (got < n) {
+		for (i = got; i < MSGS; i++) {
+			msgs[i].buf = rbufs[i];
+			msgs[i].len = sizeof(rbufs[i]);
+		}
+		rc = tipc_recvmmsg(sd, msgs + got, MSGS - got);
+		check(rc > 0);
+		if (rc <= 0)
+			break;
+		got += rc;
+		calls++;
+	}
+	return calls;
+}
+
+int main(void)
+{
+	static struct tipc_mmsg msgs[MSGS], rmsgs[MSGS];
+	struct tipc_addr tid, rid, srv = {MMSG_TYPE, 1, 0};
+	int tx, rx, lsd, csd, asd, i, j;
+	char exp[16];
+
+	tx = tipc_socket(SOCK_RDM);
+	rx = tipc_socket(SOCK_RDM);
+	if (tx < 0 || rx < 0 || tipc_sockid(tx, &tid) ||
+	    tipc_sockid(rx, &rid) || tipc_bind(rx, MMSG_TYPE, 1, 1, 0)) {
+		perror("setup");
+		return 1;
+	}
+
+	fill(msgs, &rid, &srv);
+	msgs[BAD].buf = big;
+	msgs[BAD].len = sizeof(big);
+	check(tipc_sendmmsg(tx, msgs, MSGS) == MSGS - 1);
+	for (i = 0; i < MSGS; i++)
+		check(msgs[i].err == (i == BAD ? EMSGSIZE : 0));
+
+	/* Messages from one sender are delivered in order, so once one to
+	 * itself is back, the batch is queued at the receiver
+	 */
+	check(tipc_sendto(tx, "sync", 4, &tid) == 4);
+	check(tipc_recv(tx, exp, sizeof(exp), false) == 4);
+
+	check(drain(rx, rmsgs, MSGS - 1) <=
+	      (MSGS + TIPC_MMSG_MAX - 1) / TIPC_MMSG_MAX);
+	for (i = 0, j = 0; i < MSGS - 1; i++, j++) {
+		if (j == BAD)
+			j++;
+		snprintf(exp, sizeof(exp), "msg %d", j);
+		check(rmsgs[i].len == strlen(exp));
+		check(!memcmp(rmsgs[i].buf, exp, rmsgs[i].len));
+		check(!rmsgs[i].err);
+		check(rmsgs[i].src.instance == tid.instance &&
+		      rmsgs[i].src.domain == tid.domain);
+		if (j & 1)
+			check(rmsgs[i].dst.type == MMSG_TYPE &&
+			      rmsgs[i].dst.instance == 1);
+		else
+			check(rmsgs[i].dst.instance == rid.instance);
+	}
+
+	/* Connected */
+	lsd = tipc_socket(SOCK_SEQPACKET);
+	csd = tipc_socket(SOCK_SEQPACKET);
+	check(lsd >= 0 && csd >= 0);
+	check(!tipc_bind(lsd, MMSG_TYPE, 2, 2, 0) && !tipc_listen(lsd, 0));
+	srv.instance = 2;
+	check(!tipc_connect(csd, &srv));
+	asd = tipc_accept(lsd, NULL);
+	check(asd >= 0);
+	fill(msgs, NULL, NULL);
+	check(tipc_sendmmsg(csd, msgs, MSGS) == MSGS);
+	drain(asd, rmsgs, MSGS);
+	for (i = 0; i < MSGS; i++)
+		check(rmsgs[i].len == msgs[i].len &&
+		      !memcmp(rmsgs[i].buf, msgs[i].buf, msgs[i].len));
+
+	tipc_close(asd);
+	tipc_close(csd);
+	tipc_close(lsd);
+	tipc_close(rx);
+	tipc_close(tx);
+	return failed;
+}
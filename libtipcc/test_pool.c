@@ -0,0 +1,152 @@
+/* ------------------------------------------------------------------------
+ *
+ * test_pool.c
+ *
+ * Short description: libtipcc check, connection pool reuse, limits and pruning
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ *
+ * ------------------------------------------------------------------------
+ */
+
+/* A pool of SEQPACKET connections to two services must hand back the
+ * most recently used idle connection, keep no more idle ones than asked,
+ * fail with ENOBUFS when all are busy and make room by closing an idle
+ * connection to another service. Idle connections must be dropped when
+ * the peer closes them, and when the service is withdrawn.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include "tipcc.h"
+
+#define POOL_TYPE	18893
+
+static struct tipc_addr srv1 = {POOL_TYPE, 1, 0};
+static struct tipc_addr srv2 = {POOL_TYPE, 2, 0};
+static int failed;
+
+#define check(cond) do { if (!(cond)) { \
+	fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+	failed = 1; } } while (0)
+
+/* Updates the directory until cond holds or a second has passed */
+#define dir_until(dir, cond) do { \
+	struct pollfd pfd = {tipc_dir_fd(dir), POLLIN, 0}; \
+	int n_ = 100; \
+	while (!(cond) && n_-- && poll(&pfd, 1, 10) >= 0) \
+		check(tipc_dir_update(dir) >= 0); \
+	check(cond); \
+} while (0)
+
+static void test_reuse(int lsd)
+{
+	struct tipc_cpool *pool = tipc_cpool_create(NULL, SOCK_SEQPACKET,
+						    2, 1);
+	int a, b, c, asd, idle;
+
+	check(pool != NULL);
+	a = tipc_cpool_get(pool, &srv1);
+	check(a >= 0);
+	tipc_cpool_put(pool, a, true);
+	check(tipc_cpool_get(pool, &srv1) == a);
+
+	/* Only one may be kept idle */
+	b = tipc_cpool_get(pool, &srv1);
+	check(b >= 0 && b != a);
+	tipc_cpool_put(pool, b, true);
+	tipc_cpool_put(pool, a, true);
+	check(tipc_cpool_count(pool, &idle) == 1 && idle == 1);
+	check(tipc_cpool_get(pool, &srv1) == b);
+
+	/* Full of busy ones, then one idle to another service gives way */
+	c = tipc_cpool_get(pool, &srv2);
+	check(c >= 0);
+	errno = 0;
+	check(tipc_cpool_get(pool, &srv1) < 0 && errno == ENOBUFS);
+	tipc_cpool_put(pool, c, true);
+	a = tipc_cpool_get(pool, &srv1);
+	check(a >= 0);
+	check(tipc_cpool_count(pool, &idle) == 2 && idle == 0);
+	tipc_cpool_put(pool, a, false);
+	check(tipc_cpool_count(pool, &idle) == 1);
+
+	/* The peer closes an idle connection */
+	tipc_cpool_put(pool, b, true);
+	while ((asd = tipc_accept(lsd, NULL)) >= 0)
+		tipc_close(asd);
+	poll(NULL, 0, 10);
+	check(tipc_cpool_prune(pool) == 1);
+	check(tipc_cpool_count(pool, &idle) == 0 && idle == 0);
+	tipc_cpool_destroy(pool);
+}
+
+static void test_withdraw(int lsd)
+{
+	struct tipc_dir *dir = tipc_dir_create(0, NULL, NULL);
+	struct tipc_cpool *pool = tipc_cpool_create(dir, SOCK_SEQPACKET,
+						    4, 4);
+	int sd, idle;
+
+	check(dir && pool);
+	sd = tipc_cpool_get(pool, &srv1);
+	check(sd >= 0);
+	tipc_cpool_put(pool, sd, true);
+	dir_until(dir, tipc_dir_lookup(dir, POOL_TYPE, 1, 0, NULL, 0) == 1);
+	check(tipc_cpool_prune(pool) == 0);
+
+	check(!tipc_unbind(lsd, POOL_TYPE, 1, 1));
+	dir_until(dir, tipc_dir_lookup(dir, POOL_TYPE, 1, 0, NULL, 0) == 0);
+	check(tipc_cpool_prune(pool) == 1);
+	check(tipc_cpool_count(pool, &idle) == 0);
+	tipc_cpool_destroy(pool);
+	tipc_dir_destroy(dir);
+}
+
+int main(void)
+{
+	int lsd = tipc_socket(SOCK_SEQPACKET);
+
+	if (lsd < 0 || tipc_bind(lsd, POOL_TYPE, 1, 1, 0) ||
+	    tipc_bind(lsd, POOL_TYPE, 2, 2, 0) ||
+	    tipc_listen(lsd, 0) || tipc_sock_non_block(lsd) < 0) {
+		perror("setup");
+		return 1;
+	}
+	test_reuse(lsd);
+	test_withdraw(lsd);
+	tipc_close(lsd);
+	return failed;
+}
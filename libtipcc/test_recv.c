@@ -0,0 +1,138 @@
+/* ------------------------------------------------------------------------
+ *
+ * test_recv.c
+ *
+ * Short description: libtipcc check, receive with and without ancillary data
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ *
+ * ------------------------------------------------------------------------
+ */
+
+/* Messages must be received the same whether or not the caller asks for
+ * destination and error: data and source in all cases, the destination
+ * when asked for. A rejected message must come back as 0 without an err
+ * pointer, and as its data with the error code with one. Covered both
+ * for plain tipc_recvfrom() and for a receive context used repeatedly.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "tipcc.h"
+
+#define RECV_TYPE	18898
+#define ROUNDS		10
+
+static int failed;
+
+#define check(cond) do { if (!(cond)) { \
+	fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+	failed = 1; } } while (0)
+
+static int recvfrom_any(struct tipc_rcv_ctx *ctx, char *buf, size_t len,
+			struct tipc_addr *src, struct tipc_addr *dst, int *err)
+{
+	if (ctx->sd < 0)
+		return tipc_recvfrom(-ctx->sd - 1, buf, len, src, dst, err);
+	return tipc_recvfrom_ctx(ctx, buf, len, src, dst, err);
+}
+
+static void run(struct tipc_rcv_ctx *rctx, struct tipc_rcv_ctx *tctx,
+		int tx, const struct tipc_addr *tid,
+		const struct tipc_addr *rid, const struct tipc_addr *srv)
+{
+	struct tipc_addr src, dst, dead_id;
+	char buf[64];
+	int dead, err;
+
+	/* Source only */
+	check(tipc_sendto(tx, "abc", 3, rid) == 3);
+	memset(&src, 0, sizeof(src));
+	check(recvfrom_any(rctx, buf, sizeof(buf), &src, NULL, NULL) == 3);
+	check(!memcmp(buf, "abc", 3));
+	check(src.instance == tid->instance && src.domain == tid->domain);
+
+	/* Destination: own port id, or the service address sent to */
+	check(tipc_sendto(tx, "defg", 4, rid) == 4);
+	memset(&dst, 0xff, sizeof(dst));
+	err = -1;
+	check(recvfrom_any(rctx, buf, sizeof(buf), &src, &dst, &err) == 4);
+	check(!memcmp(buf, "defg", 4) && !err);
+	check(dst.instance == rid->instance && dst.domain == rid->domain);
+	check(tipc_sendto(tx, "hi", 2, srv) == 2);
+	check(recvfrom_any(rctx, buf, sizeof(buf), NULL, &dst, NULL) == 2);
+	check(dst.type == srv->type && dst.instance == srv->instance);
+
+	/* Rejected, without and with err */
+	dead = tipc_socket(SOCK_RDM);
+	check(dead >= 0 && !tipc_sockid(dead, &dead_id));
+	check(tipc_sendto(tx, "lost", 4, &dead_id) == 4);
+	check(tipc_sendto(tx, "lost", 4, &dead_id) == 4);
+	tipc_close(dead);
+	check(recvfrom_any(tctx, buf, sizeof(buf), &src, NULL, NULL) == 0);
+	err = 0;
+	memset(buf, 0, sizeof(buf));
+	check(recvfrom_any(tctx, buf, sizeof(buf), &src, NULL, &err) == 4);
+	check(err == TIPC_ERR_NO_PORT && !memcmp(buf, "lost", 4));
+}
+
+int main(void)
+{
+	struct tipc_addr tid, rid, srv = {RECV_TYPE, 1, 0};
+	struct tipc_rcv_ctx rctx, tctx;
+	int tx, rx, i;
+
+	tx = tipc_socket(SOCK_RDM);
+	rx = tipc_socket(SOCK_RDM);
+	if (tx < 0 || rx < 0 || tipc_sockid(tx, &tid) ||
+	    tipc_sockid(rx, &rid) || tipc_sock_rejectable(tx) ||
+	    tipc_bind(rx, RECV_TYPE, 1, 1, 0)) {
+		perror("setup");
+		return 1;
+	}
+
+	/* Plain calls, flagged by a negative socket in the context */
+	rctx.sd = -rx - 1;
+	tctx.sd = -tx - 1;
+	run(&rctx, &tctx, tx, &tid, &rid, &srv);
+
+	tipc_rcv_ctx_init(&rctx, rx);
+	tipc_rcv_ctx_init(&tctx, tx);
+	for (i = 0; i < ROUNDS; i++)
+		run(&rctx, &tctx, tx, &tid, &rid, &srv);
+
+	tipc_close(rx);
+	tipc_close(tx);
+	return failed;
+}
@@ -0,0 +1,214 @@
+/* ------------------------------------------------------------------------
+ *
+ * test_rpc.c
+ *
+ * Short description: libtipcc check, pipelined RPC with reject and retry
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ *
+ * ------------------------------------------------------------------------
+ */
+
+/* An echo server answers pipelined requests until the table is full.
+ * Then a second server port goes away while the load balancer still
+ * knows it: requests sent there come back rejected and must be resent
+ * to the live port, or fail with ECONNREFUSED once retries are used up.
+ * A request to a port that never answers must time out.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include "tipcc.h"
+
+#define RPC_TYPE	18890
+#define MAX_REQS	32
+#define TIMEOUT_MS	50
+
+static struct tipc_addr srv = {RPC_TYPE, 1, 0};
+static int done, refused, timedout;
+static int failed;
+
+#define check(cond) do { if (!(cond)) { \
+	fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+	failed = 1; } } while (0)
+
+/* Echoes request bodies until it gets an empty one */
+static void *server(void *arg)
+{
+	char buf[TIPC_MAX_USER_MSG_SIZE];
+	struct tipc_addr src;
+	const void *body;
+	int sd = *(int *)arg;
+	int n, len;
+
+	for (;;) {
+		n = tipc_recvfrom(sd, buf, sizeof(buf), &src, NULL, NULL);
+		if (n <= 0)
+			continue;
+		len = tipc_rpc_req(buf, n, &body);
+		check(len >= 0);
+		if (len < 0)
+			continue;
+		tipc_rpc_reply(sd, &src, buf, body, len);
+		if (!len)
+			return NULL;
+	}
+}
+
+static void rsp_cb(struct tipc_rpc *rpc, int err, const void *rsp,
+		   size_t len, void *arg)
+{
+	uintptr_t i = (uintptr_t)arg;
+
+	if (err == ECONNREFUSED) {
+		refused++;
+		return;
+	}
+	if (err == ETIMEDOUT) {
+		timedout++;
+		return;
+	}
+	check(!err);
+	check(len == sizeof(i) && !memcmp(rsp, &i, sizeof(i)));
+	done++;
+}
+
+static void run_all(struct tipc_rpc *rpc)
+{
+	int n = 100;
+
+	while (tipc_rpc_outstanding(rpc) && n--)
+		check(tipc_rpc_poll(rpc, 100) >= 0);
+	check(!tipc_rpc_outstanding(rpc));
+}
+
+/* Sends MAX_REQS requests over the load balancer, with retries */
+static void lb_round(int sd, struct tipc_lb *lb, int retries)
+{
+	struct tipc_rpc *rpc = tipc_rpc_create(sd, lb, MAX_REQS, retries);
+	uintptr_t i;
+
+	check(rpc != NULL);
+	done = refused = 0;
+	for (i = 0; i < MAX_REQS; i++)
+		check(!tipc_rpc_send(rpc, NULL, &i, sizeof(i), -1, rsp_cb,
+				     (void *)i));
+	run_all(rpc);
+	tipc_rpc_destroy(rpc);
+}
+
+int main(void)
+{
+	struct tipc_addr ids[2];
+	struct tipc_rpc *rpc;
+	struct tipc_dir *dir;
+	struct tipc_lb *lb;
+	pthread_t tid;
+	int ssd, dsd, sd;
+	uintptr_t i;
+	char rsp[8];
+
+	ssd = tipc_socket(SOCK_RDM);
+	sd = tipc_socket(SOCK_RDM);
+	if (ssd < 0 || sd < 0 || tipc_bind(ssd, RPC_TYPE, 1, 1, 0) ||
+	    tipc_sock_rejectable(sd)) {
+		perror("setup");
+		return 1;
+	}
+	pthread_create(&tid, NULL, server, &ssd);
+
+	/* Pipelined over the service address, until the table is full */
+	rpc = tipc_rpc_create(sd, NULL, MAX_REQS, 0);
+	check(rpc != NULL);
+	for (i = 0; i < MAX_REQS; i++)
+		check(!tipc_rpc_send(rpc, &srv, &i, sizeof(i), -1, rsp_cb,
+				     (void *)i));
+	errno = 0;
+	check(tipc_rpc_send(rpc, &srv, &i, sizeof(i), -1, rsp_cb, NULL) &&
+	      errno == ENOBUFS);
+	run_all(rpc);
+	check(done == MAX_REQS);
+	i = 42;
+	check(tipc_rpc_call(rpc, &srv, &i, sizeof(i), rsp, sizeof(rsp),
+			    1000) == sizeof(i));
+	check(!memcmp(rsp, &i, sizeof(i)));
+
+	/* A port that is bound but never reads */
+	dsd = tipc_socket(SOCK_RDM);
+	check(dsd >= 0 && !tipc_bind(dsd, RPC_TYPE, 2, 2, 0));
+	timedout = 0;
+	check(!tipc_rpc_send(rpc, &(struct tipc_addr){RPC_TYPE, 2, 0}, &i,
+			     sizeof(i), TIMEOUT_MS, rsp_cb, NULL));
+	run_all(rpc);
+	check(timedout == 1);
+	tipc_close(dsd);
+	tipc_rpc_destroy(rpc);
+
+	/* The balancer knows both ports, but one of them closes */
+	dsd = tipc_socket(SOCK_RDM);
+	check(dsd >= 0 && !tipc_bind(dsd, RPC_TYPE, 1, 1, 0));
+	dir = tipc_dir_create(0, NULL, NULL);
+	lb = tipc_lb_create(dir, RPC_TYPE, 1, 0, TIPC_LB_RR);
+	check(dir && lb);
+	while (tipc_dir_lookup(dir, RPC_TYPE, 1, 0, ids, 2) < 2) {
+		struct pollfd pfd = {tipc_dir_fd(dir), POLLIN, 0};
+
+		check(poll(&pfd, 1, 1000) == 1);
+		check(tipc_dir_update(dir) >= 0);
+	}
+	tipc_close(dsd);
+
+	lb_round(sd, lb, 1);
+	check(done == MAX_REQS && !refused);
+	lb_round(sd, lb, 0);
+	check(done > 0 && refused > 0 && done + refused == MAX_REQS);
+	printf("without retries: %d answered, %d refused\n", done, refused);
+
+	/* Too short for a header, so no request */
+	errno = 0;
+	check(tipc_rpc_req(&i, 4, NULL) < 0 && errno == EBADMSG);
+
+	/* Stop the server */
+	rpc = tipc_rpc_create(sd, NULL, 1, 0);
+	check(tipc_rpc_call(rpc, &srv, NULL, 0, rsp, sizeof(rsp), 1000) == 0);
+	pthread_join(tid, NULL);
+	tipc_rpc_destroy(rpc);
+	tipc_lb_destroy(lb);
+	tipc_dir_destroy(dir);
+	tipc_close(ssd);
+	tipc_close(sd);
+	return failed;
+}
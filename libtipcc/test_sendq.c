@@ -0,0 +1,163 @@
+/* ------------------------------------------------------------------------
+ *
+ * test_sendq.c
+ *
+ * Short description: libtipcc check, event loop send queue limit and watermarks
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ * ------------------------------------------------------------------------
+ */
+
+/* Fills the send queue of one end of an AF_UNIX socket pair until
+ * tipc_loop_sendto() fails with ENOBUFS, then lets the loop drain it to
+ * the other end. Checks the limit, that each high watermark callback is
+ * followed by exactly one low one at the right queue levels, and that
+ * every accepted message arrives once and in order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include "tipcc.h"
+
+#define MSG_LEN		1024
+#define LIMIT		(64 * MSG_LEN)
+#define HIGH		(48 * MSG_LEN)
+#define LOW		(16 * MSG_LEN)
+#define ROUNDS		3
+
+static int sv[2];
+static unsigned int sent, rcvd;
+static int highs, lows;
+static int failed;
+
+#define check(cond) do { if (!(cond)) { \
+	fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+	failed = 1; } } while (0)
+
+static void wm_cb(struct tipc_loop *loop, int sd, bool above, void *arg)
+{
+	size_t bytes = tipc_loop_sendq_bytes(loop, sd);
+
+	check(sd == sv[0]);
+	if (above) {
+		check(highs == lows);
+		check(bytes >= HIGH && bytes <= LIMIT);
+		highs++;
+	} else {
+		check(highs == lows + 1);
+		check(bytes <= LOW);
+		lows++;
+	}
+}
+
+static void rcv_cb(struct tipc_loop *loop, int sd, struct tipc_mmsg *msgs,
+		   int num, void *arg)
+{
+	unsigned int seq;
+	int i;
+
+	check(msgs != NULL);
+	if (!msgs) {
+		tipc_loop_stop(loop);
+		return;
+	}
+	for (i = 0; i < num; i++) {
+		check(msgs[i].len == MSG_LEN);
+		memcpy(&seq, msgs[i].buf, sizeof(seq));
+		check(seq == rcvd);
+		rcvd++;
+	}
+	if (rcvd == sent)
+		tipc_loop_stop(loop);
+}
+
+static void snd_cb(struct tipc_loop *loop, int sd, struct tipc_mmsg *msgs,
+		   int num, void *arg)
+{
+}
+
+static void tmo_cb(struct tipc_loop *loop, int id, void *arg)
+{
+	fprintf(stderr, "send queue not drained, %u of %u received\n",
+		rcvd, sent);
+	failed = 1;
+	tipc_loop_stop(loop);
+}
+
+int main(void)
+{
+	struct tipc_loop *loop;
+	char msg[MSG_LEN] = {0};
+	int round, tmo;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv)) {
+		perror("socketpair");
+		return 1;
+	}
+	loop = tipc_loop_create();
+	if (!loop ||
+	    tipc_loop_add_msg(loop, sv[0], snd_cb, NULL) ||
+	    tipc_loop_add_msg(loop, sv[1], rcv_cb, NULL)) {
+		perror("tipc_loop");
+		return 1;
+	}
+	check(tipc_loop_sendq(loop, sv[0], LIMIT, LOW, HIGH, wm_cb, NULL) < 0);
+	check(tipc_loop_sendq(loop, sv[0], LIMIT, HIGH, LOW, wm_cb, NULL) == 0);
+
+	for (round = 0; round < ROUNDS && !failed; round++) {
+		for (;;) {
+			memcpy(msg, &sent, sizeof(sent));
+			if (tipc_loop_sendto(loop, sv[0], msg, MSG_LEN,
+					     NULL) < 0)
+				break;
+			sent++;
+		}
+		check(errno == ENOBUFS);
+		check(tipc_loop_sendq_bytes(loop, sv[0]) <= LIMIT);
+		check(tipc_loop_sendq_bytes(loop, sv[0]) + MSG_LEN > LIMIT);
+		check(highs == round + 1 && lows == round);
+
+		tmo = tipc_loop_timer(loop, 5000, false, tmo_cb, NULL);
+		tipc_loop_run(loop);
+		tipc_loop_timer_cancel(loop, tmo);
+		check(rcvd == sent);
+		check(tipc_loop_sendq_bytes(loop, sv[0]) == 0);
+		check(highs == round + 1 && lows == round + 1);
+	}
+	printf("%d rounds, %u messages, %d high and %d low callbacks\n",
+	       round, sent, highs, lows);
+	tipc_loop_destroy(loop);
+	return failed;
+}
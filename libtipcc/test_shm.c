@@ -0,0 +1,225 @@
+/* ------------------------------------------------------------------------
+ *
+ * test_shm.c
+ *
+ * Short description: libtipcc check, shared memory ring of a killed receiver
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ *
+ * ------------------------------------------------------------------------
+ */
+
+/* A receiver process attaches a ring to its socket and is killed without
+ * detaching it, once while the sender waits on the full ring and once
+ * while the ring is only cached by the sender. In both cases the send
+ * must complete through the kernel instead of waiting forever, and the
+ * dead receiver's ring must be removed. Then a socket with a ring is
+ * polled and read in batches, as by event loops and RPC: the ring must
+ * wake the poll and its messages come back in the batches, doorbells not.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "tipcc.h"
+
+#define RING_SZ		(256 * 1024)
+#define MSG_LEN		1024
+#define KILL_DELAY_US	200000
+#define LIVE_WAIT_US	200000
+#define BATCH_MSGS	50
+
+/* Fail rather than hang, if the sender still waits on a dead ring */
+#define TIMEOUT_S	10
+
+static int failed;
+
+#define check(cond) do { if (!(cond)) { \
+	fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+	failed = 1; } } while (0)
+
+/* Forks a receiver with a ring that never reads, returns its port id */
+static pid_t receiver(struct tipc_addr *id)
+{
+	int pfd[2];
+	pid_t pid;
+	int sd;
+
+	if (pipe(pfd))
+		return -1;
+	pid = fork();
+	if (pid < 0)
+		return -1;
+	if (!pid) {
+		sd = tipc_socket(SOCK_RDM);
+		if (sd < 0 || tipc_shm_attach(sd, RING_SZ) ||
+		    tipc_sockid(sd, id))
+			_exit(1);
+		if (write(pfd[1], id, sizeof(*id)) != sizeof(*id))
+			_exit(1);
+		for (;;)
+			pause();
+	}
+	close(pfd[1]);
+	if (read(pfd[0], id, sizeof(*id)) != sizeof(*id)) {
+		waitpid(pid, NULL, 0);
+		pid = -1;
+	}
+	close(pfd[0]);
+	return pid;
+}
+
+static bool ring_exists(const struct tipc_addr *id)
+{
+	char name[32];
+	int fd;
+
+	snprintf(name, sizeof(name), "/tipcc.shm.%u", id->instance);
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0)
+		return false;
+	close(fd);
+	return true;
+}
+
+/* Reaped too, as a zombie still counts as alive */
+static void *killer(void *arg)
+{
+	pid_t pid = *(pid_t *)arg;
+
+	usleep(KILL_DELAY_US);
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	return NULL;
+}
+
+int main(void)
+{
+	static char rbuf[TIPC_MMSG_MAX][MSG_LEN];
+	struct tipc_mmsg msgs[TIPC_MMSG_MAX];
+	struct pollfd pfd = {-1, POLLIN, 0};
+	struct tipc_addr id;
+	char msg[MSG_LEN];
+	pthread_t tid;
+	int sd, rx, fl, n, i, got;
+	pid_t pid;
+
+	memset(msg, 1, sizeof(msg));
+	alarm(TIMEOUT_S);
+	if (tipc_shm_enable(true) || (sd = tipc_socket(SOCK_RDM)) < 0) {
+		perror("setup");
+		return 1;
+	}
+
+	/* Killed while the sender waits on its full ring */
+	pid = receiver(&id);
+	if (pid < 0) {
+		perror("receiver");
+		return 1;
+	}
+	check(ring_exists(&id));
+	fl = fcntl(sd, F_GETFL);
+	fcntl(sd, F_SETFL, fl | O_NONBLOCK);
+	for (n = 0; n < RING_SZ / MSG_LEN; n++)
+		if (tipc_sendto(sd, msg, sizeof(msg), &id) != sizeof(msg))
+			break;
+	check(errno == EAGAIN);
+	check(n > 0 && n < RING_SZ / MSG_LEN);
+	fcntl(sd, F_SETFL, fl);
+	pthread_create(&tid, NULL, killer, &pid);
+	check(tipc_sendto(sd, msg, sizeof(msg), &id) == sizeof(msg));
+	pthread_join(tid, NULL);
+	check(!ring_exists(&id));
+	check(tipc_sendto(sd, msg, sizeof(msg), &id) == sizeof(msg));
+
+	/* Killed while its ring is cached, but not full */
+	pid = receiver(&id);
+	if (pid < 0) {
+		perror("receiver");
+		return 1;
+	}
+	check(tipc_sendto(sd, msg, sizeof(msg), &id) == sizeof(msg));
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	check(ring_exists(&id));
+	usleep(LIVE_WAIT_US);
+	check(tipc_sendto(sd, msg, sizeof(msg), &id) == sizeof(msg));
+	check(!ring_exists(&id));
+
+	/* Polled, then read in batches */
+	rx = tipc_socket(SOCK_RDM);
+	check(rx >= 0 && !tipc_shm_attach(rx, RING_SZ) &&
+	      !tipc_sockid(rx, &id));
+	for (n = 0; n < BATCH_MSGS; n++) {
+		msg[0] = n;
+		check(tipc_sendto(sd, msg, sizeof(msg), &id) == sizeof(msg));
+	}
+	pfd.fd = rx;
+	check(poll(&pfd, 1, 1000) == 1);
+	for (n = 0; n < BATCH_MSGS; n += got) {
+		for (i = 0; i < TIPC_MMSG_MAX; i++) {
+			msgs[i].buf = rbuf[i];
+			msgs[i].len = MSG_LEN;
+		}
+		got = tipc_recvmmsg(rx, msgs, TIPC_MMSG_MAX);
+		check(got > 0);
+		if (got <= 0)
+			break;
+		for (i = 0; i < got; i++)
+			check(msgs[i].len == MSG_LEN && !msgs[i].err &&
+			      rbuf[i][0] == (char)(n + i));
+	}
+
+	/* Drained, with the doorbell, the next message must wake it again */
+	check(tipc_sock_non_block(rx) >= 0);
+	msgs[0].len = MSG_LEN;
+	errno = 0;
+	check(tipc_recvmmsg(rx, msgs, TIPC_MMSG_MAX) == -1 && errno == EAGAIN);
+	msg[0] = n;
+	check(tipc_sendto(sd, msg, sizeof(msg), &id) == sizeof(msg));
+	check(poll(&pfd, 1, 1000) == 1);
+	msgs[0].len = MSG_LEN;
+	check(tipc_recvmmsg(rx, msgs, TIPC_MMSG_MAX) == 1);
+	check(msgs[0].len == MSG_LEN && rbuf[0][0] == (char)n);
+
+	tipc_close(rx);
+	tipc_close(sd);
+	return failed;
+}
@@ -0,0 +1,147 @@
+/* ------------------------------------------------------------------------
+ *
+ * test_stats.c
+ *
+ * Short description: libtipcc check, socket statistics and their export
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ *
+ * ------------------------------------------------------------------------
+ */
+
+/* Counts messages between two RDM sockets with counters, latency and
+ * export enabled, and reads them back both through tipc_sock_stats() and
+ * through the exported segment, as another process would. Also checks
+ * that unknown flags are refused, that tipc_stats_enable(true) still
+ * means plain counters, and that tipc_close() clears a socket's slot.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "tipcc.h"
+
+#define MSGS		100
+#define MSG_LEN		128
+
+static int failed;
+
+#define check(cond) do { if (!(cond)) { \
+	fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+	failed = 1; } } while (0)
+
+static uint64_t hist_sum(const uint64_t *hist)
+{
+	uint64_t sum = 0;
+	int i;
+
+	for (i = 0; i < TIPC_STATS_BUCKETS; i++)
+		sum += hist[i];
+	return sum;
+}
+
+static int exchange(int tx, int rx, const struct tipc_addr *dst, int n)
+{
+	char msg[MSG_LEN], buf[MSG_LEN];
+	int i;
+
+	memset(msg, 7, sizeof(msg));
+	for (i = 0; i < n; i++) {
+		if (tipc_sendto(tx, msg, sizeof(msg), dst) != sizeof(msg) ||
+		    tipc_recvfrom(rx, buf, sizeof(buf), NULL, NULL,
+				  NULL) != sizeof(buf))
+			return -1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	const struct tipc_stats_map *map;
+	struct tipc_sock_stats st, xst;
+	struct tipc_addr id;
+	int tx, rx;
+
+	errno = 0;
+	check(tipc_stats_enable(8) == -1 && errno == EINVAL);
+	if (tipc_stats_enable(TIPC_STATS_LATENCY | TIPC_STATS_EXPORT)) {
+		perror("tipc_stats_enable");
+		return 1;
+	}
+	tx = tipc_socket(SOCK_RDM);
+	rx = tipc_socket(SOCK_RDM);
+	if (tx < 0 || rx < 0 || tipc_sockid(rx, &id) ||
+	    exchange(tx, rx, &id, MSGS)) {
+		perror("exchange");
+		return 1;
+	}
+
+	check(!tipc_sock_stats(tx, &st));
+	check(st.tx_msgs == MSGS && st.tx_bytes == MSGS * MSG_LEN);
+	check(!st.rx_msgs && !st.errors && !st.eagain);
+	check(hist_sum(st.tx_lat) == MSGS);
+	check(!tipc_sock_stats(rx, &st));
+	check(st.rx_msgs == MSGS && st.rx_bytes == MSGS * MSG_LEN);
+	check(hist_sum(st.rx_lat) == MSGS);
+
+	/* The exported segment, as read by tipcc_stat */
+	map = tipc_stats_attach(getpid());
+	check(map != NULL);
+	if (!map)
+		return 1;
+	check(map->version == TIPC_STATS_VERSION);
+	check(map->pid == (uint32_t)getpid());
+	check(map->hi_sd > (uint32_t)tx && map->hi_sd > (uint32_t)rx);
+	check(tipc_stats_read(map, rx, &xst) == 1);
+	check(!memcmp(&st, &xst, sizeof(st)));
+	check(tipc_stats_read(map, map->hi_sd, &xst) == 0);
+	check(tipc_stats_read(map, -1, &xst) == -1);
+
+	/* Plain counters: no more latency samples */
+	check(!tipc_stats_enable(true));
+	check(!exchange(tx, rx, &id, MSGS));
+	check(tipc_stats_read(map, tx, &xst) == 1);
+	check(xst.tx_msgs == 2 * MSGS);
+	check(hist_sum(xst.tx_lat) == MSGS);
+
+	/* Closing clears the slot for the next user of the descriptor */
+	tipc_close(tx);
+	check(tipc_stats_read(map, tx, &xst) == 0);
+	check(!xst.tx_msgs);
+
+	tipc_stats_detach(map);
+	tipc_close(rx);
+	check(!tipc_stats_enable(0));
+	return failed;
+}
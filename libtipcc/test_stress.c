@@ -0,0 +1,203 @@
+/* ------------------------------------------------------------------------
+ *
+ * test_stress.c
+ *
+ * Short description: libtipcc check, concurrent use from many threads
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ * ------------------------------------------------------------------------
+ */
+
+/* Eight threads send, receive, read statistics, wait for services and
+ * look up link names at the same time, each on a connection of its own.
+ * The library promises that these paths share no lock, so every thread
+ * should get its fair share of a single thread's throughput; a global
+ * lock or a contended cache line would pull the slowest thread far below.
+ * Nothing is shared between the threads here, so the test may also be
+ * built with -fsanitize=thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include "tipcc.h"
+
+#define STRESS_TYPE	18888
+#define THREADS		8
+#define OPS		50000
+#define MSG_LEN		64
+#define STATS_EVERY	64
+#define SLOW_EVERY	4096
+
+/* A thread may fall to this fraction of its fair share */
+#define MIN_SHARE	0.5
+
+struct worker {
+	pthread_t tid;
+	int id;
+	double rate;
+	const char *fail;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *worker_run(void *arg)
+{
+	struct worker *w = arg;
+	struct tipc_addr srv = {STRESS_TYPE, w->id, 0};
+	struct tipc_sock_stats st;
+	char msg[MSG_LEN], buf[MSG_LEN], ln[TIPC_MAX_LINK_NAME];
+	int lsd, csd, asd = -1;
+	double start;
+	int i;
+
+	lsd = tipc_socket(SOCK_SEQPACKET);
+	csd = tipc_socket(SOCK_SEQPACKET);
+	if (lsd < 0 || csd < 0 ||
+	    tipc_bind(lsd, srv.type, srv.instance, srv.instance, 0) ||
+	    tipc_listen(lsd, 0)) {
+		w->fail = "socket setup";
+		goto out;
+	}
+	if (tipc_connect(csd, &srv) || (asd = tipc_accept(lsd, NULL)) < 0) {
+		w->fail = "connect";
+		goto out;
+	}
+	memset(msg, w->id, sizeof(msg));
+
+	start = now();
+	for (i = 0; i < OPS; i++) {
+		if (tipc_send(csd, msg, sizeof(msg)) != sizeof(msg) ||
+		    tipc_recv(asd, buf, sizeof(buf), false) != sizeof(buf) ||
+		    memcmp(msg, buf, sizeof(buf))) {
+			w->fail = "send/recv";
+			goto out;
+		}
+		if (!(i % STATS_EVERY) && tipc_sock_stats(csd, &st)) {
+			w->fail = "tipc_sock_stats";
+			goto out;
+		}
+		if (i % SLOW_EVERY)
+			continue;
+		if (!tipc_srv_wait(&srv, 1000)) {
+			w->fail = "tipc_srv_wait";
+			goto out;
+		}
+		tipc_linkname(ln, sizeof(ln), tipc_own_node(), 0);
+	}
+	w->rate = OPS / (now() - start);
+
+	tipc_sock_stats(csd, &st);
+	if (st.tx_msgs != OPS || st.tx_bytes != (uint64_t)OPS * MSG_LEN)
+		w->fail = "tx counters";
+	tipc_sock_stats(asd, &st);
+	if (st.rx_msgs != OPS || st.rx_bytes != (uint64_t)OPS * MSG_LEN)
+		w->fail = "rx counters";
+out:
+	if (w->fail)
+		fprintf(stderr, "thread %d: %s failed: %s\n", w->id, w->fail,
+			strerror(errno));
+	tipc_close(asd);
+	tipc_close(csd);
+	tipc_close(lsd);
+	return NULL;
+}
+
+static int run(struct worker *w, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		memset(&w[i], 0, sizeof(w[i]));
+		w[i].id = i + 1;
+		if (pthread_create(&w[i].tid, NULL, worker_run, &w[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (i = 0; i < n; i++)
+		pthread_join(w[i].tid, NULL);
+	for (i = 0; i < n; i++) {
+		if (w[i].fail)
+			return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct worker w[THREADS];
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	double single, fair, slowest;
+	int i;
+
+	if (tipc_stats_enable(TIPC_STATS_COUNTERS)) {
+		perror("tipc_stats_enable");
+		return 1;
+	}
+	if (run(w, 1))
+		return 1;
+	single = w[0].rate;
+	if (run(w, THREADS))
+		return 1;
+
+	/* With fewer CPUs than threads each one gets a slice of a CPU */
+	if (cpus < 1)
+		cpus = 1;
+	fair = single * (cpus < THREADS ? cpus : THREADS) / THREADS;
+	slowest = w[0].rate;
+	printf("1 thread: %.0f msg/s\n", single);
+	for (i = 0; i < THREADS; i++) {
+		printf("thread %d of %d: %.0f msg/s\n", w[i].id, THREADS,
+		       w[i].rate);
+		if (w[i].rate < slowest)
+			slowest = w[i].rate;
+	}
+	printf("slowest thread at %.2f of fair share %.0f msg/s (%ld CPUs)\n",
+	       slowest / fair, fair, cpus);
+	if (slowest < fair * MIN_SHARE) {
+		fprintf(stderr, "threads contend; slowest below %.2f\n",
+			MIN_SHARE);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,1145 @@
+/* ------------------------------------------------------------------------
+ *
+ * tipcc.c
+ *
+ * Short description: TIPC C binding API
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ * ------------------------------------------------------------------------
+ */
+
+#define _GNU_SOURCE
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/poll.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <pthread.h>
+#include <linux/socket.h>
+#include <linux/tipc.h>
+#include "tipcc_int.h"
+
+#define TIPC_LINK_CACHE_SZ 16
+#define TIPC_SRV_WAIT_SUBS 16
+
+struct tipc_link_entry {
+	tipc_domain_t peer;
+	int           bearerid;
+	uint32_t      gen;
+	char          name[TIPC_MAX_LINK_NAME];
+};
+
+/* node is written last and read first, so that cluster and zone are
+ * valid whenever node is set. The link cache is protected by lock
+ */
+struct tipc_ctx {
+	tipc_domain_t          node;
+	tipc_domain_t          cluster;
+	tipc_domain_t          zone;
+	int                    ctl_sd;
+	struct tipc_dir       *dir;
+	pthread_mutex_t        lock;
+	struct tipc_link_entry links[TIPC_LINK_CACHE_SZ];
+};
+
+/* Per-thread state: topology connection for tipc_srv_wait(), with its
+ * most recently waited for services kept subscribed, and control areas
+ * for tipc_recvmmsg(), which are too big for small thread stacks
+ */
+struct tipc_srv_sub {
+	uint32_t type;
+	uint32_t instance;
+	uint64_t used;
+};
+
+struct tipc_thread {
+	struct tipc_dir    *dir;
+	struct tipc_srv_sub subs[TIPC_SRV_WAIT_SUBS];
+	int                 sub_cnt;
+	uint64_t            use_seq;
+	char                anc_space[TIPC_MMSG_MAX][TIPC_ANC_SPACE];
+};
+
+static struct tipc_ctx *dflt_ctx;
+
+/* Bumped by link down events for the cache slot of <peer, bearer id>; an
+ * entry in any context is only valid while its slot has the same value
+ */
+static uint32_t link_gens[TIPC_LINK_CACHE_SZ];
+static pthread_mutex_t dflt_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t thread_once = PTHREAD_ONCE_INIT;
+static pthread_key_t thread_key;
+static __thread struct tipc_thread *thread_state;
+
+/* Retried until it succeeds, TIPC may not be loaded at first call */
+static struct tipc_ctx *tipc_ctx_get(void)
+{
+	struct tipc_ctx *ctx = __atomic_load_n(&dflt_ctx, __ATOMIC_ACQUIRE);
+
+	if (ctx)
+		return ctx;
+	pthread_mutex_lock(&dflt_lock);
+	ctx = dflt_ctx;
+	if (!ctx) {
+		ctx = tipc_ctx_create();
+		__atomic_store_n(&dflt_ctx, ctx, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&dflt_lock);
+	return ctx;
+}
+
+static void tipc_thread_free(void *arg)
+{
+	struct tipc_thread *t = arg;
+
+	tipc_dir_destroy(t->dir);
+	free(t);
+}
+
+static void tipc_thread_once(void)
+{
+	pthread_key_create(&thread_key, tipc_thread_free);
+}
+
+static struct tipc_thread *tipc_thread_get(void)
+{
+	if (thread_state)
+		return thread_state;
+	pthread_once(&thread_once, tipc_thread_once);
+	thread_state = calloc(1, sizeof(*thread_state));
+	if (thread_state)
+		pthread_setspecific(thread_key, thread_state);
+	return thread_state;
+}
+
+/* Node address may not be assigned yet when the context is created */
+static void tipc_ctx_refresh(struct tipc_ctx *ctx)
+{
+	struct tipc_addr sockid;
+
+	if (__atomic_load_n(&ctx->node, __ATOMIC_ACQUIRE))
+		return;
+	if (tipc_sockid(ctx->ctl_sd, &sockid))
+		return;
+	ctx->cluster = sockid.domain & ~0xfff;
+	ctx->zone = sockid.domain & ~0xffffff;
+	__atomic_store_n(&ctx->node, sockid.domain, __ATOMIC_RELEASE);
+}
+
+static inline unsigned int link_slot(tipc_domain_t peer, int bearerid)
+{
+	return (peer ^ bearerid) % TIPC_LINK_CACHE_SZ;
+}
+
+static inline __u8 domain2scope(tipc_domain_t domain)
+{
+	tipc_domain_t node;
+
+	if (!domain)
+		return TIPC_ZONE_SCOPE;
+	node = tipc_own_node();
+	if (node == domain)
+		return TIPC_NODE_SCOPE;
+	if ((node & ~0xfff) == domain)
+		return TIPC_CLUSTER_SCOPE;
+	if ((node & ~0xffffff) == domain)
+		return TIPC_ZONE_SCOPE;
+	else
+		return 0xffu;
+}
+
+static inline bool my_scope(tipc_domain_t domain)
+{
+	return domain2scope(domain) <= TIPC_NODE_SCOPE;
+}
+
+static inline void sock2addr(const struct sockaddr_tipc *src,
+			     struct tipc_addr *dst)
+{
+	dst->type = 0;
+	dst->instance = src->addr.id.ref;
+	dst->domain = src->addr.id.node;
+}
+
+static inline void addr2sock(const struct tipc_addr *src,
+			     struct sockaddr_tipc *dst)
+{
+	dst->family = AF_TIPC;
+	if (src->type) {
+		dst->addrtype = TIPC_ADDR_NAME;
+		dst->addr.name.name.type = src->type;
+		dst->addr.name.name.instance = src->instance;
+		dst->addr.name.domain = src->domain;
+	} else {
+		dst->addrtype = TIPC_ADDR_ID;
+		dst->addr.id.ref = src->instance;
+		dst->addr.id.node = src->domain;
+	}
+}
+
+struct tipc_ctx *tipc_ctx_create(void)
+{
+	struct tipc_ctx *ctx = calloc(1, sizeof(*ctx));
+
+	if (!ctx)
+		return NULL;
+	ctx->ctl_sd = tipc_socket(SOCK_RDM);
+	if (ctx->ctl_sd < 0) {
+		free(ctx);
+		return NULL;
+	}
+	pthread_mutex_init(&ctx->lock, NULL);
+	tipc_ctx_refresh(ctx);
+	return ctx;
+}
+
+/* The default context lives as long as the process */
+void tipc_ctx_destroy(struct tipc_ctx *ctx)
+{
+	if (!ctx || ctx == dflt_ctx)
+		return;
+	tipc_dir_destroy(ctx->dir);
+	close(ctx->ctl_sd);
+	pthread_mutex_destroy(&ctx->lock);
+	free(ctx);
+}
+
+tipc_domain_t tipc_ctx_own_node(struct tipc_ctx *ctx)
+{
+	tipc_ctx_refresh(ctx);
+	return __atomic_load_n(&ctx->node, __ATOMIC_ACQUIRE);
+}
+
+tipc_domain_t tipc_own_node(void)
+{
+	struct tipc_ctx *ctx = tipc_ctx_get();
+
+	return ctx ? tipc_ctx_own_node(ctx) : 0;
+}
+
+tipc_domain_t tipc_own_cluster(void)
+{
+	return tipc_own_node() ? dflt_ctx->cluster : 0;
+}
+
+tipc_domain_t tipc_own_zone(void)
+{
+	return tipc_own_node() ? dflt_ctx->zone : 0;
+}
+
+int tipc_socket(int sk_type)
+{
+	return socket(AF_TIPC, sk_type, 0);
+}
+
+int tipc_sock_non_block(int sd)
+{
+	int flags;
+
+	flags = fcntl(sd, F_GETFL, 0);
+	if (flags < 0)
+		return -1;
+	if (fcntl(sd, F_SETFL, flags | O_NONBLOCK) < 0)
+		return -1;
+	return sd;
+}
+
+int tipc_sock_rejectable(int sd)
+{
+	int val = 0;
+
+	return setsockopt(sd, SOL_TIPC, TIPC_DEST_DROPPABLE,
+			  &val, sizeof(val));
+}
+
+int tipc_close(int sd)
+{
+	tipc_sock_stats_clear(sd);
+	tipcc__shm_close(sd);
+	dl_forget(sd);
+	return close(sd);
+}
+
+int tipc_sockid(int sd, struct tipc_addr *id)
+{
+	struct sockaddr_tipc addr;
+	socklen_t sz = sizeof(addr);
+
+	if (!id)
+		return -1;
+	if (getsockname(sd, (struct sockaddr *)&addr, &sz) < 0)
+		return -1;
+	id->type = 0;
+	id->instance = addr.addr.id.ref;
+	id->domain = addr.addr.id.node;
+	return 0;
+}
+
+int tipc_bind(int sd, uint32_t type, uint32_t lower, uint32_t upper,
+	      tipc_domain_t scope)
+{
+	struct sockaddr_tipc addr = {
+		.family                  = AF_TIPC,
+		.addrtype                = TIPC_ADDR_NAMESEQ,
+		.addr.nameseq.type       = type,
+		.addr.nameseq.lower      = lower,
+		.addr.nameseq.upper      = upper
+	};
+	addr.scope = domain2scope(scope);
+
+	/* TODO: introduce support for global scope in module */
+	if (!scope)
+		addr.scope = TIPC_ZONE_SCOPE;
+	if (!my_scope(scope))
+		return -1;
+	return bind(sd, (struct sockaddr *)&addr, sizeof(addr));
+}
+
+int tipc_unbind(int sd, uint32_t type, uint32_t lower, uint32_t upper)
+
+{
+	struct sockaddr_tipc addr = {
+		.family                  = AF_TIPC,
+		.addrtype                = TIPC_ADDR_NAMESEQ,
+		.addr.nameseq.type       = type,
+		.addr.nameseq.lower      = lower,
+		.addr.nameseq.upper      = upper,
+		.scope                   = -1
+	};
+	return bind(sd, (struct sockaddr *)&addr, sizeof(addr));
+}
+
+int tipc_connect(int sd, const struct tipc_addr *dst)
+{
+	struct sockaddr_tipc addr;
+	uint64_t t0;
+	int rc;
+
+	if (!dst)
+		return -1;
+	addr.family                  = AF_TIPC;
+	addr.addrtype                = TIPC_ADDR_NAME;
+	addr.addr.name.name.type     = dst->type;
+	addr.addr.name.name.instance = dst->instance;
+	addr.addr.name.domain        = dst->domain;
+	t0 = stats_t0();
+	rc = connect(sd, (struct sockaddr*)&addr, sizeof(addr));
+	stats_conn(sd, rc, false, t0);
+	return rc;
+}
+
+int tipc_listen(int sd, int backlog)
+{
+	return listen(sd, backlog);
+}
+
+int tipc_accept(int sd, struct tipc_addr *src)
+{
+	struct sockaddr_tipc addr;
+	socklen_t addrlen = sizeof(addr);
+	uint64_t t0;
+	int rc;
+
+	dl_check(sd);
+	t0 = stats_t0();
+	rc = accept(sd, (struct sockaddr *) &addr, &addrlen);
+	stats_conn(sd, rc, true, t0);
+	if (src) {
+		src->type = 0;
+		src->instance = addr.addr.id.ref;
+		src->domain = addr.addr.id.node;
+	}
+	return rc;
+}
+
+int tipc_join(int sd, struct tipc_addr *member)
+{
+#ifdef TIPC_GROUP_JOIN
+	struct tipc_group_req mreq = {
+		.type = member->type,
+		.instance = member->instance,
+		.scope = domain2scope(member->domain)
+	};
+
+	return setsockopt(sd, SOL_TIPC, TIPC_GROUP_JOIN, &mreq, sizeof(mreq));
+#else
+#warning "tipc_join() not supported by this kernel version"
+	printf("tipc_join() not supported by kernel version this was built for\n");
+	return -1;
+#endif
+}
+
+int tipc_leave(int sd)
+{
+#ifdef TIPC_GROUP_LEAVE
+	return setsockopt(sd, SOL_TIPC, TIPC_GROUP_LEAVE, NULL, 0);
+#else
+#warning "tipc_leave() not supported by this kernel version"
+	printf("tipc_leave() not supported by kernel version this was built for\n");
+	return -1;
+#endif
+}
+
+int tipc_send(int sd, const char *msg, size_t msg_len)
+{
+	uint64_t t0 = stats_t0();
+	int rc = send(sd, msg, msg_len, 0);
+
+	stats_tx(sd, rc, t0);
+	return rc;
+}
+
+int tipc_sendmsg(int sd, const struct msghdr *msg)
+{
+	uint64_t t0 = stats_t0();
+	int rc = sendmsg(sd, msg, 0);
+
+	stats_tx(sd, rc, t0);
+	return rc;
+}
+
+int tipc_sendto(int sd, const char *msg, size_t msg_len,
+		const struct tipc_addr *dst)
+{
+	struct sockaddr_tipc addr;
+	uint64_t t0;
+	int rc;
+
+	if(!dst)
+		return -1;
+
+	if (!dst->type && __atomic_load_n(&tipcc__shm_on, __ATOMIC_RELAXED)) {
+		rc = tipcc__shm_sendto(sd, msg, msg_len, dst);
+		if (rc != SHM_KERNEL)
+			return rc;
+	}
+	addr2sock(dst, &addr);
+	t0 = stats_t0();
+	rc = sendto(sd, msg, msg_len, 0,
+		    (struct sockaddr*)&addr, sizeof(addr));
+	stats_tx(sd, rc, t0);
+	return rc;
+}
+
+int tipc_mcast(int sd, const char *msg, size_t msg_len,
+	       const struct tipc_addr *dst)
+{
+	struct sockaddr_tipc addr = {
+		.family                  = AF_TIPC,
+		.addrtype                = TIPC_ADDR_MCAST,
+		.addr.name.domain        = TIPC_CLUSTER_SCOPE
+	};
+	uint64_t t0;
+	int rc;
+
+	if(!dst)
+		return -1;
+	addr.addr.nameseq.type = dst->type;
+	addr.addr.nameseq.lower = dst->instance;
+	addr.addr.nameseq.upper = dst->instance;
+	addr.scope = domain2scope(addr.scope);
+	t0 = stats_t0();
+	rc = sendto(sd, msg, msg_len, 0,
+		    (struct sockaddr*)&addr, sizeof(addr));
+	stats_tx(sd, rc, t0);
+	return rc;
+}
+
+int tipc_recv(int sd, char* buf, size_t buf_len, bool waitall)
+{
+	int flags = waitall ? MSG_WAITALL : 0;
+	uint64_t t0;
+	int rc;
+
+	dl_check(sd);
+	t0 = stats_t0();
+	rc = recv(sd, buf, buf_len, flags);
+
+	stats_rx(sd, rc, false, t0);
+	return rc;
+}
+
+/* Scatter returned data of a rejected message into the receive buffers */
+static int anc_scatter(struct msghdr *msg, const char *data, size_t len)
+{
+	size_t i, n, copied = 0;
+
+	for (i = 0; i < msg->msg_iovlen && copied < len; i++) {
+		n = msg->msg_iov[i].iov_len;
+		if (n > len - copied)
+			n = len - copied;
+		memcpy(msg->msg_iov[i].iov_base, data + copied, n);
+		copied += n;
+	}
+	return copied;
+}
+
+/* Extract returned data, error code and destination name from a received
+ * message's ancillary data. Returns the resulting message length
+ */
+static int tipc_anc_get(struct msghdr *msg, int rc, struct tipc_addr *dst,
+			int *err)
+{
+	struct cmsghdr *anc = CMSG_FIRSTHDR(msg);
+	size_t len;
+
+	*err = 0;
+	if (anc && (anc->cmsg_type == TIPC_ERRINFO)) {
+		*err = *(int*)(CMSG_DATA(anc));
+		len = *(uint32_t*)(CMSG_DATA(anc) + 4);
+		anc = CMSG_NXTHDR(msg, anc);
+		rc = 0;
+
+		/* No TIPC_RETDATA if nothing was returned; may be truncated */
+		if (anc && (anc->cmsg_type == TIPC_RETDATA)) {
+			if (len > anc->cmsg_len - CMSG_LEN(0))
+				len = anc->cmsg_len - CMSG_LEN(0);
+			rc = anc_scatter(msg, (char*)CMSG_DATA(anc), len);
+			anc = CMSG_NXTHDR(msg, anc);
+		}
+	}
+	if (anc && (anc->cmsg_type == TIPC_DESTNAME)) {
+		dst->type = *((uint32_t*)(CMSG_DATA(anc)));
+		dst->instance = *((uint32_t*)(CMSG_DATA(anc) + 4));
+		dst->domain = 0;
+	} else {
+		dst->type = ~0;
+	}
+	return rc;
+}
+
+void tipc_rcv_ctx_init(struct tipc_rcv_ctx *ctx, int sd)
+{
+	memset(&ctx->msg, 0, sizeof(ctx->msg));
+	ctx->sd = sd;
+	ctx->self.type = ~0;
+	ctx->msg.msg_name = &ctx->addr;
+	ctx->msg.msg_iov = &ctx->iov;
+	ctx->msg.msg_iovlen = 1;
+}
+
+/* Receive into the buffers already set in ctx->msg */
+int tipcc__rcv_ctx_recv(struct tipc_rcv_ctx *ctx, struct tipc_addr *src,
+			struct tipc_addr *dst, int *err)
+{
+	struct msghdr *msg = &ctx->msg;
+	bool anc = dst || err;
+	struct tipc_addr _dst;
+	uint64_t t0;
+	int rc, _err;
+
+	msg->msg_namelen = sizeof(ctx->addr);
+	msg->msg_control = anc ? ctx->anc_space : NULL;
+	msg->msg_controllen = anc ? sizeof(ctx->anc_space) : 0;
+	msg->msg_flags = 0;
+
+	t0 = stats_t0();
+	rc = recvmsg(ctx->sd, msg, 0);
+	if (rc < 0) {
+		/* Without control area the kernel reports a rejected
+		 * message on a connected socket as ECONNRESET
+		 */
+		if (!anc && errno == ECONNRESET) {
+			stats_rx(ctx->sd, 0, true, t0);
+			return 0;
+		}
+		stats_rx(ctx->sd, rc, false, t0);
+		return rc;
+	}
+	if (src)
+		sock2addr(&ctx->addr, src);
+
+	/* Fast path: nothing more to find out */
+	if (!anc) {
+		stats_rx(ctx->sd, rc, false, t0);
+		return rc;
+	}
+
+	rc = tipc_anc_get(msg, rc, &_dst, &_err);
+	stats_rx(ctx->sd, rc, _err, t0);
+
+	/* Own socket id is looked up once per context */
+	if ((_err || _dst.type == ~0) && ctx->self.type == ~0)
+		if (tipc_sockid(ctx->sd, &ctx->self))
+			return -1;
+	if (_err && src)
+		*src = ctx->self;
+
+	if (err)
+		*err = _err;
+	else if (_err)
+		rc = 0;
+
+	if (dst)
+		*dst = _dst.type == ~0 ? ctx->self : _dst;
+	return rc;
+}
+
+int tipc_recvfrom_ctx(struct tipc_rcv_ctx *ctx, char *buf, size_t len,
+		      struct tipc_addr *src, struct tipc_addr *dst, int *err)
+{
+	dl_check(ctx->sd);
+	ctx->iov.iov_base = buf;
+	ctx->iov.iov_len = len;
+	ctx->msg.msg_iov = &ctx->iov;
+	ctx->msg.msg_iovlen = 1;
+	return tipcc__rcv_ctx_recv(ctx, src, dst, err);
+}
+
+int tipc_recvv_ctx(struct tipc_rcv_ctx *ctx, const struct iovec *iov,
+		   int iovcnt, struct tipc_addr *src, struct tipc_addr *dst,
+		   int *err)
+{
+	dl_check(ctx->sd);
+	ctx->msg.msg_iov = (struct iovec *)iov;
+	ctx->msg.msg_iovlen = iovcnt;
+	return tipcc__rcv_ctx_recv(ctx, src, dst, err);
+}
+
+int tipc_recvfrom(int sd, char *buf, size_t len, struct tipc_addr *src,
+		  struct tipc_addr *dst, int *err)
+{
+	struct shm_ring *r = shm_ring_get(sd);
+	struct tipc_rcv_ctx ctx;
+
+	dl_check(sd);
+	if (r)
+		return tipcc__shm_recvfrom(r, sd, buf, len, src, dst, err);
+	tipc_rcv_ctx_init(&ctx, sd);
+	return tipc_recvfrom_ctx(&ctx, buf, len, src, dst, err);
+}
+
+int tipc_recvv(int sd, const struct iovec *iov, int iovcnt,
+	       struct tipc_addr *src, struct tipc_addr *dst, int *err)
+{
+	struct tipc_rcv_ctx ctx;
+
+	tipc_rcv_ctx_init(&ctx, sd);
+	return tipc_recvv_ctx(&ctx, iov, iovcnt, src, dst, err);
+}
+
+int tipc_recv_hdr(int sd, void *hdr, size_t hdr_len, void *body,
+		  size_t body_len, struct tipc_addr *src,
+		  struct tipc_addr *dst, int *err)
+{
+	struct iovec iov[2] = {{hdr, hdr_len}, {body, body_len}};
+
+	return tipc_recvv(sd, iov, 2, src, dst, err);
+}
+
+int tipc_sendv(int sd, const struct iovec *iov, int iovcnt,
+	       const struct tipc_addr *dst)
+{
+	struct sockaddr_tipc addr;
+	struct msghdr msg = {0, };
+	uint64_t t0;
+	int rc;
+
+	msg.msg_iov = (struct iovec *)iov;
+	msg.msg_iovlen = iovcnt;
+	if (dst) {
+		addr2sock(dst, &addr);
+		msg.msg_name = &addr;
+		msg.msg_namelen = sizeof(addr);
+	}
+	t0 = stats_t0();
+	rc = sendmsg(sd, &msg, 0);
+	stats_tx(sd, rc, t0);
+	return rc;
+}
+
+int tipc_send_hdr(int sd, const void *hdr, size_t hdr_len, const void *body,
+		  size_t body_len, const struct tipc_addr *dst)
+{
+	struct iovec iov[2] = {{(void *)hdr, hdr_len}, {(void *)body, body_len}};
+
+	return tipc_sendv(sd, iov, 2, dst);
+}
+
+int tipc_sendmmsg(int sd, struct tipc_mmsg *msgs, int num)
+{
+	struct sockaddr_tipc addr[TIPC_MMSG_MAX];
+	struct mmsghdr mmsg[TIPC_MMSG_MAX];
+	struct iovec iov[TIPC_MMSG_MAX];
+	struct tipc_mmsg *m;
+	int i, n, rc, sent = 0;
+	uint64_t t0;
+
+	while (num > 0) {
+		n = num < TIPC_MMSG_MAX ? num : TIPC_MMSG_MAX;
+		memset(mmsg, 0, n * sizeof(*mmsg));
+		for (i = 0, m = msgs; i < n; i++, m++) {
+			iov[i].iov_base = m->buf;
+			iov[i].iov_len = m->len;
+			mmsg[i].msg_hdr.msg_iov = &iov[i];
+			mmsg[i].msg_hdr.msg_iovlen = 1;
+			if (!m->dst.type && !m->dst.instance)
+				continue;
+			addr2sock(&m->dst, &addr[i]);
+			mmsg[i].msg_hdr.msg_name = &addr[i];
+			mmsg[i].msg_hdr.msg_namelen = sizeof(addr[i]);
+		}
+		t0 = stats_t0();
+		rc = sendmmsg(sd, mmsg, n, 0);
+		for (i = 0; i < rc; i++) {
+			msgs[i].err = 0;
+			stats_tx(sd, mmsg[i].msg_len, i ? 0 : t0);
+		}
+		if (rc <= 0)
+			stats_tx(sd, -1, t0);
+		if (rc > 0) {
+			sent += rc;
+			msgs += rc;
+			num -= rc;
+			continue;
+		}
+
+		/* First message failed: report it and go on with the rest */
+		msgs->err = errno;
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			for (i = 1; i < num; i++)
+				msgs[i].err = errno;
+			break;
+		}
+		msgs++;
+		num--;
+	}
+	return sent;
+}
+
+int tipc_recvmmsg(int sd, struct tipc_mmsg *msgs, int num)
+{
+	struct sockaddr_tipc addr[TIPC_MMSG_MAX];
+	struct mmsghdr mmsg[TIPC_MMSG_MAX];
+	struct iovec iov[TIPC_MMSG_MAX];
+	struct tipc_thread *t = tipc_thread_get();
+	struct shm_ring *r = shm_ring_get(sd);
+	struct tipc_addr self = {~0, };
+	struct tipc_mmsg *m;
+	uint64_t t0;
+	int i, rc;
+
+	if (!t)
+		return -1;
+	if (num > TIPC_MMSG_MAX)
+		num = TIPC_MMSG_MAX;
+	if (r && num > 0) {
+		dl_check(sd);
+		return tipcc__shm_recvmmsg(r, sd, msgs, num);
+	}
+	memset(mmsg, 0, num * sizeof(*mmsg));
+	for (i = 0; i < num; i++) {
+		iov[i].iov_base = msgs[i].buf;
+		iov[i].iov_len = msgs[i].len;
+		mmsg[i].msg_hdr.msg_name = &addr[i];
+		mmsg[i].msg_hdr.msg_namelen = sizeof(addr[i]);
+		mmsg[i].msg_hdr.msg_iov = &iov[i];
+		mmsg[i].msg_hdr.msg_iovlen = 1;
+		mmsg[i].msg_hdr.msg_control = t->anc_space[i];
+		mmsg[i].msg_hdr.msg_controllen = TIPC_ANC_SPACE;
+	}
+
+	dl_check(sd);
+	t0 = stats_t0();
+	rc = recvmmsg(sd, mmsg, num, MSG_WAITFORONE, NULL);
+	if (rc <= 0) {
+		stats_rx(sd, rc, false, t0);
+		return rc;
+	}
+
+	for (i = 0, m = msgs; i < rc; i++, m++) {
+		sock2addr(&addr[i], &m->src);
+		m->len = tipc_anc_get(&mmsg[i].msg_hdr, mmsg[i].msg_len,
+				      &m->dst, &m->err);
+		stats_rx(sd, m->len, m->err, i ? 0 : t0);
+
+		/* Own socket id is looked up at most once per batch */
+		if (m->dst.type != ~0 && !m->err)
+			continue;
+		if (self.type == ~0 && tipc_sockid(sd, &self))
+			return -1;
+		if (m->err)
+			m->src = self;
+		if (m->dst.type == ~0)
+			m->dst = self;
+	}
+	return rc;
+}
+
+int tipc_topsrv_conn(tipc_domain_t node)
+{
+	int sd;
+	struct tipc_addr srv = {TIPC_TOP_SRV, TIPC_TOP_SRV, node};
+
+	sd = tipc_socket(SOCK_SEQPACKET);
+	if (sd <= 0)
+		return sd;
+	if (tipc_connect(sd, &srv) < 0) {
+		tipc_close(sd);
+		return -1;
+	}
+	return sd;
+}
+
+int tipc_srv_subscr(int sd, uint32_t type, uint32_t lower, uint32_t upper,
+		    bool all, int expire)
+{
+	struct tipc_subscr subscr;
+
+	subscr.seq.type  = type;
+	subscr.seq.lower = lower;
+	subscr.seq.upper = upper;
+	subscr.timeout   = expire < 0 ? TIPC_WAIT_FOREVER : expire;
+	subscr.filter    = all ? TIPC_SUB_PORTS : TIPC_SUB_SERVICE;
+	if (send(sd, &subscr, sizeof(subscr), 0) != sizeof(subscr))
+		return -1;
+	return 0;
+}
+
+int tipcc__srv_evts_read(int sd, struct tipc_event *evts, int max,
+			 int flags)
+{
+	struct mmsghdr mmsg[TIPC_MMSG_MAX];
+	struct iovec iov[TIPC_MMSG_MAX];
+	int i, num, rc, n = 0;
+
+	while (n < max) {
+		num = max - n < TIPC_MMSG_MAX ? max - n : TIPC_MMSG_MAX;
+		memset(mmsg, 0, num * sizeof(*mmsg));
+		for (i = 0; i < num; i++) {
+			iov[i].iov_base = &evts[n + i];
+			iov[i].iov_len = sizeof(*evts);
+			mmsg[i].msg_hdr.msg_iov = &iov[i];
+			mmsg[i].msg_hdr.msg_iovlen = 1;
+		}
+		rc = recvmmsg(sd, mmsg, num, flags, NULL);
+		if (rc < 0 && n && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (rc < 0)
+			return n ? n : -1;
+
+		/* Connection closed or broken event; keep what came before */
+		for (i = 0; i < rc; i++) {
+			if (mmsg[i].msg_len != sizeof(*evts))
+				break;
+		}
+		n += i;
+		if (i < rc || !rc) {
+			if (n)
+				break;
+			errno = ECONNRESET;
+			return -1;
+		}
+		if (rc < num)
+			break;
+		flags = MSG_DONTWAIT;
+	}
+	return n;
+}
+
+int tipc_srv_evts(int sd, struct tipc_event *evts, int max)
+{
+	return tipcc__srv_evts_read(sd, evts, max, MSG_WAITFORONE);
+}
+
+void tipc_srv_evt_parse(const struct tipc_event *evt, struct tipc_addr *srv,
+			struct tipc_addr *id, bool *available, bool *expired)
+{
+	if (evt->event == TIPC_SUBSCR_TIMEOUT) {
+		if (expired)
+			*expired = true;
+		return;
+	}
+	if (srv) {
+		srv->type = evt->s.seq.type;
+		srv->instance = evt->found_lower;
+		srv->domain = evt->port.node;
+	}
+	if (id) {
+		id->type = 0;
+		id->instance = evt->port.ref;
+		id->domain = evt->port.node;
+	}
+	if (available)
+		*available = (evt->event == TIPC_PUBLISHED);
+	if (expired)
+		*expired = false;
+}
+
+int tipc_srv_evt(int sd, struct tipc_addr *srv, struct tipc_addr *id,
+		 bool *available, bool *expired)
+{
+	struct tipc_event evt;
+
+        if (recv(sd, &evt, sizeof(evt), 0) != sizeof(evt))
+                return -1;
+	tipc_srv_evt_parse(&evt, srv, id, available, expired);
+	return 0;
+}
+
+struct tipc_dir *tipc_ctx_dir(struct tipc_ctx *ctx)
+{
+	if (!ctx->dir)
+		ctx->dir = tipc_dir_create(0, NULL, NULL);
+	return ctx->dir;
+}
+
+static int ms_left(const struct timespec *end)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (end->tv_sec - now.tv_sec) * 1000 +
+		(end->tv_nsec - now.tv_nsec) / 1000000;
+}
+
+/* Subscriptions stay, so that the next wait for a recent service is a
+ * lookup. The least recently used one goes when the set is full
+ */
+static int srv_wait_subscr(struct tipc_thread *t, uint32_t type,
+			   uint32_t instance)
+{
+	struct tipc_srv_sub *sub, *lru = NULL;
+	int i;
+
+	for (i = 0; i < t->sub_cnt; i++) {
+		sub = &t->subs[i];
+		if (sub->type == type && sub->instance == instance) {
+			sub->used = ++t->use_seq;
+			return 0;
+		}
+		if (!lru || sub->used < lru->used)
+			lru = sub;
+	}
+	if (t->sub_cnt < TIPC_SRV_WAIT_SUBS) {
+		lru = &t->subs[t->sub_cnt];
+	} else if (tipc_dir_unsubscr(t->dir, lru->type, lru->instance,
+				     lru->instance)) {
+		return -1;
+	}
+	if (tipc_dir_subscr(t->dir, type, instance, instance))
+		return -1;
+	if (lru == &t->subs[t->sub_cnt])
+		t->sub_cnt++;
+	lru->type = type;
+	lru->instance = instance;
+	lru->used = ++t->use_seq;
+	return 0;
+}
+
+bool tipc_srv_wait(const struct tipc_addr *srv, int wait)
+{
+	struct tipc_thread *t = tipc_thread_get();
+	struct pollfd pfd = {.events = POLLIN};
+	struct tipc_dir *dir;
+	struct timespec end;
+	int tmo = -1;
+
+	if (!t)
+		return false;
+	if (!t->dir) {
+		t->dir = tipc_dir_create(0, NULL, NULL);
+		t->sub_cnt = 0;
+	}
+	dir = t->dir;
+	if (!dir)
+		return false;
+	if (srv_wait_subscr(t, srv->type, srv->instance))
+		goto err;
+	pfd.fd = tipc_dir_fd(dir);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	end.tv_sec += wait / 1000;
+	end.tv_nsec += (wait % 1000) * 1000000;
+	if (end.tv_nsec >= 1000000000) {
+		end.tv_sec++;
+		end.tv_nsec -= 1000000000;
+	}
+	while (1) {
+		if (tipc_dir_update(dir) < 0)
+			goto err;
+		if (tipc_dir_lookup(dir, srv->type, srv->instance, 0, NULL, 0))
+			return true;
+		if (wait >= 0) {
+			tmo = ms_left(&end);
+			if (tmo <= 0)
+				return false;
+		}
+		if (poll(&pfd, 1, tmo) < 0 && errno != EINTR)
+			return false;
+	}
+err:
+	/* Connection to topology server lost; start over next time */
+	tipc_dir_destroy(dir);
+	t->dir = NULL;
+	return false;
+}
+
+int tipc_neigh_subscr(tipc_domain_t node)
+{
+	int sd;
+
+	sd = tipc_topsrv_conn(node);
+	if (sd <= 0)
+		return -1;
+	if (tipc_srv_subscr(sd, TIPC_CFG_SRV, 0, ~0, true, TIPC_WAIT_FOREVER))
+		return -1;
+	return sd;
+}
+
+int tipc_neigh_evt(int sd, tipc_domain_t *neigh_node, bool *available)
+{
+	struct tipc_addr srv;
+	int rc;
+
+	rc = tipc_srv_evt(sd, &srv, 0, available, 0);
+	if (neigh_node)
+		*neigh_node = srv.instance;
+	return rc;
+}
+
+int tipc_link_subscr(tipc_domain_t node)
+{
+	int sd;
+
+	sd = tipc_topsrv_conn(node);
+	if (sd <= 0)
+		return -1;
+	if (tipc_srv_subscr(sd, TIPC_LINK_STATE, 0, ~0,
+			    true, TIPC_WAIT_FOREVER))
+		return -1;
+	return sd;
+}
+
+void tipc_link_evt_parse(const struct tipc_event *evt,
+			 tipc_domain_t *neigh_node, bool *available,
+			 int *local_bearerid, int *remote_bearerid)
+{
+	if (local_bearerid)
+		*local_bearerid = evt->port.ref & 0xffff;
+	if (remote_bearerid)
+		*remote_bearerid = (evt->port.ref >> 16) & 0xffff;
+	if (neigh_node)
+		*neigh_node = evt->found_lower;
+	if (available)
+		*available = (evt->event == TIPC_PUBLISHED);
+
+	/* Bearer id may be reused for another bearer once link is gone */
+	if (evt->event == TIPC_WITHDRAWN)
+		__atomic_add_fetch(&link_gens[link_slot(evt->found_lower,
+							evt->port.ref & 0xffff)],
+				   1, __ATOMIC_RELEASE);
+}
+
+int tipc_link_evt(int sd, tipc_domain_t *neigh_node, bool *available,
+	          int *local_bearerid, int *remote_bearerid)
+{
+	struct tipc_event evt;
+
+        if (recv(sd, &evt, sizeof(evt), 0) != sizeof(evt))
+                return -1;
+	tipc_link_evt_parse(&evt, neigh_node, available, local_bearerid,
+			    remote_bearerid);
+	return 0;
+}
+
+char* tipc_ctx_linkname(struct tipc_ctx *ctx, char *buf, size_t len,
+			tipc_domain_t peer, int bearerid)
+{
+	struct tipc_sioc_ln_req req = {peer, bearerid, };
+	unsigned int slot = link_slot(peer, bearerid);
+	struct tipc_link_entry *e = &ctx->links[slot];
+	uint32_t gen;
+
+	if (!len)
+		return buf;
+	buf[0] = 0;
+	pthread_mutex_lock(&ctx->lock);
+	gen = __atomic_load_n(&link_gens[slot], __ATOMIC_ACQUIRE);
+	if (!e->name[0] || e->peer != peer || e->bearerid != bearerid ||
+	    e->gen != gen) {
+		if (ioctl(ctx->ctl_sd, SIOCGETLINKNAME, &req) < 0)
+			goto out;
+		e->peer = peer;
+		e->bearerid = bearerid;
+		e->gen = gen;
+		memcpy(e->name, req.linkname, sizeof(e->name));
+		e->name[sizeof(e->name) - 1] = 0;
+	}
+	strncpy(buf, e->name, len - 1);
+	buf[len - 1] = 0;
+out:
+	pthread_mutex_unlock(&ctx->lock);
+	return buf;
+}
+
+char* tipc_linkname(char *buf, size_t len, tipc_domain_t peer, int bearerid)
+{
+	struct tipc_ctx *ctx = tipc_ctx_get();
+
+	if (!ctx) {
+		if (len)
+			buf[0] = 0;
+		return buf;
+	}
+	return tipc_ctx_linkname(ctx, buf, len, peer, bearerid);
+}
+
+char* tipc_dtoa(tipc_domain_t domain, char *buf, size_t len)
+{
+	snprintf(buf, len, "%u.%u.%u", tipc_zone(domain),
+		 tipc_cluster(domain),tipc_node(domain));
+	buf[len] = 0;
+	return buf;
+}
+
+char* tipc_ntoa(const struct tipc_addr *addr, char *buf, size_t len)
+{
+	snprintf(buf, len, "%u:%u@%u.%u.%u",
+		 addr->type, addr->instance, tipc_zone(addr->domain),
+		 tipc_cluster(addr->domain),tipc_node(addr->domain));
+	buf[len] = 0;
+	return buf;
+}
+
+char* tipc_rtoa(uint32_t type, uint32_t lower, uint32_t upper,
+		tipc_domain_t domain, char *buf, size_t len)
+{
+	snprintf(buf, len, "%u:%u:%u@%u.%u.%u", type, lower, upper,
+		 tipc_zone(domain), tipc_cluster(domain),tipc_node(domain));
+	buf[len] = 0;
+	return buf;
+}
@@ -0,0 +1,660 @@
+/* ------------------------------------------------------------------------
+ *
+ * tipcc.h
+ *
+ * Short description: TIPC C binding API. The complete TIPC socket API with all
+ *                    standard features is available in <linux/tipc.h>
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9.5: Jon Maloy, 2016
+ *
+ * ------------------------------------------------------------------------
+ */
+
+#ifndef __TIPCC_H_
+#define __TIPCC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <linux/tipc.h>
+
+/* Addressing:
+ * - struct tipc_addr may contain <type != 0, instance, domain> or
+ *   <type == 0, instance == port, domain == node>
+ * - tipc_domain_t has internal structure <zone.cluster.node>. Valid
+ *   contents <z.c.n>, <z.c.0>, <z.0.0> or <0.0.0>, where 0 is wildcard
+ */
+typedef uint32_t tipc_domain_t;
+
+struct tipc_addr {
+	uint32_t      type;
+	uint32_t      instance;
+	tipc_domain_t domain;
+};
+
+/* Thread safety:
+ * - All functions may be called concurrently from any thread, without
+ *   locks on the send and receive paths. Global state is set up once,
+ *   tipc_srv_wait() uses a topology connection per thread
+ * - Objects (receive context, service directory, load balancer,
+ *   connection pool, event loop) are used by one thread at a time.
+ *   Exceptions are the buffer pool, tipc_ctx and tipc_loop_stop(), which
+ *   may be used from anywhere. The directory returned by tipc_ctx_dir()
+ *   is an ordinary directory
+ */
+
+/* Context:
+ * - Caches own node/cluster/zone, keeps one control socket for ioctls
+ *   and a cache of link names. A link down event parsed by
+ *   tipc_link_evt() or tipc_link_evt_parse() drops that link's name
+ *   from the caches of all contexts
+ * - Functions without ctx argument use a default context, which is
+ *   created on first use and lives as long as the process
+ */
+struct tipc_ctx;
+
+struct tipc_ctx *tipc_ctx_create(void);
+void tipc_ctx_destroy(struct tipc_ctx *ctx);
+tipc_domain_t tipc_ctx_own_node(struct tipc_ctx *ctx);
+char* tipc_ctx_linkname(struct tipc_ctx *ctx, char *buf, size_t len,
+			tipc_domain_t peer, int bearerid);
+
+tipc_domain_t tipc_own_node(void);
+tipc_domain_t tipc_own_cluster(void);
+tipc_domain_t tipc_own_zone(void);
+static unsigned int tipc_zone(tipc_domain_t domain);
+static unsigned int tipc_cluster(tipc_domain_t domain);
+static unsigned int tipc_node(tipc_domain_t domain);
+tipc_domain_t tipc_domain(unsigned int zone, unsigned int cluster,
+			  unsigned int node);
+char* tipc_ntoa(const struct tipc_addr *addr, char *buf, size_t len);
+char* tipc_dtoa(tipc_domain_t domain, char *buf, size_t len);
+char* tipc_rtoa(uint32_t type, uint32_t lower, uint32_t upper,
+		tipc_domain_t domain, char *buf, size_t len);
+
+/* Socket:
+ * - 'Rejectable': sent messages will return if rejected at destination
+ */
+int tipc_socket(int sk_type);
+int tipc_sock_non_block(int sd);
+int tipc_sock_rejectable(int sd);
+int tipc_close(int sd);
+int tipc_sockid(int sd, struct tipc_addr *id);
+
+int tipc_bind(int sd, uint32_t type, uint32_t lower, uint32_t upper,
+	      tipc_domain_t scope);
+int tipc_unbind(int sd, uint32_t type, uint32_t lower, uint32_t upper);
+
+int tipc_connect(int sd, const struct tipc_addr *dst);
+int tipc_listen(int sd, int backlog);
+int tipc_accept(int sd, struct tipc_addr *src);
+int tipc_join(int sd, struct tipc_addr *member);
+int tipc_leave(int sd);
+
+/* Messaging:
+ * - NULL pointer parameters are always accepted
+ * - tipc_sendto() to an accepting socket initiates two-way connect
+ * - If no err pointer given, tipc_recvfrom() returns 0 on rejected message
+ * - If (*err != 0) buf contains a potentially truncated rejected message
+ */
+int tipc_recvfrom(int sd, char *buf, size_t len, struct tipc_addr *src,
+		  struct tipc_addr *dst, int *err);
+int tipc_recv(int sd, char* buf, size_t len, bool waitall);
+
+/* Deadlines:
+ * - Absolute time in ns on CLOCK_MONOTONIC; tipc_deadline() returns the
+ *   time ms from now, or 0, meaning no deadline, if ms < 0
+ * - The _dl calls fail with ETIMEDOUT once the deadline has passed.
+ *   EAGAIN still means the socket is non-blocking and nothing was there.
+ *   tipc_recv_dl() with waitall returns what it got if it times out midway
+ * - The kernel does the waiting through SO_RCVTIMEO. The timeout is left
+ *   on the socket and only changed when the time left differs from it
+ *   by more than the timer resolution, so a call is normally one system
+ *   call. The plain receive and accept calls clear it again
+ * - A socket should not be used with different deadlines by several
+ *   threads at once; a call may then wait a little past its own
+ */
+uint64_t tipc_deadline(int ms);
+int tipc_recv_dl(int sd, char *buf, size_t len, bool waitall,
+		 uint64_t deadline);
+int tipc_recvfrom_dl(int sd, char *buf, size_t len, struct tipc_addr *src,
+		     struct tipc_addr *dst, int *err, uint64_t deadline);
+int tipc_accept_dl(int sd, struct tipc_addr *src, uint64_t deadline);
+
+/* Receive context:
+ * - Keeps msghdr, name and control area set up across calls on one socket
+ * - Ancillary data is only requested if dst or err is given, otherwise
+ *   the message is read without control area (0 on rejected message)
+ * - Own socket id is looked up at most once per context
+ */
+#define TIPC_ANC_SPACE (CMSG_SPACE(8) + CMSG_SPACE(1024) + CMSG_SPACE(16))
+
+struct tipc_rcv_ctx {
+	int                   sd;
+	struct tipc_addr      self;
+	struct sockaddr_tipc  addr;
+	struct iovec          iov;
+	struct msghdr         msg;
+	char                  anc_space[TIPC_ANC_SPACE];
+};
+
+void tipc_rcv_ctx_init(struct tipc_rcv_ctx *ctx, int sd);
+int tipc_recvfrom_ctx(struct tipc_rcv_ctx *ctx, char *buf, size_t len,
+		      struct tipc_addr *src, struct tipc_addr *dst, int *err);
+
+/* Scatter-gather messaging:
+ * - Header and body stay in separate buffers; payload is never copied
+ *   in user space, except for data returned with a rejected message,
+ *   which the kernel delivers as ancillary data
+ * - dst == NULL means connected socket
+ * - Receive returns total length, i.e. body length + hdr_len if the
+ *   message filled the header. src/dst/err as for tipc_recvfrom()
+ */
+int tipc_sendv(int sd, const struct iovec *iov, int iovcnt,
+	       const struct tipc_addr *dst);
+int tipc_send_hdr(int sd, const void *hdr, size_t hdr_len, const void *body,
+		  size_t body_len, const struct tipc_addr *dst);
+int tipc_recvv(int sd, const struct iovec *iov, int iovcnt,
+	       struct tipc_addr *src, struct tipc_addr *dst, int *err);
+int tipc_recvv_ctx(struct tipc_rcv_ctx *ctx, const struct iovec *iov,
+		   int iovcnt, struct tipc_addr *src, struct tipc_addr *dst,
+		   int *err);
+int tipc_recv_hdr(int sd, void *hdr, size_t hdr_len, void *body,
+		  size_t body_len, struct tipc_addr *src,
+		  struct tipc_addr *dst, int *err);
+int tipc_sendmsg(int sd, const struct msghdr *msg);
+int tipc_sendto(int sd, const char *msg, size_t len,
+		const struct tipc_addr *dst);
+int tipc_send(int sd, const char *msg, size_t len);
+int tipc_mcast(int sd, const char *msg, size_t len,
+	       const struct tipc_addr *dst);
+
+/* Batched messaging:
+ * - One sendmmsg()/recvmmsg() call per up to TIPC_MMSG_MAX messages
+ * - tipc_sendmmsg(): msgs[i].dst == {0, 0, x} means connected socket.
+ *   Returns number of messages sent; msgs[i].err is set to 0 or errno
+ *   for each message. On EAGAIN the remaining messages are left unsent
+ * - tipc_recvmmsg(): blocks for first message only, then takes what is
+ *   queued. Returns number of messages; msgs[i].len is set to received
+ *   length, src/dst/err as for tipc_recvfrom()
+ */
+#define TIPC_MMSG_MAX 32
+
+struct tipc_mmsg {
+	char             *buf;
+	size_t            len;
+	struct tipc_addr  src;
+	struct tipc_addr  dst;
+	int               err;
+};
+
+int tipc_sendmmsg(int sd, struct tipc_mmsg *msgs, int num);
+int tipc_recvmmsg(int sd, struct tipc_mmsg *msgs, int num);
+
+/* Framed stream:
+ * - Records of up to 2^32 - 1 bytes over a connected SOCK_STREAM socket,
+ *   each preceded by its length as a 4 byte integer in network order
+ * - tipc_frame_send() appends the record to a send buffer, which is sent
+ *   in one go when it holds cork_bytes, or when its oldest record is
+ *   cork_us old at next send. cork_bytes == 0 sends each record at once,
+ *   cork_us == 0 means no time limit. A record that does not fit is
+ *   still taken, growing the buffer
+ * - tipc_frame_timeout() returns ms until the buffered records are due,
+ *   or -1 if none are, for use as poll() timeout before tipc_frame_flush()
+ * - Records at least cork_bytes long are sent without copying when
+ *   nothing is buffered
+ * - On a non-blocking socket unsent data stays buffered, and
+ *   tipc_frame_flush() fails with EAGAIN until all is sent, see
+ *   tipc_frame_pending(). tipc_frame_send() takes the record regardless
+ *   and only fails on other errors
+ * - tipc_frame_recv() returns up to max complete records as views into
+ *   a ring buffer of rcvbuf bytes (rounded up to page size), without
+ *   copying. Records are contiguous also across the ring end. Views are
+ *   valid until next call. It reads the socket only when no complete
+ *   record is buffered, returns 0 when peer has closed, and fails with
+ *   EMSGSIZE for a record larger than the ring
+ * - The socket is not closed by tipc_frame_destroy()
+ */
+struct tipc_frame;
+
+struct tipc_frame *tipc_frame_create(int sd, size_t cork_bytes,
+				     unsigned int cork_us, size_t rcvbuf);
+void tipc_frame_destroy(struct tipc_frame *f);
+int tipc_frame_send(struct tipc_frame *f, const void *rec, size_t len);
+int tipc_frame_flush(struct tipc_frame *f);
+int tipc_frame_timeout(const struct tipc_frame *f);
+size_t tipc_frame_pending(const struct tipc_frame *f);
+int tipc_frame_recv(struct tipc_frame *f, struct iovec *recs, int max);
+
+/* Node local shared memory transport:
+ * - Opt-in, for cooperating tipcc processes of the same user on a node
+ * - tipc_shm_attach() gives a socket a ring of size bytes (at least
+ *   256 kB) named after its port number, in which senders on the node
+ *   place messages for it. tipc_shm_detach() or tipc_close() removes it
+ * - With tipc_shm_enable(true), tipc_sendto() to a port id on own node,
+ *   e.g. as picked by tipc_lb_sendto(), copies the message into the
+ *   receiver's ring if it has one. Service addresses, other nodes and
+ *   messages larger than half a ring still go through the kernel
+ * - tipc_recvfrom() and tipc_recvmmsg(), hence also event loops and RPC,
+ *   on a socket with a ring take messages from the ring first, with the
+ *   sender's port id as src and own port id as dst. When the ring is
+ *   empty they read the socket; a sender finding the receiver waiting
+ *   sends it an empty message as doorbell, which is not passed up. Empty
+ *   messages can therefore not be used on such sockets
+ * - Many senders, one receiving thread per socket. A full ring makes the
+ *   sender wait, or fail with EAGAIN if its socket is non-blocking
+ * - Messages in the ring are never rejected. They are lost if the
+ *   receiver exits before reading them. A sender finding the receiver
+ *   process gone, also while waiting on its full ring, drops the ring
+ *   and sends through the kernel
+ */
+#define TIPC_SHM_MAX_SOCKS 65536
+
+int tipc_shm_enable(bool on);
+int tipc_shm_attach(int sd, size_t size);
+void tipc_shm_detach(int sd);
+
+/* Statistics:
+ * - Per-socket counters, updated with atomic operations by the send,
+ *   receive, connect and accept functions once enabled. Off by default
+ * - rejected counts messages returned to us; they also count as received
+ * - TIPC_STATS_LATENCY adds log2 histograms of time spent in each call,
+ *   bucket i counting calls of [2^i, 2^(i+1)) ns. Receive and accept
+ *   times include blocking. Costs two clock reads per call
+ * - TIPC_STATS_EXPORT places the counters in shared memory segment
+ *   /tipcc.<pid>, which other processes may map with tipc_stats_attach()
+ *   and read at any time. Must be given in the first call enabling
+ *   statistics. The segment is removed at normal exit only
+ * - Sockets with descriptor >= TIPC_STATS_MAX_SOCKS are not counted
+ * - Counters are cleared by tipc_close(); sockets closed otherwise should
+ *   be cleared with tipc_sock_stats_clear() before the fd is reused
+ * - tipc_stats_enable() takes an or of the flags below, 0 turning counting
+ *   off. TIPC_STATS_COUNTERS is 1, so tipc_stats_enable(true) means plain
+ *   counters. Unknown flags fail with EINVAL
+ * - Counters are only ever appended to tipc_sock_stats. Readers of an
+ *   exported segment go through tipc_stats_read(), which steps by the
+ *   segment's slot_size and leaves counters the writer lacks zero, so
+ *   older and newer library versions read each other's segments.
+ *   TIPC_STATS_VERSION only changes if that no longer holds
+ * - tipc_stats_read() returns 1 for a descriptor with counters, 0 for
+ *   one without, and -1 on bad arguments
+ */
+#define TIPC_STATS_COUNTERS  1
+#define TIPC_STATS_LATENCY   2
+#define TIPC_STATS_EXPORT    4
+
+#define TIPC_STATS_BUCKETS   32
+#define TIPC_STATS_MAX_SOCKS 65536
+#define TIPC_STATS_MAGIC     0x54495043
+#define TIPC_STATS_VERSION   1
+
+struct tipc_sock_stats {
+	uint64_t tx_msgs;
+	uint64_t tx_bytes;
+	uint64_t rx_msgs;
+	uint64_t rx_bytes;
+	uint64_t eagain;
+	uint64_t rejected;
+	uint64_t errors;
+	uint64_t connects;
+	uint64_t accepts;
+	uint64_t tx_lat[TIPC_STATS_BUCKETS];
+	uint64_t rx_lat[TIPC_STATS_BUCKETS];
+	uint64_t conn_lat[TIPC_STATS_BUCKETS];
+};
+
+/* Layout of the exported segment; slot n belongs to descriptor n, and
+ * only slots below hi_sd have ever been active. Slots are slot_size
+ * bytes apart, which may differ from sizeof(struct tipc_stats_slot)
+ */
+struct tipc_stats_slot {
+	uint64_t active;
+	struct tipc_sock_stats st;
+} __attribute__((aligned(64)));
+
+struct tipc_stats_map {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t pid;
+	uint32_t max_socks;
+	uint32_t slot_size;
+	uint32_t hi_sd;
+	struct tipc_stats_slot slots[] __attribute__((aligned(64)));
+};
+
+int tipc_stats_enable(unsigned int flags);
+int tipc_sock_stats(int sd, struct tipc_sock_stats *st);
+void tipc_sock_stats_clear(int sd);
+
+const struct tipc_stats_map *tipc_stats_attach(int pid);
+void tipc_stats_detach(const struct tipc_stats_map *map);
+int tipc_stats_read(const struct tipc_stats_map *map, int sd,
+		    struct tipc_sock_stats *st);
+
+/* Buffer pool:
+ * - Size classed slabs of 256 B, 1 kB, 4 kB, 16 kB and
+ *   TIPC_MAX_USER_MSG_SIZE; larger requests go to malloc()
+ * - Each thread keeps a small cache per class, so alloc/put normally
+ *   take no lock. Cache is returned to the pool at thread exit
+ * - A buffer starts with one reference. tipc_buf_get() adds one, e.g.
+ *   for each queue it is put on, tipc_buf_put() drops one and recycles
+ *   the buffer when the last is gone. A buffer may be put by another
+ *   thread than the one that allocated it
+ * - tipc_buf_pool_init(true) makes new slabs use huge pages, falling
+ *   back to transparent huge pages if none are reserved
+ * - tipc_buf_size() returns usable size, which may exceed what was asked
+ */
+void tipc_buf_pool_init(bool hugepages);
+void *tipc_buf_alloc(size_t size);
+void *tipc_buf_get(void *buf);
+void tipc_buf_put(void *buf);
+size_t tipc_buf_size(const void *buf);
+
+/* Topology Server:
+ * - Expiration time in [ms]
+ * - If (expire < 0) subscription never expires
+ * - tipc_srv_evts() reads up to max events with as few recvmmsg() calls
+ *   as possible. Blocks for the first event only, unless the socket is
+ *   non-blocking. Returns number of events read
+ * - tipc_srv_evt_parse() and tipc_link_evt_parse() decode one such event
+ *   the way tipc_srv_evt() and tipc_link_evt() do
+ */
+int tipc_topsrv_conn(tipc_domain_t topsrv_node);
+int tipc_srv_subscr(int sd, uint32_t type, uint32_t lower, uint32_t upper,
+		    bool all, int expire);
+int tipc_srv_evt(int sd, struct tipc_addr *srv, struct tipc_addr *id,
+		 bool *up, bool *expired);
+int tipc_srv_evts(int sd, struct tipc_event *evts, int max);
+void tipc_srv_evt_parse(const struct tipc_event *evt, struct tipc_addr *srv,
+			struct tipc_addr *id, bool *up, bool *expired);
+bool tipc_srv_wait(const struct tipc_addr *srv, int expire);
+
+/* Topology event coalescing:
+ * - tipc_srv_coalesce() removes publish/withdraw pairs for the same port,
+ *   range and subscription from evts[0..n), so that only net changes
+ *   remain, in their original order. Returns the new number of events
+ * - A coalescer reads a topology server connection without blocking and
+ *   holds events for window_ms after the first one arrives, so that a
+ *   port that goes and comes back within the window is never reported.
+ *   At most max events are held (0: 65536); a full coalescer releases
+ *   them at once
+ * - tipc_srv_coal_read(): call when the socket is readable or
+ *   tipc_srv_coal_timeout() has passed. Returns number of events released
+ *   to evts, 0 if none is due yet, or -1 once the connection is lost and
+ *   all held events have been released
+ */
+struct tipc_srv_coal;
+
+int tipc_srv_coalesce(struct tipc_event *evts, int n);
+struct tipc_srv_coal *tipc_srv_coal_create(int sd, int window_ms, int max);
+void tipc_srv_coal_destroy(struct tipc_srv_coal *c);
+int tipc_srv_coal_read(struct tipc_srv_coal *c, struct tipc_event *evts,
+		       int max);
+int tipc_srv_coal_timeout(const struct tipc_srv_coal *c);
+int tipc_srv_coal_pending(const struct tipc_srv_coal *c);
+
+/* Service directory:
+ * - Many subscriptions multiplexed over one topology server connection
+ * - Keeps a replica of the matching name table publications, so that
+ *   tipc_dir_lookup() answers who serves <type, instance> without any
+ *   system call. Single instance publications are found through a hash
+ *   table in O(1), range publications through a linear list
+ * - tipc_dir_update() reads all pending events without blocking. Call
+ *   it when tipc_dir_fd() is readable. Returns number of events read, or
+ *   -1 if the connection to the topology server is lost
+ * - Identical subscriptions are reference counted; only the first one
+ *   reaches the topology server
+ * - cb is called on first publication and last withdrawal of a port
+ * - tipc_dir_lookup() returns the number of distinct port ids within
+ *   domain written to ids, at most max. With ids == NULL it just returns
+ *   1 if there is any such port
+ * - tipc_dir_gen() changes whenever a port comes or goes
+ * - tipc_srv_wait() uses a directory of its own in each calling thread,
+ *   i.e. one topology connection per thread, closed at thread exit. The
+ *   16 services a thread last waited for stay subscribed
+ */
+struct tipc_dir;
+
+typedef void (*tipc_dir_cb)(struct tipc_dir *dir, uint32_t type,
+			    uint32_t lower, uint32_t upper,
+			    const struct tipc_addr *id, bool up, void *arg);
+
+struct tipc_dir *tipc_dir_create(tipc_domain_t topsrv_node,
+				 tipc_dir_cb cb, void *arg);
+void tipc_dir_destroy(struct tipc_dir *dir);
+struct tipc_dir *tipc_ctx_dir(struct tipc_ctx *ctx);
+int tipc_dir_fd(struct tipc_dir *dir);
+unsigned int tipc_dir_gen(struct tipc_dir *dir);
+int tipc_dir_subscr(struct tipc_dir *dir, uint32_t type, uint32_t lower,
+		    uint32_t upper);
+int tipc_dir_unsubscr(struct tipc_dir *dir, uint32_t type, uint32_t lower,
+		      uint32_t upper);
+int tipc_dir_update(struct tipc_dir *dir);
+int tipc_dir_lookup(struct tipc_dir *dir, uint32_t type, uint32_t instance,
+		    tipc_domain_t domain, struct tipc_addr *ids, int max);
+
+/* Load balancing:
+ * - Picks a port id for <type, instance> within domain from a service
+ *   directory, and sends to it by port id, bypassing name translation
+ * - TIPC_LB_RR: round-robin over all ports
+ * - TIPC_LB_LOCAL: round-robin over ports on own node if any, else all
+ * - TIPC_LB_LEAST: port with fewest outstanding requests. Each pick
+ *   counts as outstanding until tipc_lb_done() is called for that port
+ * - TIPC_LB_HASH: consistent hash on key; a key only moves to another
+ *   port if its port goes away
+ * - Caller keeps the directory updated; pick fails with EHOSTUNREACH if
+ *   no port is known
+ */
+#define TIPC_LB_MAX_PORTS 64
+
+enum {
+	TIPC_LB_RR,
+	TIPC_LB_LOCAL,
+	TIPC_LB_LEAST,
+	TIPC_LB_HASH
+};
+
+struct tipc_lb;
+
+struct tipc_lb *tipc_lb_create(struct tipc_dir *dir, uint32_t type,
+			       uint32_t instance, tipc_domain_t domain,
+			       int policy);
+void tipc_lb_destroy(struct tipc_lb *lb);
+int tipc_lb_pick(struct tipc_lb *lb, uint64_t key, struct tipc_addr *id);
+void tipc_lb_done(struct tipc_lb *lb, const struct tipc_addr *id);
+int tipc_lb_sendto(int sd, struct tipc_lb *lb, uint64_t key,
+		   const char *msg, size_t len, struct tipc_addr *id);
+
+/* Connection pool:
+ * - Keeps idle SOCK_SEQPACKET or SOCK_STREAM connections per service
+ *   address, so that a request does not pay for connection setup
+ * - tipc_cpool_get(): returns a connected socket, the most recently used
+ *   idle one to srv if any is left, otherwise a new one. Fails with
+ *   ENOBUFS if max connections are open and none of them is idle; an
+ *   idle connection to another service is closed to make room
+ * - tipc_cpool_put(): hands sd back. It is closed if !reuse, e.g. after
+ *   an error, or if max_idle connections to its service are idle already
+ * - An idle connection is dropped when its peer has closed it, or if a
+ *   directory is given, when its peer node withdraws the service. Caller
+ *   keeps the directory updated. tipc_cpool_prune() checks all idle
+ *   connections at once and returns the number closed
+ * - tipc_cpool_count() returns number of open connections, and the
+ *   number of idle ones in idle
+ */
+struct tipc_cpool;
+
+struct tipc_cpool *tipc_cpool_create(struct tipc_dir *dir, int sk_type,
+				     int max, int max_idle);
+void tipc_cpool_destroy(struct tipc_cpool *pool);
+int tipc_cpool_get(struct tipc_cpool *pool, const struct tipc_addr *srv);
+void tipc_cpool_put(struct tipc_cpool *pool, int sd, bool reuse);
+int tipc_cpool_prune(struct tipc_cpool *pool);
+int tipc_cpool_count(const struct tipc_cpool *pool, int *idle);
+
+int tipc_neigh_subscr(tipc_domain_t topsrv_node);
+int tipc_neigh_evt(int sd, tipc_domain_t *neigh_node, bool *up);
+
+int tipc_link_subscr(tipc_domain_t topsrv_node);
+int tipc_link_evt(int sd, tipc_domain_t *neigh_node, bool *up,
+	          int *local_bearerid, int *remote_bearerid);
+void tipc_link_evt_parse(const struct tipc_event *evt,
+			 tipc_domain_t *neigh_node, bool *up,
+			 int *local_bearerid, int *remote_bearerid);
+char* tipc_linkname(char *buf, size_t len, tipc_domain_t peer, int bearerid);
+
+/* RPC:
+ * - Request/response over an RDM socket with many requests outstanding.
+ *   Each message starts with an 8 byte header holding a correlation id
+ * - tipc_rpc_send(): dst is a service address resolved by TIPC, or NULL
+ *   to pick a port from the load balancer given to tipc_rpc_create().
+ *   cb is called with err == 0 and the response, or with an errno value.
+ *   Fails with ENOBUFS when max requests are already outstanding
+ * - A request rejected by its receiver is resent, using the data the
+ *   kernel returns, up to retries times before completing with
+ *   ECONNREFUSED. With a load balancer another port is picked if any
+ * - Deadlines are kept in a timer wheel with 1 ms ticks. An expired
+ *   request completes with ETIMEDOUT; a late response is dropped.
+ *   timeout < 0 means no deadline
+ * - tipc_rpc_call(): blocking send and wait for the response, which is
+ *   copied to rsp. Returns its length. Completes other requests meanwhile
+ * - tipc_rpc_poll(): waits up to timeout ms for responses on the socket,
+ *   and runs due timers. Returns number of requests completed.
+ *   tipc_rpc_input() and tipc_rpc_expire() do the same for messages
+ *   received elsewhere, e.g. by an event loop, which should then wake
+ *   within tipc_rpc_timeout() ms
+ * - Server side: tipc_rpc_req() checks a received message and finds the
+ *   request body; tipc_rpc_reply() sends the response back to src
+ * - An rpc instance is used by one thread at a time. Callbacks may
+ *   send new requests
+ */
+struct tipc_rpc;
+
+typedef void (*tipc_rpc_cb)(struct tipc_rpc *rpc, int err, const void *rsp,
+			    size_t len, void *arg);
+
+struct tipc_rpc *tipc_rpc_create(int sd, struct tipc_lb *lb, int max,
+				 int retries);
+void tipc_rpc_destroy(struct tipc_rpc *rpc);
+int tipc_rpc_send(struct tipc_rpc *rpc, const struct tipc_addr *dst,
+		  const void *req, size_t len, int timeout, tipc_rpc_cb cb,
+		  void *arg);
+int tipc_rpc_call(struct tipc_rpc *rpc, const struct tipc_addr *dst,
+		  const void *req, size_t len, void *rsp, size_t rsp_len,
+		  int timeout);
+int tipc_rpc_poll(struct tipc_rpc *rpc, int timeout);
+int tipc_rpc_input(struct tipc_rpc *rpc, struct tipc_mmsg *msgs, int num);
+int tipc_rpc_expire(struct tipc_rpc *rpc);
+int tipc_rpc_timeout(const struct tipc_rpc *rpc);
+int tipc_rpc_outstanding(const struct tipc_rpc *rpc);
+
+int tipc_rpc_req(const void *msg, size_t len, const void **body);
+int tipc_rpc_reply(int sd, const struct tipc_addr *src, const void *req,
+		   const void *rsp, size_t len);
+
+/* Event loop:
+ * - epoll based, edge triggered. Added sockets are set non-blocking
+ * - Readable sockets are drained in batches of up to TIPC_MMSG_MAX
+ *   messages per callback, with a budget per socket and round so that
+ *   no socket can starve the others
+ * - Message buffers belong to the loop and are only valid during callback
+ * - On socket error the socket is removed from the loop, and the callback
+ *   is called with msgs == NULL (srv == NULL for topology connections).
+ *   So it is when the peer closes a connection, after the messages that
+ *   came before the close have been delivered
+ * - Sockets are never closed by the loop; timers are
+ * - A loop is run by one thread only. tipc_loop_stop() may be called
+ *   from any thread
+ * - tipc_loop_sendto(): sends directly if nothing is queued, otherwise,
+ *   or on EAGAIN, copies the message to a per-socket send queue which is
+ *   drained when the socket becomes writable. dst == NULL means connected
+ *   socket. Fails with ENOBUFS if the queue would exceed its limit.
+ *   Messages that fail for other reasons while queued are dropped
+ * - tipc_loop_sendto_buf(): as tipc_loop_sendto(), but for a pool buffer,
+ *   which is queued by reference instead of copied. The caller keeps its
+ *   own reference, so the same buffer can go to many sockets
+ * - tipc_loop_sendq(): sets queue limit and watermarks in bytes. wm_cb is
+ *   called with above == true when queue reaches high, and with above ==
+ *   false when it is back down to low. Default is 4 MB, 3 MB and 1 MB
+ *   with no callback. Send queues need a socket added by add_msg()
+ * - tipc_loop_run_threads(): one loop per thread, each pinned to a cpu.
+ *   If (num <= 0) one thread per online cpu. setup() is called in each
+ *   thread to add its sockets, e.g. one socket per loop bound to the same
+ *   service. Returns when all loops have been stopped
+ */
+struct tipc_loop;
+
+typedef void (*tipc_loop_msg_cb)(struct tipc_loop *loop, int sd,
+				 struct tipc_mmsg *msgs, int num, void *arg);
+typedef void (*tipc_loop_accept_cb)(struct tipc_loop *loop, int lsd, int sd,
+				    const struct tipc_addr *src, void *arg);
+typedef void (*tipc_loop_srv_cb)(struct tipc_loop *loop, int sd,
+				 const struct tipc_addr *srv,
+				 const struct tipc_addr *id,
+				 bool up, bool expired, void *arg);
+typedef void (*tipc_loop_timer_cb)(struct tipc_loop *loop, int id, void *arg);
+typedef void (*tipc_loop_wm_cb)(struct tipc_loop *loop, int sd, bool above,
+				void *arg);
+typedef int (*tipc_loop_setup_cb)(struct tipc_loop *loop, int idx, void *arg);
+
+struct tipc_loop *tipc_loop_create(void);
+void tipc_loop_destroy(struct tipc_loop *loop);
+int tipc_loop_add_msg(struct tipc_loop *loop, int sd, tipc_loop_msg_cb cb,
+		      void *arg);
+int tipc_loop_add_accept(struct tipc_loop *loop, int sd,
+			 tipc_loop_accept_cb cb, void *arg);
+int tipc_loop_add_srv(struct tipc_loop *loop, int sd, tipc_loop_srv_cb cb,
+		      void *arg);
+int tipc_loop_del(struct tipc_loop *loop, int sd);
+int tipc_loop_timer(struct tipc_loop *loop, int ms, bool periodic,
+		    tipc_loop_timer_cb cb, void *arg);
+int tipc_loop_timer_cancel(struct tipc_loop *loop, int id);
+int tipc_loop_sendto(struct tipc_loop *loop, int sd, const char *msg,
+		     size_t len, const struct tipc_addr *dst);
+int tipc_loop_sendto_buf(struct tipc_loop *loop, int sd, void *buf,
+			 size_t len, const struct tipc_addr *dst);
+int tipc_loop_sendq(struct tipc_loop *loop, int sd, size_t limit,
+		    size_t high, size_t low, tipc_loop_wm_cb cb, void *arg);
+size_t tipc_loop_sendq_bytes(struct tipc_loop *loop, int sd);
+int tipc_loop_run(struct tipc_loop *loop);
+void tipc_loop_stop(struct tipc_loop *loop);
+int tipc_loop_run_threads(int num, tipc_loop_setup_cb setup, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,740 @@
+/* ------------------------------------------------------------------------
+ *
+ * tipcc.hpp
+ *
+ * Short description: TIPC C binding API, C++20 RAII and coroutine layer
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ * ------------------------------------------------------------------------
+ */
+
+#ifndef __TIPCC_HPP_
+#define __TIPCC_HPP_
+
+#include <cerrno>
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <span>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include "tipcc.h"
+
+/* C++ layer:
+ * - Header only, needs C++20. Errors are thrown as std::system_error,
+ *   except by the plain send/recv members, which return -1 as in C
+ * - tipc::socket owns its descriptor and closes it on destruction.
+ *   It can be moved but not copied
+ * - Buffers are passed as std::span and go straight to the system call,
+ *   without copying in user space
+ * - tipc::reactor is an edge triggered epoll loop resuming coroutines
+ *   when their socket is ready. A reactor is run by one thread; use one
+ *   per thread, each with its own sockets, to spread flows over cpus.
+ *   spawn() and stop() may be called from any thread
+ * - tipc::async_socket adds awaitable operations on a socket registered
+ *   with a reactor. At most one read side and one write side operation
+ *   may be pending per socket at a time
+ * - tipc::task<T> is a lazily started coroutine. Await it from another
+ *   task, or hand a task<void> to reactor::spawn() to run it detached.
+ *   An exception escaping a detached task terminates the process.
+ *   Tasks still suspended when the reactor is stopped are left as they
+ *   are; a task must not be destroyed while an operation is pending
+ */
+namespace tipc {
+
+using addr = struct ::tipc_addr;
+
+template <class T = void>
+class task;
+
+inline std::system_error sys_error(int err, const char *what)
+{
+	return std::system_error(err, std::system_category(), what);
+}
+
+inline int check(int rc, const char *what)
+{
+	if (rc < 0)
+		throw sys_error(errno, what);
+	return rc;
+}
+
+class socket {
+public:
+	socket() noexcept = default;
+	explicit socket(int sk_type) : sd_(check(tipc_socket(sk_type), "tipc_socket")) {}
+	static socket adopt(int sd) noexcept
+	{
+		socket s;
+
+		s.sd_ = sd;
+		return s;
+	}
+	socket(socket &&o) noexcept : sd_(std::exchange(o.sd_, -1)) {}
+	socket &operator=(socket &&o) noexcept
+	{
+		if (this != &o) {
+			reset();
+			sd_ = std::exchange(o.sd_, -1);
+		}
+		return *this;
+	}
+	socket(const socket &) = delete;
+	socket &operator=(const socket &) = delete;
+	~socket() { reset(); }
+
+	int fd() const noexcept { return sd_; }
+	explicit operator bool() const noexcept { return sd_ >= 0; }
+	int release() noexcept { return std::exchange(sd_, -1); }
+	void reset() noexcept
+	{
+		if (sd_ >= 0)
+			tipc_close(sd_);
+		sd_ = -1;
+	}
+
+	void bind(uint32_t type, uint32_t lower, uint32_t upper,
+		  tipc_domain_t scope = 0)
+	{
+		check(tipc_bind(sd_, type, lower, upper, scope), "tipc_bind");
+	}
+	void connect(const addr &dst)
+	{
+		check(tipc_connect(sd_, &dst), "tipc_connect");
+	}
+	void listen(int backlog = 0)
+	{
+		check(tipc_listen(sd_, backlog), "tipc_listen");
+	}
+	socket accept(addr *src = nullptr)
+	{
+		return adopt(check(tipc_accept(sd_, src), "tipc_accept"));
+	}
+	void non_block()
+	{
+		check(tipc_sock_non_block(sd_), "tipc_sock_non_block");
+	}
+	void rejectable()
+	{
+		check(tipc_sock_rejectable(sd_), "tipc_sock_rejectable");
+	}
+	addr id() const
+	{
+		addr a;
+
+		check(tipc_sockid(sd_, &a), "tipc_sockid");
+		return a;
+	}
+
+	int send(std::span<const std::byte> buf) noexcept
+	{
+		return tipc_send(sd_, cbuf(buf), buf.size());
+	}
+	int sendto(std::span<const std::byte> buf, const addr &dst) noexcept
+	{
+		return tipc_sendto(sd_, cbuf(buf), buf.size(), &dst);
+	}
+	int mcast(std::span<const std::byte> buf, const addr &dst) noexcept
+	{
+		return tipc_mcast(sd_, cbuf(buf), buf.size(), &dst);
+	}
+	int sendv(std::span<const iovec> iov, const addr *dst = nullptr) noexcept
+	{
+		return tipc_sendv(sd_, iov.data(), iov.size(), dst);
+	}
+	int recv(std::span<std::byte> buf, bool waitall = false) noexcept
+	{
+		return tipc_recv(sd_, buf_(buf), buf.size(), waitall);
+	}
+	int recvfrom(std::span<std::byte> buf, addr *src = nullptr,
+		     addr *dst = nullptr, int *err = nullptr) noexcept
+	{
+		return tipc_recvfrom(sd_, buf_(buf), buf.size(), src, dst, err);
+	}
+	int sendmmsg(std::span<tipc_mmsg> msgs) noexcept
+	{
+		return tipc_sendmmsg(sd_, msgs.data(), msgs.size());
+	}
+	int recvmmsg(std::span<tipc_mmsg> msgs) noexcept
+	{
+		return tipc_recvmmsg(sd_, msgs.data(), msgs.size());
+	}
+
+private:
+	static const char *cbuf(std::span<const std::byte> b) noexcept
+	{
+		return reinterpret_cast<const char *>(b.data());
+	}
+	static char *buf_(std::span<std::byte> b) noexcept
+	{
+		return reinterpret_cast<char *>(b.data());
+	}
+
+	int sd_ = -1;
+};
+
+namespace detail {
+
+struct promise_base {
+	std::coroutine_handle<> cont;
+	std::exception_ptr exc;
+	bool detached = false;
+
+	struct final_awaiter {
+		bool await_ready() noexcept { return false; }
+		template <class P>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+		{
+			promise_base &p = h.promise();
+
+			if (p.cont)
+				return p.cont;
+			if (p.detached) {
+				if (p.exc)
+					std::terminate();
+				h.destroy();
+			}
+			return std::noop_coroutine();
+		}
+		void await_resume() noexcept {}
+	};
+
+	std::suspend_always initial_suspend() noexcept { return {}; }
+	final_awaiter final_suspend() noexcept { return {}; }
+	void unhandled_exception() noexcept { exc = std::current_exception(); }
+};
+
+template <class T>
+struct promise : promise_base {
+	std::optional<T> val;
+
+	task<T> get_return_object();
+	template <class U>
+	void return_value(U &&v) { val.emplace(std::forward<U>(v)); }
+	T result()
+	{
+		if (exc)
+			std::rethrow_exception(exc);
+		return std::move(*val);
+	}
+};
+
+template <>
+struct promise<void> : promise_base {
+	task<void> get_return_object();
+	void return_void() noexcept {}
+	void result()
+	{
+		if (exc)
+			std::rethrow_exception(exc);
+	}
+};
+
+} /* namespace detail */
+
+template <class T>
+class [[nodiscard]] task {
+public:
+	using promise_type = detail::promise<T>;
+	using handle = std::coroutine_handle<promise_type>;
+
+	explicit task(handle h) noexcept : h_(h) {}
+	task(task &&o) noexcept : h_(std::exchange(o.h_, {})) {}
+	task &operator=(task &&o) noexcept
+	{
+		if (this != &o) {
+			if (h_)
+				h_.destroy();
+			h_ = std::exchange(o.h_, {});
+		}
+		return *this;
+	}
+	task(const task &) = delete;
+	task &operator=(const task &) = delete;
+	~task()
+	{
+		if (h_)
+			h_.destroy();
+	}
+
+	bool await_ready() const noexcept { return false; }
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> c) noexcept
+	{
+		h_.promise().cont = c;
+		return h_;
+	}
+	T await_resume() { return h_.promise().result(); }
+
+	/* Give up ownership; the coroutine frees itself when done */
+	std::coroutine_handle<> detach() && noexcept
+	{
+		h_.promise().detached = true;
+		return std::exchange(h_, {});
+	}
+
+private:
+	handle h_;
+};
+
+namespace detail {
+
+template <class T>
+inline task<T> promise<T>::get_return_object()
+{
+	return task<T>(std::coroutine_handle<promise<T>>::from_promise(*this));
+}
+
+inline task<void> promise<void>::get_return_object()
+{
+	return task<void>(std::coroutine_handle<promise<void>>::from_promise(*this));
+}
+
+} /* namespace detail */
+
+/* An operation that is retried each time its socket becomes ready,
+ * until it no longer fails with EAGAIN
+ */
+struct io_op {
+	std::coroutine_handle<> h;
+	virtual bool attempt() = 0;
+
+protected:
+	~io_op() = default;
+};
+
+class reactor {
+public:
+	reactor()
+	{
+		epfd_ = check(epoll_create1(EPOLL_CLOEXEC), "epoll_create1");
+		evfd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (evfd_ < 0) {
+			::close(epfd_);
+			throw sys_error(errno, "eventfd");
+		}
+		epoll_event ev{};
+		ev.events = EPOLLIN;
+		ev.data.fd = evfd_;
+		epoll_ctl(epfd_, EPOLL_CTL_ADD, evfd_, &ev);
+	}
+	reactor(const reactor &) = delete;
+	reactor &operator=(const reactor &) = delete;
+	~reactor()
+	{
+		::close(evfd_);
+		::close(epfd_);
+	}
+
+	void add(int fd)
+	{
+		epoll_event ev{};
+
+		check(tipc_sock_non_block(fd), "tipc_sock_non_block");
+		ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+		ev.data.fd = fd;
+		check(epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev), "epoll_ctl");
+		if ((size_t)fd >= fds_.size())
+			fds_.resize(fd + 1);
+		fds_[fd] = {};
+	}
+	void del(int fd) noexcept
+	{
+		epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr);
+		if ((size_t)fd < fds_.size())
+			fds_[fd] = {};
+	}
+
+	void wait(int fd, bool write, io_op *op) noexcept
+	{
+		(write ? fds_[fd].wr : fds_[fd].rd) = op;
+	}
+
+	/* Resume h on the reactor thread; may be called from any thread */
+	void post(std::coroutine_handle<> h)
+	{
+		{
+			std::lock_guard<std::mutex> l(lock_);
+			posted_.push_back(h);
+		}
+		wakeup();
+	}
+
+	void stop()
+	{
+		stop_.store(true);
+		wakeup();
+	}
+
+	void spawn(task<void> t)
+	{
+		post(std::move(t).detach());
+	}
+
+	auto sleep_for(std::chrono::milliseconds ms)
+	{
+		struct awaiter {
+			reactor *r;
+			clock::time_point when;
+			bool await_ready() const noexcept { return false; }
+			void await_suspend(std::coroutine_handle<> h)
+			{
+				r->timers_.push({when, r->timer_seq_++, h});
+			}
+			void await_resume() const noexcept {}
+		};
+		return awaiter{this, clock::now() + ms};
+	}
+
+	void run()
+	{
+		epoll_event evs[64];
+		int n, i;
+
+		stop_.store(false);
+		while (!stop_.load()) {
+			run_posted();
+			run_timers();
+			n = epoll_wait(epfd_, evs, 64, next_timeout());
+			if (n < 0 && errno != EINTR)
+				throw sys_error(errno, "epoll_wait");
+			for (i = 0; i < n; i++)
+				dispatch(evs[i]);
+		}
+	}
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	struct fd_state {
+		io_op *rd = nullptr;
+		io_op *wr = nullptr;
+	};
+	struct timer {
+		clock::time_point when;
+		uint64_t seq;
+		std::coroutine_handle<> h;
+		bool operator>(const timer &o) const
+		{
+			return when != o.when ? when > o.when : seq > o.seq;
+		}
+	};
+
+	void wakeup() noexcept
+	{
+		uint64_t one = 1;
+
+		(void)!::write(evfd_, &one, sizeof(one));
+	}
+
+	void run_posted()
+	{
+		std::vector<std::coroutine_handle<>> hs;
+		{
+			std::lock_guard<std::mutex> l(lock_);
+			hs.swap(posted_);
+		}
+		for (auto h : hs)
+			h.resume();
+	}
+
+	void run_timers()
+	{
+		auto now = clock::now();
+
+		while (!timers_.empty() && timers_.top().when <= now) {
+			auto h = timers_.top().h;
+
+			timers_.pop();
+			h.resume();
+		}
+	}
+
+	int next_timeout()
+	{
+		{
+			std::lock_guard<std::mutex> l(lock_);
+			if (!posted_.empty())
+				return 0;
+		}
+		if (timers_.empty())
+			return -1;
+		auto d = timers_.top().when - clock::now();
+		if (d <= clock::duration::zero())
+			return 0;
+		return std::chrono::ceil<std::chrono::milliseconds>(d).count();
+	}
+
+	static void complete(io_op *&slot)
+	{
+		io_op *op = slot;
+
+		if (!op || !op->attempt())
+			return;
+		slot = nullptr;
+		op->h.resume();
+	}
+
+	void dispatch(const epoll_event &ev)
+	{
+		int fd = ev.data.fd;
+		uint64_t cnt;
+
+		if (fd == evfd_) {
+			(void)!::read(evfd_, &cnt, sizeof(cnt));
+			return;
+		}
+		if ((size_t)fd >= fds_.size())
+			return;
+		if (ev.events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+			complete(fds_[fd].rd);
+		if ((size_t)fd < fds_.size() &&
+		    ev.events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+			complete(fds_[fd].wr);
+	}
+
+	int epfd_ = -1;
+	int evfd_ = -1;
+	std::vector<fd_state> fds_;
+	std::priority_queue<timer, std::vector<timer>, std::greater<timer>> timers_;
+	uint64_t timer_seq_ = 0;
+	std::mutex lock_;
+	std::vector<std::coroutine_handle<>> posted_;
+	std::atomic<bool> stop_{false};
+};
+
+/* Awaitable for a non-blocking operation op(), which fails with EAGAIN
+ * when it would block. op.result() makes the value of co_await
+ */
+template <class Op>
+class io_awaitable : io_op {
+public:
+	io_awaitable(reactor &r, int fd, bool write, Op op)
+		: r_(r), fd_(fd), write_(write), op_(std::move(op)) {}
+
+	bool await_ready() { return attempt(); }
+	void await_suspend(std::coroutine_handle<> h)
+	{
+		this->h = h;
+		r_.wait(fd_, write_, this);
+	}
+	auto await_resume()
+	{
+		if (err_)
+			throw sys_error(err_, "tipc");
+		return op_.result(rc_);
+	}
+
+private:
+	bool attempt() override
+	{
+		rc_ = op_();
+		if (rc_ < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return false;
+		err_ = rc_ < 0 ? errno : 0;
+		return true;
+	}
+
+	reactor &r_;
+	int fd_;
+	bool write_;
+	Op op_;
+	int rc_ = 0;
+	int err_ = 0;
+};
+
+struct message {
+	size_t len;
+	addr   src;
+	addr   dst;
+	int    err;
+};
+
+namespace detail {
+
+template <class F>
+struct fn_op {
+	F f;
+	int operator()() { return f(); }
+	int result(int rc) const noexcept { return rc; }
+};
+
+struct recvfrom_op {
+	socket *s;
+	std::span<std::byte> buf;
+	message m{};
+
+	int operator()() { return s->recvfrom(buf, &m.src, &m.dst, &m.err); }
+	message result(int rc) noexcept
+	{
+		m.len = rc;
+		return m;
+	}
+};
+
+struct accept_op {
+	socket *s;
+	addr *src;
+
+	int operator()() { return tipc_accept(s->fd(), src); }
+	socket result(int rc) const noexcept { return socket::adopt(rc); }
+};
+
+/* Non-blocking connect is complete when the socket has a peer */
+struct connect_op {
+	socket *s;
+	addr dst;
+	bool started = false;
+
+	int operator()()
+	{
+		sockaddr_tipc peer;
+		socklen_t len = sizeof(int);
+		int err = 0;
+
+		if (!started) {
+			if (!tipc_connect(s->fd(), &dst))
+				return 0;
+			if (errno != EINPROGRESS)
+				return -1;
+			started = true;
+			errno = EAGAIN;
+			return -1;
+		}
+		if (getsockopt(s->fd(), SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+			return -1;
+		if (err) {
+			errno = err;
+			return -1;
+		}
+		len = sizeof(peer);
+		if (!getpeername(s->fd(), (sockaddr *)&peer, &len))
+			return 0;
+		if (errno == ENOTCONN)
+			errno = EAGAIN;
+		return -1;
+	}
+	int result(int rc) const noexcept { return rc; }
+};
+
+} /* namespace detail */
+
+class async_socket {
+public:
+	async_socket(reactor &r, socket s) : r_(&r), s_(std::move(s))
+	{
+		r_->add(s_.fd());
+	}
+	async_socket(async_socket &&o) noexcept
+		: r_(o.r_), s_(std::move(o.s_)) {}
+	async_socket &operator=(async_socket &&o) noexcept
+	{
+		if (this != &o) {
+			close();
+			r_ = o.r_;
+			s_ = std::move(o.s_);
+		}
+		return *this;
+	}
+	async_socket(const async_socket &) = delete;
+	async_socket &operator=(const async_socket &) = delete;
+	~async_socket() { close(); }
+
+	socket &sock() noexcept { return s_; }
+	int fd() const noexcept { return s_.fd(); }
+	void close() noexcept
+	{
+		if (s_)
+			r_->del(s_.fd());
+		s_.reset();
+	}
+
+	auto send(std::span<const std::byte> buf)
+	{
+		return fn(true, [this, buf] { return s_.send(buf); });
+	}
+	auto sendto(std::span<const std::byte> buf, const addr &dst)
+	{
+		return fn(true, [this, buf, dst] { return s_.sendto(buf, dst); });
+	}
+	auto sendv(std::span<const iovec> iov, const addr *dst = nullptr)
+	{
+		return fn(true, [this, iov, dst] { return s_.sendv(iov, dst); });
+	}
+	auto recv(std::span<std::byte> buf)
+	{
+		return fn(false, [this, buf] { return s_.recv(buf); });
+	}
+	auto recvmmsg(std::span<tipc_mmsg> msgs)
+	{
+		return fn(false, [this, msgs] { return s_.recvmmsg(msgs); });
+	}
+	auto recvfrom(std::span<std::byte> buf)
+	{
+		return io_awaitable<detail::recvfrom_op>(*r_, s_.fd(), false,
+							 {&s_, buf});
+	}
+	auto accept(addr *src = nullptr)
+	{
+		return io_awaitable<detail::accept_op>(*r_, s_.fd(), false,
+						       {&s_, src});
+	}
+	auto connect(const addr &dst)
+	{
+		return io_awaitable<detail::connect_op>(*r_, s_.fd(), true,
+							{&s_, dst});
+	}
+
+private:
+	template <class F>
+	io_awaitable<detail::fn_op<F>> fn(bool write, F f)
+	{
+		return io_awaitable<detail::fn_op<F>>(*r_, s_.fd(), write,
+						      {std::move(f)});
+	}
+
+	reactor *r_;
+	socket s_;
+};
+
+} /* namespace tipc */
+
+#endif
@@ -0,0 +1,256 @@
+/* ------------------------------------------------------------------------
+ *
+ * tipcc_buf.c
+ *
+ * Short description: TIPC C binding API, message buffer pool
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ * ------------------------------------------------------------------------
+ */
+
+#include <sys/mman.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/tipc.h>
+#include "tipcc.h"
+
+#define BUF_LARGE      0xffff
+#define BUF_SLAB_SZ    (2 << 20)
+#define BUF_CACHE_MAX  16
+#define BUF_ALIGN(x)   (((x) + 63) & ~(size_t)63)
+
+static const size_t buf_classes[] = {
+	256, 1024, 4096, 16384, TIPC_MAX_USER_MSG_SIZE
+};
+
+#define BUF_CLASSES (sizeof(buf_classes) / sizeof(buf_classes[0]))
+
+/* Sits in front of the data; next is only used while on a free list */
+struct buf_hdr {
+	union {
+		struct buf_hdr *next;
+		size_t          size;
+	};
+	uint32_t refs;
+	uint32_t cls;
+} __attribute__((aligned(16)));
+
+struct buf_cache {
+	struct buf_hdr *head[BUF_CLASSES];
+	int             cnt[BUF_CLASSES];
+};
+
+static struct {
+	pthread_mutex_t  lock;
+	struct buf_hdr  *head[BUF_CLASSES];
+	bool             hugepages;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static pthread_once_t buf_once = PTHREAD_ONCE_INIT;
+static pthread_key_t buf_key;
+static __thread struct buf_cache cache;
+static __thread bool cache_registered;
+
+/* Thread exit: give cached buffers back to the pool */
+static void buf_flush(void *arg)
+{
+	struct buf_cache *c = arg;
+	struct buf_hdr *h;
+	unsigned int cls;
+
+	pthread_mutex_lock(&pool.lock);
+	for (cls = 0; cls < BUF_CLASSES; cls++) {
+		while ((h = c->head[cls])) {
+			c->head[cls] = h->next;
+			h->next = pool.head[cls];
+			pool.head[cls] = h;
+		}
+		c->cnt[cls] = 0;
+	}
+	pthread_mutex_unlock(&pool.lock);
+}
+
+static void buf_once_init(void)
+{
+	pthread_key_create(&buf_key, buf_flush);
+}
+
+static struct buf_cache *buf_cache(void)
+{
+	if (!cache_registered) {
+		pthread_once(&buf_once, buf_once_init);
+		pthread_setspecific(buf_key, &cache);
+		cache_registered = true;
+	}
+	return &cache;
+}
+
+static void *slab_map(size_t len)
+{
+	void *p = MAP_FAILED;
+
+	if (pool.hugepages)
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (p != MAP_FAILED)
+		return p;
+
+	/* No reserved huge pages; transparent ones may still do */
+	p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+	if (pool.hugepages)
+		madvise(p, len, MADV_HUGEPAGE);
+	return p;
+}
+
+/* Move half a cache worth from pool to thread, carving a new slab if
+ * the pool is empty. Slabs are never unmapped
+ */
+static int buf_refill(struct buf_cache *c, unsigned int cls)
+{
+	size_t osz = sizeof(struct buf_hdr) + BUF_ALIGN(buf_classes[cls]);
+	struct buf_hdr *h;
+	char *slab;
+	size_t i;
+
+	pthread_mutex_lock(&pool.lock);
+	if (!pool.head[cls]) {
+		slab = slab_map(BUF_SLAB_SZ);
+		if (!slab) {
+			pthread_mutex_unlock(&pool.lock);
+			return -1;
+		}
+		for (i = 0; i + osz <= BUF_SLAB_SZ; i += osz) {
+			h = (struct buf_hdr *)(slab + i);
+			h->cls = cls;
+			h->next = pool.head[cls];
+			pool.head[cls] = h;
+		}
+	}
+	while (pool.head[cls] && c->cnt[cls] < BUF_CACHE_MAX / 2) {
+		h = pool.head[cls];
+		pool.head[cls] = h->next;
+		h->next = c->head[cls];
+		c->head[cls] = h;
+		c->cnt[cls]++;
+	}
+	pthread_mutex_unlock(&pool.lock);
+	return 0;
+}
+
+static void buf_drain(struct buf_cache *c, unsigned int cls)
+{
+	struct buf_hdr *h;
+
+	pthread_mutex_lock(&pool.lock);
+	while (c->cnt[cls] > BUF_CACHE_MAX / 2) {
+		h = c->head[cls];
+		c->head[cls] = h->next;
+		c->cnt[cls]--;
+		h->next = pool.head[cls];
+		pool.head[cls] = h;
+	}
+	pthread_mutex_unlock(&pool.lock);
+}
+
+void tipc_buf_pool_init(bool hugepages)
+{
+	pool.hugepages = hugepages;
+}
+
+void *tipc_buf_alloc(size_t size)
+{
+	struct buf_cache *c;
+	struct buf_hdr *h;
+	unsigned int cls;
+
+	for (cls = 0; cls < BUF_CLASSES && size > buf_classes[cls]; cls++)
+		;
+	if (cls == BUF_CLASSES) {
+		h = malloc(sizeof(*h) + size);
+		if (!h)
+			return NULL;
+		h->size = size;
+		h->cls = BUF_LARGE;
+	} else {
+		c = buf_cache();
+		if (!c->head[cls] && buf_refill(c, cls))
+			return NULL;
+		h = c->head[cls];
+		c->head[cls] = h->next;
+		c->cnt[cls]--;
+	}
+	h->refs = 1;
+	return h + 1;
+}
+
+void *tipc_buf_get(void *buf)
+{
+	struct buf_hdr *h = (struct buf_hdr *)buf - 1;
+
+	__atomic_add_fetch(&h->refs, 1, __ATOMIC_RELAXED);
+	return buf;
+}
+
+void tipc_buf_put(void *buf)
+{
+	struct buf_hdr *h;
+	struct buf_cache *c;
+
+	if (!buf)
+		return;
+	h = (struct buf_hdr *)buf - 1;
+	if (__atomic_sub_fetch(&h->refs, 1, __ATOMIC_ACQ_REL))
+		return;
+	if (h->cls == BUF_LARGE) {
+		free(h);
+		return;
+	}
+	c = buf_cache();
+	h->next = c->head[h->cls];
+	c->head[h->cls] = h;
+	if (++c->cnt[h->cls] > BUF_CACHE_MAX)
+		buf_drain(c, h->cls);
+}
+
+size_t tipc_buf_size(const void *buf)
+{
+	const struct buf_hdr *h = (const struct buf_hdr *)buf - 1;
+
+	if (h->cls == BUF_LARGE)
+		return h->size;
+	return BUF_ALIGN(buf_classes[h->cls]);
+}
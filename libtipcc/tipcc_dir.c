@@ -0,0 +1,446 @@
+/* ------------------------------------------------------------------------
+ *
+ * tipcc_dir.c
+ *
+ * Short description: TIPC C binding API, service directory
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ * ------------------------------------------------------------------------
+ */
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <linux/tipc.h>
+#include "tipcc_int.h"
+
+#define DIR_BUCKETS_MIN 64
+#define DIR_EVT_BATCH   64
+
+/* A publication as seen through one subscription. Single instance
+ * publications are hashed on <type, instance>, ranges are kept in a list
+ */
+struct dir_pub {
+	struct dir_pub   *next;
+	uint32_t          sub;
+	uint32_t          type;
+	uint32_t          lower;
+	uint32_t          upper;
+	struct tipc_addr  id;
+};
+
+/* Subscription slot. usr_handle carries <slot, gen> so that events can
+ * be matched in O(1), and events for cancelled subscriptions dropped
+ */
+struct dir_sub {
+	uint32_t type;
+	uint32_t lower;
+	uint32_t upper;
+	uint32_t gen;
+	int      refs;
+};
+
+struct tipc_dir {
+	int               sd;
+	struct dir_pub  **buckets;
+	unsigned int      bucket_cnt;
+	unsigned int      pub_cnt;
+	struct dir_pub   *ranges;
+	struct dir_sub   *subs;
+	unsigned int      sub_cnt;
+	unsigned int      gen;
+	tipc_dir_cb       cb;
+	void             *arg;
+};
+
+static inline uint32_t dir_hash(uint32_t type, uint32_t instance)
+{
+	uint32_t h = (type * 0x9e3779b1u) ^ instance;
+
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	return h;
+}
+
+static inline bool in_domain(tipc_domain_t domain, tipc_domain_t node)
+{
+	return !domain || domain == node || domain == (node & ~0xfff) ||
+		domain == (node & ~0xffffff);
+}
+
+static inline bool same_id(const struct tipc_addr *a,
+			   const struct tipc_addr *b)
+{
+	return a->instance == b->instance && a->domain == b->domain;
+}
+
+static struct dir_pub **dir_head(struct tipc_dir *dir, uint32_t type,
+				 uint32_t lower, uint32_t upper)
+{
+	if (lower != upper)
+		return &dir->ranges;
+	return &dir->buckets[dir_hash(type, lower) & (dir->bucket_cnt - 1)];
+}
+
+/* Find link to matching publication; sub == ~0 matches any subscription */
+static struct dir_pub **dir_find(struct tipc_dir *dir, uint32_t sub,
+				 uint32_t type, uint32_t lower, uint32_t upper,
+				 const struct tipc_addr *id)
+{
+	struct dir_pub **pp = dir_head(dir, type, lower, upper);
+
+	for (; *pp; pp = &(*pp)->next) {
+		struct dir_pub *p = *pp;
+
+		if (p->type == type && p->lower == lower &&
+		    p->upper == upper && same_id(&p->id, id) &&
+		    (sub == ~0u || p->sub == sub))
+			return pp;
+	}
+	return NULL;
+}
+
+static void dir_grow(struct tipc_dir *dir)
+{
+	unsigned int i, cnt = dir->bucket_cnt * 2;
+	struct dir_pub **buckets, *p, *next;
+
+	buckets = calloc(cnt, sizeof(*buckets));
+	if (!buckets)
+		return;
+	for (i = 0; i < dir->bucket_cnt; i++) {
+		for (p = dir->buckets[i]; p; p = next) {
+			next = p->next;
+			p->next = buckets[dir_hash(p->type, p->lower) & (cnt - 1)];
+			buckets[dir_hash(p->type, p->lower) & (cnt - 1)] = p;
+		}
+	}
+	free(dir->buckets);
+	dir->buckets = buckets;
+	dir->bucket_cnt = cnt;
+}
+
+static void dir_notify(struct tipc_dir *dir, struct dir_pub *p, bool up)
+{
+	/* Only report first publication and last withdrawal */
+	if (dir_find(dir, ~0, p->type, p->lower, p->upper, &p->id))
+		return;
+	dir->gen++;
+	if (dir->cb)
+		dir->cb(dir, p->type, p->lower, p->upper, &p->id, up, dir->arg);
+}
+
+static void dir_publish(struct tipc_dir *dir, uint32_t sub, uint32_t type,
+			uint32_t lower, uint32_t upper,
+			const struct tipc_addr *id)
+{
+	struct dir_pub **pp, *p;
+
+	if (dir_find(dir, sub, type, lower, upper, id))
+		return;
+	p = malloc(sizeof(*p));
+	if (!p)
+		return;
+	p->sub = sub;
+	p->type = type;
+	p->lower = lower;
+	p->upper = upper;
+	p->id = *id;
+	dir_notify(dir, p, true);
+	pp = dir_head(dir, type, lower, upper);
+	p->next = *pp;
+	*pp = p;
+	if (lower == upper && ++dir->pub_cnt > dir->bucket_cnt)
+		dir_grow(dir);
+}
+
+static void dir_unlink(struct tipc_dir *dir, struct dir_pub **pp)
+{
+	struct dir_pub *p = *pp;
+
+	*pp = p->next;
+	if (p->lower == p->upper)
+		dir->pub_cnt--;
+	dir_notify(dir, p, false);
+	free(p);
+}
+
+static void dir_withdraw(struct tipc_dir *dir, uint32_t sub, uint32_t type,
+			 uint32_t lower, uint32_t upper,
+			 const struct tipc_addr *id)
+{
+	struct dir_pub **pp = dir_find(dir, sub, type, lower, upper, id);
+
+	if (pp)
+		dir_unlink(dir, pp);
+}
+
+static void dir_purge_chain(struct tipc_dir *dir, struct dir_pub **pp,
+			    uint32_t sub)
+{
+	while (*pp) {
+		if ((*pp)->sub == sub)
+			dir_unlink(dir, pp);
+		else
+			pp = &(*pp)->next;
+	}
+}
+
+/* Drop everything learnt through a cancelled subscription */
+static void dir_purge(struct tipc_dir *dir, uint32_t sub)
+{
+	unsigned int i;
+
+	for (i = 0; i < dir->bucket_cnt; i++)
+		dir_purge_chain(dir, &dir->buckets[i], sub);
+	dir_purge_chain(dir, &dir->ranges, sub);
+}
+
+static int dir_send(struct tipc_dir *dir, uint32_t slot, bool cancel)
+{
+	struct dir_sub *s = &dir->subs[slot];
+	struct tipc_subscr subscr;
+
+	memset(&subscr, 0, sizeof(subscr));
+	subscr.seq.type  = s->type;
+	subscr.seq.lower = s->lower;
+	subscr.seq.upper = s->upper;
+	subscr.timeout   = TIPC_WAIT_FOREVER;
+	subscr.filter    = TIPC_SUB_PORTS | (cancel ? TIPC_SUB_CANCEL : 0);
+	memcpy(subscr.usr_handle, &slot, 4);
+	memcpy(subscr.usr_handle + 4, &s->gen, 4);
+	if (send(dir->sd, &subscr, sizeof(subscr), 0) != sizeof(subscr))
+		return -1;
+	return 0;
+}
+
+struct tipc_dir *tipc_dir_create(tipc_domain_t topsrv_node,
+				 tipc_dir_cb cb, void *arg)
+{
+	struct tipc_dir *dir = calloc(1, sizeof(*dir));
+
+	if (!dir)
+		return NULL;
+	dir->bucket_cnt = DIR_BUCKETS_MIN;
+	dir->buckets = calloc(dir->bucket_cnt, sizeof(*dir->buckets));
+	if (!dir->buckets) {
+		free(dir);
+		return NULL;
+	}
+	dir->sd = tipc_topsrv_conn(topsrv_node);
+	if (dir->sd < 0) {
+		free(dir->buckets);
+		free(dir);
+		return NULL;
+	}
+	dir->cb = cb;
+	dir->arg = arg;
+	return dir;
+}
+
+void tipc_dir_destroy(struct tipc_dir *dir)
+{
+	struct dir_pub *p, *next;
+	unsigned int i;
+
+	if (!dir)
+		return;
+	dir->cb = NULL;
+	for (i = 0; i < dir->bucket_cnt; i++) {
+		for (p = dir->buckets[i]; p; p = next) {
+			next = p->next;
+			free(p);
+		}
+	}
+	for (p = dir->ranges; p; p = next) {
+		next = p->next;
+		free(p);
+	}
+	tipc_close(dir->sd);
+	free(dir->buckets);
+	free(dir->subs);
+	free(dir);
+}
+
+int tipc_dir_fd(struct tipc_dir *dir)
+{
+	return dir->sd;
+}
+
+unsigned int tipc_dir_gen(struct tipc_dir *dir)
+{
+	return dir->gen;
+}
+
+int tipc_dir_subscr(struct tipc_dir *dir, uint32_t type, uint32_t lower,
+		    uint32_t upper)
+{
+	struct dir_sub *s, *subs;
+	uint32_t slot, free_slot = ~0;
+
+	for (slot = 0; slot < dir->sub_cnt; slot++) {
+		s = &dir->subs[slot];
+		if (!s->refs) {
+			if (free_slot == ~0u)
+				free_slot = slot;
+			continue;
+		}
+		if (s->type == type && s->lower == lower && s->upper == upper) {
+			s->refs++;
+			return 0;
+		}
+	}
+	if (free_slot == ~0u) {
+		subs = realloc(dir->subs, (dir->sub_cnt + 16) * sizeof(*subs));
+		if (!subs)
+			return -1;
+		memset(&subs[dir->sub_cnt], 0, 16 * sizeof(*subs));
+		dir->subs = subs;
+		free_slot = dir->sub_cnt;
+		dir->sub_cnt += 16;
+	}
+	s = &dir->subs[free_slot];
+	s->type = type;
+	s->lower = lower;
+	s->upper = upper;
+	s->gen++;
+	if (dir_send(dir, free_slot, false))
+		return -1;
+	s->refs = 1;
+	return 0;
+}
+
+int tipc_dir_unsubscr(struct tipc_dir *dir, uint32_t type, uint32_t lower,
+		      uint32_t upper)
+{
+	struct dir_sub *s;
+	uint32_t slot;
+
+	for (slot = 0; slot < dir->sub_cnt; slot++) {
+		s = &dir->subs[slot];
+		if (!s->refs || s->type != type || s->lower != lower ||
+		    s->upper != upper)
+			continue;
+		if (--s->refs)
+			return 0;
+		dir_purge(dir, slot);
+		return dir_send(dir, slot, true);
+	}
+	errno = ENOENT;
+	return -1;
+}
+
+static void dir_evt(struct tipc_dir *dir, const struct tipc_event *evt)
+{
+	struct tipc_addr id;
+	uint32_t slot, gen;
+
+	memcpy(&slot, evt->s.usr_handle, 4);
+	memcpy(&gen, evt->s.usr_handle + 4, 4);
+	if (slot >= dir->sub_cnt || !dir->subs[slot].refs ||
+	    dir->subs[slot].gen != gen)
+		return;
+
+	id.type = 0;
+	id.instance = evt->port.ref;
+	id.domain = evt->port.node;
+	if (evt->event == TIPC_PUBLISHED)
+		dir_publish(dir, slot, evt->s.seq.type, evt->found_lower,
+			    evt->found_upper, &id);
+	else if (evt->event == TIPC_WITHDRAWN)
+		dir_withdraw(dir, slot, evt->s.seq.type, evt->found_lower,
+			     evt->found_upper, &id);
+}
+
+int tipc_dir_update(struct tipc_dir *dir)
+{
+	struct tipc_event evts[DIR_EVT_BATCH];
+	int i, rc, n = 0;
+
+	while (1) {
+		rc = tipcc__srv_evts_read(dir->sd, evts, DIR_EVT_BATCH,
+					  MSG_DONTWAIT);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return n;
+		if (rc < 0)
+			return -1;
+		for (i = 0; i < rc; i++)
+			dir_evt(dir, &evts[i]);
+		n += rc;
+	}
+}
+
+static bool dir_add_id(const struct dir_pub *p, tipc_domain_t domain,
+		       struct tipc_addr *ids, int max, int *n)
+{
+	int i;
+
+	if (!in_domain(domain, p->id.domain))
+		return false;
+	for (i = 0; i < *n; i++) {
+		if (same_id(&ids[i], &p->id))
+			return false;
+	}
+	if (*n < max)
+		ids[(*n)++] = p->id;
+	return true;
+}
+
+int tipc_dir_lookup(struct tipc_dir *dir, uint32_t type, uint32_t instance,
+		    tipc_domain_t domain, struct tipc_addr *ids, int max)
+{
+	struct dir_pub *p = *dir_head(dir, type, instance, instance);
+	int n = 0;
+
+	for (; p; p = p->next) {
+		if (p->type != type || p->lower != instance)
+			continue;
+		if (!ids && in_domain(domain, p->id.domain))
+			return 1;
+		if (ids && dir_add_id(p, domain, ids, max, &n) && n == max)
+			return n;
+	}
+	for (p = dir->ranges; p; p = p->next) {
+		if (p->type != type || instance < p->lower ||
+		    instance > p->upper)
+			continue;
+		if (!ids && in_domain(domain, p->id.domain))
+			return 1;
+		if (ids && dir_add_id(p, domain, ids, max, &n) && n == max)
+			return n;
+	}
+	return n;
+}
@@ -0,0 +1,249 @@
+/* ------------------------------------------------------------------------
+ *
+ * tipcc_dl.c
+ *
+ * Short description: TIPC C API, deadline aware blocking calls
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ * ------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <linux/tipc.h>
+#include "tipcc_int.h"
+
+/* A timeout already set is kept if it ends at most this much after the
+ * deadline, which is below the kernel's timer resolution anyway...
+ */
+#define DL_LATE_NS  1000000ull
+
+/* ...or if it ends at most 1/DL_EARLY of the time left before it. The
+ * rest is then waited out with a new timeout
+ */
+#define DL_EARLY    8
+
+uint64_t *tipcc__dl_tmo;
+
+struct dl_recv {
+	char   *buf;
+	size_t  len;
+	int     flags;
+};
+
+struct dl_recvfrom {
+	struct tipc_addr *src;
+	struct tipc_addr *dst;
+	int              *err;
+	char             *buf;
+	size_t            len;
+};
+
+static uint64_t *dl_tbl(void)
+{
+	uint64_t *tbl = __atomic_load_n(&tipcc__dl_tmo, __ATOMIC_ACQUIRE);
+	uint64_t *old = NULL;
+
+	if (tbl)
+		return tbl;
+	tbl = calloc(DL_MAX_SOCKS, sizeof(*tbl));
+	if (!tbl)
+		return NULL;
+	if (!__atomic_compare_exchange_n(&tipcc__dl_tmo, &old, tbl, false,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		free(tbl);
+		return old;
+	}
+	return tbl;
+}
+
+static int dl_set(int sd, uint64_t tmo)
+{
+	struct timeval tv;
+
+	/* Rounded up to whole us, since 0 means no timeout */
+	tmo = (tmo + 999) / 1000;
+	tv.tv_sec = tmo / 1000000;
+	tv.tv_usec = tmo % 1000000;
+	return setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+void tipcc__dl_clear(int sd)
+{
+	int e = errno;
+
+	dl_set(sd, 0);
+	__atomic_store_n(&tipcc__dl_tmo[sd], 0, __ATOMIC_RELAXED);
+	errno = e;
+}
+
+/* Make sure the timeout in force on sd suits left ns, 0 meaning no
+ * deadline, and return it in tmo
+ */
+static int dl_arm(int sd, uint64_t left, uint64_t *tmo)
+{
+	uint64_t *tbl = NULL, cur;
+
+	if (sd >= 0 && sd < DL_MAX_SOCKS)
+		tbl = dl_tbl();
+	if (tbl) {
+		cur = __atomic_load_n(&tbl[sd], __ATOMIC_RELAXED);
+		if (cur == left ||
+		    (cur && left && cur <= left + DL_LATE_NS &&
+		     cur >= left - left / DL_EARLY)) {
+			*tmo = cur;
+			return 0;
+		}
+	}
+	if (dl_set(sd, left))
+		return -1;
+	if (tbl)
+		__atomic_store_n(&tbl[sd], left, __ATOMIC_RELAXED);
+	*tmo = left;
+	return 0;
+}
+
+/* Run a blocking call with the kernel doing the waiting. A call returning
+ * EAGAIN before its timeout could have passed is on a non-blocking socket
+ */
+static int dl_run(int sd, uint64_t deadline,
+		  int (*call)(int sd, void *arg), void *arg)
+{
+	uint64_t now, tmo;
+	int rc, e;
+
+	for (;;) {
+		now = stats_now();
+		if (deadline && now >= deadline) {
+			errno = ETIMEDOUT;
+			rc = -1;
+			break;
+		}
+		if (dl_arm(sd, deadline ? deadline - now : 0, &tmo))
+			return -1;
+		rc = call(sd, arg);
+		if (rc >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+			break;
+		if (!tmo || stats_now() - now < tmo)
+			break;
+	}
+
+	/* Nowhere to remember it; do not leave it behind */
+	if (sd >= DL_MAX_SOCKS && deadline) {
+		e = errno;
+		dl_set(sd, 0);
+		errno = e;
+	}
+	return rc;
+}
+
+static int dl_recv(int sd, void *arg)
+{
+	struct dl_recv *a = arg;
+	uint64_t t0 = stats_t0();
+	int rc = recv(sd, a->buf, a->len, a->flags);
+
+	stats_rx(sd, rc, false, t0);
+	return rc;
+}
+
+static int dl_recvfrom(int sd, void *arg)
+{
+	struct dl_recvfrom *a = arg;
+	struct shm_ring *r = shm_ring_get(sd);
+	struct tipc_rcv_ctx ctx;
+
+	if (r)
+		return tipcc__shm_recvfrom(r, sd, a->buf, a->len, a->src,
+					   a->dst, a->err);
+	tipc_rcv_ctx_init(&ctx, sd);
+	ctx.iov.iov_base = a->buf;
+	ctx.iov.iov_len = a->len;
+	return tipcc__rcv_ctx_recv(&ctx, a->src, a->dst, a->err);
+}
+
+static int dl_accept(int sd, void *arg)
+{
+	struct sockaddr_tipc addr;
+	socklen_t addrlen = sizeof(addr);
+	struct tipc_addr *src = arg;
+	uint64_t t0 = stats_t0();
+	int rc;
+
+	rc = accept(sd, (struct sockaddr *) &addr, &addrlen);
+	stats_conn(sd, rc, true, t0);
+	if (rc >= 0 && src) {
+		src->type = 0;
+		src->instance = addr.addr.id.ref;
+		src->domain = addr.addr.id.node;
+	}
+	return rc;
+}
+
+uint64_t tipc_deadline(int ms)
+{
+	if (ms < 0)
+		return 0;
+	return stats_now() + ms * 1000000ull;
+}
+
+int tipc_recv_dl(int sd, char *buf, size_t len, bool waitall,
+		 uint64_t deadline)
+{
+	struct dl_recv a = {buf, len, waitall ? MSG_WAITALL : 0};
+	int rc, n = 0;
+
+	/* A wait cut short by the timeout returns what it has so far */
+	do {
+		rc = dl_run(sd, deadline, dl_recv, &a);
+		if (rc <= 0)
+			return n ? n : rc;
+		n += rc;
+		a.buf += rc;
+		a.len -= rc;
+	} while (waitall && a.len);
+	return n;
+}
+
+int tipc_recvfrom_dl(int sd, char *buf, size_t len, struct tipc_addr *src,
+		     struct tipc_addr *dst, int *err, uint64_t deadline)
+{
+	struct dl_recvfrom a = {src, dst, err, buf, len};
+
+	return dl_run(sd, deadline, dl_recvfrom, &a);
+}
+
+int tipc_accept_dl(int sd, struct tipc_addr *src, uint64_t deadline)
+{
+	return dl_run(sd, deadline, dl_accept, src);
+}
@@ -0,0 +1,219 @@
+/* ------------------------------------------------------------------------
+ *
+ * tipcc_evt.c
+ *
+ * Short description: TIPC C API, topology event coalescing
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ * ------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "tipcc_int.h"
+
+#define COAL_MAX_DFLT  65536
+
+struct tipc_srv_coal {
+	int sd;
+	uint64_t window_ns;
+	uint64_t first_ns;
+	bool lost;
+	int cnt;
+	int cap;
+	struct tipc_event *evts;
+};
+
+/* Subscriptions may be in either byte order; events follow their own */
+static uint32_t evt_kind(const struct tipc_event *evt)
+{
+	uint32_t mask = TIPC_SUB_PORTS | TIPC_SUB_SERVICE | TIPC_SUB_CANCEL;
+
+	if (evt->s.filter & mask)
+		return evt->event;
+	return __builtin_bswap32(evt->event);
+}
+
+/* Same port, same range, same subscription */
+static bool evt_same(const struct tipc_event *a, const struct tipc_event *b)
+{
+	return a->found_lower == b->found_lower &&
+		a->found_upper == b->found_upper &&
+		a->port.ref == b->port.ref && a->port.node == b->port.node &&
+		!memcmp(&a->s, &b->s, sizeof(a->s));
+}
+
+static uint32_t evt_hash(const struct tipc_event *evt)
+{
+	uint32_t h = 2166136261u;
+	uint32_t v[5] = {evt->found_lower, evt->found_upper, evt->port.ref,
+			 evt->port.node, evt->s.seq.type};
+	int i;
+
+	for (i = 0; i < 5; i++)
+		h = (h ^ v[i]) * 16777619u;
+	return h ^ (h >> 15);
+}
+
+int tipc_srv_coalesce(struct tipc_event *evts, int n)
+{
+	uint32_t kind, sz = 16, h;
+	char *dead;
+	int *tbl;
+	int i, j, k;
+
+	if (n < 2)
+		return n;
+	while (sz < 2 * (uint32_t)n)
+		sz <<= 1;
+	tbl = malloc(sz * sizeof(*tbl));
+	dead = calloc(n, 1);
+	if (!tbl || !dead) {
+		free(tbl);
+		free(dead);
+		return n;
+	}
+	memset(tbl, 0xff, sz * sizeof(*tbl));
+
+	/* The table holds the latest event per key; an opposite event
+	 * cancels it if it is still alive
+	 */
+	for (i = 0; i < n; i++) {
+		kind = evt_kind(&evts[i]);
+		if (kind != TIPC_PUBLISHED && kind != TIPC_WITHDRAWN)
+			continue;
+		h = evt_hash(&evts[i]) & (sz - 1);
+		while ((j = tbl[h]) >= 0 && !evt_same(&evts[j], &evts[i]))
+			h = (h + 1) & (sz - 1);
+		if (j >= 0 && !dead[j] && evt_kind(&evts[j]) != kind) {
+			dead[i] = dead[j] = 1;
+			continue;
+		}
+		tbl[h] = i;
+	}
+	for (i = 0, k = 0; i < n; i++) {
+		if (!dead[i])
+			evts[k++] = evts[i];
+	}
+	free(tbl);
+	free(dead);
+	return k;
+}
+
+struct tipc_srv_coal *tipc_srv_coal_create(int sd, int window_ms, int max)
+{
+	struct tipc_srv_coal *c;
+
+	if (window_ms < 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	c = calloc(1, sizeof(*c));
+	if (!c)
+		return NULL;
+	c->cap = max > 0 ? max : COAL_MAX_DFLT;
+	c->evts = malloc(c->cap * sizeof(*c->evts));
+	if (!c->evts) {
+		free(c);
+		return NULL;
+	}
+	c->sd = sd;
+	c->window_ns = (uint64_t)window_ms * 1000000;
+	return c;
+}
+
+void tipc_srv_coal_destroy(struct tipc_srv_coal *c)
+{
+	if (!c)
+		return;
+	free(c->evts);
+	free(c);
+}
+
+int tipc_srv_coal_pending(const struct tipc_srv_coal *c)
+{
+	return c->cnt;
+}
+
+int tipc_srv_coal_timeout(const struct tipc_srv_coal *c)
+{
+	uint64_t elapsed;
+
+	if (!c->cnt)
+		return -1;
+	elapsed = stats_now() - c->first_ns;
+	if (elapsed >= c->window_ns)
+		return 0;
+	return (c->window_ns - elapsed + 999999) / 1000000;
+}
+
+int tipc_srv_coal_read(struct tipc_srv_coal *c, struct tipc_event *evts,
+		       int max)
+{
+	int n, added = 0;
+
+	/* Take in everything there is, as long as there is room */
+	while (!c->lost && c->cnt < c->cap) {
+		n = tipcc__srv_evts_read(c->sd, c->evts + c->cnt,
+					 c->cap - c->cnt, MSG_DONTWAIT);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				c->lost = true;
+			break;
+		}
+		if (!c->cnt)
+			c->first_ns = stats_now();
+		c->cnt += n;
+		added += n;
+	}
+	if (added)
+		c->cnt = tipc_srv_coalesce(c->evts, c->cnt);
+
+	/* Hold events back until the window has passed, unless full */
+	if (!c->cnt) {
+		if (!c->lost)
+			return 0;
+		errno = ECONNRESET;
+		return -1;
+	}
+	if (!c->lost && c->cnt < c->cap &&
+	    stats_now() - c->first_ns < c->window_ns)
+		return 0;
+	n = c->cnt < max ? c->cnt : max;
+	memcpy(evts, c->evts, n * sizeof(*evts));
+	c->cnt -= n;
+	memmove(c->evts, c->evts + n, c->cnt * sizeof(*evts));
+	return n;
+}
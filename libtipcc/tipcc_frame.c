@@ -0,0 +1,323 @@
+/* ------------------------------------------------------------------------
+ *
+ * tipcc_frame.c
+ *
+ * Short description: TIPC C binding API, framed records over stream sockets
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ * ------------------------------------------------------------------------
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include "tipcc_int.h"
+
+#define FRAME_HDR       4
+#define FRAME_RCVBUF    (256 * 1024)
+#define FRAME_TX_SLACK  4096
+
+struct tipc_frame {
+	int sd;
+
+	/* Send side: records in tx[tx_off..tx_len) are not yet sent */
+	char *tx;
+	size_t tx_cap;
+	size_t tx_off;
+	size_t tx_len;
+	size_t cork_bytes;
+	uint64_t cork_ns;
+	uint64_t first_ns;
+
+	/* Receive side: ring is mapped twice in a row, so that the len bytes
+	 * starting at head are always contiguous. done is what the views
+	 * returned last time cover
+	 */
+	char *ring;
+	size_t ring_sz;
+	size_t head;
+	size_t len;
+	size_t done;
+};
+
+static char *ring_map(size_t sz)
+{
+	char *base;
+	int fd;
+
+	fd = memfd_create("tipcc_frame", MFD_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+	if (ftruncate(fd, sz))
+		goto err;
+	base = mmap(NULL, 2 * sz, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+		    -1, 0);
+	if (base == MAP_FAILED)
+		goto err;
+	if (mmap(base, sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+		 fd, 0) == MAP_FAILED ||
+	    mmap(base + sz, sz, PROT_READ | PROT_WRITE,
+		 MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(base, 2 * sz);
+		goto err;
+	}
+	close(fd);
+	return base;
+err:
+	close(fd);
+	return NULL;
+}
+
+struct tipc_frame *tipc_frame_create(int sd, size_t cork_bytes,
+				     unsigned int cork_us, size_t rcvbuf)
+{
+	size_t pg = sysconf(_SC_PAGESIZE);
+	struct tipc_frame *f;
+
+	if (sd < 0)
+		return NULL;
+	f = calloc(1, sizeof(*f));
+	if (!f)
+		return NULL;
+	f->sd = sd;
+	f->cork_bytes = cork_bytes;
+	f->cork_ns = cork_us * 1000ull;
+	f->tx_cap = cork_bytes + FRAME_TX_SLACK;
+	f->tx = malloc(f->tx_cap);
+	if (!rcvbuf)
+		rcvbuf = FRAME_RCVBUF;
+	f->ring_sz = (rcvbuf + pg - 1) & ~(pg - 1);
+	f->ring = ring_map(f->ring_sz);
+	if (!f->tx || !f->ring) {
+		tipc_frame_destroy(f);
+		return NULL;
+	}
+	return f;
+}
+
+void tipc_frame_destroy(struct tipc_frame *f)
+{
+	if (!f)
+		return;
+	if (f->ring)
+		munmap(f->ring, 2 * f->ring_sz);
+	free(f->tx);
+	free(f);
+}
+
+size_t tipc_frame_pending(const struct tipc_frame *f)
+{
+	return f->tx_len - f->tx_off;
+}
+
+/* Make room for need more bytes at tx_len */
+static int frame_reserve(struct tipc_frame *f, size_t need)
+{
+	size_t cap;
+	char *tx;
+
+	if (f->tx_len + need <= f->tx_cap)
+		return 0;
+	if (f->tx_off) {
+		memmove(f->tx, f->tx + f->tx_off, f->tx_len - f->tx_off);
+		f->tx_len -= f->tx_off;
+		f->tx_off = 0;
+		if (f->tx_len + need <= f->tx_cap)
+			return 0;
+	}
+	cap = f->tx_cap * 2;
+	if (cap < f->tx_len + need)
+		cap = f->tx_len + need;
+	tx = realloc(f->tx, cap);
+	if (!tx)
+		return -1;
+	f->tx = tx;
+	f->tx_cap = cap;
+	return 0;
+}
+
+static void frame_append(struct tipc_frame *f, const void *data, size_t len)
+{
+	if (f->tx_len == f->tx_off && f->cork_ns)
+		f->first_ns = stats_now();
+	memcpy(f->tx + f->tx_len, data, len);
+	f->tx_len += len;
+}
+
+int tipc_frame_flush(struct tipc_frame *f)
+{
+	uint64_t t0;
+	ssize_t rc;
+
+	while (f->tx_off < f->tx_len) {
+		t0 = stats_t0();
+		rc = send(f->sd, f->tx + f->tx_off, f->tx_len - f->tx_off,
+			  MSG_NOSIGNAL);
+		stats_tx(f->sd, rc, t0);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		f->tx_off += rc;
+	}
+	f->tx_off = f->tx_len = 0;
+	return 0;
+}
+
+/* Send a large record without copying; what the socket does not take
+ * is buffered
+ */
+static int frame_send_direct(struct tipc_frame *f, uint32_t *hdr,
+			     const void *rec, size_t len)
+{
+	struct iovec iov[2] = {{hdr, FRAME_HDR}, {(void *)rec, len}};
+	struct msghdr msg = {0, };
+	uint64_t t0 = stats_t0();
+	ssize_t rc;
+
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+	rc = sendmsg(f->sd, &msg, MSG_NOSIGNAL);
+	stats_tx(f->sd, rc, t0);
+	if (rc < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			return -1;
+		rc = 0;
+	}
+	if ((size_t)rc == FRAME_HDR + len)
+		return 0;
+	if (frame_reserve(f, FRAME_HDR + len - rc))
+		return -1;
+	if (rc < FRAME_HDR) {
+		frame_append(f, (char *)hdr + rc, FRAME_HDR - rc);
+		rc = FRAME_HDR;
+	}
+	frame_append(f, (const char *)rec + rc - FRAME_HDR,
+		     len + FRAME_HDR - rc);
+	return tipc_frame_flush(f) && errno != EAGAIN ? -1 : 0;
+}
+
+int tipc_frame_send(struct tipc_frame *f, const void *rec, size_t len)
+{
+	uint32_t hdr = htonl(len);
+	size_t pending;
+
+	if (len > UINT32_MAX) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+	if (!tipc_frame_pending(f) && FRAME_HDR + len >= f->cork_bytes)
+		return frame_send_direct(f, &hdr, rec, len);
+
+	if (frame_reserve(f, FRAME_HDR + len))
+		return -1;
+	frame_append(f, &hdr, FRAME_HDR);
+	frame_append(f, rec, len);
+	pending = tipc_frame_pending(f);
+	if (pending < f->cork_bytes &&
+	    (!f->cork_ns || stats_now() - f->first_ns < f->cork_ns))
+		return 0;
+	return tipc_frame_flush(f) && errno != EAGAIN ? -1 : 0;
+}
+
+int tipc_frame_timeout(const struct tipc_frame *f)
+{
+	uint64_t elapsed;
+
+	if (!tipc_frame_pending(f) || !f->cork_ns)
+		return -1;
+	elapsed = stats_now() - f->first_ns;
+	if (elapsed >= f->cork_ns)
+		return 0;
+	return (f->cork_ns - elapsed + 999999) / 1000000;
+}
+
+/* Collect views of complete records; returns number found */
+static int frame_parse(struct tipc_frame *f, struct iovec *recs, int max)
+{
+	char *p = f->ring + f->head;
+	size_t off = 0;
+	uint32_t reclen;
+	int n = 0;
+
+	while (n < max && f->len - off >= FRAME_HDR) {
+		memcpy(&reclen, p + off, FRAME_HDR);
+		reclen = ntohl(reclen);
+		if (f->len - off - FRAME_HDR < reclen)
+			break;
+		recs[n].iov_base = p + off + FRAME_HDR;
+		recs[n].iov_len = reclen;
+		off += FRAME_HDR + reclen;
+		n++;
+	}
+	f->done = off;
+	return n;
+}
+
+int tipc_frame_recv(struct tipc_frame *f, struct iovec *recs, int max)
+{
+	uint32_t reclen;
+	uint64_t t0;
+	ssize_t rc;
+	size_t tail;
+	int n;
+
+	/* Views handed out last time are released now */
+	f->head = (f->head + f->done) % f->ring_sz;
+	f->len -= f->done;
+	f->done = 0;
+
+	for (;;) {
+		n = frame_parse(f, recs, max);
+		if (n || max <= 0)
+			return n;
+		if (f->len >= FRAME_HDR) {
+			memcpy(&reclen, f->ring + f->head, FRAME_HDR);
+			if (ntohl(reclen) > f->ring_sz - FRAME_HDR) {
+				errno = EMSGSIZE;
+				return -1;
+			}
+		}
+		tail = (f->head + f->len) % f->ring_sz;
+		t0 = stats_t0();
+		rc = recv(f->sd, f->ring + tail, f->ring_sz - f->len, 0);
+		stats_rx(f->sd, rc, false, t0);
+		if (rc <= 0)
+			return rc;
+		f->len += rc;
+	}
+}
@@ -0,0 +1,226 @@
+/* ------------------------------------------------------------------------
+ *
+ * tipcc_int.h
+ *
+ * Short description: TIPC C binding API, internals shared by the library sources
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ * ------------------------------------------------------------------------
+ */
+
+#ifndef TIPCC_INT_H_
+#define TIPCC_INT_H_
+
+#include <errno.h>
+#include <time.h>
+#include "tipcc.h"
+
+/* Shared between the library's files only: hidden from the shared
+ * library's users, and prefixed tipcc__ to stay out of their way when
+ * linked statically
+ */
+#pragma GCC visibility push(hidden)
+
+extern unsigned int tipcc__stats_flags;
+extern struct tipc_stats_map *tipcc__stats_tbl;
+
+void tipcc__stats_activate(struct tipc_stats_map *m, int sd);
+
+static inline void stats_add(uint64_t *ctr, uint64_t val)
+{
+	__atomic_fetch_add(ctr, val, __ATOMIC_RELAXED);
+}
+
+static inline struct tipc_sock_stats *stats_get(int sd)
+{
+	struct tipc_stats_map *m;
+	struct tipc_stats_slot *s;
+
+	if (!__atomic_load_n(&tipcc__stats_flags, __ATOMIC_RELAXED))
+		return NULL;
+	m = __atomic_load_n(&tipcc__stats_tbl, __ATOMIC_ACQUIRE);
+	if (!m || sd < 0 || (unsigned int)sd >= m->max_socks)
+		return NULL;
+	s = &m->slots[sd];
+	if (!__atomic_load_n(&s->active, __ATOMIC_RELAXED))
+		tipcc__stats_activate(m, sd);
+	return &s->st;
+}
+
+static inline uint64_t stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Start time of a call, or 0 if latency is not measured */
+static inline uint64_t stats_t0(void)
+{
+	if (!(__atomic_load_n(&tipcc__stats_flags, __ATOMIC_RELAXED) &
+	      TIPC_STATS_LATENCY))
+		return 0;
+	return stats_now();
+}
+
+static inline void stats_lat(uint64_t *hist, uint64_t t0)
+{
+	uint64_t d;
+	int b;
+
+	if (!t0)
+		return;
+	d = stats_now() - t0;
+	b = d ? 63 - __builtin_clzll(d) : 0;
+	if (b >= TIPC_STATS_BUCKETS)
+		b = TIPC_STATS_BUCKETS - 1;
+	stats_add(&hist[b], 1);
+}
+
+/* Account result of a send or receive call; errno is left untouched */
+static inline void stats_tx(int sd, long rc, uint64_t t0)
+{
+	struct tipc_sock_stats *st = stats_get(sd);
+
+	if (!st)
+		return;
+	stats_lat(st->tx_lat, t0);
+	if (rc >= 0) {
+		stats_add(&st->tx_msgs, 1);
+		stats_add(&st->tx_bytes, rc);
+	} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+		stats_add(&st->eagain, 1);
+	} else {
+		stats_add(&st->errors, 1);
+	}
+}
+
+static inline void stats_rx(int sd, long rc, bool rejected, uint64_t t0)
+{
+	struct tipc_sock_stats *st = stats_get(sd);
+
+	if (!st)
+		return;
+	stats_lat(st->rx_lat, t0);
+	if (rc >= 0) {
+		stats_add(&st->rx_msgs, 1);
+		stats_add(&st->rx_bytes, rc);
+		if (rejected)
+			stats_add(&st->rejected, 1);
+	} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+		stats_add(&st->eagain, 1);
+	} else if (errno != EINTR) {
+		stats_add(&st->errors, 1);
+	}
+}
+
+/* Connect is counted on the connecting socket, accept on the listener */
+static inline void stats_conn(int sd, int rc, bool accept, uint64_t t0)
+{
+	struct tipc_sock_stats *st = stats_get(sd);
+
+	if (!st)
+		return;
+	stats_lat(st->conn_lat, t0);
+	if (rc >= 0)
+		stats_add(accept ? &st->accepts : &st->connects, 1);
+	else if (errno == EAGAIN || errno == EWOULDBLOCK ||
+		 errno == EINPROGRESS)
+		stats_add(&st->eagain, 1);
+	else if (errno != EINTR)
+		stats_add(&st->errors, 1);
+}
+
+/* Receive into the buffers already set in ctx->msg */
+int tipcc__rcv_ctx_recv(struct tipc_rcv_ctx *ctx, struct tipc_addr *src,
+			struct tipc_addr *dst, int *err);
+
+/* Deadline calls leave SO_RCVTIMEO set for the next one. The value in
+ * force is cached per socket, 0 meaning none; plain blocking calls
+ * clear it before they wait
+ */
+#define DL_MAX_SOCKS 65536
+
+extern uint64_t *tipcc__dl_tmo;
+
+void tipcc__dl_clear(int sd);
+
+static inline void dl_check(int sd)
+{
+	uint64_t *tbl = __atomic_load_n(&tipcc__dl_tmo, __ATOMIC_ACQUIRE);
+
+	if (tbl && sd >= 0 && sd < DL_MAX_SOCKS &&
+	    __atomic_load_n(&tbl[sd], __ATOMIC_RELAXED))
+		tipcc__dl_clear(sd);
+}
+
+static inline void dl_forget(int sd)
+{
+	uint64_t *tbl = __atomic_load_n(&tipcc__dl_tmo, __ATOMIC_ACQUIRE);
+
+	if (tbl && sd >= 0 && sd < DL_MAX_SOCKS)
+		__atomic_store_n(&tbl[sd], 0, __ATOMIC_RELAXED);
+}
+
+/* Read up to max topology events; flags apply to the first one only */
+int tipcc__srv_evts_read(int sd, struct tipc_event *evts, int max,
+			 int flags);
+
+/* Node local shared memory transport */
+#define SHM_KERNEL (-2)
+
+struct shm_ring;
+
+extern bool tipcc__shm_on;
+extern struct shm_ring **tipcc__shm_rings;
+
+int tipcc__shm_sendto(int sd, const char *msg, size_t len,
+		      const struct tipc_addr *dst);
+int tipcc__shm_recvfrom(struct shm_ring *r, int sd, char *buf, size_t len,
+			struct tipc_addr *src, struct tipc_addr *dst, int *err);
+int tipcc__shm_recvmmsg(struct shm_ring *r, int sd, struct tipc_mmsg *msgs,
+			int num);
+void tipcc__shm_close(int sd);
+
+static inline struct shm_ring *shm_ring_get(int sd)
+{
+	struct shm_ring **tbl;
+
+	tbl = __atomic_load_n(&tipcc__shm_rings, __ATOMIC_ACQUIRE);
+	if (!tbl || sd < 0 || sd >= TIPC_SHM_MAX_SOCKS)
+		return NULL;
+	return __atomic_load_n(&tbl[sd], __ATOMIC_ACQUIRE);
+}
+
+#pragma GCC visibility pop
+
+#endif
@@ -0,0 +1,233 @@
+/* ------------------------------------------------------------------------
+ *
+ * tipcc_lb.c
+ *
+ * Short description: TIPC C binding API, client side load balancing
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ * ------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "tipcc.h"
+
+struct lb_port {
+	struct tipc_addr id;
+	unsigned int     outstanding;
+};
+
+struct tipc_lb {
+	struct tipc_dir *dir;
+	uint32_t         type;
+	uint32_t         instance;
+	tipc_domain_t    domain;
+	int              policy;
+	unsigned int     gen;
+	unsigned int     next;
+	tipc_domain_t    own_node;
+	int              port_cnt;
+	int              local_cnt;
+	struct lb_port   ports[TIPC_LB_MAX_PORTS];
+};
+
+static inline uint64_t mix64(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdull;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ull;
+	x ^= x >> 33;
+	return x;
+}
+
+/* Rebuild port list from directory, keeping counters of remaining ports.
+ * Node local ports are kept first, so that TIPC_LB_LOCAL can pick among
+ * the first local_cnt entries
+ */
+static void lb_refresh(struct tipc_lb *lb)
+{
+	struct tipc_addr ids[TIPC_LB_MAX_PORTS];
+	struct lb_port ports[TIPC_LB_MAX_PORTS];
+	int i, j, n, cnt = 0, local = 0;
+
+	if (!lb->own_node)
+		lb->own_node = tipc_own_node();
+	lb->gen = tipc_dir_gen(lb->dir);
+	n = tipc_dir_lookup(lb->dir, lb->type, lb->instance, lb->domain,
+			    ids, TIPC_LB_MAX_PORTS);
+	for (i = 0; i < n; i++) {
+		struct lb_port *p;
+
+		if (ids[i].domain == lb->own_node) {
+			memmove(&ports[local + 1], &ports[local],
+				(cnt - local) * sizeof(*ports));
+			p = &ports[local++];
+		} else {
+			p = &ports[cnt];
+		}
+		cnt++;
+		p->id = ids[i];
+		p->outstanding = 0;
+		for (j = 0; j < lb->port_cnt; j++) {
+			if (lb->ports[j].id.instance == ids[i].instance &&
+			    lb->ports[j].id.domain == ids[i].domain) {
+				p->outstanding = lb->ports[j].outstanding;
+				break;
+			}
+		}
+	}
+	memcpy(lb->ports, ports, cnt * sizeof(*ports));
+	lb->port_cnt = cnt;
+	lb->local_cnt = local;
+}
+
+struct tipc_lb *tipc_lb_create(struct tipc_dir *dir, uint32_t type,
+			       uint32_t instance, tipc_domain_t domain,
+			       int policy)
+{
+	struct tipc_lb *lb;
+
+	if (policy < TIPC_LB_RR || policy > TIPC_LB_HASH) {
+		errno = EINVAL;
+		return NULL;
+	}
+	lb = calloc(1, sizeof(*lb));
+	if (!lb)
+		return NULL;
+	lb->dir = dir;
+	lb->type = type;
+	lb->instance = instance;
+	lb->domain = domain;
+	lb->policy = policy;
+	if (tipc_dir_subscr(dir, type, instance, instance)) {
+		free(lb);
+		return NULL;
+	}
+	lb_refresh(lb);
+	return lb;
+}
+
+void tipc_lb_destroy(struct tipc_lb *lb)
+{
+	if (!lb)
+		return;
+	tipc_dir_unsubscr(lb->dir, lb->type, lb->instance, lb->instance);
+	free(lb);
+}
+
+int tipc_lb_pick(struct tipc_lb *lb, uint64_t key, struct tipc_addr *id)
+{
+	struct lb_port *p = NULL;
+	uint64_t w, best = 0;
+	int i, n;
+
+	if (lb->gen != tipc_dir_gen(lb->dir))
+		lb_refresh(lb);
+
+	/* Nothing known yet; subscription may just have been issued */
+	if (!lb->port_cnt && tipc_dir_update(lb->dir) > 0)
+		lb_refresh(lb);
+	if (!lb->port_cnt) {
+		errno = EHOSTUNREACH;
+		return -1;
+	}
+
+	switch (lb->policy) {
+	case TIPC_LB_RR:
+		p = &lb->ports[lb->next++ % lb->port_cnt];
+		break;
+	case TIPC_LB_LOCAL:
+		n = lb->local_cnt ? lb->local_cnt : lb->port_cnt;
+		p = &lb->ports[lb->next++ % n];
+		break;
+	case TIPC_LB_LEAST:
+		/* Start at a rotating offset so that ties are spread */
+		n = lb->next++;
+		for (i = 0; i < lb->port_cnt; i++) {
+			struct lb_port *q = &lb->ports[(n + i) % lb->port_cnt];
+
+			if (!p || q->outstanding < p->outstanding)
+				p = q;
+		}
+		break;
+	case TIPC_LB_HASH:
+		/* Rendezvous hashing: only keys of a lost port move */
+		for (i = 0; i < lb->port_cnt; i++) {
+			struct lb_port *q = &lb->ports[i];
+
+			w = mix64(key ^ mix64(((uint64_t)q->id.domain << 32) |
+					      q->id.instance));
+			if (!p || w > best) {
+				p = q;
+				best = w;
+			}
+		}
+		break;
+	}
+	p->outstanding++;
+	if (id)
+		*id = p->id;
+	return 0;
+}
+
+void tipc_lb_done(struct tipc_lb *lb, const struct tipc_addr *id)
+{
+	int i;
+
+	for (i = 0; i < lb->port_cnt; i++) {
+		struct lb_port *p = &lb->ports[i];
+
+		if (p->id.instance == id->instance &&
+		    p->id.domain == id->domain) {
+			if (p->outstanding)
+				p->outstanding--;
+			return;
+		}
+	}
+}
+
+int tipc_lb_sendto(int sd, struct tipc_lb *lb, uint64_t key,
+		   const char *msg, size_t len, struct tipc_addr *id)
+{
+	struct tipc_addr _id;
+	int rc;
+
+	if (tipc_lb_pick(lb, key, &_id))
+		return -1;
+	rc = tipc_sendto(sd, msg, len, &_id);
+	if (rc < 0)
+		tipc_lb_done(lb, &_id);
+	else if (id)
+		*id = _id;
+	return rc;
+}
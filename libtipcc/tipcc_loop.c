@@ -0,0 +1,798 @@
+/* ------------------------------------------------------------------------
+ *
+ * tipcc_loop.c
+ *
+ * Short description: TIPC C binding API, epoll based event loop
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ * ------------------------------------------------------------------------
+ */
+
+#define _GNU_SOURCE
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include "tipcc_int.h"
+
+#define LOOP_EVENTS   256
+#define LOOP_BUDGET   8	/* Batches per socket before others get a turn */
+#define LOOP_BUF_SZ   TIPC_MAX_USER_MSG_SIZE
+#define SENDQ_LIMIT   (4 << 20)
+
+enum {
+	ENT_NONE,
+	ENT_MSG,
+	ENT_ACCEPT,
+	ENT_SRV,
+	ENT_TIMER,
+	ENT_WAKEUP
+};
+
+/* Queued message, a pool buffer itself. data is either the copy that
+ * follows, or a referenced pool buffer. off is what a stream socket has
+ * already taken
+ */
+struct sq_msg {
+	struct sq_msg     *next;
+	struct tipc_addr   dst;
+	bool               connected;
+	char              *data;
+	void              *ref;
+	size_t             len;
+	size_t             off;
+};
+
+struct loop_sendq {
+	struct sq_msg     *head;
+	struct sq_msg    **tail;
+	size_t             bytes;
+	size_t             limit;
+	size_t             high;
+	size_t             low;
+	bool               above;
+	tipc_loop_wm_cb    cb;
+	void              *arg;
+};
+
+struct loop_ent {
+	int   type;
+	bool  ready;
+	bool  queued;	/* in ready list, possibly no longer ready */
+	bool  periodic;
+	bool  conn;
+	uint32_t events;
+	struct loop_sendq *sq;
+	union {
+		tipc_loop_msg_cb    msg;
+		tipc_loop_accept_cb accept;
+		tipc_loop_srv_cb    srv;
+		tipc_loop_timer_cb  timer;
+	} cb;
+	void *arg;
+};
+
+struct tipc_loop {
+	int               epfd;
+	int               wakeup_fd;
+	bool              stop;
+	struct loop_ent  *ents;
+	int               ents_sz;
+	int              *ready;	/* ents_sz entries, sd listed once */
+	int               ready_cnt;
+	char             *bufs;
+	struct tipc_mmsg  msgs[TIPC_MMSG_MAX];
+};
+
+/* The ready list grows along, so that marking a socket ready never fails */
+static int loop_grow(struct tipc_loop *loop, int sd)
+{
+	struct loop_ent *ents;
+	int *ready;
+	int sz = loop->ents_sz ? loop->ents_sz : 64;
+
+	while (sz <= sd)
+		sz *= 2;
+	ready = realloc(loop->ready, sz * sizeof(*ready));
+	if (!ready)
+		return -1;
+	loop->ready = ready;
+	ents = realloc(loop->ents, sz * sizeof(*ents));
+	if (!ents)
+		return -1;
+	memset(&ents[loop->ents_sz], 0,
+	       (sz - loop->ents_sz) * sizeof(*ents));
+	loop->ents = ents;
+	loop->ents_sz = sz;
+	return 0;
+}
+
+static struct loop_ent *loop_add(struct tipc_loop *loop, int sd, int type,
+				 void *arg)
+{
+	struct epoll_event ev = {.events = EPOLLIN | EPOLLET, .data.fd = sd};
+	struct loop_ent *e;
+	bool queued;
+	int flags;
+
+	if (sd < 0) {
+		errno = EBADF;
+		return NULL;
+	}
+	if (sd >= loop->ents_sz && loop_grow(loop, sd))
+		return NULL;
+	if (loop->ents[sd].type != ENT_NONE) {
+		errno = EEXIST;
+		return NULL;
+	}
+	flags = fcntl(sd, F_GETFL);
+	if (flags < 0 || fcntl(sd, F_SETFL, flags | O_NONBLOCK) < 0)
+		return NULL;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, sd, &ev))
+		return NULL;
+	e = &loop->ents[sd];
+	queued = e->queued;
+	memset(e, 0, sizeof(*e));
+	e->queued = queued;
+	e->type = type;
+	e->events = ev.events;
+	e->arg = arg;
+	return e;
+}
+
+static int loop_set_events(struct tipc_loop *loop, int sd, uint32_t events)
+{
+	struct epoll_event ev = {.events = events | EPOLLET, .data.fd = sd};
+
+	if (loop->ents[sd].events == ev.events)
+		return 0;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_MOD, sd, &ev))
+		return -1;
+	loop->ents[sd].events = ev.events;
+	return 0;
+}
+
+static void sq_msg_free(struct sq_msg *m)
+{
+	tipc_buf_put(m->ref);
+	tipc_buf_put(m);
+}
+
+static void sendq_free(struct loop_sendq *sq)
+{
+	struct sq_msg *m, *next;
+
+	if (!sq)
+		return;
+	for (m = sq->head; m; m = next) {
+		next = m->next;
+		sq_msg_free(m);
+	}
+	free(sq);
+}
+
+static void loop_set_ready(struct tipc_loop *loop, int sd)
+{
+	struct loop_ent *e = &loop->ents[sd];
+
+	e->ready = true;
+	if (e->queued)
+		return;
+	e->queued = true;
+	loop->ready[loop->ready_cnt++] = sd;
+}
+
+struct tipc_loop *tipc_loop_create(void)
+{
+	struct tipc_loop *loop = calloc(1, sizeof(*loop));
+
+	if (!loop)
+		return NULL;
+	loop->epfd = -1;
+	loop->wakeup_fd = -1;
+	loop->bufs = malloc(TIPC_MMSG_MAX * LOOP_BUF_SZ);
+	if (!loop->bufs)
+		goto err;
+	loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epfd < 0)
+		goto err;
+	loop->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (loop->wakeup_fd < 0)
+		goto err;
+	if (!loop_add(loop, loop->wakeup_fd, ENT_WAKEUP, NULL))
+		goto err;
+	return loop;
+err:
+	tipc_loop_destroy(loop);
+	return NULL;
+}
+
+void tipc_loop_destroy(struct tipc_loop *loop)
+{
+	int sd;
+
+	if (!loop)
+		return;
+
+	/* Timers belong to the loop, sockets to the user */
+	for (sd = 0; sd < loop->ents_sz; sd++) {
+		if (loop->ents[sd].type == ENT_TIMER)
+			close(sd);
+		sendq_free(loop->ents[sd].sq);
+	}
+	if (loop->wakeup_fd >= 0)
+		close(loop->wakeup_fd);
+	if (loop->epfd >= 0)
+		close(loop->epfd);
+	free(loop->ents);
+	free(loop->ready);
+	free(loop->bufs);
+	free(loop);
+}
+
+int tipc_loop_add_msg(struct tipc_loop *loop, int sd, tipc_loop_msg_cb cb,
+		      void *arg)
+{
+	struct loop_ent *e = loop_add(loop, sd, ENT_MSG, arg);
+	socklen_t len = sizeof(int);
+	int type;
+
+	if (!e)
+		return -1;
+	e->cb.msg = cb;
+	if (!getsockopt(sd, SOL_SOCKET, SO_TYPE, &type, &len))
+		e->conn = type == SOCK_SEQPACKET || type == SOCK_STREAM;
+	return 0;
+}
+
+int tipc_loop_add_accept(struct tipc_loop *loop, int sd,
+			 tipc_loop_accept_cb cb, void *arg)
+{
+	struct loop_ent *e = loop_add(loop, sd, ENT_ACCEPT, arg);
+
+	if (!e)
+		return -1;
+	e->cb.accept = cb;
+	return 0;
+}
+
+int tipc_loop_add_srv(struct tipc_loop *loop, int sd, tipc_loop_srv_cb cb,
+		      void *arg)
+{
+	struct loop_ent *e = loop_add(loop, sd, ENT_SRV, arg);
+
+	if (!e)
+		return -1;
+	e->cb.srv = cb;
+	return 0;
+}
+
+int tipc_loop_del(struct tipc_loop *loop, int sd)
+{
+	if (sd < 0 || sd >= loop->ents_sz || loop->ents[sd].type == ENT_NONE) {
+		errno = ENOENT;
+		return -1;
+	}
+	epoll_ctl(loop->epfd, EPOLL_CTL_DEL, sd, NULL);
+
+	/* Any entry left in ready list is skipped as not ready */
+	loop->ents[sd].type = ENT_NONE;
+	loop->ents[sd].ready = false;
+	sendq_free(loop->ents[sd].sq);
+	loop->ents[sd].sq = NULL;
+	return 0;
+}
+
+static struct loop_sendq *sendq_get(struct tipc_loop *loop, int sd)
+{
+	struct loop_sendq *sq;
+
+	if (sd < 0 || sd >= loop->ents_sz || loop->ents[sd].type != ENT_MSG) {
+		errno = ENOENT;
+		return NULL;
+	}
+	sq = loop->ents[sd].sq;
+	if (sq)
+		return sq;
+	sq = calloc(1, sizeof(*sq));
+	if (!sq)
+		return NULL;
+	sq->tail = &sq->head;
+	sq->limit = SENDQ_LIMIT;
+	sq->high = SENDQ_LIMIT / 4 * 3;
+	sq->low = SENDQ_LIMIT / 4;
+	loop->ents[sd].sq = sq;
+	return sq;
+}
+
+int tipc_loop_sendq(struct tipc_loop *loop, int sd, size_t limit,
+		    size_t high, size_t low, tipc_loop_wm_cb cb, void *arg)
+{
+	struct loop_sendq *sq;
+
+	if (low > high || high > limit) {
+		errno = EINVAL;
+		return -1;
+	}
+	sq = sendq_get(loop, sd);
+	if (!sq)
+		return -1;
+	sq->limit = limit;
+	sq->high = high;
+	sq->low = low;
+	sq->cb = cb;
+	sq->arg = arg;
+	return 0;
+}
+
+size_t tipc_loop_sendq_bytes(struct tipc_loop *loop, int sd)
+{
+	if (sd < 0 || sd >= loop->ents_sz || !loop->ents[sd].sq)
+		return 0;
+	return loop->ents[sd].sq->bytes;
+}
+
+static int sendq_xmit(int sd, const struct tipc_addr *dst, const char *buf,
+		      size_t len)
+{
+	uint64_t t0;
+	int rc;
+
+	if (dst)
+		return tipc_sendto(sd, buf, len, dst);
+	t0 = stats_t0();
+	rc = send(sd, buf, len, MSG_NOSIGNAL);
+	stats_tx(sd, rc, t0);
+	return rc;
+}
+
+/* Send or queue; a queued message refers to buf if given, else is copied */
+static int loop_sendto(struct tipc_loop *loop, int sd, const char *msg,
+		       size_t len, const struct tipc_addr *dst, void *buf)
+{
+	struct loop_sendq *sq = sendq_get(loop, sd);
+	struct sq_msg *m, **prev;
+	int rc = 0;
+
+	if (!sq)
+		return -1;
+
+	/* Nothing queued: try directly, keeping message order */
+	if (!sq->head) {
+		rc = sendq_xmit(sd, dst, msg, len);
+		if (rc >= 0 && (size_t)rc == len)
+			return len;
+		if (rc < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+			return -1;
+		if (rc < 0)
+			rc = 0;
+	}
+
+	/* Remainder of a partial stream write must be queued regardless */
+	if (!rc && sq->bytes + len > sq->limit) {
+		errno = ENOBUFS;
+		return -1;
+	}
+	m = tipc_buf_alloc(sizeof(*m) + (buf ? 0 : len - rc));
+	if (!m)
+		return -1;
+	m->next = NULL;
+	m->connected = !dst;
+	if (dst)
+		m->dst = *dst;
+	m->len = len - rc;
+	m->off = 0;
+	if (buf) {
+		m->ref = tipc_buf_get(buf);
+		m->data = (char *)msg + rc;
+	} else {
+		m->ref = NULL;
+		m->data = (char *)(m + 1);
+		memcpy(m->data, msg + rc, m->len);
+	}
+	prev = sq->tail;
+	*sq->tail = m;
+	sq->tail = &m->next;
+	sq->bytes += m->len;
+
+	/* Cannot be drained; take it back unless partially sent */
+	if (loop_set_events(loop, sd, EPOLLIN | EPOLLOUT) && !rc) {
+		*prev = NULL;
+		sq->tail = prev;
+		sq->bytes -= m->len;
+		sq_msg_free(m);
+		return -1;
+	}
+	if (!sq->above && sq->bytes >= sq->high) {
+		sq->above = true;
+		if (sq->cb)
+			sq->cb(loop, sd, true, sq->arg);
+	}
+	return len;
+}
+
+int tipc_loop_sendto(struct tipc_loop *loop, int sd, const char *msg,
+		     size_t len, const struct tipc_addr *dst)
+{
+	return loop_sendto(loop, sd, msg, len, dst, NULL);
+}
+
+int tipc_loop_sendto_buf(struct tipc_loop *loop, int sd, void *buf,
+			 size_t len, const struct tipc_addr *dst)
+{
+	return loop_sendto(loop, sd, buf, len, dst, buf);
+}
+
+static void loop_drain(struct tipc_loop *loop, int sd)
+{
+	struct loop_sendq *sq = loop->ents[sd].sq;
+	struct sq_msg *m;
+	int rc;
+
+	while (sq && (m = sq->head)) {
+		rc = sendq_xmit(sd, m->connected ? NULL : &m->dst,
+				m->data + m->off, m->len - m->off);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return;
+		if (rc >= 0 && (size_t)rc < m->len - m->off) {
+			m->off += rc;
+			sq->bytes -= rc;
+			continue;
+		}
+
+		/* Sent, or failed for good; either way it leaves the queue */
+		sq->bytes -= m->len - m->off;
+		sq->head = m->next;
+		if (!sq->head)
+			sq->tail = &sq->head;
+		sq_msg_free(m);
+		if (sq->above && sq->bytes <= sq->low) {
+			sq->above = false;
+			if (sq->cb)
+				sq->cb(loop, sd, false, sq->arg);
+			if (loop->ents[sd].sq != sq)
+				return;
+		}
+	}
+	if (sq)
+		loop_set_events(loop, sd, EPOLLIN);
+}
+
+int tipc_loop_timer(struct tipc_loop *loop, int ms, bool periodic,
+		    tipc_loop_timer_cb cb, void *arg)
+{
+	struct itimerspec its = {{0, 0}, {ms / 1000, (ms % 1000) * 1000000}};
+	struct loop_ent *e;
+	int fd;
+
+	if (ms <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (periodic)
+		its.it_interval = its.it_value;
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	if (timerfd_settime(fd, 0, &its, NULL) < 0)
+		goto err;
+	e = loop_add(loop, fd, ENT_TIMER, arg);
+	if (!e)
+		goto err;
+	e->cb.timer = cb;
+	e->periodic = periodic;
+	return fd;
+err:
+	close(fd);
+	return -1;
+}
+
+int tipc_loop_timer_cancel(struct tipc_loop *loop, int id)
+{
+	if (id < 0 || id >= loop->ents_sz || loop->ents[id].type != ENT_TIMER) {
+		errno = ENOENT;
+		return -1;
+	}
+	tipc_loop_del(loop, id);
+	return close(id);
+}
+
+/* Each loop_xxx() handler returns true if socket may have more to read */
+static bool loop_msg(struct tipc_loop *loop, int sd)
+{
+	tipc_loop_msg_cb cb;
+	void *arg;
+	int i, n, got, budget = LOOP_BUDGET;
+	bool eof;
+
+	while (budget--) {
+		for (i = 0; i < TIPC_MMSG_MAX; i++) {
+			loop->msgs[i].buf = loop->bufs + i * LOOP_BUF_SZ;
+			loop->msgs[i].len = LOOP_BUF_SZ;
+		}
+		n = got = tipc_recvmmsg(sd, loop->msgs, TIPC_MMSG_MAX);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return false;
+
+		/* At end of a connection the rest of the batch is zero length
+		 * entries; messages before the first one are still delivered
+		 */
+		eof = n <= 0;
+		if (!eof && loop->ents[sd].conn) {
+			for (i = 0; i < n; i++) {
+				if (!loop->msgs[i].len && !loop->msgs[i].err)
+					break;
+			}
+			eof = i < n;
+			n = i;
+		}
+
+		/* Callback may add or remove entries; don't keep pointers */
+		if (n > 0) {
+			cb = loop->ents[sd].cb.msg;
+			arg = loop->ents[sd].arg;
+			cb(loop, sd, loop->msgs, n, arg);
+			if (loop->ents[sd].type != ENT_MSG)
+				return false;
+		}
+		if (eof) {
+			cb = loop->ents[sd].cb.msg;
+			arg = loop->ents[sd].arg;
+			tipc_loop_del(loop, sd);
+			cb(loop, sd, NULL, 0, arg);
+			return false;
+		}
+		if (got < TIPC_MMSG_MAX)
+			return false;
+	}
+	return true;
+}
+
+static bool loop_accept(struct tipc_loop *loop, int lsd)
+{
+	struct tipc_addr src;
+	int sd, budget = LOOP_BUDGET * TIPC_MMSG_MAX;
+
+	while (budget--) {
+		sd = tipc_accept(lsd, &src);
+		if (sd < 0 && (errno == EINTR || errno == ECONNABORTED))
+			continue;
+		if (sd < 0)
+			return false;
+		loop->ents[lsd].cb.accept(loop, lsd, sd, &src,
+					  loop->ents[lsd].arg);
+		if (loop->ents[lsd].type != ENT_ACCEPT)
+			return false;
+	}
+	return true;
+}
+
+static bool loop_srv(struct tipc_loop *loop, int sd)
+{
+	struct tipc_event evts[TIPC_MMSG_MAX];
+	struct tipc_addr srv, id;
+	bool up, expired;
+	tipc_loop_srv_cb cb;
+	void *arg;
+	int i, n, budget = LOOP_BUDGET;
+
+	while (budget--) {
+		n = tipcc__srv_evts_read(sd, evts, TIPC_MMSG_MAX, MSG_DONTWAIT);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return false;
+		cb = loop->ents[sd].cb.srv;
+		arg = loop->ents[sd].arg;
+		if (n < 0) {
+			tipc_loop_del(loop, sd);
+			cb(loop, sd, NULL, NULL, false, false, arg);
+			return false;
+		}
+		for (i = 0; i < n; i++) {
+			memset(&srv, 0, sizeof(srv));
+			memset(&id, 0, sizeof(id));
+			up = expired = false;
+			tipc_srv_evt_parse(&evts[i], &srv, &id, &up, &expired);
+			cb(loop, sd, &srv, &id, up, expired, arg);
+			if (loop->ents[sd].type != ENT_SRV)
+				return false;
+		}
+		if (n < TIPC_MMSG_MAX)
+			return false;
+	}
+	return true;
+}
+
+static void loop_timer(struct tipc_loop *loop, int fd)
+{
+	uint64_t expirations;
+
+	if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+		return;
+	loop->ents[fd].cb.timer(loop, fd, loop->ents[fd].arg);
+	if (loop->ents[fd].type == ENT_TIMER && !loop->ents[fd].periodic)
+		tipc_loop_timer_cancel(loop, fd);
+}
+
+static void loop_dispatch(struct tipc_loop *loop, int sd)
+{
+	uint64_t cnt;
+	bool more = false;
+
+	switch (loop->ents[sd].type) {
+	case ENT_MSG:
+		more = loop_msg(loop, sd);
+		break;
+	case ENT_ACCEPT:
+		more = loop_accept(loop, sd);
+		break;
+	case ENT_SRV:
+		more = loop_srv(loop, sd);
+		break;
+	case ENT_TIMER:
+		loop_timer(loop, sd);
+		break;
+	case ENT_WAKEUP:
+		while (read(sd, &cnt, sizeof(cnt)) > 0)
+			;
+		break;
+	default:
+		return;
+	}
+	if (!more)
+		loop->ents[sd].ready = false;
+	else if (!loop->ents[sd].ready)
+		loop_set_ready(loop, sd);
+}
+
+int tipc_loop_run(struct tipc_loop *loop)
+{
+	struct epoll_event ev[LOOP_EVENTS];
+	int i, n, sd, cnt;
+
+	while (!__atomic_load_n(&loop->stop, __ATOMIC_ACQUIRE)) {
+		n = epoll_wait(loop->epfd, ev, LOOP_EVENTS,
+			       loop->ready_cnt ? 0 : -1);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -1;
+
+		/* Sockets left unfinished in previous round go first.
+		 * Re-queued entries never overtake the read position
+		 */
+		cnt = loop->ready_cnt;
+		loop->ready_cnt = 0;
+		for (i = 0; i < cnt; i++) {
+			sd = loop->ready[i];
+			loop->ents[sd].queued = false;
+			if (!loop->ents[sd].ready)
+				continue;
+			loop->ents[sd].ready = false;
+			loop_dispatch(loop, sd);
+		}
+		for (i = 0; i < n; i++) {
+			sd = ev[i].data.fd;
+			if (ev[i].events & EPOLLOUT)
+				loop_drain(loop, sd);
+			if (ev[i].events & ~EPOLLOUT)
+				loop_dispatch(loop, sd);
+		}
+	}
+	loop->stop = false;
+	return 0;
+}
+
+void tipc_loop_stop(struct tipc_loop *loop)
+{
+	uint64_t one = 1;
+
+	__atomic_store_n(&loop->stop, true, __ATOMIC_RELEASE);
+	if (write(loop->wakeup_fd, &one, sizeof(one)) < 0)
+		return;
+}
+
+struct loop_thread {
+	pthread_t            tid;
+	int                  idx;
+	tipc_loop_setup_cb   setup;
+	void                *arg;
+	int                  rc;
+};
+
+static void *loop_thread_main(void *p)
+{
+	struct loop_thread *t = p;
+	struct tipc_loop *loop;
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	cpu_set_t cpus;
+
+	if (ncpus > 0) {
+		CPU_ZERO(&cpus);
+		CPU_SET(t->idx % ncpus, &cpus);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	}
+	t->rc = -1;
+	loop = tipc_loop_create();
+	if (!loop)
+		return NULL;
+	t->rc = t->setup(loop, t->idx, t->arg);
+	if (!t->rc)
+		t->rc = tipc_loop_run(loop);
+	tipc_loop_destroy(loop);
+	return NULL;
+}
+
+int tipc_loop_run_threads(int num, tipc_loop_setup_cb setup, void *arg)
+{
+	struct loop_thread *threads;
+	int i, started, rc = 0;
+
+	if (num <= 0)
+		num = sysconf(_SC_NPROCESSORS_ONLN);
+	if (num <= 0)
+		num = 1;
+	threads = calloc(num, sizeof(*threads));
+	if (!threads)
+		return -1;
+
+	/* Set up default context before threads start using it */
+	tipc_own_node();
+
+	for (started = 0; started < num; started++) {
+		threads[started].idx = started;
+		threads[started].setup = setup;
+		threads[started].arg = arg;
+		if (pthread_create(&threads[started].tid, NULL,
+				   loop_thread_main, &threads[started]))
+			break;
+	}
+	for (i = 0; i < started; i++) {
+		pthread_join(threads[i].tid, NULL);
+		if (threads[i].rc && !rc)
+			rc = threads[i].rc;
+	}
+	if (started < num)
+		rc = -1;
+	free(threads);
+	return rc;
+}
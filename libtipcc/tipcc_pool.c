@@ -0,0 +1,361 @@
+/* ------------------------------------------------------------------------
+ *
+ * tipcc_pool.c
+ *
+ * Short description: TIPC C API, connection pool
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ * ------------------------------------------------------------------------
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <linux/tipc.h>
+#include "tipcc.h"
+
+#define POOL_LOOKUP_MAX 64
+
+struct pool_conn {
+	int              sd;
+	bool             busy;
+	bool             dead;
+	bool             seen;
+	struct tipc_addr srv;
+	struct tipc_addr peer;
+	uint64_t         used;
+};
+
+struct tipc_cpool {
+	struct tipc_dir  *dir;
+	int               sk_type;
+	int               max;
+	int               max_idle;
+	int               cnt;
+	unsigned int      gen;
+	uint64_t          clock;
+	struct pool_conn *conns;
+	struct pollfd    *pfds;
+	int               srv_cnt;
+	int               srv_cap;
+	struct tipc_addr *srvs;
+};
+
+static bool srv_equal(const struct tipc_addr *a, const struct tipc_addr *b)
+{
+	return a->type == b->type && a->instance == b->instance &&
+		a->domain == b->domain;
+}
+
+static void pool_close(struct tipc_cpool *pool, struct pool_conn *c)
+{
+	tipc_close(c->sd);
+	c->sd = -1;
+	pool->cnt--;
+}
+
+/* Subscribe once per service, so that withdrawn ports become visible */
+static void pool_watch(struct tipc_cpool *pool, const struct tipc_addr *srv)
+{
+	struct tipc_addr *srvs;
+	int i, cap;
+
+	if (!pool->dir)
+		return;
+	for (i = 0; i < pool->srv_cnt; i++) {
+		if (srv_equal(&pool->srvs[i], srv))
+			return;
+	}
+	if (pool->srv_cnt == pool->srv_cap) {
+		cap = pool->srv_cap ? 2 * pool->srv_cap : 8;
+		srvs = realloc(pool->srvs, cap * sizeof(*srvs));
+		if (!srvs)
+			return;
+		pool->srvs = srvs;
+		pool->srv_cap = cap;
+	}
+	if (tipc_dir_subscr(pool->dir, srv->type, srv->instance, srv->instance))
+		return;
+	pool->srvs[pool->srv_cnt++] = *srv;
+}
+
+/* The peer of a connection is the socket accepting it, not the published
+ * one, so a connection is dead once its peer node has been seen serving
+ * srv in the directory and no longer does. A node never seen may just be
+ * waiting for its publication event
+ */
+static int pool_check_dir(struct tipc_cpool *pool)
+{
+	struct tipc_addr ids[POOL_LOOKUP_MAX];
+	struct pool_conn *c;
+	int i, j, n, closed = 0;
+
+	if (!pool->dir || pool->gen == tipc_dir_gen(pool->dir))
+		return 0;
+	pool->gen = tipc_dir_gen(pool->dir);
+	for (i = 0; i < pool->max; i++) {
+		c = &pool->conns[i];
+		if (c->sd < 0 || c->dead)
+			continue;
+		n = tipc_dir_lookup(pool->dir, c->srv.type, c->srv.instance,
+				    c->srv.domain, ids, POOL_LOOKUP_MAX);
+		for (j = 0; j < n; j++) {
+			if (ids[j].domain == c->peer.domain)
+				break;
+		}
+		if (j < n) {
+			c->seen = true;
+			continue;
+		}
+		if (!c->seen || n == POOL_LOOKUP_MAX)
+			continue;
+		if (c->busy) {
+			c->dead = true;
+			continue;
+		}
+		pool_close(pool, c);
+		closed++;
+	}
+	return closed;
+}
+
+/* An idle connection has nothing to read; anything there means the peer
+ * has closed it or broken the protocol
+ */
+static bool pool_alive(int sd)
+{
+	struct pollfd pfd = {.fd = sd, .events = POLLIN | POLLRDHUP};
+
+	return poll(&pfd, 1, 0) == 0;
+}
+
+struct tipc_cpool *tipc_cpool_create(struct tipc_dir *dir, int sk_type,
+				     int max, int max_idle)
+{
+	struct tipc_cpool *pool;
+	int i;
+
+	if ((sk_type != SOCK_SEQPACKET && sk_type != SOCK_STREAM) ||
+	    max <= 0 || max_idle < 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+	pool->conns = calloc(max, sizeof(*pool->conns));
+	pool->pfds = calloc(max, sizeof(*pool->pfds));
+	if (!pool->conns || !pool->pfds) {
+		free(pool->conns);
+		free(pool->pfds);
+		free(pool);
+		return NULL;
+	}
+	for (i = 0; i < max; i++)
+		pool->conns[i].sd = -1;
+	pool->dir = dir;
+	pool->sk_type = sk_type;
+	pool->max = max;
+	pool->max_idle = max_idle;
+	if (dir)
+		pool->gen = tipc_dir_gen(dir);
+	return pool;
+}
+
+void tipc_cpool_destroy(struct tipc_cpool *pool)
+{
+	int i;
+
+	if (!pool)
+		return;
+	for (i = 0; i < pool->max; i++) {
+		if (pool->conns[i].sd >= 0)
+			pool_close(pool, &pool->conns[i]);
+	}
+	for (i = 0; i < pool->srv_cnt; i++)
+		tipc_dir_unsubscr(pool->dir, pool->srvs[i].type,
+				  pool->srvs[i].instance,
+				  pool->srvs[i].instance);
+	free(pool->srvs);
+	free(pool->pfds);
+	free(pool->conns);
+	free(pool);
+}
+
+int tipc_cpool_get(struct tipc_cpool *pool, const struct tipc_addr *srv)
+{
+	struct pool_conn *c, *best, *free_slot, *lru;
+	struct sockaddr_tipc addr;
+	socklen_t sz = sizeof(addr);
+	int i, sd;
+
+	if (!srv) {
+		errno = EINVAL;
+		return -1;
+	}
+	pool_check_dir(pool);
+
+	/* Most recently used idle connection first; it is the warmest */
+	while (1) {
+		best = NULL;
+		for (i = 0; i < pool->max; i++) {
+			c = &pool->conns[i];
+			if (c->sd < 0 || c->busy || !srv_equal(&c->srv, srv))
+				continue;
+			if (!best || c->used > best->used)
+				best = c;
+		}
+		if (!best)
+			break;
+		if (pool_alive(best->sd)) {
+			best->busy = true;
+			return best->sd;
+		}
+		pool_close(pool, best);
+	}
+
+	/* Make room by closing the least recently used idle connection */
+	free_slot = lru = NULL;
+	for (i = 0; i < pool->max; i++) {
+		c = &pool->conns[i];
+		if (c->sd < 0) {
+			if (!free_slot)
+				free_slot = c;
+		} else if (!c->busy && (!lru || c->used < lru->used)) {
+			lru = c;
+		}
+	}
+	if (!free_slot && !lru) {
+		errno = ENOBUFS;
+		return -1;
+	}
+	if (!free_slot) {
+		pool_close(pool, lru);
+		free_slot = lru;
+	}
+
+	sd = tipc_socket(pool->sk_type);
+	if (sd < 0)
+		return -1;
+	if (tipc_connect(sd, srv) < 0 ||
+	    getpeername(sd, (struct sockaddr *)&addr, &sz) < 0) {
+		i = errno;
+		tipc_close(sd);
+		errno = i;
+		return -1;
+	}
+	pool_watch(pool, srv);
+	c = free_slot;
+	memset(c, 0, sizeof(*c));
+	c->sd = sd;
+	c->busy = true;
+	c->srv = *srv;
+	c->peer.instance = addr.addr.id.ref;
+	c->peer.domain = addr.addr.id.node;
+	pool->cnt++;
+	return sd;
+}
+
+void tipc_cpool_put(struct tipc_cpool *pool, int sd, bool reuse)
+{
+	struct pool_conn *c = NULL;
+	int i, idle = 0;
+
+	for (i = 0; i < pool->max; i++) {
+		if (pool->conns[i].sd == sd && pool->conns[i].busy) {
+			c = &pool->conns[i];
+			break;
+		}
+	}
+	if (!c) {
+		tipc_close(sd);
+		return;
+	}
+	pool_check_dir(pool);
+	if (!reuse || c->dead) {
+		pool_close(pool, c);
+		return;
+	}
+	for (i = 0; i < pool->max; i++) {
+		struct pool_conn *o = &pool->conns[i];
+
+		if (o->sd >= 0 && !o->busy && srv_equal(&o->srv, &c->srv))
+			idle++;
+	}
+	if (idle >= pool->max_idle) {
+		pool_close(pool, c);
+		return;
+	}
+	c->busy = false;
+	c->used = ++pool->clock;
+}
+
+int tipc_cpool_prune(struct tipc_cpool *pool)
+{
+	int i, closed;
+
+	closed = pool_check_dir(pool);
+
+	/* Slots not idle get a negative fd, which poll() ignores */
+	for (i = 0; i < pool->max; i++) {
+		struct pool_conn *c = &pool->conns[i];
+
+		pool->pfds[i].fd = c->busy ? -1 : c->sd;
+		pool->pfds[i].events = POLLIN | POLLRDHUP;
+		pool->pfds[i].revents = 0;
+	}
+	if (poll(pool->pfds, pool->max, 0) <= 0)
+		return closed;
+	for (i = 0; i < pool->max; i++) {
+		if (pool->pfds[i].fd < 0 || !pool->pfds[i].revents)
+			continue;
+		pool_close(pool, &pool->conns[i]);
+		closed++;
+	}
+	return closed;
+}
+
+int tipc_cpool_count(const struct tipc_cpool *pool, int *idle)
+{
+	int i, n = 0;
+
+	for (i = 0; idle && i < pool->max; i++) {
+		if (pool->conns[i].sd >= 0 && !pool->conns[i].busy)
+			n++;
+	}
+	if (idle)
+		*idle = n;
+	return pool->cnt;
+}
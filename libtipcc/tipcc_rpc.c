@@ -0,0 +1,458 @@
+/* ------------------------------------------------------------------------
+ *
+ * tipcc_rpc.c
+ *
+ * Short description: TIPC C binding API, pipelined request/response
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ * ------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include "tipcc_int.h"
+
+#define RPC_MAGIC     0x54525000
+#define RPC_REQ       1
+#define RPC_RSP       2
+#define RPC_HDR_SZ    sizeof(struct rpc_hdr)
+#define RPC_WHEEL     256
+#define RPC_BUF_SZ    TIPC_MAX_USER_MSG_SIZE
+#define RPC_PICKS     4
+
+struct rpc_hdr {
+	uint32_t magic;
+	uint32_t id;
+};
+
+/* Correlation id is <seq, slot>; seq is bumped each time a slot is
+ * reused, so that late responses to an earlier request are not taken
+ * for the current one
+ */
+struct rpc_req {
+	uint32_t         id;
+	uint32_t         seq;
+	int              tries;
+	uint64_t         deadline;
+	struct tipc_addr dst;
+	struct tipc_addr port;
+	bool             use_lb;
+	tipc_rpc_cb      cb;
+	void            *arg;
+	struct rpc_req  *next;
+	struct rpc_req **pprev;
+	int              next_free;
+};
+
+struct tipc_rpc {
+	int               sd;
+	struct tipc_lb   *lb;
+	int               retries;
+	uint32_t          mask;
+	int               shift;
+	int               free;
+	int               outstanding;
+	unsigned int      completed;
+	int               timed;
+	uint64_t          tick;
+	struct rpc_req   *wheel[RPC_WHEEL];
+	struct tipc_mmsg  msgs[TIPC_MMSG_MAX];
+	struct rpc_req    reqs[];
+};
+
+static uint64_t rpc_now(void)
+{
+	return stats_now() / 1000000;
+}
+
+static void wheel_add(struct tipc_rpc *rpc, struct rpc_req *r)
+{
+	struct rpc_req **head;
+
+	if (r->deadline < rpc->tick)
+		r->deadline = rpc->tick;
+	head = &rpc->wheel[r->deadline & (RPC_WHEEL - 1)];
+	r->next = *head;
+	if (r->next)
+		r->next->pprev = &r->next;
+	r->pprev = head;
+	*head = r;
+	rpc->timed++;
+}
+
+static void wheel_del(struct tipc_rpc *rpc, struct rpc_req *r)
+{
+	if (!r->pprev)
+		return;
+	*r->pprev = r->next;
+	if (r->next)
+		r->next->pprev = r->pprev;
+	r->pprev = NULL;
+	r->next = NULL;
+	rpc->timed--;
+}
+
+struct tipc_rpc *tipc_rpc_create(int sd, struct tipc_lb *lb, int max,
+				 int retries)
+{
+	struct tipc_rpc *rpc;
+	uint32_t sz = 1;
+	int i;
+
+	if (sd < 0 || max <= 0 || max > 65536) {
+		errno = EINVAL;
+		return NULL;
+	}
+	while (sz < (uint32_t)max)
+		sz <<= 1;
+	rpc = calloc(1, sizeof(*rpc) + sz * sizeof(struct rpc_req));
+	if (!rpc)
+		return NULL;
+	rpc->sd = sd;
+	rpc->lb = lb;
+	rpc->retries = retries;
+	rpc->mask = sz - 1;
+	rpc->shift = __builtin_ctz(sz);
+	rpc->tick = rpc_now();
+	for (i = 0; i < (int)sz; i++)
+		rpc->reqs[i].next_free = i + 1 < (int)sz ? i + 1 : -1;
+	for (i = 0; i < TIPC_MMSG_MAX; i++) {
+		rpc->msgs[i].buf = malloc(RPC_BUF_SZ);
+		if (!rpc->msgs[i].buf) {
+			tipc_rpc_destroy(rpc);
+			return NULL;
+		}
+	}
+	return rpc;
+}
+
+void tipc_rpc_destroy(struct tipc_rpc *rpc)
+{
+	int i;
+
+	if (!rpc)
+		return;
+	for (i = 0; i < TIPC_MMSG_MAX; i++)
+		free(rpc->msgs[i].buf);
+	free(rpc);
+}
+
+int tipc_rpc_outstanding(const struct tipc_rpc *rpc)
+{
+	return rpc->outstanding;
+}
+
+static struct rpc_req *rpc_find(struct tipc_rpc *rpc, uint32_t id)
+{
+	struct rpc_req *r = &rpc->reqs[id & rpc->mask];
+
+	return r->id == id && id ? r : NULL;
+}
+
+/* Take request out of table and timer wheel, then report it */
+static void rpc_complete(struct tipc_rpc *rpc, struct rpc_req *r, int err,
+			 const void *rsp, size_t len)
+{
+	tipc_rpc_cb cb = r->cb;
+	void *arg = r->arg;
+
+	wheel_del(rpc, r);
+	if (r->use_lb && rpc->lb)
+		tipc_lb_done(rpc->lb, &r->port);
+	r->id = 0;
+	r->next_free = rpc->free;
+	rpc->free = r - rpc->reqs;
+	rpc->outstanding--;
+	rpc->completed++;
+	if (cb)
+		cb(rpc, err, rsp, len, arg);
+}
+
+/* Send header and body to r's destination, picking a new port if load
+ * balanced. avoid is a port that just rejected the request
+ */
+static int rpc_xmit(struct tipc_rpc *rpc, struct rpc_req *r,
+		    const struct rpc_hdr *hdr, const void *body, size_t len,
+		    const struct tipc_addr *avoid)
+{
+	const struct tipc_addr *dst = &r->dst;
+	int i;
+
+	if (r->use_lb) {
+		for (i = 0; i < RPC_PICKS; i++) {
+			if (tipc_lb_pick(rpc->lb, r->id + r->tries + i,
+					 &r->port))
+				return -1;
+			if (!avoid || r->port.instance != avoid->instance ||
+			    r->port.domain != avoid->domain)
+				break;
+			tipc_lb_done(rpc->lb, &r->port);
+		}
+		dst = &r->port;
+	}
+	if (tipc_send_hdr(rpc->sd, hdr, RPC_HDR_SZ, body, len, dst) < 0) {
+		if (r->use_lb)
+			tipc_lb_done(rpc->lb, &r->port);
+		return -1;
+	}
+	return 0;
+}
+
+int tipc_rpc_send(struct tipc_rpc *rpc, const struct tipc_addr *dst,
+		  const void *req, size_t len, int timeout, tipc_rpc_cb cb,
+		  void *arg)
+{
+	struct rpc_hdr hdr;
+	struct rpc_req *r;
+
+	if (!dst && !rpc->lb) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (rpc->free < 0) {
+		errno = ENOBUFS;
+		return -1;
+	}
+	r = &rpc->reqs[rpc->free];
+	do {
+		r->seq++;
+		r->id = (r->seq << rpc->shift) | (r - rpc->reqs);
+	} while (!r->id);
+	r->tries = 0;
+	r->use_lb = !dst;
+	if (dst)
+		r->dst = *dst;
+	r->cb = cb;
+	r->arg = arg;
+
+	hdr.magic = htonl(RPC_MAGIC | RPC_REQ);
+	hdr.id = htonl(r->id);
+	if (rpc_xmit(rpc, r, &hdr, req, len, NULL)) {
+		r->id = 0;
+		return -1;
+	}
+	rpc->free = r->next_free;
+	rpc->outstanding++;
+	if (timeout >= 0) {
+		r->deadline = rpc_now() + timeout;
+		wheel_add(rpc, r);
+	}
+	return 0;
+}
+
+static void rpc_input_one(struct tipc_rpc *rpc, struct tipc_mmsg *m)
+{
+	const struct rpc_hdr *hdr = (const struct rpc_hdr *)m->buf;
+	struct tipc_addr port;
+	struct rpc_req *r;
+	uint32_t magic;
+
+	if (m->len < RPC_HDR_SZ)
+		return;
+	magic = ntohl(hdr->magic);
+	r = rpc_find(rpc, ntohl(hdr->id));
+	if (!r)
+		return;
+
+	/* Our own request, returned with the reason it was rejected */
+	if (m->err && magic == (RPC_MAGIC | RPC_REQ)) {
+		port = r->port;
+		if (r->tries < rpc->retries) {
+			r->tries++;
+			if (r->use_lb)
+				tipc_lb_done(rpc->lb, &r->port);
+			if (!rpc_xmit(rpc, r, hdr, m->buf + RPC_HDR_SZ,
+				      m->len - RPC_HDR_SZ, &port))
+				return;
+			/* No port is held by the failed attempt */
+			r->use_lb = false;
+		}
+		rpc_complete(rpc, r, ECONNREFUSED, NULL, 0);
+		return;
+	}
+	if (!m->err && magic == (RPC_MAGIC | RPC_RSP))
+		rpc_complete(rpc, r, 0, m->buf + RPC_HDR_SZ,
+			     m->len - RPC_HDR_SZ);
+}
+
+int tipc_rpc_input(struct tipc_rpc *rpc, struct tipc_mmsg *msgs, int num)
+{
+	unsigned int completed = rpc->completed;
+	int i;
+
+	for (i = 0; i < num; i++)
+		rpc_input_one(rpc, &msgs[i]);
+	return rpc->completed - completed;
+}
+
+int tipc_rpc_expire(struct tipc_rpc *rpc)
+{
+	unsigned int completed = rpc->completed;
+	uint64_t now = rpc_now();
+	struct rpc_req *r, *next;
+	uint64_t n;
+
+	if (!rpc->timed) {
+		rpc->tick = now + 1;
+		return 0;
+	}
+	/* After a long pause every slot is visited once */
+	for (n = 0; rpc->tick <= now && n < RPC_WHEEL; rpc->tick++, n++) {
+		r = rpc->wheel[rpc->tick & (RPC_WHEEL - 1)];
+		for (; r; r = next) {
+			next = r->next;
+			if (r->deadline <= now)
+				rpc_complete(rpc, r, ETIMEDOUT, NULL, 0);
+		}
+	}
+	rpc->tick = now + 1;
+	return rpc->completed - completed;
+}
+
+int tipc_rpc_timeout(const struct tipc_rpc *rpc)
+{
+	uint64_t now = rpc_now();
+	int i;
+
+	if (!rpc->timed)
+		return -1;
+	if (rpc->tick <= now)
+		return 0;
+	for (i = 0; i < RPC_WHEEL; i++)
+		if (rpc->wheel[(rpc->tick + i) & (RPC_WHEEL - 1)])
+			return rpc->tick + i - now;
+	return RPC_WHEEL;
+}
+
+int tipc_rpc_poll(struct tipc_rpc *rpc, int timeout)
+{
+	struct pollfd pfd = {rpc->sd, POLLIN, 0};
+	unsigned int completed = rpc->completed;
+	int i, n, wait;
+
+	tipc_rpc_expire(rpc);
+	if (rpc->completed != completed)
+		timeout = 0;
+	wait = tipc_rpc_timeout(rpc);
+	if (wait < 0 || (timeout >= 0 && timeout < wait))
+		wait = timeout;
+	n = poll(&pfd, 1, wait);
+	if (n < 0 && errno != EINTR)
+		return -1;
+	if (n > 0) {
+		for (i = 0; i < TIPC_MMSG_MAX; i++)
+			rpc->msgs[i].len = RPC_BUF_SZ;
+		n = tipc_recvmmsg(rpc->sd, rpc->msgs, TIPC_MMSG_MAX);
+		if (n < 0 && errno != EAGAIN && errno != EINTR)
+			return -1;
+		if (n > 0)
+			tipc_rpc_input(rpc, rpc->msgs, n);
+	}
+	tipc_rpc_expire(rpc);
+	return rpc->completed - completed;
+}
+
+struct rpc_call {
+	bool   done;
+	int    err;
+	void  *rsp;
+	size_t len;
+};
+
+static void rpc_call_cb(struct tipc_rpc *rpc, int err, const void *rsp,
+			size_t len, void *arg)
+{
+	struct rpc_call *call = arg;
+
+	call->done = true;
+	call->err = err;
+	if (err)
+		return;
+	if (len > call->len)
+		len = call->len;
+	memcpy(call->rsp, rsp, len);
+	call->len = len;
+}
+
+int tipc_rpc_call(struct tipc_rpc *rpc, const struct tipc_addr *dst,
+		  const void *req, size_t len, void *rsp, size_t rsp_len,
+		  int timeout)
+{
+	struct rpc_call call = {false, 0, rsp, rsp_len};
+	struct rpc_req *r;
+
+	if (tipc_rpc_send(rpc, dst, req, len, timeout, rpc_call_cb, &call))
+		return -1;
+	while (!call.done) {
+		if (tipc_rpc_poll(rpc, -1) >= 0)
+			continue;
+		/* Must not leave a request pointing at our stack */
+		for (r = rpc->reqs; r <= &rpc->reqs[rpc->mask]; r++) {
+			if (r->id && r->arg == &call) {
+				r->cb = NULL;
+				rpc_complete(rpc, r, 0, NULL, 0);
+			}
+		}
+		return -1;
+	}
+	if (call.err) {
+		errno = call.err;
+		return -1;
+	}
+	return call.len;
+}
+
+int tipc_rpc_req(const void *msg, size_t len, const void **body)
+{
+	const struct rpc_hdr *hdr = msg;
+
+	if (len < RPC_HDR_SZ || ntohl(hdr->magic) != (RPC_MAGIC | RPC_REQ)) {
+		errno = EBADMSG;
+		return -1;
+	}
+	if (body)
+		*body = (const char *)msg + RPC_HDR_SZ;
+	return len - RPC_HDR_SZ;
+}
+
+int tipc_rpc_reply(int sd, const struct tipc_addr *src, const void *req,
+		   const void *rsp, size_t len)
+{
+	const struct rpc_hdr *rhdr = req;
+	struct rpc_hdr hdr;
+
+	hdr.magic = htonl(RPC_MAGIC | RPC_RSP);
+	hdr.id = rhdr->id;
+	return tipc_send_hdr(sd, &hdr, RPC_HDR_SZ, rsp, len, src);
+}
@@ -0,0 +1,582 @@
+/* ------------------------------------------------------------------------
+ *
+ * tipcc_shm.c
+ *
+ * Short description: TIPC C binding API, node local shared memory transport
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ * ------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tipcc_int.h"
+
+/* Each receiving socket may own a ring in shared memory, named after its
+ * port number. The data area is mapped twice in a row, so a record is
+ * always contiguous. Producers reserve space by moving tail with CAS and
+ * then mark the record complete by writing its position into the tag;
+ * the consumer takes records in order from head. A tag can not be left
+ * over from earlier laps, since positions never repeat
+ */
+#define SHM_MAGIC     0x5453484d
+#define SHM_VERSION   1
+#define SHM_MIN_SIZE  (256 * 1024)
+#define SHM_CACHE     8
+#define SHM_NEG_NS    1000000000ull
+#define SHM_LIVE_NS   100000000ull
+#define SHM_FULL_NS   50000
+
+struct shm_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t ref;
+	int32_t  pid;
+	uint64_t size;
+	uint32_t closed;
+	uint64_t head __attribute__((aligned(64)));
+	uint32_t waiting;
+	uint64_t tail __attribute__((aligned(64)));
+};
+
+struct shm_rec {
+	uint64_t         tag;
+	uint32_t         len;
+	struct tipc_addr src;
+};
+
+#define SHM_REC_SZ(len) ((sizeof(struct shm_rec) + (len) + 7) & ~7ul)
+
+struct shm_ring {
+	struct shm_hdr   *hdr;
+	char             *data;
+	size_t            size;
+	size_t            map_len;
+	struct tipc_addr  self;
+};
+
+/* Senders cache rings of recent peers per thread, and also peers found
+ * to have none for a while. A cached ring's owner is checked to be alive
+ * every SHM_LIVE_NS, since a killed owner never marks its ring closed
+ */
+struct shm_peer {
+	uint32_t         ref;
+	uint64_t         neg_until;
+	uint64_t         live_until;
+	struct shm_ring *r;
+};
+
+struct shm_thread {
+	struct shm_peer peers[SHM_CACHE];
+	unsigned int    next;
+	int             self_sd;
+	unsigned int    self_gen;
+	struct tipc_addr self;
+};
+
+bool tipcc__shm_on;
+struct shm_ring **tipcc__shm_rings;
+
+static pthread_mutex_t shm_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t shm_key;
+static pthread_once_t shm_once = PTHREAD_ONCE_INIT;
+static unsigned int shm_gen;
+
+static void shm_name(char *buf, size_t len, uint32_t ref)
+{
+	snprintf(buf, len, "/tipcc.shm.%u", ref);
+}
+
+static struct shm_ring *shm_map(int fd, size_t size)
+{
+	size_t pg = sysconf(_SC_PAGESIZE);
+	struct shm_ring *r;
+	char *base;
+
+	r = calloc(1, sizeof(*r));
+	if (!r)
+		return NULL;
+	r->size = size;
+	r->map_len = pg + 2 * size;
+	base = mmap(NULL, r->map_len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+		    -1, 0);
+	if (base == MAP_FAILED)
+		goto err;
+	if (mmap(base, pg + size, PROT_READ | PROT_WRITE,
+		 MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+	    mmap(base + pg + size, size, PROT_READ | PROT_WRITE,
+		 MAP_SHARED | MAP_FIXED, fd, pg) == MAP_FAILED) {
+		munmap(base, r->map_len);
+		goto err;
+	}
+	r->hdr = (struct shm_hdr *)base;
+	r->data = base + pg;
+	return r;
+err:
+	free(r);
+	return NULL;
+}
+
+static void shm_unmap(struct shm_ring *r)
+{
+	if (!r)
+		return;
+	munmap(r->hdr, r->map_len);
+	free(r);
+}
+
+int tipc_shm_enable(bool on)
+{
+	__atomic_store_n(&tipcc__shm_on, on, __ATOMIC_RELAXED);
+	return 0;
+}
+
+int tipc_shm_attach(int sd, size_t size)
+{
+	size_t pg = sysconf(_SC_PAGESIZE);
+	struct shm_ring **tbl, *r;
+	struct tipc_addr id;
+	char name[32];
+	int fd;
+
+	if (sd < 0 || sd >= TIPC_SHM_MAX_SOCKS || tipc_sockid(sd, &id))
+		return -1;
+	if (size < SHM_MIN_SIZE)
+		size = SHM_MIN_SIZE;
+	size = (size + pg - 1) & ~(pg - 1);
+
+	/* A ring left by a dead owner of the same port number goes */
+	shm_name(name, sizeof(name), id.instance);
+	shm_unlink(name);
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0)
+		return -1;
+	if (ftruncate(fd, pg + size)) {
+		close(fd);
+		shm_unlink(name);
+		return -1;
+	}
+	r = shm_map(fd, size);
+	close(fd);
+	if (!r) {
+		shm_unlink(name);
+		return -1;
+	}
+	r->self = id;
+	r->hdr->version = SHM_VERSION;
+	r->hdr->ref = id.instance;
+	r->hdr->pid = getpid();
+	r->hdr->size = size;
+
+	/* Until first read, as the socket may be polled rather than read */
+	r->hdr->waiting = 1;
+	__atomic_store_n(&r->hdr->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+
+	pthread_mutex_lock(&shm_lock);
+	tbl = tipcc__shm_rings;
+	if (!tbl)
+		tbl = calloc(TIPC_SHM_MAX_SOCKS, sizeof(*tbl));
+	if (!tbl || tbl[sd]) {
+		pthread_mutex_unlock(&shm_lock);
+		shm_unmap(r);
+		shm_unlink(name);
+		errno = tbl ? EEXIST : ENOMEM;
+		return -1;
+	}
+	__atomic_store_n(&tbl[sd], r, __ATOMIC_RELEASE);
+	__atomic_store_n(&tipcc__shm_rings, tbl, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&shm_lock);
+	return 0;
+}
+
+void tipc_shm_detach(int sd)
+{
+	struct shm_ring *r = NULL;
+	char name[32];
+
+	pthread_mutex_lock(&shm_lock);
+	if (tipcc__shm_rings && sd >= 0 && sd < TIPC_SHM_MAX_SOCKS) {
+		r = tipcc__shm_rings[sd];
+		__atomic_store_n(&tipcc__shm_rings[sd], NULL, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&shm_lock);
+	if (!r)
+		return;
+	__atomic_store_n(&r->hdr->closed, 1, __ATOMIC_RELEASE);
+	shm_name(name, sizeof(name), r->self.instance);
+	shm_unlink(name);
+	shm_unmap(r);
+}
+
+void tipcc__shm_close(int sd)
+{
+	__atomic_fetch_add(&shm_gen, 1, __ATOMIC_RELAXED);
+	if (__atomic_load_n(&tipcc__shm_rings, __ATOMIC_ACQUIRE))
+		tipc_shm_detach(sd);
+}
+
+static void shm_thread_free(void *arg)
+{
+	struct shm_thread *t = arg;
+	int i;
+
+	for (i = 0; i < SHM_CACHE; i++)
+		shm_unmap(t->peers[i].r);
+	free(t);
+}
+
+static void shm_key_init(void)
+{
+	pthread_key_create(&shm_key, shm_thread_free);
+}
+
+static struct shm_thread *shm_thread_get(void)
+{
+	struct shm_thread *t;
+
+	pthread_once(&shm_once, shm_key_init);
+	t = pthread_getspecific(shm_key);
+	if (t)
+		return t;
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+	t->self_sd = -1;
+	if (pthread_setspecific(shm_key, t)) {
+		free(t);
+		return NULL;
+	}
+	return t;
+}
+
+static bool shm_owner_gone(const struct shm_hdr *hdr)
+{
+	return kill(hdr->pid, 0) && errno == ESRCH;
+}
+
+static struct shm_ring *shm_open_peer(uint32_t ref)
+{
+	size_t pg = sysconf(_SC_PAGESIZE);
+	struct shm_ring *r;
+	struct stat st;
+	char name[32];
+	int fd;
+
+	shm_name(name, sizeof(name), ref);
+	fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) || (size_t)st.st_size <= pg ||
+	    (st.st_size - pg) % pg) {
+		close(fd);
+		return NULL;
+	}
+	r = shm_map(fd, st.st_size - pg);
+	close(fd);
+	if (!r)
+		return NULL;
+	if (__atomic_load_n(&r->hdr->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC ||
+	    r->hdr->version != SHM_VERSION || r->hdr->ref != ref ||
+	    r->hdr->size != r->size || r->hdr->closed) {
+		shm_unmap(r);
+		return NULL;
+	}
+	if (shm_owner_gone(r->hdr)) {
+		shm_unmap(r);
+		shm_unlink(name);
+		return NULL;
+	}
+	return r;
+}
+
+/* The peer's ring is closed or its owner dead. A dead owner's ring is
+ * removed, as at open, and the peer goes through the kernel for a while
+ */
+static void shm_peer_drop(struct shm_peer *p)
+{
+	char name[32];
+
+	p->neg_until = 0;
+	if (shm_owner_gone(p->r->hdr)) {
+		shm_name(name, sizeof(name), p->ref);
+		shm_unlink(name);
+		p->neg_until = stats_now() + SHM_NEG_NS;
+	}
+	shm_unmap(p->r);
+	p->r = NULL;
+}
+
+static struct shm_peer *shm_peer_get(struct shm_thread *t, uint32_t ref)
+{
+	struct shm_peer *p;
+	uint64_t now;
+	int i;
+
+	for (i = 0; i < SHM_CACHE; i++) {
+		p = &t->peers[i];
+		if (p->ref != ref || (!p->r && !p->neg_until))
+			continue;
+		if (!p->r) {
+			if (stats_now() < p->neg_until)
+				return p;
+			p->neg_until = 0;
+			break;
+		}
+		if (__atomic_load_n(&p->r->hdr->closed, __ATOMIC_ACQUIRE)) {
+			shm_peer_drop(p);
+			if (p->neg_until)
+				return p;
+			break;
+		}
+		now = stats_now();
+		if (now < p->live_until)
+			return p;
+		if (shm_owner_gone(p->r->hdr)) {
+			shm_peer_drop(p);
+			return p;
+		}
+		p->live_until = now + SHM_LIVE_NS;
+		return p;
+	}
+	if (i == SHM_CACHE) {
+		p = &t->peers[t->next++ % SHM_CACHE];
+		shm_unmap(p->r);
+	}
+	now = stats_now();
+	p->ref = ref;
+	p->r = shm_open_peer(ref);
+	p->neg_until = p->r ? 0 : now + SHM_NEG_NS;
+	p->live_until = now + SHM_LIVE_NS;
+	return p;
+}
+
+static int shm_self(struct shm_thread *t, int sd, struct tipc_addr *id)
+{
+	unsigned int gen = __atomic_load_n(&shm_gen, __ATOMIC_RELAXED);
+
+	if (t->self_sd != sd || t->self_gen != gen) {
+		if (tipc_sockid(sd, &t->self))
+			return -1;
+		t->self_sd = sd;
+		t->self_gen = gen;
+	}
+	*id = t->self;
+	return 0;
+}
+
+/* Reserve room for need bytes; returns position, or -1 if sender should
+ * give up on the ring, i.e. it is closed or its owner died while full
+ */
+static int64_t shm_reserve(struct shm_ring *r, int sd, size_t need)
+{
+	struct timespec ts = {0, SHM_FULL_NS};
+	struct shm_hdr *hdr = r->hdr;
+	uint64_t head, tail;
+	int flags = -1;
+
+	tail = __atomic_load_n(&hdr->tail, __ATOMIC_RELAXED);
+	for (;;) {
+		head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+		if (tail + need - head <= r->size) {
+			if (__atomic_compare_exchange_n(&hdr->tail, &tail,
+							tail + need, true,
+							__ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				return tail;
+			continue;
+		}
+		if (__atomic_load_n(&hdr->closed, __ATOMIC_ACQUIRE) ||
+		    shm_owner_gone(hdr))
+			return -1;
+		if (flags < 0)
+			flags = fcntl(sd, F_GETFL);
+		if (flags >= 0 && (flags & O_NONBLOCK)) {
+			errno = EAGAIN;
+			return -2;
+		}
+		nanosleep(&ts, NULL);
+		tail = __atomic_load_n(&hdr->tail, __ATOMIC_RELAXED);
+	}
+}
+
+int tipcc__shm_sendto(int sd, const char *msg, size_t len,
+		      const struct tipc_addr *dst)
+{
+	size_t need = SHM_REC_SZ(len);
+	struct shm_thread *t;
+	struct shm_peer *p;
+	struct shm_rec *rec;
+	struct shm_ring *r;
+	int64_t pos;
+
+	if (dst->domain != tipc_own_node())
+		return SHM_KERNEL;
+	t = shm_thread_get();
+	if (!t)
+		return SHM_KERNEL;
+	p = shm_peer_get(t, dst->instance);
+	r = p->r;
+	if (!r || need > r->size / 2)
+		return SHM_KERNEL;
+
+	pos = shm_reserve(r, sd, need);
+	if (pos == -1) {
+		shm_peer_drop(p);
+		return SHM_KERNEL;
+	}
+	if (pos < 0) {
+		stats_tx(sd, -1, 0);
+		return -1;
+	}
+	rec = (struct shm_rec *)(r->data + pos % r->size);
+	rec->len = len;
+	if (shm_self(t, sd, &rec->src))
+		rec->src.type = rec->src.instance = rec->src.domain = 0;
+	memcpy(rec + 1, msg, len);
+	__atomic_store_n(&rec->tag, pos + 1, __ATOMIC_RELEASE);
+
+	/* Pairs with the fence in shm_get_wait(): either the receiver sees
+	 * the record, or we see it waiting and ring the doorbell
+	 */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&r->hdr->waiting, __ATOMIC_RELAXED) &&
+	    __atomic_exchange_n(&r->hdr->waiting, 0, __ATOMIC_RELAXED))
+		tipc_sendv(sd, NULL, 0, dst);
+	stats_tx(sd, len, 0);
+	return len;
+}
+
+static int shm_get(struct shm_ring *r, char *buf, size_t len,
+		   struct tipc_addr *src)
+{
+	struct shm_hdr *hdr = r->hdr;
+	struct shm_rec *rec;
+	uint64_t head;
+	size_t n;
+
+	head = __atomic_load_n(&hdr->head, __ATOMIC_RELAXED);
+	rec = (struct shm_rec *)(r->data + head % r->size);
+	if (__atomic_load_n(&rec->tag, __ATOMIC_ACQUIRE) != head + 1)
+		return -1;
+	n = rec->len < len ? rec->len : len;
+	memcpy(buf, rec + 1, n);
+	if (src)
+		*src = rec->src;
+	__atomic_store_n(&hdr->head, head + SHM_REC_SZ(rec->len),
+			 __ATOMIC_RELEASE);
+	return n;
+}
+
+/* As shm_get(), but leaves senders knowing we wait if the ring is empty */
+static int shm_get_wait(struct shm_ring *r, char *buf, size_t len,
+			struct tipc_addr *src)
+{
+	int rc;
+
+	rc = shm_get(r, buf, len, src);
+	if (rc >= 0)
+		return rc;
+	__atomic_store_n(&r->hdr->waiting, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	rc = shm_get(r, buf, len, src);
+	if (rc >= 0)
+		__atomic_store_n(&r->hdr->waiting, 0, __ATOMIC_RELAXED);
+	return rc;
+}
+
+int tipcc__shm_recvfrom(struct shm_ring *r, int sd, char *buf, size_t len,
+			struct tipc_addr *src, struct tipc_addr *dst, int *err)
+{
+	struct tipc_rcv_ctx ctx;
+	int rc, _err;
+
+	tipc_rcv_ctx_init(&ctx, sd);
+	for (;;) {
+		rc = shm_get_wait(r, buf, len, src);
+		if (rc >= 0) {
+			stats_rx(sd, rc, false, 0);
+			if (dst)
+				*dst = r->self;
+			if (err)
+				*err = 0;
+			return rc;
+		}
+
+		/* Ring is empty, and senders know we are waiting. A
+		 * timeout left by a deadline call stays in force
+		 */
+		ctx.iov.iov_base = buf;
+		ctx.iov.iov_len = len;
+		rc = tipcc__rcv_ctx_recv(&ctx, src, dst, &_err);
+		if (rc == 0 && !_err)
+			continue;
+		if (err)
+			*err = _err;
+		else if (_err)
+			return 0;
+		return rc;
+	}
+}
+
+/* First message as by tipcc__shm_recvfrom(), the rest of the batch from
+ * the ring only. Doorbells for the messages taken are skipped by later
+ * receives
+ */
+int tipcc__shm_recvmmsg(struct shm_ring *r, int sd, struct tipc_mmsg *msgs,
+			int num)
+{
+	struct tipc_mmsg *m = msgs;
+	int i, rc;
+
+	rc = tipcc__shm_recvfrom(r, sd, m->buf, m->len, &m->src, &m->dst,
+				 &m->err);
+	if (rc < 0)
+		return rc;
+	m->len = rc;
+	for (i = 1, m++; i < num; i++, m++) {
+		rc = shm_get_wait(r, m->buf, m->len, &m->src);
+		if (rc < 0)
+			break;
+		stats_rx(sd, rc, false, 0);
+		m->len = rc;
+		m->dst = r->self;
+		m->err = 0;
+	}
+	return i;
+}
@@ -0,0 +1,259 @@
+/* ------------------------------------------------------------------------
+ *
+ * tipcc_stats.c
+ *
+ * Short description: TIPC C binding API, per-socket statistics
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ * ------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tipcc_int.h"
+
+/* Counters live in one flat table indexed by descriptor, either private
+ * or in a shared memory segment. The table is mapped at first enable and
+ * never unmapped, so updaters take no lock. Pages are only backed once a
+ * slot in them is touched
+ */
+#define STATS_WORDS (sizeof(struct tipc_sock_stats) / sizeof(uint64_t))
+#define STATS_FLAGS (TIPC_STATS_COUNTERS | TIPC_STATS_LATENCY | \
+		     TIPC_STATS_EXPORT)
+
+unsigned int tipcc__stats_flags;
+struct tipc_stats_map *tipcc__stats_tbl;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static char stats_name[32];
+
+static size_t stats_map_size(unsigned int max_socks, unsigned int slot_size)
+{
+	return sizeof(struct tipc_stats_map) + (size_t)max_socks * slot_size;
+}
+
+/* Slot of a segment possibly written by another library version */
+static const struct tipc_stats_slot *stats_slot(const struct tipc_stats_map *m,
+						 int sd)
+{
+	return (const void *)((const char *)m->slots +
+			      (size_t)sd * m->slot_size);
+}
+
+static void stats_unlink(void)
+{
+	shm_unlink(stats_name);
+}
+
+static struct tipc_stats_map *stats_map_create(bool export)
+{
+	size_t size = stats_map_size(TIPC_STATS_MAX_SOCKS,
+				     sizeof(struct tipc_stats_slot));
+	struct tipc_stats_map *m;
+	int fd;
+
+	if (!export) {
+		m = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	} else {
+		snprintf(stats_name, sizeof(stats_name), "/tipcc.%d", getpid());
+		fd = shm_open(stats_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0)
+			return NULL;
+		if (ftruncate(fd, size)) {
+			close(fd);
+			shm_unlink(stats_name);
+			return NULL;
+		}
+		m = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_NORESERVE, fd, 0);
+		close(fd);
+		if (m == MAP_FAILED) {
+			shm_unlink(stats_name);
+			return NULL;
+		}
+		atexit(stats_unlink);
+	}
+	if (m == MAP_FAILED)
+		return NULL;
+	m->pid = getpid();
+	m->max_socks = TIPC_STATS_MAX_SOCKS;
+	m->slot_size = sizeof(struct tipc_stats_slot);
+	m->version = TIPC_STATS_VERSION;
+	__atomic_store_n(&m->magic, TIPC_STATS_MAGIC, __ATOMIC_RELEASE);
+	return m;
+}
+
+void tipcc__stats_activate(struct tipc_stats_map *m, int sd)
+{
+	uint32_t hi = __atomic_load_n(&m->hi_sd, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&m->slots[sd].active, 1, __ATOMIC_RELAXED);
+	while (hi <= (uint32_t)sd &&
+	       !__atomic_compare_exchange_n(&m->hi_sd, &hi, sd + 1, true,
+					    __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+		;
+}
+
+int tipc_stats_enable(unsigned int flags)
+{
+	struct tipc_stats_map *m;
+	int rc = 0;
+
+	if (flags & ~STATS_FLAGS) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (flags)
+		flags |= TIPC_STATS_COUNTERS;
+	pthread_mutex_lock(&stats_lock);
+	m = tipcc__stats_tbl;
+	if (flags && !m) {
+		m = stats_map_create(flags & TIPC_STATS_EXPORT);
+		__atomic_store_n(&tipcc__stats_tbl, m, __ATOMIC_RELEASE);
+	}
+	if (flags && (!m || ((flags & TIPC_STATS_EXPORT) && !stats_name[0])))
+		rc = -1;
+	else
+		__atomic_store_n(&tipcc__stats_flags, flags, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&stats_lock);
+	return rc;
+}
+
+/* Copies the counters both versions know; the st argument is zeroed */
+static void stats_copy(const struct tipc_stats_map *m,
+		       const struct tipc_stats_slot *s,
+		       struct tipc_sock_stats *st)
+{
+	const uint64_t *src = (const uint64_t *)&s->st;
+	uint64_t *dst = (uint64_t *)st;
+	unsigned int i, n;
+
+	n = (m->slot_size - offsetof(struct tipc_stats_slot, st)) /
+		sizeof(uint64_t);
+	if (n > STATS_WORDS)
+		n = STATS_WORDS;
+	for (i = 0; i < n; i++)
+		dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+}
+
+int tipc_stats_read(const struct tipc_stats_map *m, int sd,
+		    struct tipc_sock_stats *st)
+{
+	const struct tipc_stats_slot *s;
+
+	memset(st, 0, sizeof(*st));
+	if (sd < 0 || !m)
+		return -1;
+	if ((unsigned int)sd >= m->max_socks)
+		return 0;
+	s = stats_slot(m, sd);
+	if (!__atomic_load_n(&s->active, __ATOMIC_RELAXED))
+		return 0;
+	stats_copy(m, s, st);
+	return 1;
+}
+
+int tipc_sock_stats(int sd, struct tipc_sock_stats *st)
+{
+	struct tipc_stats_map *m;
+
+	m = __atomic_load_n(&tipcc__stats_tbl, __ATOMIC_ACQUIRE);
+	if (!m) {
+		memset(st, 0, sizeof(*st));
+		return sd < 0 ? -1 : 0;
+	}
+	return tipc_stats_read(m, sd, st) < 0 ? -1 : 0;
+}
+
+void tipc_sock_stats_clear(int sd)
+{
+	struct tipc_stats_map *m;
+	struct tipc_stats_slot *s;
+	uint64_t *w;
+	unsigned int i;
+
+	m = __atomic_load_n(&tipcc__stats_tbl, __ATOMIC_ACQUIRE);
+	if (!m || sd < 0 || (unsigned int)sd >= m->max_socks)
+		return;
+	s = &m->slots[sd];
+	if (!__atomic_load_n(&s->active, __ATOMIC_RELAXED))
+		return;
+	w = (uint64_t *)&s->st;
+	for (i = 0; i < STATS_WORDS; i++)
+		__atomic_store_n(&w[i], 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&s->active, 0, __ATOMIC_RELAXED);
+}
+
+const struct tipc_stats_map *tipc_stats_attach(int pid)
+{
+	const struct tipc_stats_map *m;
+	char name[32];
+	struct stat st;
+	int fd;
+
+	snprintf(name, sizeof(name), "/tipcc.%d", pid);
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(*m)) {
+		close(fd);
+		return NULL;
+	}
+	m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (m == MAP_FAILED)
+		return NULL;
+	if (__atomic_load_n(&m->magic, __ATOMIC_ACQUIRE) != TIPC_STATS_MAGIC ||
+	    m->version != TIPC_STATS_VERSION ||
+	    m->slot_size < offsetof(struct tipc_stats_slot, st) +
+			   offsetof(struct tipc_sock_stats, tx_lat) ||
+	    m->slot_size % sizeof(uint64_t) ||
+	    stats_map_size(m->max_socks, m->slot_size) > (size_t)st.st_size) {
+		munmap((void *)m, st.st_size);
+		return NULL;
+	}
+	return m;
+}
+
+void tipc_stats_detach(const struct tipc_stats_map *m)
+{
+	if (m)
+		munmap((void *)m, stats_map_size(m->max_socks, m->slot_size));
+}
@@ -0,0 +1,137 @@
+/* ------------------------------------------------------------------------
+ *
+ * tipcc_stat.c
+ *
+ * Short description: Dump tipcc per-socket statistics of a running process
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Version 0.9: Jon Maloy, 2015
+ *
+ * ------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <tipcc.h>
+
+static int syntax(char *argv[])
+{
+	fprintf(stderr, "Usage: %s [-i interval_s] [-l] pid\n", argv[0]);
+	fprintf(stderr, "  -i  repeat every interval_s seconds\n");
+	fprintf(stderr, "  -l  also print latency histograms\n");
+	return 1;
+}
+
+static void print_hist(const char *name, const uint64_t *hist)
+{
+	int i;
+
+	for (i = 0; i < TIPC_STATS_BUCKETS; i++) {
+		if (!hist[i])
+			continue;
+		printf("      %s >= %10llu ns: %llu\n", name, 1ull << i,
+		       (unsigned long long)hist[i]);
+	}
+}
+
+static void dump(const struct tipc_stats_map *map, bool lat)
+{
+	struct tipc_sock_stats st;
+	unsigned int sd, hi;
+
+	hi = __atomic_load_n(&map->hi_sd, __ATOMIC_RELAXED);
+	printf("%6s %12s %14s %12s %14s %10s %8s %8s %8s %8s\n",
+	       "sd", "tx_msgs", "tx_bytes", "rx_msgs", "rx_bytes",
+	       "eagain", "rejected", "errors", "connects", "accepts");
+	for (sd = 0; sd < hi; sd++) {
+		if (tipc_stats_read(map, sd, &st) <= 0)
+			continue;
+		printf("%6u %12llu %14llu %12llu %14llu %10llu %8llu %8llu "
+		       "%8llu %8llu\n", sd,
+		       (unsigned long long)st.tx_msgs,
+		       (unsigned long long)st.tx_bytes,
+		       (unsigned long long)st.rx_msgs,
+		       (unsigned long long)st.rx_bytes,
+		       (unsigned long long)st.eagain,
+		       (unsigned long long)st.rejected,
+		       (unsigned long long)st.errors,
+		       (unsigned long long)st.connects,
+		       (unsigned long long)st.accepts);
+		if (!lat)
+			continue;
+		print_hist("tx  ", st.tx_lat);
+		print_hist("rx  ", st.rx_lat);
+		print_hist("conn", st.conn_lat);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const struct tipc_stats_map *map;
+	unsigned int intv = 0;
+	bool lat = false;
+	int option, pid;
+
+	while ((option = getopt(argc, argv, ":i:l")) != -1) {
+		switch (option) {
+		case 'i':
+			intv = atoi(optarg);
+			continue;
+		case 'l':
+			lat = true;
+			continue;
+		default:
+			return syntax(argv);
+		}
+	}
+	if (optind != argc - 1)
+		return syntax(argv);
+	pid = atoi(argv[optind]);
+
+	map = tipc_stats_attach(pid);
+	if (!map) {
+		fprintf(stderr, "No statistics exported by process %d\n", pid);
+		return 1;
+	}
+	do {
+		if (kill(pid, 0) && intv) {
+			fprintf(stderr, "Process %d has gone\n", pid);
+			break;
+		}
+		dump(map, lat);
+		if (intv)
+			sleep(intv);
+	} while (intv);
+	tipc_stats_detach(map);
+	return 0;
+}
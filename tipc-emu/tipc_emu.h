@@ -0,0 +1,91 @@
+/* ------------------------------------------------------------------------
+ *
+ * tipc_emu.h
+ *
+ * Short description: User space TIPC emulator, daemon protocol
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ------------------------------------------------------------------------
+ */
+
+#ifndef __TIPC_EMU_H_
+#define __TIPC_EMU_H_
+
+#include <stdint.h>
+#include <linux/tipc.h>
+
+/* Each emulated TIPC socket is a seqpacket connection to the daemon,
+ * opened with EMU_OPEN and answered with EMU_OPENED. Datagrams travel
+ * over it as an emu_hdr followed by the payload.
+ * Each process also keeps one control connection for the requests that
+ * need an answer while data may be arriving on the socket itself.
+ * A successful connect or accept hands out one end of a socket pair,
+ * which then replaces the socket's connection to the daemon, so that
+ * connection oriented traffic never passes the daemon.
+ */
+#define TIPC_EMU_SOCKET_ENV	"TIPC_EMU_SOCKET"
+#define TIPC_EMU_SOCKET		"@tipc-emu"
+#define TIPC_EMU_NODE		0x01001001
+#define TIPC_EMU_MIN_REF	0x1000
+#define TIPC_EMU_MAX_MSG	TIPC_MAX_USER_MSG_SIZE
+
+enum {
+	EMU_OPEN = 1,	/* arg[0]: socket type */
+	EMU_OPENED,	/* ref: assigned port number */
+	EMU_CTL,	/* first packet on a control connection */
+	EMU_BIND,	/* ref, dst: name sequence, arg[0]: scope */
+	EMU_UNBIND,	/* ref, dst: name sequence, or none for all */
+	EMU_LISTEN,	/* ref */
+	EMU_CONNECT,	/* ref, dst */
+	EMU_REPLY,	/* err, src: peer port, socket pair end if connected */
+	EMU_DATA,	/* dst, src; err if returned, arg[0]: EMU_DEST_* */
+	EMU_CONNREQ	/* src: peer, arg[0]: own port, socket pair end */
+};
+
+#define EMU_DEST_DROPPABLE	1
+
+struct emu_addr {
+	uint32_t type;
+	uint32_t lower;		/* port number if TIPC_ADDR_ID */
+	uint32_t upper;
+	uint32_t node;
+	uint32_t addrtype;	/* TIPC_ADDR_*, or 0 if not set */
+};
+
+struct emu_hdr {
+	uint32_t op;
+	int32_t err;
+	uint32_t ref;
+	uint32_t arg[2];
+	struct emu_addr src;
+	struct emu_addr dst;
+};
+
+#endif
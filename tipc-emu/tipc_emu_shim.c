@@ -0,0 +1,1153 @@
+/* ------------------------------------------------------------------------
+ *
+ * tipc_emu_shim.c
+ *
+ * Short description: Preload library routing AF_TIPC sockets to tipc-emud
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ------------------------------------------------------------------------
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include "tipc_emu.h"
+
+#define MAX_SOCKS	65536
+#define MAX_IOV		64
+#define MAX_EPOLLS	4
+
+/* Emulated socket; the descriptor itself is a unix socket, so that poll,
+ * epoll, fcntl and socket level options work on it. Only POLLWRBAND,
+ * which a TIPC socket never reports, is masked in poll and epoll
+ */
+struct esock {
+	int type;
+	uint32_t ref;
+	bool connected;
+	bool listening;
+	bool has_dst;
+	struct emu_addr peer;
+	int importance;
+	int src_droppable;
+	int dest_droppable;
+	int conn_timeout;
+	pid_t pid;		/* process that opened it */
+
+	/* epoll sets watching the socket, which must watch the connection
+	 * that replaces it too
+	 */
+	int nepolls;
+	int epfds[MAX_EPOLLS];
+	struct epoll_event epevs[MAX_EPOLLS];
+};
+
+static struct esock *socks[MAX_SOCKS];
+static pthread_mutex_t ctl_lock = PTHREAD_MUTEX_INITIALIZER;
+static int ctl_sd = -1;
+static pid_t ctl_pid;
+
+/* The wrapped functions, looked up on first use since other libraries'
+ * constructors may open sockets before ours would run
+ */
+#define REAL(f) ((typeof(real_##f))real_sym((void **)&real_##f, #f))
+
+static int (*real_socket)(int, int, int);
+static int (*real_socketpair)(int, int, int, int[2]);
+static int (*real_bind)(int, const struct sockaddr *, socklen_t);
+static int (*real_listen)(int, int);
+static int (*real_accept4)(int, struct sockaddr *, socklen_t *, int);
+static int (*real_connect)(int, const struct sockaddr *, socklen_t);
+static ssize_t (*real_sendmsg)(int, const struct msghdr *, int);
+static ssize_t (*real_recvmsg)(int, struct msghdr *, int);
+static ssize_t (*real_send)(int, const void *, size_t, int);
+static ssize_t (*real_sendto)(int, const void *, size_t, int,
+			      const struct sockaddr *, socklen_t);
+static ssize_t (*real_recv)(int, void *, size_t, int);
+static ssize_t (*real_recvfrom)(int, void *, size_t, int, struct sockaddr *,
+				socklen_t *);
+static ssize_t (*real_read)(int, void *, size_t);
+static ssize_t (*real_write)(int, const void *, size_t);
+static ssize_t (*real_readv)(int, const struct iovec *, int);
+static ssize_t (*real_writev)(int, const struct iovec *, int);
+static int (*real_sendmmsg)(int, struct mmsghdr *, unsigned int, int);
+static int (*real_recvmmsg)(int, struct mmsghdr *, unsigned int, int,
+			    struct timespec *);
+static int (*real_getsockname)(int, struct sockaddr *, socklen_t *);
+static int (*real_getpeername)(int, struct sockaddr *, socklen_t *);
+static int (*real_setsockopt)(int, int, int, const void *, socklen_t);
+static int (*real_getsockopt)(int, int, int, void *, socklen_t *);
+static int (*real_shutdown)(int, int);
+static int (*real_close)(int);
+static int (*real_dup)(int);
+static int (*real_dup2)(int, int);
+static int (*real_dup3)(int, int, int);
+static int (*real_ioctl)(int, unsigned long, void *);
+static int (*real_poll)(struct pollfd *, nfds_t, int);
+static int (*real_ppoll)(struct pollfd *, nfds_t, const struct timespec *,
+			 const sigset_t *);
+static int (*real_epoll_ctl)(int, int, int, struct epoll_event *);
+
+static void *real_sym(void **fn, const char *name)
+{
+	if (!*fn)
+		*fn = dlsym(RTLD_NEXT, name);
+	return *fn;
+}
+
+static struct esock *sock_get(int sd)
+{
+	if (sd < 0 || sd >= MAX_SOCKS)
+		return NULL;
+	return socks[sd];
+}
+
+static void sock_put(int sd, struct esock *s)
+{
+	struct esock *old = socks[sd];
+
+	socks[sd] = s;
+	free(old);
+}
+
+static int fail(int err)
+{
+	errno = err;
+	return -1;
+}
+
+static int emu_dial(void)
+{
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	const char *path = getenv(TIPC_EMU_SOCKET_ENV);
+	socklen_t len;
+	int sd;
+
+	if (!path)
+		path = TIPC_EMU_SOCKET;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	len = offsetof(struct sockaddr_un, sun_path) + strlen(addr.sun_path);
+	if (path[0] == '@')
+		addr.sun_path[0] = 0;
+	sd = REAL(socket)(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (sd < 0)
+		return -1;
+	if (REAL(connect)(sd, (struct sockaddr *)&addr, len) < 0) {
+		REAL(close)(sd);
+		return -1;
+	}
+	return sd;
+}
+
+static ssize_t emu_recv_fd(int sd, struct emu_hdr *h, int *fd, int flags)
+{
+	char cbuf[CMSG_SPACE(sizeof(int))];
+	struct iovec iov = {h, sizeof(*h)};
+	struct msghdr msg = {0, };
+	struct cmsghdr *cm;
+	ssize_t rc;
+
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	*fd = -1;
+	rc = REAL(recvmsg)(sd, &msg, flags);
+	if (rc <= 0)
+		return rc;
+	cm = CMSG_FIRSTHDR(&msg);
+	if (cm && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS)
+		memcpy(fd, CMSG_DATA(cm), sizeof(int));
+	return rc;
+}
+
+/* Synchronous request over the per process control connection */
+static int ctl_call(struct emu_hdr *h, struct emu_hdr *rsp, int *fd)
+{
+	struct emu_hdr ctl = {.op = EMU_CTL};
+	int rc = -1, _fd;
+
+	if (!fd)
+		fd = &_fd;
+	pthread_mutex_lock(&ctl_lock);
+	if (ctl_sd >= 0 && ctl_pid != getpid()) {
+		REAL(close)(ctl_sd);
+		ctl_sd = -1;
+	}
+	if (ctl_sd < 0) {
+		ctl_sd = emu_dial();
+		ctl_pid = getpid();
+		if (ctl_sd >= 0 &&
+		    REAL(send)(ctl_sd, &ctl, sizeof(ctl), MSG_NOSIGNAL) < 0) {
+			REAL(close)(ctl_sd);
+			ctl_sd = -1;
+		}
+	}
+	if (ctl_sd >= 0 &&
+	    REAL(send)(ctl_sd, h, sizeof(*h), MSG_NOSIGNAL) == sizeof(*h) &&
+	    emu_recv_fd(ctl_sd, rsp, fd, MSG_CMSG_CLOEXEC) == sizeof(*rsp))
+		rc = 0;
+	pthread_mutex_unlock(&ctl_lock);
+	if (rc < 0)
+		return fail(EIO);
+	if (*fd >= 0 && fd == &_fd)
+		REAL(close)(*fd);
+	if (rsp->err)
+		return fail(rsp->err);
+	return 0;
+}
+
+static int sock_ctl(struct esock *s, int op, struct emu_addr *dst,
+		    uint32_t arg, struct emu_hdr *rsp, int *fd)
+{
+	struct emu_hdr h = {.op = op, .ref = s->ref};
+	struct emu_hdr _rsp;
+
+	if (dst)
+		h.dst = *dst;
+	h.arg[0] = arg;
+	return ctl_call(&h, rsp ? rsp : &_rsp, fd);
+}
+
+static int addr_get(const struct sockaddr *sa, socklen_t len,
+		    struct emu_addr *a)
+{
+	const struct sockaddr_tipc *t = (const struct sockaddr_tipc *)sa;
+
+	memset(a, 0, sizeof(*a));
+	if (!sa || len < sizeof(*t) || t->family != AF_TIPC)
+		return fail(EINVAL);
+	a->addrtype = t->addrtype;
+	switch (t->addrtype) {
+	case TIPC_ADDR_NAMESEQ:
+		a->type = t->addr.nameseq.type;
+		a->lower = t->addr.nameseq.lower;
+		a->upper = t->addr.nameseq.upper;
+		return 0;
+	case TIPC_ADDR_NAME:
+		a->type = t->addr.name.name.type;
+		a->lower = a->upper = t->addr.name.name.instance;
+		a->node = t->addr.name.domain;
+		return 0;
+	case TIPC_ADDR_ID:
+		a->lower = t->addr.id.ref;
+		a->node = t->addr.id.node;
+		return 0;
+	}
+	return fail(EINVAL);
+}
+
+static void addr_put(const struct emu_addr *a, struct sockaddr *sa,
+		     socklen_t *len)
+{
+	struct sockaddr_tipc t = {.family = AF_TIPC};
+
+	t.addrtype = TIPC_ADDR_ID;
+	t.addr.id.ref = a->lower;
+	t.addr.id.node = a->node;
+	if (!sa || !len)
+		return;
+	memcpy(sa, &t, *len < sizeof(t) ? *len : sizeof(t));
+	*len = sizeof(t);
+}
+
+int socket(int domain, int type, int protocol)
+{
+	int base = type & ~(SOCK_NONBLOCK | SOCK_CLOEXEC);
+	struct emu_hdr h = {.op = EMU_OPEN};
+	struct esock *s;
+	int sd;
+
+	if (domain != AF_TIPC)
+		return REAL(socket)(domain, type, protocol);
+	if (base != SOCK_RDM && base != SOCK_DGRAM &&
+	    base != SOCK_SEQPACKET && base != SOCK_STREAM)
+		return fail(EPROTOTYPE);
+	sd = emu_dial();
+	if (sd < 0)
+		return fail(EAFNOSUPPORT);
+	h.arg[0] = base;
+	s = calloc(1, sizeof(*s));
+	if (!s || sd >= MAX_SOCKS ||
+	    REAL(send)(sd, &h, sizeof(h), MSG_NOSIGNAL) != sizeof(h) ||
+	    REAL(recv)(sd, &h, sizeof(h), 0) != sizeof(h) ||
+	    h.op != EMU_OPENED) {
+		REAL(close)(sd);
+		free(s);
+		return fail(s ? EAFNOSUPPORT : ENOMEM);
+	}
+	if (!(type & SOCK_CLOEXEC))
+		fcntl(sd, F_SETFD, 0);
+	if (type & SOCK_NONBLOCK)
+		fcntl(sd, F_SETFL, O_NONBLOCK);
+	s->type = base;
+	s->ref = h.ref;
+	s->peer = h.src;
+	s->conn_timeout = 8000;
+	s->pid = getpid();
+	s->src_droppable = base == SOCK_DGRAM;
+	s->dest_droppable = base == SOCK_DGRAM || base == SOCK_RDM;
+	sock_put(sd, s);
+	return sd;
+}
+
+/* A pair is connected from the start and never reaches the daemon, so
+ * its sockets have no port numbers of their own
+ */
+int socketpair(int domain, int type, int protocol, int sv[2])
+{
+	int base = type & ~(SOCK_NONBLOCK | SOCK_CLOEXEC);
+	struct esock *s[2];
+	int i;
+
+	if (domain != AF_TIPC)
+		return REAL(socketpair)(domain, type, protocol, sv);
+	if (base != SOCK_RDM && base != SOCK_DGRAM &&
+	    base != SOCK_SEQPACKET && base != SOCK_STREAM)
+		return fail(EPROTOTYPE);
+	if (REAL(socketpair)(AF_UNIX, (type & ~base) |
+			     (base == SOCK_STREAM ? SOCK_STREAM :
+			      SOCK_SEQPACKET), 0, sv) < 0)
+		return -1;
+	s[0] = calloc(1, sizeof(*s[0]));
+	s[1] = calloc(1, sizeof(*s[1]));
+	if (!s[0] || !s[1] || sv[0] >= MAX_SOCKS || sv[1] >= MAX_SOCKS) {
+		REAL(close)(sv[0]);
+		REAL(close)(sv[1]);
+		free(s[0]);
+		free(s[1]);
+		return fail(ENOMEM);
+	}
+	for (i = 0; i < 2; i++) {
+		s[i]->type = base;
+		s[i]->connected = true;
+		s[i]->peer.addrtype = TIPC_ADDR_ID;
+		s[i]->peer.node = TIPC_EMU_NODE;
+		s[i]->conn_timeout = 8000;
+		sock_put(sv[i], s[i]);
+	}
+	return 0;
+}
+
+int bind(int sd, const struct sockaddr *addr, socklen_t len)
+{
+	const struct sockaddr_tipc *t = (const struct sockaddr_tipc *)addr;
+	struct esock *s = sock_get(sd);
+	struct emu_addr a;
+	int scope;
+
+	if (!s)
+		return REAL(bind)(sd, addr, len);
+	if (!addr || !len)
+		return sock_ctl(s, EMU_UNBIND, NULL, 0, NULL, NULL);
+	if (addr_get(addr, len, &a) < 0 || a.addrtype == TIPC_ADDR_ID)
+		return fail(EAFNOSUPPORT);
+	a.node = 0;
+	scope = t->scope;
+	if (scope < 0)
+		return sock_ctl(s, EMU_UNBIND, &a, -scope, NULL, NULL);
+	return sock_ctl(s, EMU_BIND, &a, scope, NULL, NULL);
+}
+
+int listen(int sd, int backlog)
+{
+	struct esock *s = sock_get(sd);
+
+	if (!s)
+		return REAL(listen)(sd, backlog);
+	if (s->connected)
+		return fail(EINVAL);
+	if (sock_ctl(s, EMU_LISTEN, NULL, 0, NULL, NULL) < 0)
+		return -1;
+	s->listening = true;
+	return 0;
+}
+
+/* Put the daemon supplied socket pair end in place of the socket */
+static int sock_connect(int sd, struct esock *s, struct emu_addr *dst)
+{
+	struct emu_hdr rsp;
+	int fd, fl, fdfl, i;
+
+	if (sock_ctl(s, EMU_CONNECT, dst, 0, &rsp, &fd) < 0) {
+		/* A bound but not listening peer never answers the SYN */
+		if (errno != ETIMEDOUT)
+			return -1;
+		if (!(fcntl(sd, F_GETFL) & O_NONBLOCK))
+			REAL(poll)(NULL, 0, s->conn_timeout);
+		return fail(ETIMEDOUT);
+	}
+	if (fd < 0)
+		return fail(ECONNREFUSED);
+	fl = fcntl(sd, F_GETFL);
+	fdfl = fcntl(sd, F_GETFD);
+	fcntl(fd, F_SETFL, fl & O_NONBLOCK);
+	if (REAL(dup3)(fd, sd, (fdfl & FD_CLOEXEC) ? O_CLOEXEC : 0) < 0) {
+		REAL(close)(fd);
+		return -1;
+	}
+	REAL(close)(fd);
+	for (i = 0; i < s->nepolls; i++)
+		REAL(epoll_ctl)(s->epfds[i], EPOLL_CTL_ADD, sd, &s->epevs[i]);
+	s->connected = true;
+	s->peer = rsp.src;
+	return 0;
+}
+
+int connect(int sd, const struct sockaddr *addr, socklen_t len)
+{
+	struct esock *s = sock_get(sd);
+	struct emu_addr a;
+
+	if (!s)
+		return REAL(connect)(sd, addr, len);
+
+	/* Connectionless sockets just remember the default destination */
+	if (s->type == SOCK_RDM || s->type == SOCK_DGRAM) {
+		if (addr && len >= sizeof(sa_family_t) &&
+		    addr->sa_family == AF_UNSPEC) {
+			s->has_dst = false;
+			return 0;
+		}
+		if (addr_get(addr, len, &a) < 0)
+			return -1;
+		s->peer = a;
+		s->has_dst = true;
+		return 0;
+	}
+	if (s->connected)
+		return fail(EISCONN);
+	if (s->listening)
+		return fail(EINVAL);
+	if (addr_get(addr, len, &a) < 0)
+		return -1;
+	return sock_connect(sd, s, &a);
+}
+
+int accept4(int sd, struct sockaddr *addr, socklen_t *len, int flags)
+{
+	struct esock *s = sock_get(sd), *ns;
+	struct emu_hdr h;
+	ssize_t rc;
+	int fd;
+
+	if (!s)
+		return REAL(accept4)(sd, addr, len, flags);
+	if (!s->listening)
+		return fail(EINVAL);
+	for (;;) {
+		rc = emu_recv_fd(sd, &h, &fd,
+				 flags & SOCK_CLOEXEC ? MSG_CMSG_CLOEXEC : 0);
+		if (rc < 0)
+			return -1;
+		if (rc == 0)
+			return fail(ECONNABORTED);
+		if (fd >= 0 && h.op == EMU_CONNREQ)
+			break;
+		if (fd >= 0)
+			REAL(close)(fd);
+	}
+	ns = calloc(1, sizeof(*ns));
+	if (!ns || fd >= MAX_SOCKS) {
+		REAL(close)(fd);
+		free(ns);
+		return fail(ENOMEM);
+	}
+	if (flags & SOCK_NONBLOCK)
+		fcntl(fd, F_SETFL, O_NONBLOCK);
+	*ns = *s;
+	ns->listening = false;
+	ns->connected = true;
+	ns->ref = h.arg[0];
+	ns->peer = h.src;
+	sock_put(fd, ns);
+	addr_put(&h.src, addr, len);
+	return fd;
+}
+
+int accept(int sd, struct sockaddr *addr, socklen_t *len)
+{
+	return accept4(sd, addr, len, 0);
+}
+
+/* Data path */
+
+static ssize_t emu_sendmsg(int sd, struct esock *s, const struct msghdr *m,
+			   int flags)
+{
+	struct emu_hdr h = {.op = EMU_DATA};
+	struct iovec iov[MAX_IOV + 1];
+	struct msghdr mm = *m;
+	size_t i, len = 0;
+	ssize_t rc;
+
+	if (!s->connected && m->msg_name) {
+		if (addr_get(m->msg_name, m->msg_namelen, &h.dst) < 0)
+			return -1;
+		if ((s->type == SOCK_SEQPACKET || s->type == SOCK_STREAM) &&
+		    !s->listening) {
+			if (sock_connect(sd, s, &h.dst) < 0)
+				return -1;
+		}
+	} else if (s->has_dst) {
+		h.dst = s->peer;
+	}
+	if (s->connected) {
+		mm.msg_name = NULL;
+		mm.msg_namelen = 0;
+		mm.msg_control = NULL;
+		mm.msg_controllen = 0;
+		return REAL(sendmsg)(sd, &mm, flags);
+	}
+	if (!h.dst.addrtype)
+		return fail(s->type == SOCK_RDM || s->type == SOCK_DGRAM ?
+			    EDESTADDRREQ : ENOTCONN);
+	if (m->msg_iovlen > MAX_IOV)
+		return fail(EMSGSIZE);
+	for (i = 0; i < m->msg_iovlen; i++) {
+		iov[i + 1] = m->msg_iov[i];
+		len += m->msg_iov[i].iov_len;
+	}
+	if (len > TIPC_EMU_MAX_MSG)
+		return fail(EMSGSIZE);
+	h.arg[0] = s->dest_droppable ? EMU_DEST_DROPPABLE : 0;
+	iov[0].iov_base = &h;
+	iov[0].iov_len = sizeof(h);
+	memset(&mm, 0, sizeof(mm));
+	mm.msg_iov = iov;
+	mm.msg_iovlen = m->msg_iovlen + 1;
+	rc = REAL(sendmsg)(sd, &mm, flags | MSG_NOSIGNAL);
+	if (rc < 0 && errno == EPIPE)
+		errno = ECONNRESET;
+	return rc < 0 ? rc : rc - (ssize_t)sizeof(h);
+}
+
+static bool anc_put(struct msghdr *m, size_t *used, int type,
+		    const void *data, size_t len)
+{
+	struct cmsghdr *cm;
+
+	if (*used + CMSG_SPACE(len) > m->msg_controllen) {
+		m->msg_flags |= MSG_CTRUNC;
+		return false;
+	}
+	cm = (struct cmsghdr *)((char *)m->msg_control + *used);
+	cm->cmsg_level = SOL_TIPC;
+	cm->cmsg_type = type;
+	cm->cmsg_len = CMSG_LEN(len);
+	memcpy(CMSG_DATA(cm), data, len);
+	*used += CMSG_SPACE(len);
+	return true;
+}
+
+/* Returned data moves from the receive buffers to TIPC_RETDATA, the way
+ * the kernel reports a rejected message
+ */
+static void anc_retdata(struct msghdr *m, size_t *used, size_t len)
+{
+	struct cmsghdr *cm;
+	size_t i, n, off = 0;
+
+	if (*used + CMSG_SPACE(len) > m->msg_controllen) {
+		m->msg_flags |= MSG_CTRUNC;
+		return;
+	}
+	cm = (struct cmsghdr *)((char *)m->msg_control + *used);
+	cm->cmsg_level = SOL_TIPC;
+	cm->cmsg_type = TIPC_RETDATA;
+	for (i = 0; i < m->msg_iovlen && off < len; i++) {
+		n = m->msg_iov[i].iov_len;
+		if (n > len - off)
+			n = len - off;
+		memcpy(CMSG_DATA(cm) + off, m->msg_iov[i].iov_base, n);
+		off += n;
+	}
+	cm->cmsg_len = CMSG_LEN(off);
+	*used += CMSG_SPACE(off);
+}
+
+static ssize_t emu_recvmsg(int sd, struct esock *s, struct msghdr *m,
+			   int flags)
+{
+	struct iovec iov[MAX_IOV + 1];
+	struct msghdr mm = {0, };
+	struct emu_hdr h;
+	size_t i, used = 0;
+	uint32_t info[3];
+	ssize_t rc, len;
+
+	if (s->connected) {
+		mm = *m;
+		mm.msg_name = NULL;
+		mm.msg_namelen = 0;
+		mm.msg_control = NULL;
+		mm.msg_controllen = 0;
+		rc = REAL(recvmsg)(sd, &mm, flags);
+		m->msg_flags = mm.msg_flags;
+		m->msg_controllen = 0;
+		if (m->msg_name)
+			addr_put(&s->peer, m->msg_name, &m->msg_namelen);
+		return rc;
+	}
+	if (s->listening)
+		return fail(ENOTCONN);
+	if (m->msg_iovlen > MAX_IOV)
+		return fail(EINVAL);
+	iov[0].iov_base = &h;
+	iov[0].iov_len = sizeof(h);
+	for (i = 0; i < m->msg_iovlen; i++)
+		iov[i + 1] = m->msg_iov[i];
+	mm.msg_iov = iov;
+	mm.msg_iovlen = m->msg_iovlen + 1;
+	rc = REAL(recvmsg)(sd, &mm, flags);
+	if (rc < 0)
+		return rc;
+	if (rc < (ssize_t)sizeof(h))
+		return 0;
+	len = rc - sizeof(h);
+	m->msg_flags = mm.msg_flags;
+	if (m->msg_name)
+		addr_put(&h.src, m->msg_name, &m->msg_namelen);
+	if (h.err) {
+		info[0] = h.err;
+		info[1] = len;
+		if (anc_put(m, &used, TIPC_ERRINFO, info, 8) && len)
+			anc_retdata(m, &used, len);
+		len = 0;
+	}
+	if (h.dst.addrtype == TIPC_ADDR_NAME ||
+	    h.dst.addrtype == TIPC_ADDR_MCAST) {
+		info[0] = h.dst.type;
+		info[1] = h.dst.lower;
+		info[2] = h.dst.upper;
+		anc_put(m, &used, TIPC_DESTNAME, info, sizeof(info));
+	}
+	m->msg_controllen = used;
+	return len;
+}
+
+ssize_t sendmsg(int sd, const struct msghdr *m, int flags)
+{
+	struct esock *s = sock_get(sd);
+
+	if (!s)
+		return REAL(sendmsg)(sd, m, flags);
+	return emu_sendmsg(sd, s, m, flags);
+}
+
+ssize_t sendto(int sd, const void *buf, size_t len, int flags,
+	       const struct sockaddr *addr, socklen_t alen)
+{
+	struct iovec iov = {(void *)buf, len};
+	struct esock *s = sock_get(sd);
+	struct msghdr m = {0, };
+
+	if (!s)
+		return REAL(sendto)(sd, buf, len, flags, addr, alen);
+	m.msg_name = (void *)addr;
+	m.msg_namelen = alen;
+	m.msg_iov = &iov;
+	m.msg_iovlen = 1;
+	return emu_sendmsg(sd, s, &m, flags);
+}
+
+ssize_t send(int sd, const void *buf, size_t len, int flags)
+{
+	if (!sock_get(sd))
+		return REAL(send)(sd, buf, len, flags);
+	return sendto(sd, buf, len, flags, NULL, 0);
+}
+
+ssize_t write(int sd, const void *buf, size_t len)
+{
+	if (!sock_get(sd))
+		return REAL(write)(sd, buf, len);
+	return sendto(sd, buf, len, 0, NULL, 0);
+}
+
+ssize_t writev(int sd, const struct iovec *iov, int iovcnt)
+{
+	struct esock *s = sock_get(sd);
+	struct msghdr m = {0, };
+
+	if (!s)
+		return REAL(writev)(sd, iov, iovcnt);
+	m.msg_iov = (struct iovec *)iov;
+	m.msg_iovlen = iovcnt;
+	return emu_sendmsg(sd, s, &m, 0);
+}
+
+ssize_t recvmsg(int sd, struct msghdr *m, int flags)
+{
+	struct esock *s = sock_get(sd);
+
+	if (!s)
+		return REAL(recvmsg)(sd, m, flags);
+	return emu_recvmsg(sd, s, m, flags);
+}
+
+ssize_t recvfrom(int sd, void *buf, size_t len, int flags,
+		 struct sockaddr *addr, socklen_t *alen)
+{
+	struct iovec iov = {buf, len};
+	struct esock *s = sock_get(sd);
+	struct msghdr m = {0, };
+	ssize_t rc;
+
+	if (!s)
+		return REAL(recvfrom)(sd, buf, len, flags, addr, alen);
+	m.msg_name = addr;
+	m.msg_namelen = addr && alen ? *alen : 0;
+	m.msg_iov = &iov;
+	m.msg_iovlen = 1;
+	rc = emu_recvmsg(sd, s, &m, flags);
+	if (rc >= 0 && addr && alen)
+		*alen = m.msg_namelen;
+	return rc;
+}
+
+ssize_t recv(int sd, void *buf, size_t len, int flags)
+{
+	if (!sock_get(sd))
+		return REAL(recv)(sd, buf, len, flags);
+	return recvfrom(sd, buf, len, flags, NULL, NULL);
+}
+
+ssize_t read(int sd, void *buf, size_t len)
+{
+	if (!sock_get(sd))
+		return REAL(read)(sd, buf, len);
+	return recvfrom(sd, buf, len, 0, NULL, NULL);
+}
+
+ssize_t readv(int sd, const struct iovec *iov, int iovcnt)
+{
+	struct esock *s = sock_get(sd);
+	struct msghdr m = {0, };
+
+	if (!s)
+		return REAL(readv)(sd, iov, iovcnt);
+	m.msg_iov = (struct iovec *)iov;
+	m.msg_iovlen = iovcnt;
+	return emu_recvmsg(sd, s, &m, 0);
+}
+
+/* Fortified builds call these instead of read(), recv() and recvfrom() */
+ssize_t __read_chk(int sd, void *buf, size_t len, size_t buflen)
+{
+	(void)buflen;
+	return read(sd, buf, len);
+}
+
+ssize_t __recv_chk(int sd, void *buf, size_t len, size_t buflen, int flags)
+{
+	(void)buflen;
+	return recv(sd, buf, len, flags);
+}
+
+ssize_t __recvfrom_chk(int sd, void *buf, size_t len, size_t buflen,
+		       int flags, struct sockaddr *addr, socklen_t *alen)
+{
+	(void)buflen;
+	return recvfrom(sd, buf, len, flags, addr, alen);
+}
+
+int sendmmsg(int sd, struct mmsghdr *v, unsigned int n, int flags)
+{
+	struct esock *s = sock_get(sd);
+	unsigned int i;
+	ssize_t rc;
+
+	if (!s)
+		return REAL(sendmmsg)(sd, v, n, flags);
+	for (i = 0; i < n; i++) {
+		rc = emu_sendmsg(sd, s, &v[i].msg_hdr, flags);
+		if (rc < 0)
+			return i ? (int)i : -1;
+		v[i].msg_len = rc;
+	}
+	return i;
+}
+
+int recvmmsg(int sd, struct mmsghdr *v, unsigned int n, int flags,
+	     struct timespec *tmo)
+{
+	struct esock *s = sock_get(sd);
+	unsigned int i;
+	ssize_t rc;
+
+	if (!s)
+		return REAL(recvmmsg)(sd, v, n, flags, tmo);
+	for (i = 0; i < n; i++) {
+		rc = emu_recvmsg(sd, s, &v[i].msg_hdr, flags & ~MSG_WAITFORONE);
+		if (rc < 0)
+			return i ? (int)i : -1;
+		v[i].msg_len = rc;
+		if (flags & MSG_WAITFORONE)
+			flags |= MSG_DONTWAIT;
+	}
+	return i;
+}
+
+/* Polling. A unix socket reports POLLWRBAND whenever it is writable, so a
+ * program polling for anything but POLLOUT would wake at once. It is not
+ * asked for on emulated sockets, and given back in events afterwards.
+ * select() needs nothing: a writable unix socket reports POLLOUT as well
+ */
+static bool *poll_mask(struct pollfd *fds, nfds_t n)
+{
+	bool *masked = NULL;
+	nfds_t i;
+
+	for (i = 0; i < n; i++) {
+		if (!(fds[i].events & POLLWRBAND) || !sock_get(fds[i].fd))
+			continue;
+		if (!masked)
+			masked = calloc(n, sizeof(*masked));
+		if (!masked)
+			return NULL;
+		masked[i] = true;
+		fds[i].events &= ~POLLWRBAND;
+	}
+	return masked;
+}
+
+static void poll_unmask(struct pollfd *fds, nfds_t n, bool *masked)
+{
+	nfds_t i;
+
+	if (!masked)
+		return;
+	for (i = 0; i < n; i++) {
+		if (masked[i])
+			fds[i].events |= POLLWRBAND;
+	}
+	free(masked);
+}
+
+int poll(struct pollfd *fds, nfds_t n, int tmo)
+{
+	bool *masked = poll_mask(fds, n);
+	int rc, e;
+
+	rc = REAL(poll)(fds, n, tmo);
+	e = errno;
+	poll_unmask(fds, n, masked);
+	errno = e;
+	return rc;
+}
+
+int ppoll(struct pollfd *fds, nfds_t n, const struct timespec *tmo,
+	  const sigset_t *mask)
+{
+	bool *masked = poll_mask(fds, n);
+	int rc, e;
+
+	rc = REAL(ppoll)(fds, n, tmo, mask);
+	e = errno;
+	poll_unmask(fds, n, masked);
+	errno = e;
+	return rc;
+}
+
+/* Fortified builds call these instead of poll() and ppoll() */
+int __poll_chk(struct pollfd *fds, nfds_t n, int tmo, size_t fdslen)
+{
+	return poll(fds, n, tmo);
+}
+
+int __ppoll_chk(struct pollfd *fds, nfds_t n, const struct timespec *tmo,
+		const sigset_t *mask, size_t fdslen)
+{
+	return ppoll(fds, n, tmo, mask);
+}
+
+/* Keep track of the epoll sets watching a socket */
+static void sock_epoll(struct esock *s, int epfd, int op,
+		       const struct epoll_event *ev)
+{
+	int i;
+
+	for (i = 0; i < s->nepolls && s->epfds[i] != epfd; i++)
+		;
+	if (op == EPOLL_CTL_DEL) {
+		if (i == s->nepolls)
+			return;
+		s->nepolls--;
+		s->epfds[i] = s->epfds[s->nepolls];
+		s->epevs[i] = s->epevs[s->nepolls];
+		return;
+	}
+	if (i == MAX_EPOLLS)
+		return;
+	if (i == s->nepolls)
+		s->nepolls++;
+	s->epfds[i] = epfd;
+	s->epevs[i] = *ev;
+}
+
+/* epoll_wait() does not know the descriptors, so masking is done here */
+int epoll_ctl(int epfd, int op, int sd, struct epoll_event *ev)
+{
+	struct esock *s = sock_get(sd);
+	struct epoll_event e;
+	int rc;
+
+	if (!s)
+		return REAL(epoll_ctl)(epfd, op, sd, ev);
+	if (ev) {
+		e = *ev;
+		e.events &= ~EPOLLWRBAND;
+		ev = &e;
+	}
+	rc = REAL(epoll_ctl)(epfd, op, sd, ev);
+	if (!rc && !s->connected)
+		sock_epoll(s, epfd, op, ev);
+	return rc;
+}
+
+/* Socket information and options */
+
+int getsockname(int sd, struct sockaddr *addr, socklen_t *len)
+{
+	struct esock *s = sock_get(sd);
+	struct emu_addr a = {.addrtype = TIPC_ADDR_ID};
+
+	if (!s)
+		return REAL(getsockname)(sd, addr, len);
+	a.lower = s->ref;
+	a.node = TIPC_EMU_NODE;
+	addr_put(&a, addr, len);
+	return 0;
+}
+
+int getpeername(int sd, struct sockaddr *addr, socklen_t *len)
+{
+	struct esock *s = sock_get(sd);
+
+	if (!s)
+		return REAL(getpeername)(sd, addr, len);
+	if (!s->connected)
+		return fail(ENOTCONN);
+	addr_put(&s->peer, addr, len);
+	return 0;
+}
+
+static int *sock_opt(struct esock *s, int name)
+{
+	switch (name) {
+	case TIPC_IMPORTANCE:
+		return &s->importance;
+	case TIPC_SRC_DROPPABLE:
+		return &s->src_droppable;
+	case TIPC_DEST_DROPPABLE:
+		return &s->dest_droppable;
+	case TIPC_CONN_TIMEOUT:
+		return &s->conn_timeout;
+	}
+	return NULL;
+}
+
+int setsockopt(int sd, int level, int name, const void *val, socklen_t len)
+{
+	struct esock *s = sock_get(sd);
+	int *opt;
+
+	if (!s || level != SOL_TIPC)
+		return REAL(setsockopt)(sd, level, name, val, len);
+	if (name == TIPC_MCAST_BROADCAST || name == TIPC_MCAST_REPLICAST ||
+	    name == TIPC_NODELAY)
+		return 0;
+	opt = sock_opt(s, name);
+	if (!opt)
+		return fail(ENOPROTOOPT);
+	if (!val || len < sizeof(int))
+		return fail(EINVAL);
+	if (name == TIPC_IMPORTANCE &&
+	    (*(int *)val < 0 || *(int *)val > TIPC_CRITICAL_IMPORTANCE))
+		return fail(EINVAL);
+	*opt = *(int *)val;
+	return 0;
+}
+
+int getsockopt(int sd, int level, int name, void *val, socklen_t *len)
+{
+	struct esock *s = sock_get(sd);
+	int v, *opt;
+
+	if (!s || (level != SOL_TIPC && level != SOL_SOCKET))
+		return REAL(getsockopt)(sd, level, name, val, len);
+	if (level == SOL_SOCKET) {
+		if (name == SO_TYPE)
+			v = s->type;
+		else if (name == SO_DOMAIN)
+			v = AF_TIPC;
+		else if (name == SO_PROTOCOL)
+			v = 0;
+		else
+			return REAL(getsockopt)(sd, level, name, val, len);
+	} else if ((opt = sock_opt(s, name))) {
+		v = *opt;
+	} else if (name == TIPC_NODE_RECVQ_DEPTH ||
+		   name == TIPC_SOCK_RECVQ_DEPTH) {
+		v = 0;
+	} else {
+		return fail(ENOPROTOOPT);
+	}
+	if (!val || !len || *len < sizeof(int))
+		return fail(EINVAL);
+	memcpy(val, &v, sizeof(v));
+	*len = sizeof(v);
+	return 0;
+}
+
+int ioctl(int sd, unsigned long req, ...)
+{
+	va_list ap;
+	void *arg;
+
+	va_start(ap, req);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+	if (sock_get(sd) && req == SIOCGETLINKNAME)
+		return fail(EADDRNOTAVAIL);
+	return REAL(ioctl)(sd, req, arg);
+}
+
+int shutdown(int sd, int how)
+{
+	struct esock *s = sock_get(sd);
+
+	if (s && !s->connected)
+		return fail(ENOTCONN);
+	return REAL(shutdown)(sd, how);
+}
+
+/* Descriptor bookkeeping */
+
+static bool sock_shared(int sd, struct esock *s)
+{
+	int i;
+
+	for (i = 0; i < MAX_SOCKS; i++) {
+		if (i != sd && socks[i] && socks[i]->ref == s->ref)
+			return true;
+	}
+	return false;
+}
+
+/* Hand unread messages back to the daemon for return to their senders,
+ * as the kernel rejects the receive queue of a released socket. Reading
+ * is shut down first, so that the daemon returns messages itself from
+ * then on, rather than losing them in a queue about to be closed
+ */
+static void sock_reject(int sd)
+{
+	size_t sz = sizeof(struct emu_hdr) + TIPC_EMU_MAX_MSG;
+	struct emu_hdr *h;
+	ssize_t rc;
+
+	h = malloc(sz);
+	if (!h)
+		return;
+	REAL(shutdown)(sd, SHUT_RD);
+	while ((rc = REAL(recv)(sd, h, sz, MSG_DONTWAIT)) >=
+	       (ssize_t)sizeof(*h)) {
+		if (h->op != EMU_DATA || h->err ||
+		    (h->arg[0] & EMU_DEST_DROPPABLE) ||
+		    h->dst.addrtype == TIPC_ADDR_MCAST)
+			continue;
+		h->err = TIPC_ERR_NO_PORT;
+		REAL(send)(sd, h, rc, MSG_DONTWAIT | MSG_NOSIGNAL);
+	}
+	free(h);
+}
+
+int close(int sd)
+{
+	struct esock *s = sock_get(sd);
+
+	if (!s)
+		return REAL(close)(sd);
+	/* A copy inherited across fork() leaves the socket open elsewhere */
+	if (!s->connected && !s->listening &&
+	    (s->type == SOCK_RDM || s->type == SOCK_DGRAM) &&
+	    s->pid == getpid() && !sock_shared(sd, s))
+		sock_reject(sd);
+	sock_put(sd, NULL);
+	return REAL(close)(sd);
+}
+
+static int sock_dup(int sd, int nsd)
+{
+	struct esock *s = sock_get(sd), *ns;
+
+	if (nsd < 0 || nsd >= MAX_SOCKS)
+		return nsd;
+	ns = NULL;
+	if (s && (ns = malloc(sizeof(*ns)))) {
+		*ns = *s;
+		ns->nepolls = 0;
+	}
+	sock_put(nsd, ns);
+	return nsd;
+}
+
+int dup(int sd)
+{
+	return sock_dup(sd, REAL(dup)(sd));
+}
+
+int dup2(int sd, int nsd)
+{
+	if (sd == nsd)
+		return REAL(dup2)(sd, nsd);
+	return sock_dup(sd, REAL(dup2)(sd, nsd));
+}
+
+int dup3(int sd, int nsd, int flags)
+{
+	return sock_dup(sd, REAL(dup3)(sd, nsd, flags));
+}
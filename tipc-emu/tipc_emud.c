@@ -0,0 +1,1167 @@
+/* ------------------------------------------------------------------------
+ *
+ * tipc_emud.c
+ *
+ * Short description: User space TIPC emulator daemon
+ *
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Ericsson Canada
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * Neither the name of Ericsson Canada nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ------------------------------------------------------------------------
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include "tipc_emu.h"
+
+#define MAX_EVENTS	64
+#define RCV_BATCH	32
+#define QUEUE_LIMIT	(4 * 1024 * 1024)
+#define CONG_LIMIT	(1024 * 1024)
+#define REF_HASH	1024
+#define TYPE_HASH	256
+
+#ifndef TIPC_FILTER_MASK
+#define TIPC_FILTER_MASK (TIPC_SUB_PORTS | TIPC_SUB_SERVICE | TIPC_SUB_CANCEL)
+#endif
+
+#define dbg(fmt, ...) do { if (verbose) \
+	fprintf(stderr, "tipc-emud: " fmt, ##__VA_ARGS__); } while (0)
+
+enum {
+	CONN_NEW,
+	CONN_CTL,
+	CONN_PORT,
+	CONN_TOP
+};
+
+/* Packet waiting for its receiver to make room */
+struct pkt {
+	struct pkt *next;
+	int fd;
+	size_t off;
+	size_t len;
+	char data[];
+};
+
+struct publ {
+	struct publ *next;
+	struct publ *port_next;
+	struct conn *port;
+	uint32_t type;
+	uint32_t lower;
+	uint32_t upper;
+	uint32_t scope;
+	uint64_t used;
+};
+
+struct sub {
+	struct sub *next;
+	struct conn *top;
+	struct tipc_subscr s;
+	uint32_t type;
+	uint32_t lower;
+	uint32_t upper;
+	uint32_t filter;
+	bool swap;
+	uint64_t expires;
+};
+
+struct conn {
+	int fd;
+	int kind;
+	uint32_t ref;
+	int type;
+	bool listening;
+	uint64_t mark;
+	struct conn *ref_next;
+	struct publ *publs;
+	struct pkt *head;
+	struct pkt *tail;
+	size_t qbytes;
+	uint32_t events;
+	struct conn *blocked_on;
+	struct conn *wait_next;
+	struct conn *waiters;
+	bool stream;
+	size_t rlen;
+	char rbuf[sizeof(struct tipc_subscr)];
+};
+
+static int epfd;
+static int verbose;
+static uint32_t own_node = TIPC_EMU_NODE;
+static uint32_t next_ref;
+static uint64_t mark_seq;
+static uint64_t use_seq;
+static struct conn *ref_tbl[REF_HASH];
+static struct publ *type_tbl[TYPE_HASH];
+static struct sub *subs;
+static uint64_t next_expiry;
+static char rcvbuf[sizeof(struct emu_hdr) + TIPC_EMU_MAX_MSG];
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static struct conn *ref_lookup(uint32_t ref)
+{
+	struct conn *c;
+
+	for (c = ref_tbl[ref % REF_HASH]; c; c = c->ref_next) {
+		if (c->ref == ref)
+			return c;
+	}
+	return NULL;
+}
+
+/* Port numbers are handed out in sequence from a random start, as the
+ * kernel does, skipping those still in use
+ */
+static uint32_t ref_alloc(void)
+{
+	do {
+		next_ref++;
+		if (next_ref < TIPC_EMU_MIN_REF)
+			next_ref = TIPC_EMU_MIN_REF;
+	} while (ref_lookup(next_ref));
+	return next_ref;
+}
+
+static void ref_insert(struct conn *c)
+{
+	struct conn **pp = &ref_tbl[c->ref % REF_HASH];
+
+	c->ref_next = *pp;
+	*pp = c;
+}
+
+static void ref_remove(struct conn *c)
+{
+	struct conn **pp = &ref_tbl[c->ref % REF_HASH];
+
+	for (; *pp; pp = &(*pp)->ref_next) {
+		if (*pp == c) {
+			*pp = c->ref_next;
+			return;
+		}
+	}
+}
+
+static void set_events(struct conn *c)
+{
+	struct epoll_event ev = {.data.ptr = c};
+
+	ev.events = c->blocked_on ? 0 : EPOLLIN;
+	if (c->head)
+		ev.events |= EPOLLOUT;
+	if (ev.events == c->events)
+		return;
+	c->events = ev.events;
+	epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+/* Multicast senders are held back while a receiver is congested, the way
+ * the broadcast link would hold them back, instead of losing messages
+ */
+static void conn_block(struct conn *c, struct conn *dst)
+{
+	c->blocked_on = dst;
+	c->wait_next = dst->waiters;
+	dst->waiters = c;
+	set_events(c);
+}
+
+static void conn_unblock(struct conn *dst)
+{
+	struct conn *c;
+
+	while ((c = dst->waiters)) {
+		dst->waiters = c->wait_next;
+		c->blocked_on = NULL;
+		set_events(c);
+	}
+}
+
+static ssize_t send_iov(int sd, struct iovec *iov, int iovcnt, int fd)
+{
+	char cbuf[CMSG_SPACE(sizeof(int))];
+	struct msghdr msg = {0, };
+	struct cmsghdr *cm;
+
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovcnt;
+	if (fd >= 0) {
+		msg.msg_control = cbuf;
+		msg.msg_controllen = sizeof(cbuf);
+		cm = CMSG_FIRSTHDR(&msg);
+		cm->cmsg_level = SOL_SOCKET;
+		cm->cmsg_type = SCM_RIGHTS;
+		cm->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cm), &fd, sizeof(int));
+	}
+	return sendmsg(sd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+/* Queue a packet to a connection, optionally passing a descriptor along.
+ * The descriptor is consumed. Returns -1 if the receiver is overloaded,
+ * or -1 with errno EPIPE if it is closing and takes no more.
+ * Only a stream connection may take part of a packet; the rest is queued
+ */
+static int conn_xmit(struct conn *c, struct iovec *iov, int iovcnt, int fd)
+{
+	size_t len = 0, off = 0, sent = 0;
+	struct pkt *p;
+	ssize_t rc;
+	int i;
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+	if (!c->head) {
+		rc = send_iov(c->fd, iov, iovcnt, fd);
+		if (rc >= 0 && fd >= 0) {
+			close(fd);
+			fd = -1;
+		}
+		if (rc < 0 && errno == EPIPE)
+			goto overload;
+		if ((rc >= 0 && (size_t)rc == len) ||
+		    (rc < 0 && errno != EAGAIN && errno != ENOBUFS))
+			return 0;
+		if (rc > 0)
+			sent = rc;
+	}
+	if (c->qbytes + len > QUEUE_LIMIT && !sent) {
+		errno = ENOBUFS;
+		goto overload;
+	}
+	p = malloc(sizeof(*p) + len);
+	if (!p)
+		goto overload;
+	for (i = 0; i < iovcnt; i++) {
+		memcpy(p->data + off, iov[i].iov_base, iov[i].iov_len);
+		off += iov[i].iov_len;
+	}
+	p->next = NULL;
+	p->fd = fd;
+	p->off = sent;
+	p->len = len;
+	if (c->tail)
+		c->tail->next = p;
+	else
+		c->head = p;
+	c->tail = p;
+	c->qbytes += len;
+	set_events(c);
+	return 0;
+overload:
+	if (fd >= 0)
+		close(fd);
+	return -1;
+}
+
+static void conn_flush(struct conn *c)
+{
+	struct iovec iov;
+	struct pkt *p;
+
+	ssize_t rc;
+
+	while ((p = c->head)) {
+		iov.iov_base = p->data + p->off;
+		iov.iov_len = p->len - p->off;
+		rc = send_iov(c->fd, &iov, 1, p->fd);
+		if (rc < 0 && (errno == EAGAIN || errno == ENOBUFS ||
+			       errno == EPIPE))
+			break;
+		if (p->fd >= 0)
+			close(p->fd);
+		p->fd = -1;
+		if (rc >= 0 && (size_t)rc < iov.iov_len) {
+			p->off += rc;
+			break;
+		}
+		c->head = p->next;
+		c->qbytes -= p->len;
+		free(p);
+	}
+	if (!c->head)
+		c->tail = NULL;
+	if (c->qbytes <= CONG_LIMIT / 2)
+		conn_unblock(c);
+	set_events(c);
+}
+
+static struct conn *conn_new(int fd, int kind)
+{
+	struct epoll_event ev = {.events = EPOLLIN};
+	struct conn *c = calloc(1, sizeof(*c));
+
+	if (!c) {
+		close(fd);
+		return NULL;
+	}
+	c->fd = fd;
+	c->kind = kind;
+	c->events = ev.events;
+	ev.data.ptr = c;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		close(fd);
+		free(c);
+		return NULL;
+	}
+	return c;
+}
+
+/* Topology service */
+
+static uint32_t sub_val(struct sub *sub, uint32_t v)
+{
+	return sub->swap ? __builtin_bswap32(v) : v;
+}
+
+static void sub_event(struct sub *sub, uint32_t event, uint32_t lower,
+		      uint32_t upper, uint32_t ref, uint32_t node)
+{
+	struct tipc_event ev;
+	struct iovec iov = {&ev, sizeof(ev)};
+
+	ev.event = sub_val(sub, event);
+	ev.found_lower = sub_val(sub, lower);
+	ev.found_upper = sub_val(sub, upper);
+	ev.port.ref = sub_val(sub, ref);
+	ev.port.node = sub_val(sub, node);
+	ev.s = sub->s;
+	if (conn_xmit(sub->top, &iov, 1, -1))
+		dbg("topology event lost, subscriber overloaded\n");
+}
+
+static void sub_report(struct sub *sub, struct publ *p, uint32_t event,
+		       bool must)
+{
+	uint32_t lower = p->lower, upper = p->upper;
+
+	if (sub->type != p->type || p->lower > sub->upper ||
+	    p->upper < sub->lower)
+		return;
+	if (!must && !(sub->filter & TIPC_SUB_PORTS))
+		return;
+	if (lower < sub->lower)
+		lower = sub->lower;
+	if (upper > sub->upper)
+		upper = sub->upper;
+	sub_event(sub, event, lower, upper, p->port ? p->port->ref : 0,
+		  own_node);
+}
+
+static void sub_free(struct sub *sub)
+{
+	struct sub **pp;
+
+	for (pp = &subs; *pp; pp = &(*pp)->next) {
+		if (*pp == sub) {
+			*pp = sub->next;
+			break;
+		}
+	}
+	free(sub);
+}
+
+static void sub_expire(void)
+{
+	uint64_t now = now_ms();
+	struct sub *sub, *next;
+
+	next_expiry = 0;
+	for (sub = subs; sub; sub = next) {
+		next = sub->next;
+		if (!sub->expires)
+			continue;
+		if (sub->expires <= now) {
+			sub_event(sub, TIPC_SUBSCR_TIMEOUT, sub->lower,
+				  sub->upper, 0, 0);
+			sub_free(sub);
+			continue;
+		}
+		if (!next_expiry || sub->expires < next_expiry)
+			next_expiry = sub->expires;
+	}
+}
+
+/* Publication table */
+
+static bool publ_twin(struct publ *p)
+{
+	struct publ *q;
+
+	for (q = type_tbl[p->type % TYPE_HASH]; q; q = q->next) {
+		if (q != p && q->type == p->type && q->lower == p->lower &&
+		    q->upper == p->upper)
+			return true;
+	}
+	return false;
+}
+
+static int publ_add(struct conn *port, uint32_t type, uint32_t lower,
+		    uint32_t upper, uint32_t scope)
+{
+	struct publ *p, **pp = &type_tbl[type % TYPE_HASH];
+	struct sub *sub;
+	bool first;
+
+	p = calloc(1, sizeof(*p));
+	if (!p)
+		return -ENOMEM;
+	p->port = port;
+	p->type = type;
+	p->lower = lower;
+	p->upper = upper;
+	p->scope = scope;
+	p->next = *pp;
+	*pp = p;
+	if (port) {
+		p->port_next = port->publs;
+		port->publs = p;
+	}
+	first = !publ_twin(p);
+	for (sub = subs; sub; sub = sub->next)
+		sub_report(sub, p, TIPC_PUBLISHED, first);
+	dbg("publish {%u,%u,%u} by %u\n", type, lower, upper,
+	    port ? port->ref : 0);
+	return 0;
+}
+
+static void publ_del(struct publ *p)
+{
+	struct publ **pp;
+	struct sub *sub;
+	bool last;
+
+	for (pp = &type_tbl[p->type % TYPE_HASH]; *pp; pp = &(*pp)->next) {
+		if (*pp == p) {
+			*pp = p->next;
+			break;
+		}
+	}
+	for (pp = &p->port->publs; *pp; pp = &(*pp)->port_next) {
+		if (*pp == p) {
+			*pp = p->port_next;
+			break;
+		}
+	}
+	last = !publ_twin(p);
+	for (sub = subs; sub; sub = sub->next)
+		sub_report(sub, p, TIPC_WITHDRAWN, last);
+	dbg("withdraw {%u,%u,%u} by %u\n", p->type, p->lower, p->upper,
+	    p->port->ref);
+	free(p);
+}
+
+/* Anycast lookup: the least recently used of the matching ports */
+static struct conn *publ_lookup(uint32_t type, uint32_t instance)
+{
+	struct publ *p, *best = NULL;
+
+	for (p = type_tbl[type % TYPE_HASH]; p; p = p->next) {
+		if (p->type != type || instance < p->lower ||
+		    instance > p->upper || !p->port)
+			continue;
+		if (!best || p->used < best->used)
+			best = p;
+	}
+	if (!best)
+		return NULL;
+	best->used = ++use_seq;
+	return best->port;
+}
+
+static void top_subscribe(struct conn *c, struct tipc_subscr *s)
+{
+	struct sub *sub, **pp;
+	struct publ *p;
+	uint32_t timeout;
+
+	sub = calloc(1, sizeof(*sub));
+	if (!sub)
+		return;
+	sub->s = *s;
+	sub->top = c;
+	sub->swap = !(s->filter & TIPC_FILTER_MASK);
+	sub->type = sub_val(sub, s->seq.type);
+	sub->lower = sub_val(sub, s->seq.lower);
+	sub->upper = sub_val(sub, s->seq.upper);
+	sub->filter = sub_val(sub, s->filter);
+	timeout = sub_val(sub, s->timeout);
+
+	if (sub->filter & TIPC_SUB_CANCEL) {
+		sub->filter &= ~TIPC_SUB_CANCEL;
+		for (pp = &subs; *pp; pp = &(*pp)->next) {
+			if ((*pp)->top == c && (*pp)->type == sub->type &&
+			    (*pp)->lower == sub->lower &&
+			    (*pp)->upper == sub->upper &&
+			    (*pp)->filter == sub->filter &&
+			    !memcmp((*pp)->s.usr_handle, s->usr_handle,
+				    sizeof(s->usr_handle))) {
+				sub_free(*pp);
+				break;
+			}
+		}
+		free(sub);
+		return;
+	}
+	if (sub->lower > sub->upper) {
+		free(sub);
+		return;
+	}
+	if (timeout != (uint32_t)TIPC_WAIT_FOREVER) {
+		sub->expires = now_ms() + timeout;
+		if (!next_expiry || sub->expires < next_expiry)
+			next_expiry = sub->expires;
+	}
+	sub->next = subs;
+	subs = sub;
+
+	/* Report what is there already, once per range unless ports wanted */
+	for (p = type_tbl[sub->type % TYPE_HASH]; p; p = p->next) {
+		struct publ *q;
+		bool must = true;
+
+		for (q = p->next; q; q = q->next) {
+			if (q->type == p->type && q->lower == p->lower &&
+			    q->upper == p->upper)
+				must = false;
+		}
+		sub_report(sub, p, TIPC_PUBLISHED, must);
+	}
+}
+
+static int top_rcv(struct conn *c)
+{
+	size_t n = sizeof(c->rbuf) - c->rlen;
+	ssize_t rc;
+
+	rc = recv(c->fd, c->rbuf + c->rlen, n, MSG_DONTWAIT);
+	if (rc < 0)
+		return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+	if (rc == 0)
+		return -1;
+
+	/* A subscription must come as a whole on a seqpacket connection */
+	if (!c->stream && (size_t)rc != sizeof(c->rbuf))
+		return -1;
+	c->rlen += rc;
+	if (c->rlen < sizeof(c->rbuf))
+		return 0;
+	c->rlen = 0;
+	top_subscribe(c, (struct tipc_subscr *)c->rbuf);
+	return 0;
+}
+
+/* Port traffic */
+
+static void port_addr(struct emu_addr *a, uint32_t ref)
+{
+	memset(a, 0, sizeof(*a));
+	a->addrtype = TIPC_ADDR_ID;
+	a->lower = ref;
+	a->node = own_node;
+}
+
+static int port_deliver(struct conn *dst, struct emu_hdr *h, void *data,
+			size_t len)
+{
+	struct iovec iov[2] = {{h, sizeof(*h)}, {data, len}};
+
+	return conn_xmit(dst, iov, 2, -1);
+}
+
+/* Return an undeliverable message to its sender, unless it has asked
+ * for such messages to be dropped
+ */
+static void port_reject(struct conn *c, struct emu_hdr *h, void *data,
+			size_t len, int err, uint32_t ref)
+{
+	if (h->arg[0] & EMU_DEST_DROPPABLE)
+		return;
+	h->err = err;
+	port_addr(&h->src, ref);
+	port_deliver(c, h, data, len);
+}
+
+static void port_route(struct conn *c, struct emu_hdr *h, void *data,
+		       size_t len)
+{
+	struct emu_addr dst = h->dst;
+	struct conn *p, *cong;
+	struct publ *pub;
+
+	h->err = 0;
+	port_addr(&h->src, c->ref);
+	switch (dst.addrtype) {
+	case TIPC_ADDR_ID:
+		p = ref_lookup(dst.lower);
+		if (!p || p->kind != CONN_PORT || p->listening ||
+		    (dst.node && dst.node != own_node)) {
+			port_reject(c, h, data, len, TIPC_ERR_NO_PORT, 0);
+			return;
+		}
+		h->dst.addrtype = 0;
+		if (port_deliver(p, h, data, len))
+			port_reject(c, h, data, len, errno == EPIPE ?
+				    TIPC_ERR_NO_PORT : TIPC_ERR_OVERLOAD, p->ref);
+		return;
+	case TIPC_ADDR_NAME:
+		p = NULL;
+		if (!dst.node || dst.node == own_node)
+			p = publ_lookup(dst.type, dst.lower);
+		if (!p) {
+			port_reject(c, h, data, len, TIPC_ERR_NO_NAME, 0);
+			return;
+		}
+		if (port_deliver(p, h, data, len))
+			port_reject(c, h, data, len, errno == EPIPE ?
+				    TIPC_ERR_NO_PORT : TIPC_ERR_OVERLOAD, p->ref);
+		return;
+	case TIPC_ADDR_MCAST:
+		cong = NULL;
+		mark_seq++;
+		for (pub = type_tbl[dst.type % TYPE_HASH]; pub;
+		     pub = pub->next) {
+			p = pub->port;
+			if (!p || pub->type != dst.type ||
+			    pub->lower > dst.upper || pub->upper < dst.lower ||
+			    p->mark == mark_seq)
+				continue;
+			p->mark = mark_seq;
+			if (port_deliver(p, h, data, len))
+				dbg("multicast to %u dropped\n", p->ref);
+			else if (p->qbytes > CONG_LIMIT && p != c)
+				cong = p;
+		}
+		if (cong)
+			conn_block(c, cong);
+		return;
+	default:
+		dbg("bad destination address type %u\n", dst.addrtype);
+	}
+}
+
+/* A message the receiving socket did not read before closing */
+static void port_return(struct conn *c, struct emu_hdr *h, void *data,
+			size_t len)
+{
+	struct conn *p = ref_lookup(h->src.lower);
+
+	if (!p || p == c || p->kind != CONN_PORT || p->listening)
+		return;
+	port_addr(&h->src, c->ref);
+	port_deliver(p, h, data, len);
+}
+
+/* Messages still queued in the daemon go back as if the socket had them */
+static void port_drop(struct conn *c, struct pkt *p)
+{
+	struct emu_hdr *h = (struct emu_hdr *)p->data;
+
+	if (p->len < sizeof(*h) || h->op != EMU_DATA || h->err ||
+	    (h->arg[0] & EMU_DEST_DROPPABLE) ||
+	    h->dst.addrtype == TIPC_ADDR_MCAST)
+		return;
+	h->err = TIPC_ERR_NO_PORT;
+	port_return(c, h, p->data + sizeof(*h), p->len - sizeof(*h));
+}
+
+static int port_rcv(struct conn *c)
+{
+	struct emu_hdr *h = (struct emu_hdr *)rcvbuf;
+	ssize_t rc;
+	int i;
+
+	for (i = 0; i < RCV_BATCH; i++) {
+		rc = recv(c->fd, rcvbuf, sizeof(rcvbuf), MSG_DONTWAIT);
+		if (rc < 0)
+			return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+		if (rc == 0)
+			return -1;
+		if ((size_t)rc < sizeof(*h) || h->op != EMU_DATA)
+			continue;
+		if (h->err)
+			port_return(c, h, rcvbuf + sizeof(*h), rc - sizeof(*h));
+		else
+			port_route(c, h, rcvbuf + sizeof(*h), rc - sizeof(*h));
+		if (c->blocked_on)
+			break;
+	}
+	return 0;
+}
+
+static void conn_free(struct conn *c)
+{
+	struct sub *sub, *next;
+	struct conn **pp;
+	struct pkt *p;
+
+	conn_unblock(c);
+	if (c->blocked_on) {
+		for (pp = &c->blocked_on->waiters; *pp; pp = &(*pp)->wait_next) {
+			if (*pp == c) {
+				*pp = c->wait_next;
+				break;
+			}
+		}
+	}
+	while (c->publs)
+		publ_del(c->publs);
+	for (sub = subs; sub; sub = next) {
+		next = sub->next;
+		if (sub->top == c)
+			sub_free(sub);
+	}
+	while ((p = c->head)) {
+		c->head = p->next;
+		if (p->fd >= 0)
+			close(p->fd);
+		else if (c->kind == CONN_PORT && !p->off)
+			port_drop(c, p);
+		free(p);
+	}
+	if (c->kind == CONN_PORT)
+		ref_remove(c);
+	epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	dbg("closed %u\n", c->ref);
+	free(c);
+}
+
+/* Control requests */
+
+static void ctl_reply(struct conn *c, int err, struct emu_hdr *req,
+		      uint32_t ref, int fd)
+{
+	struct emu_hdr h = {.op = EMU_REPLY, .err = err};
+	struct iovec iov = {&h, sizeof(h)};
+
+	h.ref = req->ref;
+	if (ref)
+		port_addr(&h.src, ref);
+
+	/* The caller waits for this, so wait for room rather than drop */
+	while (send_iov(c->fd, &iov, 1, fd) < 0) {
+		if (errno != EAGAIN && errno != ENOBUFS && errno != EINTR)
+			break;
+		usleep(1000);
+	}
+	if (fd >= 0)
+		close(fd);
+}
+
+static int ctl_bind(struct conn *port, struct emu_hdr *h)
+{
+	struct emu_addr *a = &h->dst;
+
+	if (a->type < TIPC_RESERVED_TYPES)
+		return EACCES;
+	if (a->lower > a->upper)
+		return EINVAL;
+	return -publ_add(port, a->type, a->lower, a->upper, h->arg[0]);
+}
+
+static int ctl_unbind(struct conn *port, struct emu_hdr *h)
+{
+	struct emu_addr *a = &h->dst;
+	struct publ *p;
+
+	if (!a->addrtype) {
+		while (port->publs)
+			publ_del(port->publs);
+		return 0;
+	}
+	for (p = port->publs; p; p = p->port_next) {
+		if (p->type == a->type && p->lower == a->lower &&
+		    p->upper == a->upper) {
+			publ_del(p);
+			return 0;
+		}
+	}
+	return EINVAL;
+}
+
+/* A connection is set up as a socket pair: one end goes back to the
+ * connecting socket, the other one to the listener's accept queue, or
+ * to the topology server if that is what was asked for
+ */
+static void ctl_connect(struct conn *c, struct conn *port, struct emu_hdr *h)
+{
+	struct emu_hdr req = {.op = EMU_CONNREQ};
+	struct iovec iov = {&req, sizeof(req)};
+	struct emu_addr *a = &h->dst;
+	struct conn *lsn = NULL, *top;
+	int sv[2], type;
+	uint32_t ref;
+
+	type = port->type == SOCK_STREAM ? SOCK_STREAM : SOCK_SEQPACKET;
+	if (a->addrtype == TIPC_ADDR_NAME && a->type == TIPC_TOP_SRV &&
+	    a->lower == TIPC_TOP_SRV) {
+		if (socketpair(AF_UNIX, type | SOCK_CLOEXEC, 0, sv) < 0)
+			goto refused;
+		fcntl(sv[1], F_SETFL, O_NONBLOCK);
+		top = conn_new(sv[1], CONN_TOP);
+		if (!top) {
+			close(sv[0]);
+			goto refused;
+		}
+		top->stream = type == SOCK_STREAM;
+		ctl_reply(c, 0, h, TIPC_TOP_SRV, sv[0]);
+		return;
+	}
+	if (a->addrtype == TIPC_ADDR_NAME)
+		lsn = publ_lookup(a->type, a->lower);
+	else if (a->addrtype == TIPC_ADDR_ID &&
+		 (!a->node || a->node == own_node))
+		lsn = ref_lookup(a->lower);
+	else if (a->addrtype != TIPC_ADDR_ID) {
+		ctl_reply(c, EINVAL, h, 0, -1);
+		return;
+	}
+	if (!lsn || lsn->type != port->type)
+		goto refused;
+	if (!lsn->listening) {
+		/* Nobody will ever answer; the caller waits out its timeout */
+		ctl_reply(c, ETIMEDOUT, h, 0, -1);
+		return;
+	}
+	if (socketpair(AF_UNIX, type | SOCK_CLOEXEC, 0, sv) < 0)
+		goto refused;
+	ref = ref_alloc();
+	req.arg[0] = ref;
+	port_addr(&req.src, port->ref);
+	req.dst = *a;
+	if (conn_xmit(lsn, &iov, 1, sv[1])) {
+		close(sv[0]);
+		goto refused;
+	}
+	dbg("%u connected to %u as %u\n", port->ref, lsn->ref, ref);
+	ctl_reply(c, 0, h, ref, sv[0]);
+	return;
+refused:
+	ctl_reply(c, ECONNREFUSED, h, 0, -1);
+}
+
+static int ctl_rcv(struct conn *c)
+{
+	struct emu_hdr *h = (struct emu_hdr *)rcvbuf;
+	struct conn *port;
+	ssize_t rc;
+	int err = 0;
+
+	rc = recv(c->fd, rcvbuf, sizeof(rcvbuf), MSG_DONTWAIT);
+	if (rc < 0)
+		return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+	if ((size_t)rc < sizeof(*h))
+		return -1;
+	port = ref_lookup(h->ref);
+	if (!port) {
+		ctl_reply(c, EBADF, h, 0, -1);
+		return 0;
+	}
+	switch (h->op) {
+	case EMU_BIND:
+		err = ctl_bind(port, h);
+		break;
+	case EMU_UNBIND:
+		err = ctl_unbind(port, h);
+		break;
+	case EMU_LISTEN:
+		if (port->type != SOCK_SEQPACKET && port->type != SOCK_STREAM)
+			err = EOPNOTSUPP;
+		else
+			port->listening = true;
+		break;
+	case EMU_CONNECT:
+		ctl_connect(c, port, h);
+		return 0;
+	default:
+		err = EINVAL;
+	}
+	ctl_reply(c, err, h, 0, -1);
+	return 0;
+}
+
+/* The first packet on a new connection tells what it is for */
+static int conn_open(struct conn *c)
+{
+	struct emu_hdr *h = (struct emu_hdr *)rcvbuf;
+	struct emu_hdr rsp = {.op = EMU_OPENED};
+	struct iovec iov = {&rsp, sizeof(rsp)};
+	ssize_t rc;
+
+	rc = recv(c->fd, rcvbuf, sizeof(rcvbuf), MSG_DONTWAIT);
+	if (rc < 0)
+		return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+	if ((size_t)rc < sizeof(*h))
+		return -1;
+	if (h->op == EMU_CTL) {
+		c->kind = CONN_CTL;
+		return 0;
+	}
+	if (h->op != EMU_OPEN)
+		return -1;
+	c->kind = CONN_PORT;
+	c->type = h->arg[0];
+	c->ref = ref_alloc();
+	ref_insert(c);
+	rsp.ref = c->ref;
+	port_addr(&rsp.src, c->ref);
+	dbg("opened %u, type %d\n", c->ref, c->type);
+	return conn_xmit(c, &iov, 1, -1);
+}
+
+static int conn_rcv(struct conn *c)
+{
+	switch (c->kind) {
+	case CONN_NEW:
+		return conn_open(c);
+	case CONN_CTL:
+		return ctl_rcv(c);
+	case CONN_PORT:
+		return port_rcv(c);
+	case CONN_TOP:
+		return top_rcv(c);
+	}
+	return -1;
+}
+
+static int emu_listen(const char *path)
+{
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	socklen_t len;
+	int sd;
+
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	len = offsetof(struct sockaddr_un, sun_path) + strlen(addr.sun_path);
+	sd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (sd < 0)
+		return -1;
+
+	/* Only take over a socket file nobody is listening on any more */
+	if (path[0] == '@') {
+		addr.sun_path[0] = 0;
+	} else if (!connect(sd, (struct sockaddr *)&addr, len)) {
+		close(sd);
+		errno = EADDRINUSE;
+		return -1;
+	} else {
+		close(sd);
+		unlink(path);
+		sd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+		if (sd < 0)
+			return -1;
+	}
+	if (bind(sd, (struct sockaddr *)&addr, len) < 0 ||
+	    listen(sd, SOMAXCONN) < 0) {
+		close(sd);
+		return -1;
+	}
+	return sd;
+}
+
+static uint32_t parse_node(const char *s)
+{
+	unsigned int z, c, n;
+
+	if (sscanf(s, "%u.%u.%u", &z, &c, &n) == 3)
+		return tipc_addr(z, c, n);
+	return strtoul(s, NULL, 0);
+}
+
+/* The pid file is written before the foreground process returns, so that
+ * whoever started the daemon may read it right away
+ */
+static int emu_daemon(bool background, const char *pidfile)
+{
+	pid_t pid = getpid();
+	FILE *f;
+	int fd;
+
+	if (background) {
+		pid = fork();
+		if (pid < 0) {
+			perror("tipc-emud: fork");
+			return -1;
+		}
+	}
+	if (pidfile && pid) {
+		f = fopen(pidfile, "w");
+		if (!f) {
+			perror("tipc-emud: pidfile");
+			if (background)
+				kill(pid, SIGTERM);
+			return -1;
+		}
+		fprintf(f, "%d\n", (int)pid);
+		fclose(f);
+	}
+	if (!background)
+		return 0;
+	if (pid)
+		exit(0);
+	setsid();
+	if (chdir("/") < 0)
+		perror("tipc-emud: chdir");
+	fd = open("/dev/null", O_RDWR);
+	if (fd >= 0) {
+		dup2(fd, 0);
+		dup2(fd, 1);
+		dup2(fd, 2);
+		if (fd > 2)
+			close(fd);
+	}
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-s socket] [-n Z.C.N] [-d] [-p pidfile] [-v]\n"
+		"  -s  daemon socket, '@' for abstract namespace "
+		"(default $%s or %s)\n"
+		"  -n  emulated node address (default 1.1.1)\n"
+		"  -d  run in the background\n"
+		"  -p  write own pid to pidfile once the socket is open\n"
+		"  -v  log name table changes and connections\n",
+		name, TIPC_EMU_SOCKET_ENV, TIPC_EMU_SOCKET);
+}
+
+int main(int argc, char *argv[])
+{
+	struct epoll_event evs[MAX_EVENTS];
+	const char *path = getenv(TIPC_EMU_SOCKET_ENV);
+	const char *pidfile = NULL;
+	bool background = false;
+	int lsd, sd, n, i, tmo;
+	struct conn *c;
+	int opt;
+
+	if (!path)
+		path = TIPC_EMU_SOCKET;
+	while ((opt = getopt(argc, argv, "s:n:dp:vh")) != -1) {
+		switch (opt) {
+		case 's':
+			path = optarg;
+			break;
+		case 'n':
+			own_node = parse_node(optarg);
+			break;
+		case 'd':
+			background = true;
+			break;
+		case 'p':
+			pidfile = optarg;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	signal(SIGPIPE, SIG_IGN);
+	srandom(time(NULL) ^ getpid());
+	next_ref = random();
+
+	lsd = emu_listen(path);
+	if (lsd < 0) {
+		perror("tipc-emud: failed to open daemon socket");
+		return 1;
+	}
+	if (emu_daemon(background, pidfile))
+		return 1;
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	c = conn_new(lsd, CONN_NEW);
+	if (epfd < 0 || !c) {
+		perror("tipc-emud: epoll");
+		return 1;
+	}
+
+	/* What the kernel publishes for itself */
+	publ_add(NULL, TIPC_NODE_STATE, own_node, own_node, TIPC_ZONE_SCOPE);
+	publ_add(NULL, TIPC_TOP_SRV, TIPC_TOP_SRV, TIPC_TOP_SRV,
+		 TIPC_NODE_SCOPE);
+
+	for (;;) {
+		tmo = -1;
+		if (next_expiry) {
+			uint64_t now = now_ms();
+
+			tmo = next_expiry > now ? next_expiry - now : 0;
+		}
+		n = epoll_wait(epfd, evs, MAX_EVENTS, tmo);
+		if (n < 0 && errno != EINTR) {
+			perror("tipc-emud: epoll_wait");
+			return 1;
+		}
+		for (i = 0; i < n; i++) {
+			c = evs[i].data.ptr;
+			if (c->fd == lsd) {
+				sd = accept4(lsd, NULL, NULL,
+					     SOCK_NONBLOCK | SOCK_CLOEXEC);
+				if (sd >= 0)
+					conn_new(sd, CONN_NEW);
+				continue;
+			}
+			if (evs[i].events & EPOLLOUT)
+				conn_flush(c);
+			if (evs[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR) &&
+			    conn_rcv(c) < 0)
+				conn_free(c);
+		}
+		if (next_expiry && next_expiry <= now_ms())
+			sub_expire();
+	}
+	return 0;
+}
@@ -132,6 +132,16 @@ static inline void timestamp()
 	fprintf(stderr,"[%s.%03ld] ",buf, ms);
 }
 
+/*
+ * wait_writable - wait for congestion to abate after EAGAIN, at most 100 ms
+ */
+static void wait_writable(int fd)
+{
+	struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+
+	poll(&pfd, 1, 100);
+}
+
 /*
  * tipc_write - unified write, works with connected or connectionless socket.
  */
@@ -180,7 +190,7 @@ again:
 		ret = tipc_write(tipc, buf, strlen(buf) + 1);
 		if (ret < 0 && errno == EAGAIN) {
 			eagin_stat++;
-			nanosleep(&((struct timespec) {.tv_nsec = 100000000}), NULL);
+			wait_writable(tipc);
 			goto again;
 		}
 		if (ret < 0) {
@@ -286,13 +296,13 @@ int pipe_start(int tipc)
 again:
 			chkne(len = tipc_write(tipc, buf, data_in_len));
 			if (len < 0 && errno == EAGAIN) {
-				nanosleep(&((struct timespec) {.tv_nsec = 100000000}), NULL);
+				wait_writable(tipc);
 				goto again;
 			}
 again1:
 			chkne(len = tipc_write(fd_pair[1], buf, data_in_len));
 			if (len < 0 && errno == EAGAIN) {
-				nanosleep(&((struct timespec) {.tv_nsec = 100000000}), NULL);
+				wait_writable(fd_pair[1]);
 				goto again1;
 			}
 		}